@@ -212,8 +212,8 @@ uint64_t BlazeServer::AcquireLock() {
                             globals->options->block_for_lock, &blaze_lock_);
 }
 
-// Communication method that uses gRPC on a socket bound to localhost. More
-// documentation is in command_server.proto .
+// Communication method that uses gRPC on a Unix domain socket or on a socket
+// bound to localhost. More documentation is in command_server.proto .
 class GrpcBlazeServer : public BlazeServer {
  public:
   GrpcBlazeServer(int connect_timeout_secs);
@@ -357,9 +357,17 @@ class GetInstallKeyFileProcessor : public PureZipExtractorProcessor {
   string *install_base_key_;
 };
 
-// Populates globals->install_md5 and globals->extracted_binaries by reading the
-// ZIP entries in the Blaze binary.
+// Populates globals->install_md5 and globals->extracted_binaries from the
+// install index at the end of the Blaze binary if it has one, or else by
+// reading the ZIP entries in the Blaze binary.
 static void ComputeInstallMd5AndNoteAllFiles(const string &self_path) {
+  if (ReadInstallIndex(self_path, &globals->install_md5,
+                       &globals->extracted_binaries)) {
+    return;
+  }
+  globals->install_md5.clear();
+  globals->extracted_binaries.clear();
+
   NoteAllFilesZipProcessor note_all_files_processor(
       &globals->extracted_binaries);
   GetInstallKeyFileProcessor install_key_processor(&globals->install_md5);
@@ -398,6 +406,12 @@ string GetEmbeddedBinariesRoot(const string &install_base) {
   return blaze_util::JoinPath(install_base, "_embedded_binaries");
 }
 
+// Returns the path of the stamp that marks a complete installation under the
+// install_base location.
+static string GetInstallStampPath(const string &install_base) {
+  return blaze_util::JoinPath(install_base, "install_stamp");
+}
+
 // Returns the JVM command argument array.
 static vector<string> GetArgumentArray(
     const WorkspaceLayout *workspace_layout) {
@@ -958,6 +972,14 @@ static void ActuallyExtractData(const string &argv0,
         << " as a zip file: " << extractor->GetError();
   }
 
+  // The dumper sets the timestamps of the extracted files to a distantly
+  // futuristic value so we can observe tampering, and syncs them to disk.
+  // Note that keeping a static, deterministic timestamp, such as the default
+  // timestamp set by unzip (1970-01-01) and using that to detect tampering is
+  // not enough, because we also need the timestamp to change between Bazel
+  // releases so that the metadata cache knows that the files may have
+  // changed. This is essential for the correctness of actions that use
+  // embedded binaries as artifacts.
   if (!dumper->Finish(&error)) {
     BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
         << "Failed to extract embedded binaries: " << error;
@@ -974,53 +996,26 @@ static void ActuallyExtractData(const string &argv0,
            "this then you should investigate what happened.";
   }
 
-  // Set the timestamps of the extracted files to the future and make sure (or
-  // at least as sure as we can...) that the files we have written are actually
-  // on the disk.
-
-  vector<string> extracted_files;
-
-  // Walks the temporary directory recursively and collects full file paths.
-  blaze_util::GetAllFilesUnder(embedded_binaries, &extracted_files);
-
+  // Stamp the complete installation, so that later invocations can trust it
+  // after looking at the stamp alone instead of at every extracted file. The
+  // stamp gets a future timestamp like the extracted files, and it is written
+  // last, so it only exists if the extraction succeeded.
+  string stamp;
+  if (!ComputeInstallStamp(embedded_binaries, globals->extracted_binaries,
+                           &stamp)) {
+    BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
+        << "couldn't compute the installation stamp of '" << embedded_binaries
+        << "': " << GetLastErrorString();
+  }
+  string stamp_path =
+      GetInstallStampPath(blaze_util::Dirname(embedded_binaries));
   std::unique_ptr<blaze_util::IFileMtime> mtime(blaze_util::CreateFileMtime());
-  set<string> synced_directories;
-  for (const auto &it : extracted_files) {
-    const char *extracted_path = it.c_str();
-
-    // Set the time to a distantly futuristic value so we can observe tampering.
-    // Note that keeping a static, deterministic timestamp, such as the default
-    // timestamp set by unzip (1970-01-01) and using that to detect tampering is
-    // not enough, because we also need the timestamp to change between Bazel
-    // releases so that the metadata cache knows that the files may have
-    // changed. This is essential for the correctness of actions that use
-    // embedded binaries as artifacts.
-    if (!mtime->SetToDistantFuture(it)) {
-      BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
-          << "failed to set timestamp on '" << extracted_path
-          << "': " << GetLastErrorString();
-    }
-
-    blaze_util::SyncFile(it);
-
-    string directory = blaze_util::Dirname(extracted_path);
-
-    // Now walk up until embedded_binaries and sync every directory in between.
-    // synced_directories is used to avoid syncing the same directory twice.
-    // The !directory.empty() and !blaze_util::IsRootDirectory(directory)
-    // conditions are not strictly needed, but it makes this loop more robust,
-    // because otherwise, if due to some glitch, directory was not under
-    // embedded_binaries, it would get into an infinite loop.
-    while (directory != embedded_binaries &&
-           synced_directories.count(directory) == 0 && !directory.empty() &&
-           !blaze_util::IsRootDirectory(directory)) {
-      blaze_util::SyncFile(directory);
-      synced_directories.insert(directory);
-      directory = blaze_util::Dirname(directory);
-    }
+  if (!blaze_util::WriteFile(stamp, stamp_path, 0644) ||
+      !mtime->SetToDistantFuture(stamp_path)) {
+    BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
+        << "couldn't write '" << stamp_path << "': " << GetLastErrorString();
   }
-
-  blaze_util::SyncFile(embedded_binaries);
+  blaze_util::SyncFile(stamp_path);
 }
 
 // Installs Blaze by extracting the embedded data files, iff necessary.
@@ -1081,8 +1076,37 @@ static void ExtractData(const string &self_path) {
 
     std::unique_ptr<blaze_util::IFileMtime> mtime(
         blaze_util::CreateFileMtime());
+    string stamp_path = GetInstallStampPath(globals->options->install_base);
     string real_install_dir = blaze_util::JoinPath(
         globals->options->install_base, "_embedded_binaries");
+    // The stamp is only written once the extraction is complete.
+    bool has_stamp = mtime->IsUntampered(stamp_path) &&
+                     !blaze_util::IsDirectory(stamp_path);
+    if (has_stamp && !globals->options->verify_install_base) {
+      // --noverify_install_base trusts the stamp alone. That takes a single
+      // stat, but does not notice extracted files that were edited, replaced
+      // or removed.
+      return;
+    }
+
+    if (has_stamp) {
+      // The stamp covers the size, modification time and, on POSIX, status
+      // change time of every file. Recomputing it takes one stat per file, as
+      // the check of each file's modification time below does, and also
+      // catches changes that kept the modification time.
+      string expected_stamp, actual_stamp;
+      if (!blaze_util::ReadFile(stamp_path, &expected_stamp) ||
+          !ComputeInstallStamp(real_install_dir, globals->extracted_binaries,
+                               &actual_stamp) ||
+          expected_stamp != actual_stamp) {
+        BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
+            << "corrupt installation: files under '" << real_install_dir
+            << "' are missing or modified.  Please remove '"
+            << globals->options->install_base << "' and try again.";
+      }
+      return;
+    }
+
     for (const auto &it : globals->extracted_binaries) {
       string path = blaze_util::JoinPath(real_install_dir, it);
       if (!mtime->IsUntampered(path)) {
@@ -1602,18 +1626,13 @@ bool GrpcBlazeServer::Connect() {
   std::string ipv6_prefix_1 = "[0:0:0:0:0:0:0:1]:";
   std::string ipv6_prefix_2 = "[::1]:";
 
+  // The server writes the port file after it started listening on all of its
+  // sockets, so it also tells whether the Unix domain socket is ready.
   if (!blaze_util::ReadFile(blaze_util::JoinPath(server_dir, "command_port"),
                             &port)) {
     return false;
   }
 
-  // Make sure that we are being directed to localhost
-  if (port.compare(0, ipv4_prefix.size(), ipv4_prefix) &&
-      port.compare(0, ipv6_prefix_1.size(), ipv6_prefix_1) &&
-      port.compare(0, ipv6_prefix_2.size(), ipv6_prefix_2)) {
-    return false;
-  }
-
   if (!blaze_util::ReadFile(blaze_util::JoinPath(server_dir, "request_cookie"),
                             &request_cookie_)) {
     return false;
@@ -1633,8 +1652,23 @@ bool GrpcBlazeServer::Connect() {
     return false;
   }
 
+  // Prefer the Unix domain socket, which skips the TCP stack, if the kernel
+  // confirms that it belongs to the server process. Otherwise make sure that we
+  // are being directed to localhost.
+  std::string socket_path = blaze_util::JoinPath(server_dir, "command.socket");
+  std::string target;
+  if (VerifyServerSocket(server_pid, socket_path)) {
+    target = "unix:" + socket_path;
+  } else if (!port.compare(0, ipv4_prefix.size(), ipv4_prefix) ||
+             !port.compare(0, ipv6_prefix_1.size(), ipv6_prefix_1) ||
+             !port.compare(0, ipv6_prefix_2.size(), ipv6_prefix_2)) {
+    target = port;
+  } else {
+    return false;
+  }
+
   std::shared_ptr<grpc::Channel> channel(
-      grpc::CreateChannel(port, grpc::InsecureChannelCredentials()));
+      grpc::CreateChannel(target, grpc::InsecureChannelCredentials()));
   std::unique_ptr<CommandServer::Stub> client(
       CommandServer::NewStub(channel));
 
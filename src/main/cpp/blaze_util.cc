@@ -16,11 +16,15 @@
 
 #include <fcntl.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <algorithm>
 #include <cassert>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 
 #include "src/main/cpp/blaze_util_platform.h"
 #include "src/main/cpp/util/errors.h"
@@ -168,6 +172,109 @@ bool AwaitServerProcessTermination(int pid, const string& output_base,
   return true;
 }
 
+const char kInstallIndexMarker[] = "INSTALL_INDEX";
+
+namespace {
+
+// The size of a zip end of central directory record without the comment.
+const size_t kEndOfCentralDirSize = 22;
+const size_t kMaxZipCommentSize = 65535;
+
+// Adds a byte to the CRC computed by POSIX cksum.
+uint32_t CksumUpdate(uint32_t crc, unsigned char byte) {
+  crc ^= static_cast<uint32_t>(byte) << 24;
+  for (int i = 0; i < 8; ++i) {
+    crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+  }
+  return crc;
+}
+
+uint32_t CksumFinish(uint32_t crc, uint64_t size) {
+  for (; size > 0; size >>= 8) {
+    crc = CksumUpdate(crc, size & 0xff);
+  }
+  return ~crc;
+}
+
+}  // namespace
+
+bool ParseInstallIndex(const string& tail, string* install_md5,
+                       vector<string>* files) {
+  // Find the end of central directory record whose comment ends the file.
+  if (tail.size() < kEndOfCentralDirSize) {
+    return false;
+  }
+  size_t comment_start = string::npos;
+  for (size_t i = tail.size() - kEndOfCentralDirSize + 1; i-- > 0;) {
+    const unsigned char* p =
+        reinterpret_cast<const unsigned char*>(tail.data()) + i;
+    if (p[0] == 'P' && p[1] == 'K' && p[2] == 5 && p[3] == 6 &&
+        static_cast<size_t>(p[20] | (p[21] << 8)) ==
+            tail.size() - i - kEndOfCentralDirSize) {
+      comment_start = i + kEndOfCentralDirSize;
+      break;
+    }
+  }
+  if (comment_start == string::npos) {
+    return false;
+  }
+
+  vector<string> lines;
+  uint32_t crc = 0;
+  uint64_t size = 0;
+  for (size_t start = comment_start; start < tail.size();) {
+    size_t end = tail.find('\n', start);
+    if (end == string::npos) {
+      end = tail.size();
+    }
+    size_t line_end = end > start && tail[end - 1] == '\r' ? end - 1 : end;
+    lines.push_back(tail.substr(start, line_end - start));
+    start = end + 1;
+  }
+  if (lines.size() < 2) {
+    return false;
+  }
+  for (size_t i = 0; i + 1 < lines.size(); ++i) {
+    for (char c : lines[i]) {
+      crc = CksumUpdate(crc, c);
+    }
+    crc = CksumUpdate(crc, '\n');
+    size += lines[i].size() + 1;
+  }
+
+  std::istringstream footer(lines.back());
+  string marker;
+  uint32_t expected_crc;
+  uint64_t expected_size;
+  if (!(footer >> marker >> expected_crc >> expected_size) ||
+      marker != kInstallIndexMarker || expected_size != size ||
+      expected_crc != CksumFinish(crc, size) || lines[0].size() != 32) {
+    return false;
+  }
+  *install_md5 = lines[0];
+  files->assign(lines.begin() + 1, lines.end() - 1);
+  return true;
+}
+
+bool ReadInstallIndex(const string& path, string* install_md5,
+                      vector<string>* files) {
+  std::ifstream stm(path, std::ios::binary | std::ios::ate);
+  if (!stm.is_open()) {
+    return false;
+  }
+  std::streamoff file_size = stm.tellg();
+  if (file_size < 0) {
+    return false;
+  }
+  std::streamoff tail_size = std::min<std::streamoff>(
+      file_size, kEndOfCentralDirSize + kMaxZipCommentSize);
+  string tail(tail_size, '\0');
+  if (!stm.seekg(file_size - tail_size) || !stm.read(&tail[0], tail_size)) {
+    return false;
+  }
+  return ParseInstallIndex(tail, install_md5, files);
+}
+
 // For now, we don't have the client set up to log to a file. If --client_debug
 // is passed, however, all BAZEL_LOG statements will be output to stderr.
 // If/when we switch to logging these to a file, care will have to be taken to
@@ -100,6 +100,29 @@ std::string ToString(const T &value) {
 #endif
 }
 
+// The first word of the last line of the install index.
+extern const char kInstallIndexMarker[];
+
+// Parses the install index that the build stores in the zip comment of the
+// Blaze binary, which lets the client learn the install key and the names of
+// the embedded files without walking the central directory of the zip.
+// `tail` holds the last bytes of the binary, including the end of central
+// directory record.
+//
+// The lines of the index are the install key, the names of the embedded files
+// in the order of the zip, and "<kInstallIndexMarker> <crc> <size>", where crc
+// and size are what POSIX cksum prints for the preceding lines. Lines may end
+// in "\r\n", and the last one may lack its line break.
+//
+// Returns false if there is no index or it does not check out.
+bool ParseInstallIndex(const std::string& tail, std::string* install_md5,
+                       std::vector<std::string>* files);
+
+// Reads the install index at the end of the Blaze binary at `path` with a
+// single read, see ParseInstallIndex. Returns false if there is none.
+bool ReadInstallIndex(const std::string& path, std::string* install_md5,
+                      std::vector<std::string>* files);
+
 // Control the output of debug information by debug_log.
 // Revisit once client logging is fixed (b/32939567).
 void SetDebugLog(bool enabled);
@@ -161,6 +161,11 @@ bool VerifyServerProcess(int pid, const string &output_base) {
   return killpg(pid, 0) == 0;
 }
 
+// Not supported: the server only listens on a Unix domain socket on Linux.
+bool VerifyServerSocket(int pid, const string &path) {
+  return false;
+}
+
 // Not supported.
 void ExcludePathFromBackup(const string &path) {
 }
@@ -24,6 +24,7 @@
 #include <sys/stat.h>
 #include <sys/statfs.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <unistd.h>
 
 #include "src/main/cpp/blaze_util.h"
@@ -253,6 +254,30 @@ bool VerifyServerProcess(int pid, const string& output_base) {
   return !file_present || recorded_start_time == start_time;
 }
 
+bool VerifyServerSocket(int pid, const string& path) {
+  struct sockaddr_un addr;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    return false;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  memcpy(addr.sun_path, path.c_str(), path.size());
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return false;
+  }
+  struct ucred credentials;
+  socklen_t size = sizeof(credentials);
+  bool result =
+      connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) ==
+          0 &&
+      getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &size) == 0 &&
+      credentials.pid == pid && credentials.uid == geteuid();
+  close(fd);
+  return result;
+}
+
 // Not supported.
 void ExcludePathFromBackup(const string &path) {
 }
@@ -32,7 +32,8 @@ namespace embedded_binaries {
 class Dumper {
  public:
   // Requests to write the `data` of `size` bytes to disk under `path`.
-  // The actual writing may happen asynchronously.
+  // The actual writing may happen asynchronously, and this method may block
+  // while too much data is still waiting to be written.
   // `path` must be an absolute path. All of its parent directories will be
   // created.
   // The caller retains ownership of `data` and may release it immediately after
@@ -50,6 +51,10 @@ class Dumper {
   // writes are still in progress.
   // Subsequent `Dump` calls after this method have no effect.
   //
+  // Once this method returned true, every dumped file has its modification
+  // time set to the distant future (see `IFileMtime::SetToDistantFuture`) and
+  // is synced to disk, as far as the platform supports it.
+  //
   // Returns true if there were no errors in any of the `Dump` calls.
   // Returns false if any of the `Dump` calls failed, and if `error` is not
   // null then puts an error message in `error`.
@@ -189,6 +194,12 @@ void ReleaseLock(BlazeLock* blaze_lock);
 // Verifies whether the server process still exists. Returns true if it does.
 bool VerifyServerProcess(int pid, const std::string& output_base);
 
+// Verifies that the server process `pid` listens on the Unix domain socket at
+// `path` and runs as the same user as the client, as reported by the kernel for
+// a connection to the socket. Returns false if it does not or if this cannot be
+// checked on this platform, in which case the client uses the TCP port.
+bool VerifyServerSocket(int pid, const std::string& path);
+
 // Kills a server process based on its PID.
 // Returns true if the server process was found and killed.
 // WARNING! This function can be called from a signal handler!
@@ -207,6 +218,14 @@ void ExcludePathFromBackup(const std::string& path);
 std::string GetHashedBaseDir(const std::string& root,
                              const std::string& hashable);
 
+// Computes the stamp of an installation: a digest of the path, size,
+// modification time and, on POSIX, status change time of each of `files` under
+// `embedded_binaries`.
+// Returns false if any of the files cannot be accessed.
+bool ComputeInstallStamp(const std::string& embedded_binaries,
+                         const std::vector<std::string>& files,
+                         std::string* stamp);
+
 // Create a safe installation directory where we keep state, installations etc.
 // This method ensures that the directory is created, is owned by the current
 // user, and not accessible to anyone else.
@@ -34,10 +34,17 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <atomic>
 #include <cassert>
 #include <cinttypes>
+#include <condition_variable>  // NOLINT
+#include <deque>
+#include <memory>
+#include <mutex>  // NOLINT
 #include <set>
 #include <string>
+#include <thread>  // NOLINT
+#include <vector>
 
 #include "src/main/cpp/blaze_util.h"
 #include "src/main/cpp/global_variables.h"
@@ -58,6 +65,7 @@ using blaze_util::GetLastErrorString;
 
 using std::set;
 using std::string;
+using std::unique_ptr;
 using std::vector;
 
 namespace embedded_binaries {
@@ -70,53 +78,245 @@ class PosixDumper : public Dumper {
   bool Finish(string* error) override;
 
  private:
-  PosixDumper() : was_error_(false) {}
-
+  // A file waiting to be written by one of the worker threads.
+  struct Job {
+    unique_ptr<uint8_t[]> data;
+    size_t size;
+    string path;
+  };
+
+  PosixDumper();
+  void Work();
+  void Write(const Job& job);
+  bool Sync();
+  void MaybeSignalError(const string& msg);
+
+  // The access and modification time of the extracted files, 10 years in the
+  // future, like IFileMtime::SetToDistantFuture.
+  struct timespec distant_future_[2];
+
+  std::mutex queue_lock_;
+  std::condition_variable queue_changed_;
+  std::deque<Job> queue_;
+  // Total size of the files in `queue_`, bounded by kMaxQueuedBytes.
+  size_t queued_bytes_;
+  bool finishing_;
+  vector<std::thread> workers_;
+
+  std::mutex dir_cache_lock_;
   set<string> dir_cache_;
+  std::atomic_bool was_error_;
   string error_msg_;
-  bool was_error_;
 };
 
+namespace {
+
+// The number of threads writing files. As on Windows, the writes are bound by
+// I/O latency rather than CPU, so this need not follow the number of cores.
+const int kNumWorkers = 8;
+
+// Dump() blocks while the files waiting to be written take up more than this
+// many bytes, so that the client does not hold a copy of the whole archive.
+const size_t kMaxQueuedBytes = 64 * 1024 * 1024;
+
+}  // namespace
+
 Dumper* Create(string* error) { return PosixDumper::Create(error); }
 
 PosixDumper* PosixDumper::Create(string* error) { return new PosixDumper(); }
 
+PosixDumper::PosixDumper()
+    : queued_bytes_(0), finishing_(false), was_error_(false) {
+  time_t future = time(nullptr) + 3600 * 24 * 365 * 10;
+  distant_future_[0].tv_sec = future;
+  distant_future_[0].tv_nsec = 0;
+  distant_future_[1] = distant_future_[0];
+  for (int i = 0; i < kNumWorkers; ++i) {
+    workers_.push_back(std::thread(&PosixDumper::Work, this));
+  }
+}
+
 void PosixDumper::Dump(const void* data, const size_t size,
                        const string& path) {
   if (was_error_) {
     return;
   }
 
-  string dirname = blaze_util::Dirname(path);
+  Job job;
+  job.data.reset(new uint8_t[size]);
+  memcpy(job.data.get(), data, size);
+  job.size = size;
+  job.path = path;
+
+  std::unique_lock<std::mutex> lock(queue_lock_);
+  if (finishing_) {
+    return;
+  }
+  queue_changed_.wait(lock, [this, size] {
+    return queued_bytes_ == 0 || queued_bytes_ + size <= kMaxQueuedBytes;
+  });
+  queued_bytes_ += size;
+  queue_.push_back(std::move(job));
+  queue_changed_.notify_all();
+}
+
+void PosixDumper::Work() {
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(queue_lock_);
+      queue_changed_.wait(lock,
+                          [this] { return finishing_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        return;
+      }
+      job = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    if (!was_error_) {
+      Write(job);
+    }
+    {
+      std::lock_guard<std::mutex> lock(queue_lock_);
+      queued_bytes_ -= job.size;
+    }
+    queue_changed_.notify_all();
+  }
+}
+
+void PosixDumper::Write(const Job& job) {
+  string dirname = blaze_util::Dirname(job.path);
   // Performance optimization: memoize the paths we already created a
   // directory for, to spare a stat in attempting to recreate an already
   // existing directory.
-  if (dir_cache_.insert(dirname).second) {
-    if (!blaze_util::MakeDirectories(dirname, 0777)) {
-      was_error_ = true;
+  {
+    std::lock_guard<std::mutex> guard(dir_cache_lock_);
+    if (dir_cache_.insert(dirname).second &&
+        !blaze_util::MakeDirectories(dirname, 0777)) {
       string msg = GetLastErrorString();
-      error_msg_ = string("couldn't create '") + path + "': " + msg;
+      MaybeSignalError(string("couldn't create '") + job.path + "': " + msg);
+      return;
     }
   }
 
-  if (was_error_) {
+  // The files are created read-only so that they cannot be edited without a
+  // chmod first, which changes their ctime and thereby the install stamp.
+  int fd = open(job.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                0555);
+  if (fd < 0) {
+    string msg = GetLastErrorString();
+    MaybeSignalError(string("Failed to write zipped file '") + job.path +
+                     "': " + msg);
     return;
   }
+  bool success = true;
+  size_t written = 0;
+  while (success && written < job.size) {
+    ssize_t r = write(fd, job.data.get() + written, job.size - written);
+    if (r < 0 && errno == EINTR) {
+      continue;
+    }
+    success = r > 0;
+    written += success ? r : 0;
+  }
+  // Set the times on the open file so that no one else can observe it
+  // without them, and so that no further path lookup is needed.
+  success = success && futimens(fd, distant_future_) == 0;
+#ifndef __linux__
+  // Without syncfs, every file has to be synced on its own.
+  success = success && fsync(fd) == 0;
+#endif
+  string msg = success ? "" : GetLastErrorString();
+  if (close(fd) < 0 && success) {
+    success = false;  // Can fail on NFS.
+    msg = GetLastErrorString();
+  }
+  if (!success) {
+    MaybeSignalError(string("Failed to write zipped file '") + job.path +
+                     "': " + msg);
+  }
+}
 
-  if (!blaze_util::WriteFile(data, size, path, 0755)) {
-    was_error_ = true;
+// Makes sure (or at least as sure as we can...) that the files and directories
+// we have created are actually on the disk.
+bool PosixDumper::Sync() {
+  if (dir_cache_.empty()) {
+    return true;
+  }
+#ifdef __linux__
+  // A single syncfs of the file system holding the extracted files is much
+  // faster than syncing each file and directory separately.
+  const string& dir = *dir_cache_.begin();
+  int fd = open(dir.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0 || syncfs(fd) < 0) {
     string msg = GetLastErrorString();
-    error_msg_ = string("Failed to write zipped file '") + path + "': " + msg;
+    if (fd >= 0) {
+      close(fd);
+    }
+    error_msg_ = string("failed to sync '") + dir + "': " + msg;
+    return false;
   }
+  close(fd);
+#else
+  // The files were synced when they were written, so only the directories
+  // are left. MakeDirectories may have created the parents of the directories
+  // in `dir_cache_` too, so sync those as well. This also syncs the few
+  // directories above the extraction root once, which is harmless.
+  set<string> synced;
+  for (const string& it : dir_cache_) {
+    string dir = it;
+    while (!dir.empty() && synced.insert(dir).second &&
+           !blaze_util::IsRootDirectory(dir)) {
+      int fd = open(dir.c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd < 0 || fsync(fd) < 0) {
+        string msg = GetLastErrorString();
+        if (fd >= 0) {
+          close(fd);
+        }
+        error_msg_ = string("failed to sync '") + dir + "': " + msg;
+        return false;
+      }
+      close(fd);
+      dir = blaze_util::Dirname(dir);
+    }
+  }
+#endif
+  return true;
 }
 
 bool PosixDumper::Finish(string* error) {
+  if (!workers_.empty()) {
+    {
+      std::lock_guard<std::mutex> lock(queue_lock_);
+      finishing_ = true;
+    }
+    queue_changed_.notify_all();
+    for (std::thread& worker : workers_) {
+      worker.join();
+    }
+    workers_.clear();
+    // No race condition accessing `error_msg_`: all worker threads terminated
+    // by now.
+    if (!was_error_ && !Sync()) {
+      was_error_ = true;
+    }
+  }
   if (was_error_ && error) {
     *error = error_msg_;
   }
   return !was_error_;
 }
 
+void PosixDumper::MaybeSignalError(const string& msg) {
+  if (!was_error_.exchange(true)) {
+    // Benign race condition: though we use no locks to access `error_msg_`,
+    // only one thread may ever flip `was_error_` from false to true and enter
+    // the body of this if-clause, which provides adequate mutual exclusion to
+    // write `error_msg_`.
+    error_msg_ = msg;
+  }
+}
+
 }  // namespace embedded_binaries
 
 SignalHandler SignalHandler::INSTANCE;
@@ -464,6 +664,25 @@ string GetHashedBaseDir(const string& root, const string& hashable) {
   return blaze_util::JoinPath(root, digest.String());
 }
 
+bool ComputeInstallStamp(const string& embedded_binaries,
+                         const vector<string>& files, string* stamp) {
+  unsigned char buf[blaze_util::Md5Digest::kDigestLength];
+  blaze_util::Md5Digest digest;
+  for (const string& file : files) {
+    struct stat st;
+    if (stat(blaze_util::JoinPath(embedded_binaries, file).c_str(), &st) < 0) {
+      return false;
+    }
+    string entry = file + '\0' + ToString(static_cast<int64_t>(st.st_size)) +
+                   '\0' + ToString(static_cast<int64_t>(st.st_mtime)) +
+                   '\0' + ToString(static_cast<int64_t>(st.st_ctime)) + '\n';
+    digest.Update(entry.data(), entry.size());
+  }
+  digest.Finish(buf);
+  *stamp = digest.String();
+  return true;
+}
+
 void CreateSecureOutputRoot(const string& path) {
   const char* root = path.c_str();
   struct stat fileinfo = {};
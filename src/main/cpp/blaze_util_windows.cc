@@ -248,6 +248,12 @@ void DumpContext::Run() {
 
   if (!blaze_util::WriteFile(data_.get(), size_, path_, 0755)) {
     MaybeSignalError(string("Failed to write zipped file '") + path_ + "'");
+    return;
+  }
+
+  unique_ptr<blaze_util::IFileMtime> mtime(blaze_util::CreateFileMtime());
+  if (!mtime->SetToDistantFuture(path_)) {
+    MaybeSignalError(string("Failed to set timestamp on '") + path_ + "'");
   }
 }
 
@@ -913,6 +919,9 @@ bool VerifyServerProcess(int pid, const string& output_base) {
   return !file_present || recorded_start_time == ToString(start_time);
 }
 
+// Not supported: the server only listens on a Unix domain socket on Linux.
+bool VerifyServerSocket(int pid, const string& path) { return false; }
+
 bool KillServerProcess(int pid, const string& output_base) {
   AutoHandle process(::OpenProcess(
       PROCESS_TERMINATE | PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid));
@@ -973,6 +982,33 @@ string GetHashedBaseDir(const string& root, const string& hashable) {
   return blaze_util::JoinPath(root, string(coded_name));
 }
 
+bool ComputeInstallStamp(const string& embedded_binaries,
+                         const std::vector<string>& files, string* stamp) {
+  unsigned char buf[blaze_util::Md5Digest::kDigestLength];
+  blaze_util::Md5Digest digest;
+  for (const string& file : files) {
+    wstring wpath;
+    string error;
+    WIN32_FILE_ATTRIBUTE_DATA attrs;
+    if (!blaze_util::AsAbsoluteWindowsPath(
+            blaze_util::JoinPath(embedded_binaries, file), &wpath, &error) ||
+        !GetFileAttributesExW(wpath.c_str(), GetFileExInfoStandard, &attrs)) {
+      return false;
+    }
+    ULARGE_INTEGER size, mtime;
+    size.LowPart = attrs.nFileSizeLow;
+    size.HighPart = attrs.nFileSizeHigh;
+    mtime.LowPart = attrs.ftLastWriteTime.dwLowDateTime;
+    mtime.HighPart = attrs.ftLastWriteTime.dwHighDateTime;
+    string entry = file + '\0' + ToString(size.QuadPart) + '\0' +
+                   ToString(mtime.QuadPart) + '\n';
+    digest.Update(entry.data(), entry.size());
+  }
+  digest.Finish(buf);
+  *stamp = digest.String();
+  return true;
+}
+
 void CreateSecureOutputRoot(const string& path) {
   // TODO(bazel-team): implement this properly, by mimicing whatever the POSIX
   // implementation does.
@@ -73,6 +73,7 @@ void StartupOptions::RegisterUnaryStartupFlag(const std::string &flag_name) {
 StartupOptions::StartupOptions(const string &product_name,
                                const WorkspaceLayout *workspace_layout)
     : product_name(product_name),
+      verify_install_base(true),
       ignore_all_rc_files(false),
       deep_execroot(true),
       block_for_lock(true),
@@ -134,6 +135,7 @@ StartupOptions::StartupOptions(const string &product_name,
   RegisterNullaryStartupFlag("fatal_event_bus_exceptions");
   RegisterNullaryStartupFlag("host_jvm_debug");
   RegisterNullaryStartupFlag("ignore_all_rc_files");
+  RegisterNullaryStartupFlag("verify_install_base");
   RegisterNullaryStartupFlag("watchfs");
   RegisterNullaryStartupFlag("write_command_log");
   RegisterUnaryStartupFlag("command_port");
@@ -199,6 +201,12 @@ blaze_exit_code::ExitCode StartupOptions::ProcessArg(
                                      "--install_base")) != NULL) {
     install_base = blaze::AbsolutePathFromFlag(value);
     option_sources["install_base"] = rcfile;
+  } else if (GetNullaryOption(arg, "--verify_install_base")) {
+    verify_install_base = true;
+    option_sources["verify_install_base"] = rcfile;
+  } else if (GetNullaryOption(arg, "--noverify_install_base")) {
+    verify_install_base = false;
+    option_sources["verify_install_base"] = rcfile;
   } else if ((value = GetUnaryOption(arg, next_arg,
                                      "--output_user_root")) != NULL) {
     output_user_root = blaze::AbsolutePathFromFlag(value);
@@ -212,6 +212,10 @@ class StartupOptions {
   // Installation base for a specific release installation.
   std::string install_base;
 
+  // Whether to check every extracted file of an existing installation base
+  // for tampering. If false, only its stamp is checked.
+  bool verify_install_base;
+
   // The toplevel directory containing Blaze's output.  When Blaze is
   // run by a test, we use TEST_TMPDIR, simplifying the correct
   // hermetic invocation of Blaze from tests.
@@ -27,6 +27,9 @@ import com.google.devtools.build.lib.actions.Artifact;
 import com.google.devtools.build.lib.concurrent.ThreadSafety.Immutable;
 import com.google.devtools.build.lib.skyframe.serialization.autocodec.AutoCodec;
 import com.google.devtools.build.lib.util.Fingerprint;
+import com.google.devtools.build.lib.vfs.FileSystem;
+import com.google.devtools.build.lib.vfs.Path;
+import java.io.IOException;
 import java.util.LinkedHashMap;
 import java.util.Map;
 
@@ -103,6 +106,16 @@ public final class SymlinkTreeAction extends AbstractAction {
     fp.addStrings(env.getInheritedEnv());
   }
 
+  @Override
+  public void prepare(FileSystem fileSystem, Path execRoot) throws IOException {
+    // The default implementation of this method deletes all output files; override it to keep the
+    // old output manifest around. build-runfiles diffs it against the new input manifest to update
+    // the tree incrementally, and replaces it itself once the tree is up to date.
+    if (!enableRunfiles) {
+      super.prepare(fileSystem, execRoot);
+    }
+  }
+
   @Override
   public ActionResult execute(ActionExecutionContext actionExecutionContext)
       throws ActionExecutionException, InterruptedException {
@@ -262,6 +262,17 @@ public class BlazeServerStartupOptions extends OptionsBase {
               + "complete, but instead exits immediately.")
   public boolean blockForLock;
 
+  @Option(
+      name = "verify_install_base",
+      defaultValue = "true", // NOTE: only for documentation, value never passed to the server.
+      documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
+      effectTags = {OptionEffectTag.BAZEL_INTERNAL_CONFIGURATION},
+      help =
+          "If true, check every file of an existing install base for tampering. If false, only "
+              + "check the stamp written when it was extracted, which is faster but does not "
+              + "notice extracted files that were edited, replaced or removed.")
+  public boolean verifyInstallBase;
+
   @Option(
       name = "io_nice_level",
       defaultValue = "-1", // NOTE: only for documentation, value never passed to the server.
@@ -17,6 +17,7 @@ package com.google.devtools.build.lib.runtime;
 import com.google.devtools.build.lib.util.OsUtils;
 import com.google.devtools.build.lib.vfs.Path;
 import com.google.devtools.build.lib.vfs.PathFragment;
+import java.math.BigDecimal;
 import java.time.Duration;
 import java.util.ArrayList;
 import java.util.List;
@@ -41,6 +42,17 @@ public final class ProcessWrapperUtil {
     return execPath != null ? cmdEnv.getExecRoot().getRelative(execPath) : null;
   }
 
+  /**
+   * Formats a duration as the number of seconds that the process-wrapper and linux-sandbox expect
+   * for timeouts: "10" for whole seconds, "0.25" otherwise.
+   */
+  public static String formatSeconds(Duration duration) {
+    if (duration.getNano() == 0) {
+      return Long.toString(duration.getSeconds());
+    }
+    return BigDecimal.valueOf(duration.toNanos(), 9).stripTrailingZeros().toPlainString();
+  }
+
   /** Returns a new {@link CommandLineBuilder} for the process wrapper tool. */
   public static CommandLineBuilder commandLineBuilder(
       String processWrapperPath, List<String> commandArguments) {
@@ -104,10 +116,10 @@ public final class ProcessWrapperUtil {
       fullCommandLine.add(processWrapperPath);
 
       if (timeout != null) {
-        fullCommandLine.add("--timeout=" + timeout.getSeconds());
+        fullCommandLine.add("--timeout=" + formatSeconds(timeout));
       }
       if (killDelay != null) {
-        fullCommandLine.add("--kill_delay=" + killDelay.getSeconds());
+        fullCommandLine.add("--kill_delay=" + formatSeconds(killDelay));
       }
       if (stdoutPath != null) {
         fullCommandLine.add("--stdout=" + stdoutPath);
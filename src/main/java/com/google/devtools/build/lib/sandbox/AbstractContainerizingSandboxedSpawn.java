@@ -95,20 +95,17 @@ public abstract class AbstractContainerizingSandboxedSpawn implements SandboxedS
     for (PathFragment path : Iterables.concat(inputs.keySet(), outputs)) {
       Preconditions.checkArgument(!path.isAbsolute());
       Preconditions.checkArgument(!path.containsUplevelReferences());
-      for (int i = 0; i < path.segmentCount(); i++) {
-        dirsToCreate.add(sandboxExecRoot.getRelative(path.subFragment(0, i)));
-      }
-    }
-
-    for (Path path : dirsToCreate) {
-      path.createDirectory();
+      dirsToCreate.add(sandboxExecRoot.getRelative(path).getParentDirectory());
     }
 
     for (Path dir : writableDirs) {
       if (dir.startsWith(sandboxExecRoot)) {
-        dir.createDirectoryAndParents();
+        dirsToCreate.add(dir);
       }
     }
+
+    // Creating them in one call lets the file system share the work for common ancestors.
+    sandboxExecRoot.getFileSystem().createDirectoriesAndParents(dirsToCreate);
   }
 
   protected void createInputs(Map<PathFragment, Path> inputs) throws IOException {
@@ -0,0 +1,160 @@
+// Copyright 2019 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.devtools.build.lib.sandbox;
+
+import com.google.common.collect.ImmutableList;
+import com.google.common.collect.ImmutableMap;
+import com.google.devtools.build.lib.shell.Subprocess;
+import com.google.devtools.build.lib.shell.SubprocessBuilder;
+import com.google.devtools.build.lib.shell.SubprocessBuilder.StreamAction;
+import com.google.devtools.build.lib.vfs.Path;
+import java.io.IOException;
+import java.util.logging.Logger;
+import javax.annotation.Nullable;
+
+/**
+ * A {@code linux-sandbox --server} instance, which keeps a sandbox template around so that the
+ * commands run through it with {@code --connect} skip most of the per-action sandbox setup.
+ */
+final class LinuxSandboxServer {
+  private static final Logger log = Logger.getLogger(LinuxSandboxServer.class.getName());
+
+  /** Longest socket path that fits in {@code sockaddr_un.sun_path}, minus the terminating NUL. */
+  private static final int MAX_SOCKET_PATH_LENGTH = 107;
+
+  /** How long to wait for the server to start listening on its socket. */
+  private static final long STARTUP_TIMEOUT_MILLIS = 10000;
+
+  /** Socket on which the server accepts requests. */
+  private final Path socket;
+
+  /** Process handle to the server. Null only after {@link #destroy()} has been invoked. */
+  private @Nullable Subprocess process;
+
+  /**
+   * Shutdown hook to stop the server on abrupt termination. Null only after {@link #destroy()}
+   * has been invoked.
+   */
+  private @Nullable Thread shutdownHook;
+
+  private LinuxSandboxServer(Path socket, Subprocess process) {
+    this.socket = socket;
+    this.process = process;
+    this.shutdownHook = new Thread(this::destroy);
+    Runtime.getRuntime().addShutdownHook(shutdownHook);
+  }
+
+  /**
+   * Starts a new sandbox server.
+   *
+   * @param linuxSandbox path to the {@code linux-sandbox} binary
+   * @param socket path of the socket to listen on; the server only accepts connections from our
+   *     own user
+   * @param useFakeUsername whether the template uses a fake 'nobody' username; the clients must
+   *     pass the same setting
+   * @param logFile path to the file that will receive the server's logging output
+   * @return a handle to the running server, or null if the socket path is too long to be used
+   * @throws IOException if the server fails to start
+   */
+  @Nullable
+  static LinuxSandboxServer start(
+      Path linuxSandbox, Path socket, boolean useFakeUsername, Path logFile) throws IOException {
+    if (socket.getPathString().length() > MAX_SOCKET_PATH_LENGTH) {
+      log.warning("Not starting linux-sandbox server: socket path " + socket + " is too long");
+      return null;
+    }
+    log.info("Starting linux-sandbox server on " + socket);
+
+    ImmutableList.Builder<String> argvBuilder = ImmutableList.builder();
+    argvBuilder.add(linuxSandbox.getPathString(), "--server", socket.getPathString());
+    if (useFakeUsername) {
+      argvBuilder.add("-U");
+    }
+
+    SubprocessBuilder processBuilder = new SubprocessBuilder();
+    processBuilder.setArgv(argvBuilder.build());
+    processBuilder.setStdout(StreamAction.DISCARD);
+    processBuilder.setStderr(logFile.getPathFile());
+    processBuilder.setEnv(ImmutableMap.of());
+
+    Subprocess process = processBuilder.start();
+    LinuxSandboxServer server = new LinuxSandboxServer(socket, process);
+    // The server creates the socket before it builds the template, and connections queue up on
+    // it until the template is ready, so the socket's existence is all we need to wait for.
+    long deadline = System.currentTimeMillis() + STARTUP_TIMEOUT_MILLIS;
+    while (!socket.exists()) {
+      if (process.finished() || System.currentTimeMillis() > deadline) {
+        server.destroy();
+        throw new IOException("linux-sandbox server failed to start; see " + logFile);
+      }
+      try {
+        Thread.sleep(10);
+      } catch (InterruptedException e) {
+        server.destroy();
+        Thread.currentThread().interrupt();
+        throw new IOException("interrupted while starting the linux-sandbox server", e);
+      }
+    }
+    return server;
+  }
+
+  /** Returns the socket to pass to {@code linux-sandbox --connect}. */
+  Path getSocket() {
+    return socket;
+  }
+
+  /** Returns whether the server is still running. */
+  boolean isAlive() {
+    return process != null && !process.finished();
+  }
+
+  /** Stops the server and waits for it to exit. Commands that are already running continue. */
+  synchronized void destroy() {
+    if (shutdownHook != null) {
+      try {
+        Runtime.getRuntime().removeShutdownHook(shutdownHook);
+      } catch (IllegalStateException e) {
+        // We are running as the shutdown hook.
+      }
+      shutdownHook = null;
+    }
+
+    if (process != null) {
+      process.destroy();
+      boolean interrupted = false;
+      try {
+        while (true) {
+          try {
+            process.waitFor();
+            break;
+          } catch (InterruptedException ie) {
+            interrupted = true;
+          }
+        }
+      } finally {
+        if (interrupted) {
+          Thread.currentThread().interrupt();
+        }
+      }
+      process = null;
+    }
+
+    try {
+      socket.delete();
+    } catch (IOException e) {
+      log.warning("Failed to delete linux-sandbox server socket " + socket + ": " + e);
+    }
+  }
+}
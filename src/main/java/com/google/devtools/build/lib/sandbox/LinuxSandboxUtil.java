@@ -19,6 +19,7 @@ import com.google.common.collect.ImmutableList;
 import com.google.common.collect.ImmutableMap;
 import com.google.common.collect.ImmutableSet;
 import com.google.devtools.build.lib.runtime.CommandEnvironment;
+import com.google.devtools.build.lib.runtime.ProcessWrapperUtil;
 import com.google.devtools.build.lib.util.OsUtils;
 import com.google.devtools.build.lib.vfs.Path;
 import com.google.devtools.build.lib.vfs.PathFragment;
@@ -58,6 +59,7 @@ public final class LinuxSandboxUtil {
    */
   public static class CommandLineBuilder {
     private Path linuxSandboxPath;
+    private Path connectSocket;
     private Path workingDirectory;
     private Duration timeout;
     private Duration killDelay;
@@ -72,6 +74,9 @@ public final class LinuxSandboxUtil {
     private boolean useFakeRoot = false;
     private boolean useFakeUsername = false;
     private boolean useDebugMode = false;
+    private Path overlayUpperDirectory;
+    private Path overlayWorkDirectory;
+    private Path overlayInputsManifest;
     private List<String> commandArguments = ImmutableList.of();
 
     private CommandLineBuilder() {
@@ -84,6 +89,15 @@ public final class LinuxSandboxUtil {
       return this;
     }
 
+    /**
+     * Sets the socket of a {@code linux-sandbox --server} to run the command on, if any. The fake
+     * root and fake username settings must match the server's.
+     */
+    public CommandLineBuilder setConnectSocket(Path connectSocket) {
+      this.connectSocket = connectSocket;
+      return this;
+    }
+
     /** Sets the working directory to use, if any. */
     public CommandLineBuilder setWorkingDirectory(Path workingDirectory) {
       this.workingDirectory = workingDirectory;
@@ -175,6 +189,23 @@ public final class LinuxSandboxUtil {
       return this;
     }
 
+    /**
+     * Sets the directories of an overlay filesystem to mount on the working directory: all writes
+     * go to {@code upperDirectory}, and {@code workDirectory} is an empty directory on the same
+     * filesystem for internal use by overlayfs.
+     */
+    public CommandLineBuilder setOverlayDirectories(Path upperDirectory, Path workDirectory) {
+      this.overlayUpperDirectory = upperDirectory;
+      this.overlayWorkDirectory = workDirectory;
+      return this;
+    }
+
+    /** Sets the manifest of the inputs to make available in the overlay filesystem. */
+    public CommandLineBuilder setOverlayInputsManifest(Path overlayInputsManifest) {
+      this.overlayInputsManifest = overlayInputsManifest;
+      return this;
+    }
+
     /** Sets the command (and its arguments) to run using the {@code linux-sandbox} tool. */
     public CommandLineBuilder setCommandArguments(List<String> commandArguments) {
       this.commandArguments = commandArguments;
@@ -190,18 +221,24 @@ public final class LinuxSandboxUtil {
       Preconditions.checkState(
           !(this.useFakeUsername && this.useFakeRoot),
           "useFakeUsername and useFakeRoot are exclusive");
+      Preconditions.checkState(
+          (overlayUpperDirectory == null) == (overlayInputsManifest == null),
+          "an overlay filesystem requires both directories and an inputs manifest");
 
       ImmutableList.Builder<String> commandLineBuilder = ImmutableList.builder();
 
       commandLineBuilder.add(linuxSandboxPath.getPathString());
+      if (connectSocket != null) {
+        commandLineBuilder.add("--connect", connectSocket.getPathString());
+      }
       if (workingDirectory != null) {
         commandLineBuilder.add("-W", workingDirectory.getPathString());
       }
       if (timeout != null) {
-        commandLineBuilder.add("-T", Long.toString(timeout.getSeconds()));
+        commandLineBuilder.add("-T", ProcessWrapperUtil.formatSeconds(timeout));
       }
       if (killDelay != null) {
-        commandLineBuilder.add("-t", Long.toString(killDelay.getSeconds()));
+        commandLineBuilder.add("-t", ProcessWrapperUtil.formatSeconds(killDelay));
       }
       if (stdoutPath != null) {
         commandLineBuilder.add("-l", stdoutPath.getPathString());
@@ -241,6 +278,11 @@ public final class LinuxSandboxUtil {
       if (useDebugMode) {
         commandLineBuilder.add("-D");
       }
+      if (overlayUpperDirectory != null) {
+        commandLineBuilder.add("--overlay_upper", overlayUpperDirectory.getPathString());
+        commandLineBuilder.add("--overlay_work", overlayWorkDirectory.getPathString());
+        commandLineBuilder.add("--overlay_inputs", overlayInputsManifest.getPathString());
+      }
       commandLineBuilder.add("--");
       commandLineBuilder.addAll(commandArguments);
 
@@ -96,6 +96,7 @@ final class LinuxSandboxedSpawnRunner extends AbstractSandboxSpawnRunner {
   private final LocalEnvProvider localEnvProvider;
   private final Duration timeoutKillDelay;
   private final @Nullable SandboxfsProcess sandboxfsProcess;
+  private final @Nullable LinuxSandboxServer linuxSandboxServer;
 
   /**
    * Creates a sandboxed spawn runner that uses the {@code linux-sandbox} tool.
@@ -107,6 +108,8 @@ final class LinuxSandboxedSpawnRunner extends AbstractSandboxSpawnRunner {
    * @param timeoutKillDelay an additional grace period before killing timing out commands
    * @param sandboxfsProcess instance of the sandboxfs process to use; may be null for none, in
    *     which case the runner uses a symlinked sandbox
+   * @param linuxSandboxServer sandbox server to run the commands on; may be null for none, in
+   *     which case every command sets up its own sandbox
    */
   LinuxSandboxedSpawnRunner(
       CommandEnvironment cmdEnv,
@@ -114,7 +117,8 @@ final class LinuxSandboxedSpawnRunner extends AbstractSandboxSpawnRunner {
       Path inaccessibleHelperFile,
       Path inaccessibleHelperDir,
       Duration timeoutKillDelay,
-      @Nullable SandboxfsProcess sandboxfsProcess) {
+      @Nullable SandboxfsProcess sandboxfsProcess,
+      @Nullable LinuxSandboxServer linuxSandboxServer) {
     super(cmdEnv);
     this.fileSystem = cmdEnv.getRuntime().getFileSystem();
     this.blazeDirs = cmdEnv.getDirectories();
@@ -126,6 +130,7 @@ final class LinuxSandboxedSpawnRunner extends AbstractSandboxSpawnRunner {
     this.inaccessibleHelperDir = inaccessibleHelperDir;
     this.timeoutKillDelay = timeoutKillDelay;
     this.sandboxfsProcess = sandboxfsProcess;
+    this.linuxSandboxServer = linuxSandboxServer;
     this.localEnvProvider = new PosixLocalEnvProvider(cmdEnv.getClientEnv());
   }
 
@@ -169,8 +174,14 @@ final class LinuxSandboxedSpawnRunner extends AbstractSandboxSpawnRunner {
 
     if (spawn.getExecutionInfo().containsKey(ExecutionRequirements.REQUIRES_FAKEROOT)) {
       commandLineBuilder.setUseFakeRoot(true);
-    } else if (getSandboxOptions().sandboxFakeUsername) {
-      commandLineBuilder.setUseFakeUsername(true);
+    } else {
+      if (getSandboxOptions().sandboxFakeUsername) {
+        commandLineBuilder.setUseFakeUsername(true);
+      }
+      // The server was started with the same fake username setting, but never as fake root.
+      if (linuxSandboxServer != null && linuxSandboxServer.isAlive()) {
+        commandLineBuilder.setConnectSocket(linuxSandboxServer.getSocket());
+      }
     }
 
     Path statisticsPath = null;
@@ -190,6 +201,21 @@ final class LinuxSandboxedSpawnRunner extends AbstractSandboxSpawnRunner {
               SandboxHelpers.processInputFiles(spawn, context, execRoot),
               outputs,
               ImmutableSet.of());
+    } else if (getSandboxOptions().useLinuxSandboxOverlayfs) {
+      commandLineBuilder
+          .setOverlayDirectories(
+              OverlaySandboxedSpawn.getUpperDirectory(sandboxPath),
+              OverlaySandboxedSpawn.getWorkDirectory(sandboxPath))
+          .setOverlayInputsManifest(OverlaySandboxedSpawn.getInputsManifest(sandboxPath));
+      sandbox =
+          new OverlaySandboxedSpawn(
+              sandboxPath,
+              sandboxExecRoot,
+              commandLineBuilder.build(),
+              environment,
+              SandboxHelpers.processInputFiles(spawn, context, execRoot),
+              outputs,
+              writableDirs);
     } else {
       sandbox =
           new SymlinkedSandboxedSpawn(
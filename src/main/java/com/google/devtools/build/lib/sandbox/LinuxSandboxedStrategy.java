@@ -49,10 +49,12 @@ public final class LinuxSandboxedStrategy extends AbstractSpawnStrategy {
    * @param timeoutKillDelay additional grace period before killing timing out commands
    * @param sandboxfsProcess instance of the sandboxfs process to use; may be null for none, in
    *     which case the runner uses a symlinked sandbox
+   * @param linuxSandboxServer sandbox server to run the commands on; may be null for none
    */
   static LinuxSandboxedSpawnRunner create(
       CommandEnvironment cmdEnv, Path sandboxBase, Duration timeoutKillDelay,
-      @Nullable SandboxfsProcess sandboxfsProcess) throws IOException {
+      @Nullable SandboxfsProcess sandboxfsProcess,
+      @Nullable LinuxSandboxServer linuxSandboxServer) throws IOException {
     Path inaccessibleHelperFile = sandboxBase.getRelative("inaccessibleHelperFile");
     FileSystemUtils.touchFile(inaccessibleHelperFile);
     inaccessibleHelperFile.setReadable(false);
@@ -71,6 +73,7 @@ public final class LinuxSandboxedStrategy extends AbstractSpawnStrategy {
         inaccessibleHelperFile,
         inaccessibleHelperDir,
         timeoutKillDelay,
-        sandboxfsProcess);
+        sandboxfsProcess,
+        linuxSandboxServer);
   }
 }
@@ -0,0 +1,140 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.devtools.build.lib.sandbox;
+
+import com.google.devtools.build.lib.vfs.FileSystemUtils;
+import com.google.devtools.build.lib.vfs.Path;
+import com.google.devtools.build.lib.vfs.PathFragment;
+import java.io.IOException;
+import java.util.Collection;
+import java.util.List;
+import java.util.Map;
+import java.util.Set;
+
+/**
+ * Creates an execRoot for a Spawn as an overlay filesystem that the {@code linux-sandbox} mounts
+ * itself.
+ *
+ * <p>Instead of a symlink tree, we only write a manifest of the inputs, from which the {@code
+ * linux-sandbox} creates the symlinks in a tmpfs that goes away together with the sandbox. Whatever
+ * the spawn writes ends up in an upper directory, from which the outputs are collected.
+ */
+class OverlaySandboxedSpawn implements SandboxedSpawn {
+  private final Path sandboxPath;
+  private final Path sandboxExecRoot;
+  private final List<String> arguments;
+  private final Map<String, String> environment;
+  private final Map<PathFragment, Path> inputs;
+  private final Collection<PathFragment> outputs;
+  private final Set<Path> writableDirs;
+
+  OverlaySandboxedSpawn(
+      Path sandboxPath,
+      Path sandboxExecRoot,
+      List<String> arguments,
+      Map<String, String> environment,
+      Map<PathFragment, Path> inputs,
+      Collection<PathFragment> outputs,
+      Set<Path> writableDirs) {
+    this.sandboxPath = sandboxPath;
+    this.sandboxExecRoot = sandboxExecRoot;
+    this.arguments = arguments;
+    this.environment = environment;
+    this.inputs = inputs;
+    this.outputs = outputs;
+    this.writableDirs = writableDirs;
+  }
+
+  /** Returns the directory that receives everything the spawn writes to its execRoot. */
+  static Path getUpperDirectory(Path sandboxPath) {
+    return sandboxPath.getRelative("upper");
+  }
+
+  /** Returns the scratch directory that overlayfs needs next to the upper directory. */
+  static Path getWorkDirectory(Path sandboxPath) {
+    return sandboxPath.getRelative("work");
+  }
+
+  /** Returns the path of the manifest listing the inputs of the spawn. */
+  static Path getInputsManifest(Path sandboxPath) {
+    return sandboxPath.getRelative("inputs.manifest");
+  }
+
+  @Override
+  public Path getSandboxExecRoot() {
+    return sandboxExecRoot;
+  }
+
+  @Override
+  public List<String> getArguments() {
+    return arguments;
+  }
+
+  @Override
+  public Map<String, String> getEnvironment() {
+    return environment;
+  }
+
+  @Override
+  public void createFileSystem() throws IOException {
+    Path upperDir = getUpperDirectory(sandboxPath);
+    upperDir.createDirectory();
+    getWorkDirectory(sandboxPath).createDirectory();
+
+    // One "<path> <target>" line per input, with an empty target for empty files.
+    StringBuilder manifest = new StringBuilder();
+    for (Map.Entry<PathFragment, Path> entry : inputs.entrySet()) {
+      String path = entry.getKey().getPathString();
+      if (path.indexOf(' ') >= 0 || path.indexOf('\n') >= 0) {
+        throw new IOException(
+            String.format(
+                "Input '%s' contains a space or newline, which the overlayfs sandbox does not "
+                    + "support",
+                path));
+      }
+      manifest.append(path).append(' ');
+      if (entry.getValue() != null) {
+        manifest.append(entry.getValue().getPathString());
+      }
+      manifest.append('\n');
+    }
+    FileSystemUtils.writeContentAsLatin1(getInputsManifest(sandboxPath), manifest.toString());
+
+    // Directories in the upper directory show up in the execRoot, too.
+    for (PathFragment output : outputs) {
+      upperDir.getRelative(output).getParentDirectory().createDirectoryAndParents();
+    }
+    for (Path dir : writableDirs) {
+      if (dir.startsWith(sandboxExecRoot)) {
+        upperDir.getRelative(dir.relativeTo(sandboxExecRoot)).createDirectoryAndParents();
+      }
+    }
+  }
+
+  @Override
+  public void copyOutputs(Path execRoot) throws IOException {
+    SandboxedSpawn.moveOutputs(outputs, getUpperDirectory(sandboxPath), execRoot);
+  }
+
+  @Override
+  public void delete() {
+    try {
+      FileSystemUtils.deleteTree(sandboxPath);
+    } catch (IOException e) {
+      // See AbstractContainerizingSandboxedSpawn.delete(); the SandboxModule will try again once
+      // the build is done.
+    }
+  }
+}
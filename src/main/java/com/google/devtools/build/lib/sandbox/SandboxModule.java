@@ -67,6 +67,9 @@ public final class SandboxModule extends BlazeModule {
   /** Instance of the sandboxfs process in use, if enabled. */
   private @Nullable SandboxfsProcess sandboxfsProcess;
 
+  /** Instance of the linux-sandbox server, if running, shared by all linux-sandbox spawns. */
+  private @Nullable LinuxSandboxServer linuxSandboxServer;
+
   /**
    * Whether to remove the sandbox worker directories after a build or not. Useful for debugging
    * to inspect the state of files on failures.
@@ -103,6 +106,7 @@ public final class SandboxModule extends BlazeModule {
 
     // Don't attempt cleanup unless the executor is initialized.
     sandboxfsProcess = null;
+    linuxSandboxServer = null;
     shouldCleanupSandboxBase = false;
   }
 
@@ -189,11 +193,24 @@ public final class SandboxModule extends BlazeModule {
 
     // This is the preferred sandboxing strategy on Linux.
     if (linuxSandboxSupported) {
+      if (options.useLinuxSandboxServer) {
+        linuxSandboxServer =
+            LinuxSandboxServer.start(
+                LinuxSandboxUtil.getLinuxSandbox(cmdEnv),
+                sandboxBase.getRelative("linux-sandbox.sock"),
+                options.sandboxFakeUsername,
+                sandboxBase.getRelative("linux-sandbox-server.log"));
+        if (linuxSandboxServer == null) {
+          env.getReporter().handle(Event.warn(
+              "Not using the linux-sandbox server: the path of its socket under " + sandboxBase
+              + " is too long"));
+        }
+      }
       SpawnRunner spawnRunner =
           withFallback(
               cmdEnv,
               LinuxSandboxedStrategy.create(
-                  cmdEnv, sandboxBase, timeoutKillDelay, sandboxfsProcess));
+                  cmdEnv, sandboxBase, timeoutKillDelay, sandboxfsProcess, linuxSandboxServer));
       builder.addActionContext(new LinuxSandboxedStrategy(cmdEnv.getExecRoot(), spawnRunner));
     }
 
@@ -304,14 +321,23 @@ public final class SandboxModule extends BlazeModule {
     }
   }
 
+  private void stopLinuxSandboxServer() {
+    if (linuxSandboxServer != null) {
+      linuxSandboxServer.destroy();
+      linuxSandboxServer = null;
+    }
+  }
+
   @Subscribe
   public void buildComplete(@SuppressWarnings("unused") BuildCompleteEvent event) {
     unmountSandboxfs("Build complete; unmounting sandboxfs...");
+    stopLinuxSandboxServer();
   }
 
   @Subscribe
   public void buildInterrupted(@SuppressWarnings("unused") BuildInterruptedEvent event) {
     unmountSandboxfs("Build interrupted; unmounting sandboxfs...");
+    stopLinuxSandboxServer();
   }
 
   @Override
@@ -330,6 +356,8 @@ public final class SandboxModule extends BlazeModule {
 
     checkState(sandboxfsProcess == null, "sandboxfs instance should have been shut down at this "
         + "point; were the buildComplete/buildInterrupted events sent?");
+    checkState(linuxSandboxServer == null, "linux-sandbox server should have been stopped at "
+        + "this point; were the buildComplete/buildInterrupted events sent?");
     sandboxBase = null;
 
     env.getEventBus().unregister(this);
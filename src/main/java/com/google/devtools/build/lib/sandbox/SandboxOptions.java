@@ -192,6 +192,30 @@ public class SandboxOptions extends OptionsBase {
   )
   public String sandboxfsPath;
 
+  @Option(
+    name = "experimental_linux_sandbox_overlayfs",
+    defaultValue = "false",
+    documentationCategory = OptionDocumentationCategory.EXECUTION_STRATEGY,
+    effectTags = {OptionEffectTag.UNKNOWN},
+    help =
+        "If true, the linux-sandbox mounts an overlay filesystem as the actions' execroot instead "
+            + "of Bazel building a symlink tree for every action. Requires a kernel that allows "
+            + "mounting overlayfs in user namespaces, e.g. Linux 5.11 or later."
+  )
+  public boolean useLinuxSandboxOverlayfs;
+
+  @Option(
+    name = "experimental_linux_sandbox_server",
+    defaultValue = "false",
+    documentationCategory = OptionDocumentationCategory.EXECUTION_STRATEGY,
+    effectTags = {OptionEffectTag.UNKNOWN},
+    help =
+        "If true, Bazel starts a linux-sandbox server for the duration of each build and runs "
+            + "sandboxed actions through it, which saves most of the namespace setup per action. "
+            + "Actions that require a fake root still get a sandbox of their own."
+  )
+  public boolean useLinuxSandboxServer;
+
   public ImmutableSet<Path> getInaccessiblePaths(FileSystem fs) {
     List<Path> inaccessiblePaths = new ArrayList<>();
     for (String path : sandboxBlockPath) {
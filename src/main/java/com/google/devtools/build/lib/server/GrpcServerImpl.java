@@ -48,15 +48,30 @@ import com.google.devtools.common.options.OptionsParsingException;
 import com.google.protobuf.ByteString;
 import io.grpc.Server;
 import io.grpc.StatusRuntimeException;
+import io.grpc.netty.GrpcHttp2ConnectionHandler;
 import io.grpc.netty.NettyServerBuilder;
+import io.grpc.netty.ProtocolNegotiator;
+import io.grpc.netty.ProtocolNegotiators;
 import io.grpc.stub.ServerCallStreamObserver;
 import io.grpc.stub.StreamObserver;
+import io.netty.channel.ChannelHandlerAdapter;
+import io.netty.channel.ChannelHandlerContext;
+import io.netty.channel.epoll.Epoll;
+import io.netty.channel.epoll.EpollDomainSocketChannel;
+import io.netty.channel.epoll.EpollEventLoopGroup;
+import io.netty.channel.epoll.EpollServerDomainSocketChannel;
+import io.netty.channel.unix.DomainSocketAddress;
+import io.netty.channel.unix.PeerCredentials;
+import io.netty.util.AsciiString;
+import io.netty.util.concurrent.DefaultThreadFactory;
 import java.io.IOException;
 import java.io.OutputStream;
 import java.io.PrintWriter;
 import java.io.StringWriter;
 import java.net.InetSocketAddress;
 import java.nio.charset.StandardCharsets;
+import java.nio.file.Files;
+import java.nio.file.Paths;
 import java.security.SecureRandom;
 import java.util.ArrayList;
 import java.util.Collections;
@@ -76,6 +91,7 @@ import java.util.concurrent.atomic.AtomicBoolean;
 import java.util.concurrent.atomic.AtomicLong;
 import java.util.concurrent.atomic.AtomicReference;
 import java.util.logging.Logger;
+import javax.annotation.Nullable;
 import javax.annotation.concurrent.GuardedBy;
 
 /**
@@ -490,6 +506,7 @@ public class GrpcServerImpl implements RPCServer {
 
   // These paths are all relative to the server directory
   private static final String PORT_FILE = "command_port";
+  private static final String SOCKET_FILE = "command.socket";
   private static final String REQUEST_COOKIE_FILE = "request_cookie";
   private static final String RESPONSE_COOKIE_FILE = "response_cookie";
 
@@ -514,6 +531,7 @@ public class GrpcServerImpl implements RPCServer {
   private final int port;
 
   private Server server;
+  @Nullable private Server domainSocketServer;
   private IdleServerTasks idleServerTasks;
   boolean serving;
 
@@ -644,7 +662,7 @@ public class GrpcServerImpl implements RPCServer {
     }
 
     logger.info("About to shutdown due to idleness");
-    server.shutdown();
+    shutdownServers();
   }
 
   /**
@@ -709,6 +727,7 @@ public class GrpcServerImpl implements RPCServer {
               .build()
               .start();
     }
+    domainSocketServer = startDomainSocketServer();
 
     if (maxIdleSeconds > 0) {
       Thread timeoutThread = new Thread(this::timeoutThread);
@@ -731,6 +750,98 @@ public class GrpcServerImpl implements RPCServer {
     }
   }
 
+  /**
+   * Starts serving on a Unix domain socket in the server directory, which the client prefers to the
+   * TCP port because it avoids the overhead of the TCP stack. Only processes of the user owning the
+   * server directory may connect to it.
+   *
+   * <p>Returns null if Unix domain sockets are not supported on this platform or the socket cannot
+   * be created, e.g. because its path is too long. The client uses the TCP port then.
+   */
+  @Nullable
+  private Server startDomainSocketServer() {
+    if (!Epoll.isAvailable()) {
+      return null;
+    }
+    Path socket = serverDirectory.getChild(SOCKET_FILE);
+    try {
+      // A server that was killed may have left its socket behind.
+      socket.delete();
+      int uid =
+          (Integer) Files.getAttribute(Paths.get(serverDirectory.getPathString()), "unix:uid");
+      EpollEventLoopGroup eventLoopGroup =
+          new EpollEventLoopGroup(1, new DefaultThreadFactory("grpc-domain-socket", true));
+      Server result =
+          NettyServerBuilder.forAddress(new DomainSocketAddress(socket.getPathString()))
+              .channelType(EpollServerDomainSocketChannel.class)
+              .bossEventLoopGroup(eventLoopGroup)
+              .workerEventLoopGroup(eventLoopGroup)
+              .protocolNegotiator(new PeerCredentialsNegotiator(uid))
+              .addService(commandServer)
+              .directExecutor()
+              .build()
+              .start();
+      deleteAtExit(socket);
+      return result;
+    } catch (IOException e) {
+      logger.info("Cannot listen on " + socket + ", using only the TCP port: " + e.getMessage());
+      return null;
+    }
+  }
+
+  /**
+   * Lets through only connections from processes of the given user, as reported by the kernel
+   * (SO_PEERCRED). Requests still have to carry the request cookie.
+   */
+  private static class PeerCredentialsNegotiator implements ProtocolNegotiator {
+    private final int uid;
+
+    PeerCredentialsNegotiator(int uid) {
+      this.uid = uid;
+    }
+
+    @Override
+    public Handler newHandler(GrpcHttp2ConnectionHandler grpcHandler) {
+      Handler plaintextHandler = ProtocolNegotiators.serverPlaintext().newHandler(grpcHandler);
+      return new PeerCredentialsHandler(plaintextHandler);
+    }
+
+    private class PeerCredentialsHandler extends ChannelHandlerAdapter
+        implements ProtocolNegotiator.Handler {
+      private final Handler next;
+
+      PeerCredentialsHandler(Handler next) {
+        this.next = next;
+      }
+
+      @Override
+      public void handlerAdded(ChannelHandlerContext ctx) throws Exception {
+        PeerCredentials credentials = ((EpollDomainSocketChannel) ctx.channel()).peerCredentials();
+        if (credentials.uid() != uid) {
+          logger.warning(
+              String.format(
+                  "Rejected connection from process %d of user %d",
+                  credentials.pid(), credentials.uid()));
+          ctx.close();
+          return;
+        }
+        ctx.pipeline().replace(this, null, next);
+      }
+
+      @Override
+      public AsciiString scheme() {
+        return next.scheme();
+      }
+    }
+  }
+
+  private void shutdownServers() {
+    if (domainSocketServer != null) {
+      domainSocketServer.shutdown();
+    }
+    server.shutdown();
+  }
+
   private void writeServerFile(String name, String contents) throws IOException {
     Path file = serverDirectory.getChild(name);
     FileSystemUtils.writeContentAsLatin1(file, contents);
@@ -884,7 +995,7 @@ public class GrpcServerImpl implements RPCServer {
     Thread.interrupted();
 
     if (result.shutdown()) {
-      server.shutdown();
+      shutdownServers();
     }
 
     RunResponse.Builder response = RunResponse.newBuilder()
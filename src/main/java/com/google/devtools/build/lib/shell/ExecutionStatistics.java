@@ -19,6 +19,8 @@ import java.io.BufferedInputStream;
 import java.io.IOException;
 import java.io.InputStream;
 import java.time.Duration;
+import java.time.Instant;
+import java.time.temporal.ChronoUnit;
 import java.util.Optional;
 
 /** Provides execution statistics (e.g. resource usage) for external commands. */
@@ -43,6 +45,46 @@ public final class ExecutionStatistics {
     }
   }
 
+  /**
+   * Provides cgroup statistics based on a {@code execution_statistics.proto} file.
+   *
+   * @param executionStatisticsProtoPath path to a materialized ExecutionStatistics proto
+   * @return a {@link CgroupUsage} object, if the command ran in a cgroup of its own
+   */
+  public static Optional<CgroupUsage> getCgroupUsage(Path executionStatisticsProtoPath)
+      throws IOException {
+    try (InputStream protoInputStream =
+        new BufferedInputStream(executionStatisticsProtoPath.getInputStream())) {
+      Protos.ExecutionStatistics executionStatisticsProto =
+          Protos.ExecutionStatistics.parseFrom(protoInputStream);
+      if (executionStatisticsProto.hasCgroupUsage()) {
+        return Optional.of(new CgroupUsage(executionStatisticsProto.getCgroupUsage()));
+      } else {
+        return Optional.empty();
+      }
+    }
+  }
+
+  /**
+   * Provides the wall-clock times of a command based on a {@code execution_statistics.proto} file.
+   *
+   * @param executionStatisticsProtoPath path to a materialized ExecutionStatistics proto
+   * @return an {@link ExecutionTimes} object, if the tool that ran the command recorded them
+   */
+  public static Optional<ExecutionTimes> getExecutionTimes(Path executionStatisticsProtoPath)
+      throws IOException {
+    try (InputStream protoInputStream =
+        new BufferedInputStream(executionStatisticsProtoPath.getInputStream())) {
+      Protos.ExecutionStatistics executionStatisticsProto =
+          Protos.ExecutionStatistics.parseFrom(protoInputStream);
+      if (executionStatisticsProto.hasExecutionTimes()) {
+        return Optional.of(new ExecutionTimes(executionStatisticsProto.getExecutionTimes()));
+      } else {
+        return Optional.empty();
+      }
+    }
+  }
+
   /**
    * Provides resource usage statistics for command execution, derived from the getrusage() system
    * call.
@@ -148,4 +190,121 @@ public final class ExecutionStatistics {
       return resourceUsageProto.getNivcsw();
     }
   }
+
+  /**
+   * Provides resource usage statistics for command execution, read from the cgroup (v2) the
+   * command ran in. Unlike {@link ResourceUsage}, these also cover processes that were not waited
+   * for. Values are zero if the corresponding controller was not enabled.
+   */
+  public static class CgroupUsage {
+    private final Protos.CgroupUsage cgroupUsageProto;
+
+    /** Provides cgroup statistics via a CgroupUsage proto object. */
+    public CgroupUsage(Protos.CgroupUsage cgroupUsageProto) {
+      this.cgroupUsageProto = cgroupUsageProto;
+    }
+
+    /** Returns the peak memory usage (in bytes) during command execution. */
+    public long getMemoryPeak() {
+      return cgroupUsageProto.getMemoryPeakBytes();
+    }
+
+    /** Returns the number of processes killed by the OOM killer during command execution. */
+    public long getMemoryOomKills() {
+      return cgroupUsageProto.getMemoryOomKills();
+    }
+
+    /** Returns the total CPU time for command execution. */
+    public Duration getCpuTime() {
+      return Duration.ofNanos(cgroupUsageProto.getCpuUsageUsec() * 1000);
+    }
+
+    /** Returns the user CPU time for command execution. */
+    public Duration getUserCpuTime() {
+      return Duration.ofNanos(cgroupUsageProto.getCpuUserUsec() * 1000);
+    }
+
+    /** Returns the system CPU time for command execution. */
+    public Duration getSystemCpuTime() {
+      return Duration.ofNanos(cgroupUsageProto.getCpuSystemUsec() * 1000);
+    }
+
+    /** Returns the number of bytes read from block devices during command execution. */
+    public long getIoReadBytes() {
+      return cgroupUsageProto.getIoReadBytes();
+    }
+
+    /** Returns the number of bytes written to block devices during command execution. */
+    public long getIoWriteBytes() {
+      return cgroupUsageProto.getIoWriteBytes();
+    }
+
+    /** Returns the maximum number of concurrent processes during command execution. */
+    public long getPidsPeak() {
+      return cgroupUsageProto.getPidsPeak();
+    }
+
+    /** Returns the time during which some of the processes waited for a CPU. */
+    public Duration getCpuPressureSome() {
+      return Duration.ofNanos(cgroupUsageProto.getCpuPressureSomeUsec() * 1000);
+    }
+
+    /** Returns the time during which some of the processes waited for memory. */
+    public Duration getMemoryPressureSome() {
+      return Duration.ofNanos(cgroupUsageProto.getMemoryPressureSomeUsec() * 1000);
+    }
+
+    /** Returns the time during which all of the processes waited for memory. */
+    public Duration getMemoryPressureFull() {
+      return Duration.ofNanos(cgroupUsageProto.getMemoryPressureFullUsec() * 1000);
+    }
+
+    /** Returns the time during which some of the processes waited for IO. */
+    public Duration getIoPressureSome() {
+      return Duration.ofNanos(cgroupUsageProto.getIoPressureSomeUsec() * 1000);
+    }
+
+    /** Returns the time during which all of the processes waited for IO. */
+    public Duration getIoPressureFull() {
+      return Duration.ofNanos(cgroupUsageProto.getIoPressureFullUsec() * 1000);
+    }
+  }
+
+  /**
+   * Provides the wall-clock times at which a command was started, had been exec'd and was seen to
+   * have exited, with microsecond precision.
+   */
+  public static class ExecutionTimes {
+    private final Protos.ExecutionTimes executionTimesProto;
+
+    /** Provides execution times via an ExecutionTimes proto object. */
+    public ExecutionTimes(Protos.ExecutionTimes executionTimesProto) {
+      this.executionTimesProto = executionTimesProto;
+    }
+
+    private static Instant toInstant(long usec) {
+      return Instant.EPOCH.plus(usec, ChronoUnit.MICROS);
+    }
+
+    /** Returns the time right before the command was spawned. */
+    public Instant getStartTime() {
+      return toInstant(executionTimesProto.getStartTimeUsec());
+    }
+
+    /** Returns the time at which the command had been exec'd, if known. */
+    public Optional<Instant> getExecTime() {
+      long usec = executionTimesProto.getExecTimeUsec();
+      return usec == 0 ? Optional.empty() : Optional.of(toInstant(usec));
+    }
+
+    /** Returns the time at which the command was seen to have exited. */
+    public Instant getExitTime() {
+      return toInstant(executionTimesProto.getExitTimeUsec());
+    }
+
+    /** Returns the wall time from starting the command until it exited. */
+    public Duration getWallTime() {
+      return Duration.between(getStartTime(), getExitTime());
+    }
+  }
 }
@@ -38,7 +38,10 @@ import com.google.devtools.build.lib.util.LoggingUtil;
 import com.google.devtools.build.lib.util.Pair;
 import com.google.devtools.build.lib.util.io.TimestampGranularityMonitor;
 import com.google.devtools.build.lib.vfs.BatchStat;
+import com.google.devtools.build.lib.vfs.FileStatus;
 import com.google.devtools.build.lib.vfs.FileStatusWithDigest;
+import com.google.devtools.build.lib.vfs.FileStatusWithDigestAdapter;
+import com.google.devtools.build.lib.vfs.FileSystem;
 import com.google.devtools.build.lib.vfs.ModifiedFileSet;
 import com.google.devtools.build.lib.vfs.Path;
 import com.google.devtools.build.lib.vfs.PathFragment;
@@ -49,6 +52,7 @@ import com.google.devtools.build.skyframe.SkyKey;
 import com.google.devtools.build.skyframe.SkyValue;
 import com.google.devtools.build.skyframe.WalkableGraph;
 import java.io.IOException;
+import java.util.ArrayList;
 import java.util.Collection;
 import java.util.Collections;
 import java.util.HashMap;
@@ -361,11 +365,13 @@ public class FilesystemValueChecker {
     return new Runnable() {
       @Override
       public void run() {
+        Map<Artifact, FileStatusWithDigest> stats =
+            batchStatOutputFiles(shard, knownModifiedOutputFiles);
         for (Pair<SkyKey, ActionExecutionValue> keyAndValue : shard) {
           ActionExecutionValue value = keyAndValue.getSecond();
           if (value == null
               || actionValueIsDirtyWithDirectSystemCalls(
-                  value, knownModifiedOutputFiles, sortedKnownModifiedOutputFiles)) {
+                  value, stats, knownModifiedOutputFiles, sortedKnownModifiedOutputFiles)) {
             dirtyKeys.add(keyAndValue.getFirst());
           }
         }
@@ -373,6 +379,53 @@ public class FilesystemValueChecker {
     };
   }
 
+  /**
+   * Stats the output files of the shard that need to be checked with a single {@link
+   * FileSystem#batchStatIfFound} call, which lets file systems overlap the calls. Files that do not
+   * exist or could not be stat-ed this way are left out and get stat-ed one by one later.
+   */
+  private static Map<Artifact, FileStatusWithDigest> batchStatOutputFiles(
+      List<Pair<SkyKey, ActionExecutionValue>> shard,
+      ImmutableSet<PathFragment> knownModifiedOutputFiles) {
+    Map<Artifact, FileStatusWithDigest> stats = new HashMap<>();
+    List<Artifact> artifacts = new ArrayList<>();
+    List<Path> paths = new ArrayList<>();
+    FileSystem fileSystem = null;
+    for (Pair<SkyKey, ActionExecutionValue> keyAndValue : shard) {
+      ActionExecutionValue value = keyAndValue.getSecond();
+      if (value == null) {
+        continue;
+      }
+      for (Artifact artifact : value.getAllFileValues().keySet()) {
+        Path path = artifact.getPath();
+        if (fileSystem == null) {
+          fileSystem = path.getFileSystem();
+        }
+        if (shouldCheckFile(knownModifiedOutputFiles, artifact)
+            && path.getFileSystem() == fileSystem) {
+          artifacts.add(artifact);
+          paths.add(path);
+        }
+      }
+    }
+    if (paths.isEmpty()) {
+      return stats;
+    }
+    List<FileStatus> statuses;
+    try {
+      statuses = fileSystem.batchStatIfFound(paths, /*followSymlinks=*/ false);
+    } catch (IOException e) {
+      // Stat-ing the files one by one reports the error for the right action.
+      return stats;
+    }
+    for (int i = 0; i < artifacts.size(); i++) {
+      if (statuses.get(i) != null) {
+        stats.put(artifacts.get(i), FileStatusWithDigestAdapter.adapt(statuses.get(i)));
+      }
+    }
+    return stats;
+  }
+
   /**
    * Returns the number of modified output files inside of dirty actions.
    */
@@ -404,6 +457,7 @@ public class FilesystemValueChecker {
   }
 
   private boolean actionValueIsDirtyWithDirectSystemCalls(ActionExecutionValue actionValue,
+      Map<Artifact, FileStatusWithDigest> stats,
       ImmutableSet<PathFragment> knownModifiedOutputFiles,
       Supplier<NavigableSet<PathFragment>> sortedKnownModifiedOutputFiles) {
     boolean isDirty = false;
@@ -412,8 +466,8 @@ public class FilesystemValueChecker {
       FileValue lastKnownData = entry.getValue();
       if (shouldCheckFile(knownModifiedOutputFiles, file)) {
         try {
-          FileValue fileValue = ActionMetadataHandler.fileValueFromArtifact(file, null,
-              tsgm);
+          FileValue fileValue =
+              ActionMetadataHandler.fileValueFromArtifact(file, stats.get(file), tsgm);
           if (!fileValue.equals(lastKnownData)) {
             updateIntraBuildModifiedCounter(fileValue.exists()
                 ? fileValue.realRootedPath().asPath().getLastModifiedTime()
@@ -93,6 +93,7 @@ import java.io.FileNotFoundException;
 import java.io.IOException;
 import java.util.Collection;
 import java.util.HashSet;
+import java.util.LinkedHashSet;
 import java.util.List;
 import java.util.Map;
 import java.util.Set;
@@ -781,75 +782,85 @@ public final class SkyframeActionExecutor {
   private void createOutputDirectories(Action action, ActionExecutionContext context)
       throws ActionExecutionException {
     try {
-      Set<Path> done = new HashSet<>(); // avoid redundant calls for the same directory.
+      Set<Path> outputDirs = new LinkedHashSet<>(); // avoid redundant calls for the same directory.
       for (Artifact outputFile : action.getOutputs()) {
-        Path outputDir;
         if (outputFile.isTreeArtifact()) {
-          outputDir = context.getPathResolver().toPath(outputFile);
+          outputDirs.add(context.getPathResolver().toPath(outputFile));
         } else {
-          outputDir = context.getPathResolver().toPath(outputFile).getParentDirectory();
+          outputDirs.add(context.getPathResolver().toPath(outputFile).getParentDirectory());
         }
+      }
+      if (outputDirs.isEmpty()) {
+        return;
+      }
 
-        if (done.add(outputDir)) {
-          try {
-            outputDir.createDirectoryAndParents();
-            continue;
-          } catch (IOException e) {
-            /* Fall through to plan B. */
-          }
+      // Usually all of them can be created at once, which file systems may batch.
+      try {
+        outputDirs.iterator().next().getFileSystem().createDirectoriesAndParents(outputDirs);
+        return;
+      } catch (IOException e) {
+        /* Fall through to creating them one by one. */
+      }
 
-          // Possibly some direct ancestors are not directories.  In that case, we traverse the
-          // ancestors upward, deleting any non-directories, until we reach a directory, then try
-          // again. This handles the case where a file becomes a directory, either from one build to
-          // another, or within a single build.
-          //
-          // Symlinks should not be followed so in order to clean up symlinks pointing to Fileset
-          // outputs from previous builds. See bug [incremental build of Fileset fails if
-          // Fileset.out was changed to be a subdirectory of the old value].
-          try {
-            Path p = outputDir;
-            while (true) {
-
-              // This lock ensures that the only thread that observes a filesystem transition in
-              // which the path p first exists and then does not is the thread that calls
-              // p.delete() and causes the transition.
-              //
-              // If it were otherwise, then some thread A could test p.exists(), see that it does,
-              // then test p.isDirectory(), see that p isn't a directory (because, say, thread
-              // B deleted it), and then call p.delete(). That could result in two different kinds
-              // of failures:
-              //
-              // 1) In the time between when thread A sees that p is not a directory and when thread
-              // A calls p.delete(), thread B may reach the call to createDirectoryAndParents
-              // and create a directory at p, which thread A then deletes. Thread B would then try
-              // adding outputs to the directory it thought was there, and fail.
-              //
-              // 2) In the time between when thread A sees that p is not a directory and when thread
-              // A calls p.delete(), thread B may create a directory at p, and then either create a
-              // subdirectory beneath it or add outputs to it. Then when thread A tries to delete p,
-              // it would fail.
-              Lock lock = outputDirectoryDeletionLock.get(p);
-              lock.lock();
-              try {
-                if (p.exists(Symlinks.NOFOLLOW)) {
-                  boolean isDirectory = p.isDirectory(Symlinks.NOFOLLOW);
-                  if (isDirectory) {
-                    break;
-                  }
-                  // p may be a file or dangling symlink, or a symlink to an old Fileset output
-                  p.delete(); // throws IOException
+      for (Path outputDir : outputDirs) {
+        try {
+          outputDir.createDirectoryAndParents();
+          continue;
+        } catch (IOException e) {
+          /* Fall through to plan B. */
+        }
+
+        // Possibly some direct ancestors are not directories.  In that case, we traverse the
+        // ancestors upward, deleting any non-directories, until we reach a directory, then try
+        // again. This handles the case where a file becomes a directory, either from one build to
+        // another, or within a single build.
+        //
+        // Symlinks should not be followed so in order to clean up symlinks pointing to Fileset
+        // outputs from previous builds. See bug [incremental build of Fileset fails if
+        // Fileset.out was changed to be a subdirectory of the old value].
+        try {
+          Path p = outputDir;
+          while (true) {
+
+            // This lock ensures that the only thread that observes a filesystem transition in
+            // which the path p first exists and then does not is the thread that calls
+            // p.delete() and causes the transition.
+            //
+            // If it were otherwise, then some thread A could test p.exists(), see that it does,
+            // then test p.isDirectory(), see that p isn't a directory (because, say, thread
+            // B deleted it), and then call p.delete(). That could result in two different kinds
+            // of failures:
+            //
+            // 1) In the time between when thread A sees that p is not a directory and when thread
+            // A calls p.delete(), thread B may reach the call to createDirectoryAndParents
+            // and create a directory at p, which thread A then deletes. Thread B would then try
+            // adding outputs to the directory it thought was there, and fail.
+            //
+            // 2) In the time between when thread A sees that p is not a directory and when thread
+            // A calls p.delete(), thread B may create a directory at p, and then either create a
+            // subdirectory beneath it or add outputs to it. Then when thread A tries to delete p,
+            // it would fail.
+            Lock lock = outputDirectoryDeletionLock.get(p);
+            lock.lock();
+            try {
+              if (p.exists(Symlinks.NOFOLLOW)) {
+                boolean isDirectory = p.isDirectory(Symlinks.NOFOLLOW);
+                if (isDirectory) {
+                  break;
                 }
-              } finally {
-                lock.unlock();
+                // p may be a file or dangling symlink, or a symlink to an old Fileset output
+                p.delete(); // throws IOException
               }
-
-              p = p.getParentDirectory();
+            } finally {
+              lock.unlock();
             }
-            outputDir.createDirectoryAndParents();
-          } catch (IOException e) {
-            throw new ActionExecutionException(
-                "failed to create output directory '" + outputDir + "'", e, action, false);
+
+            p = p.getParentDirectory();
           }
+          outputDir.createDirectoryAndParents();
+        } catch (IOException e) {
+          throw new ActionExecutionException(
+              "failed to create output directory '" + outputDir + "'", e, action, false);
         }
       }
     } catch (ActionExecutionException ex) {
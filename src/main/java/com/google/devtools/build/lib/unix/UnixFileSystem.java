@@ -31,6 +31,7 @@ import java.io.IOException;
 import java.util.ArrayList;
 import java.util.Collection;
 import java.util.List;
+import java.util.Map;
 
 /**
  * This class implements the FileSystem interface using direct calls to the UNIX filesystem.
@@ -38,6 +39,10 @@ import java.util.List;
 @ThreadSafe
 public class UnixFileSystem extends AbstractFileSystemWithCustomStat {
 
+  /** The maximum number of threads used to create a single symlink forest. */
+  private static final int SYMLINK_FOREST_PARALLELISM =
+      Math.min(8, Runtime.getRuntime().availableProcessors());
+
   public UnixFileSystem() {
   }
 
@@ -234,6 +239,32 @@ public class UnixFileSystem extends AbstractFileSystemWithCustomStat {
     }
   }
 
+  @Override
+  public List<FileStatus> batchStatIfFound(List<Path> paths, boolean followSymlinks)
+      throws IOException {
+    String[] names = new String[paths.size()];
+    for (int i = 0; i < names.length; i++) {
+      names[i] = paths.get(i).getPathString();
+    }
+    ErrnoFileStatus[] stats = followSymlinks
+        ? NativePosixFiles.batchStat(names)
+        : NativePosixFiles.batchLstat(names);
+    List<FileStatus> statuses = new ArrayList<>(stats.length);
+    for (int i = 0; i < stats.length; i++) {
+      ErrnoFileStatus stat = stats[i];
+      if (!stat.hasError()) {
+        statuses.add(new UnixFileStatus(stat));
+      } else if (stat.getErrno() == ErrnoFileStatus.ENOENT
+          || stat.getErrno() == ErrnoFileStatus.ENOTDIR) {
+        statuses.add(null);
+      } else {
+        // Stat the file again to throw the proper exception, as statIfFound does.
+        statuses.add(statIfFound(paths.get(i), followSymlinks));
+      }
+    }
+    return statuses;
+  }
+
   @Override
   protected boolean isReadable(Path path) throws IOException {
     return (statInternal(path, true).getPermissions() & 0400) != 0;
@@ -324,12 +355,52 @@ public class UnixFileSystem extends AbstractFileSystemWithCustomStat {
     NativePosixFiles.mkdirs(path.toString(), 0777);
   }
 
+  @Override
+  public void createDirectoriesAndParents(Collection<Path> paths) throws IOException {
+    String[] names = new String[paths.size()];
+    int i = 0;
+    for (Path path : paths) {
+      names[i++] = path.toString();
+    }
+    NativePosixFiles.mkdirsBatch(names, 0777);
+  }
+
   @Override
   protected void createSymbolicLink(Path linkPath, PathFragment targetFragment)
       throws IOException {
     NativePosixFiles.symlink(targetFragment.getSafePathString(), linkPath.toString());
   }
 
+  @Override
+  public void createSymbolicLinkForest(Path root, Map<PathFragment, PathFragment> links)
+      throws IOException {
+    String[] linkNames = new String[links.size()];
+    String[] targets = new String[links.size()];
+    int i = 0;
+    for (Map.Entry<PathFragment, PathFragment> entry : links.entrySet()) {
+      Preconditions.checkArgument(!entry.getKey().isAbsolute(), entry.getKey());
+      linkNames[i] = entry.getKey().getPathString();
+      targets[i] = entry.getValue().getSafePathString();
+      i++;
+    }
+
+    String name = root.toString();
+    long startTime = Profiler.nanoTimeMaybe();
+    int[] errors;
+    try {
+      errors =
+          NativePosixFiles.createSymlinkForest(
+              name, linkNames, targets, 0777, SYMLINK_FOREST_PARALLELISM);
+    } finally {
+      profiler.logSimpleTask(startTime, ProfilerTask.VFS_WRITE, name);
+    }
+    for (i = 0; i < errors.length; i++) {
+      if (errors[i] != 0) {
+        NativePosixFiles.throwFileException(root.getRelative(linkNames[i]).toString(), errors[i]);
+      }
+    }
+  }
+
   @Override
   protected PathFragment readSymbolicLink(Path path) throws IOException {
     // Note that the default implementation of readSymbolicLinkUnchecked calls this method and thus
@@ -367,6 +438,17 @@ public class UnixFileSystem extends AbstractFileSystemWithCustomStat {
     }
   }
 
+  @Override
+  public void deleteTreesBelow(Path dir) throws IOException {
+    String name = dir.toString();
+    long startTime = Profiler.nanoTimeMaybe();
+    try {
+      NativePosixFiles.deleteTreesBelow(name);
+    } finally {
+      profiler.logSimpleTask(startTime, ProfilerTask.VFS_DELETE, name);
+    }
+  }
+
   @Override
   protected long getLastModifiedTime(Path path, boolean followSymlinks) throws IOException {
     return stat(path, followSymlinks).getLastModifiedTime();
@@ -28,8 +28,10 @@ import java.io.InputStream;
 import java.io.InputStreamReader;
 import java.io.OutputStream;
 import java.nio.file.FileAlreadyExistsException;
+import java.util.ArrayList;
 import java.util.Collection;
 import java.util.List;
+import java.util.Map;
 
 /**
  * This interface models a file system using UNIX the naming scheme.
@@ -197,6 +199,16 @@ public abstract class FileSystem {
    */
   public abstract void createDirectoryAndParents(Path path) throws IOException;
 
+  /**
+   * Creates all directories up to each of the given paths, as if by calling {@link
+   * #createDirectoryAndParents} on each of them in turn, but possibly more efficiently.
+   */
+  public void createDirectoriesAndParents(Collection<Path> paths) throws IOException {
+    for (Path path : paths) {
+      createDirectoryAndParents(path);
+    }
+  }
+
   /**
    * Returns the size in bytes of the file denoted by {@code path}. See {@link
    * Path#getFileSize(Symlinks)} for specification.
@@ -210,6 +222,34 @@ public abstract class FileSystem {
   /** Deletes the file denoted by {@code path}. See {@link Path#delete} for specification. */
   public abstract boolean delete(Path path) throws IOException;
 
+  /**
+   * Deletes all directory trees recursively beneath {@code dir}. See {@link
+   * Path#deleteTreesBelow} for specification.
+   *
+   * <p>The default implementation walks the tree through this file system one entry at a time;
+   * file systems with a faster way of wiping a whole tree should override it.
+   */
+  public void deleteTreesBelow(Path dir) throws IOException {
+    if (isDirectory(dir, /*followSymlinks=*/ false)) {
+      // Make sure that the directory can be listed and its entries removed.
+      setReadable(dir, true);
+      setWritable(dir, true);
+      setExecutable(dir, true);
+      for (String entry : getDirectoryEntries(dir)) {
+        deleteTree(dir.getChild(entry));
+      }
+    }
+  }
+
+  /**
+   * Deletes {@code path} and everything recursively beneath it. See {@link Path#deleteTree} for
+   * specification.
+   */
+  public void deleteTree(Path path) throws IOException {
+    deleteTreesBelow(path);
+    delete(path);
+  }
+
   /**
    * Returns the last modification time of the file denoted by {@code path}. See {@link
    * Path#getLastModifiedTime(Symlinks)} for specification.
@@ -472,6 +512,20 @@ public abstract class FileSystem {
     }
   }
 
+  /**
+   * Returns the status of each of the given paths, in the same order, as if by calling {@link
+   * #statIfFound} on each of them in turn, but possibly more efficiently. The returned list
+   * contains null for the paths that were not found.
+   */
+  public List<FileStatus> batchStatIfFound(List<Path> paths, boolean followSymlinks)
+      throws IOException {
+    List<FileStatus> statuses = new ArrayList<>(paths.size());
+    for (Path path : paths) {
+      statuses.add(statIfFound(path, followSymlinks));
+    }
+    return statuses;
+  }
+
   /**
    * Returns true iff {@code path} denotes an existing directory. See
    * {@link Path#isDirectory(Symlinks)} for specification.
@@ -499,6 +553,35 @@ public abstract class FileSystem {
   protected abstract void createSymbolicLink(Path linkPath, PathFragment targetFragment)
       throws IOException;
 
+  /**
+   * Creates a symbolic link at {@code root.getRelative(link)} pointing to {@code target} for every
+   * entry {@code (link, target)} of {@code links}, creating missing parent directories of the
+   * links as needed. No link may be below another link of the same forest.
+   *
+   * <p>All links are attempted even if some fail, in no particular order.
+   *
+   * @throws IOException if any of the links could not be created.
+   */
+  public void createSymbolicLinkForest(Path root, Map<PathFragment, PathFragment> links)
+      throws IOException {
+    IOException failure = null;
+    for (Map.Entry<PathFragment, PathFragment> entry : links.entrySet()) {
+      Preconditions.checkArgument(!entry.getKey().isAbsolute(), entry.getKey());
+      Path link = root.getRelative(entry.getKey());
+      try {
+        link.getParentDirectory().createDirectoryAndParents();
+        createSymbolicLink(link, entry.getValue());
+      } catch (IOException e) {
+        if (failure == null) {
+          failure = e;
+        }
+      }
+    }
+    if (failure != null) {
+      throw failure;
+    }
+  }
+
   /**
    * Returns the target of a symbolic link. See {@link Path#readSymbolicLink} for specification.
    *
@@ -525,8 +525,7 @@ public class FileSystemUtils {
    */
   @ThreadSafe
   public static void deleteTree(Path p) throws IOException {
-    deleteTreesBelow(p);
-    p.delete();
+    p.deleteTree();
   }
 
   /**
@@ -537,14 +536,7 @@ public class FileSystemUtils {
    */
   @ThreadSafe
   public static void deleteTreesBelow(Path dir) throws IOException {
-    if (dir.isDirectory(Symlinks.NOFOLLOW)) {  // real directories (not symlinks)
-      dir.setReadable(true);
-      dir.setWritable(true);
-      dir.setExecutable(true);
-      for (Path child : dir.getDirectoryEntries()) {
-        deleteTree(child);
-      }
-    }
+    dir.deleteTreesBelow();
   }
 
   /**
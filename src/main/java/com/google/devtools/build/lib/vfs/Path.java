@@ -686,6 +686,28 @@ public class Path
     return fileSystem.delete(this);
   }
 
+  /**
+   * Deletes all directory trees recursively beneath this path if it's a directory, and does
+   * nothing otherwise. Does not follow any symbolic links. Directories that are missing read,
+   * write or execute permissions for the owner are made accessible before their contents are
+   * removed.
+   *
+   * @throws IOException if any file could not be removed
+   */
+  public void deleteTreesBelow() throws IOException {
+    fileSystem.deleteTreesBelow(this);
+  }
+
+  /**
+   * Deletes the file denoted by this path, and everything recursively beneath it if it's a
+   * directory. Does not follow any symbolic links.
+   *
+   * @throws IOException if any file could not be removed
+   */
+  public void deleteTree() throws IOException {
+    fileSystem.deleteTree(this);
+  }
+
   /**
    * Returns the last modification time of the file, in milliseconds since the UNIX epoch, of the
    * file denoted by the current path, following symbolic links.
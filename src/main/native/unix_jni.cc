@@ -29,7 +29,14 @@
 #include <unistd.h>
 #include <utime.h>
 
+#include <algorithm>
+#include <atomic>
+#include <list>
+#include <mutex>
 #include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include "src/main/native/macros.h"
@@ -47,72 +54,144 @@ using blaze_util::Md5Digest;
 // Like the Sun JDK in its usual configuration, we assume all UNIX
 // filenames are Latin1 encoded.
 
+// These conversions run for every path crossing the JNI boundary, so they
+// avoid the heap for anything shorter than PATH_MAX, i.e. all valid paths.
+
 /**
  * Returns a new Java String for the specified Latin1 characters.
  */
-static jstring NewStringLatin1(JNIEnv *env, const char *str) {
-    int len = strlen(str);
-    jchar buf[512];
-    jchar *str1;
-
-    if (len > 512) {
-      str1 = reinterpret_cast<jchar *>(malloc(len * sizeof(jchar)));
-      if (str1 == 0) {
-        ::PostException(env, ENOMEM, "Out of memory in NewStringLatin1");
-        return NULL;
-      }
-    } else {
-      str1 = buf;
-    }
+static jstring NewStringLatin1(JNIEnv *env, const char *str, size_t len) {
+  // Pure ASCII strings are also valid modified UTF-8, which the JVM can turn
+  // into a String without an intermediate UTF-16 copy.
+  bool ascii = true;
+  for (size_t i = 0; i < len && ascii; i++) {
+    ascii = static_cast<unsigned char>(str[i]) < 0x80;
+  }
+  if (ascii && str[len] == '\0') {
+    return env->NewStringUTF(str);
+  }
 
-    for (int i = 0; i < len ; i++) {
-      str1[i] = (unsigned char) str[i];
-    }
-    jstring result = env->NewString(str1, len);
-    if (str1 != buf) {
-      free(str1);
+  jchar buf[PATH_MAX];
+  jchar *str1;
+  if (len > arraysize(buf)) {
+    str1 = reinterpret_cast<jchar *>(malloc(len * sizeof(jchar)));
+    if (str1 == 0) {
+      ::PostException(env, ENOMEM, "Out of memory in NewStringLatin1");
+      return NULL;
     }
-    return result;
+  } else {
+    str1 = buf;
+  }
+
+  for (size_t i = 0; i < len; i++) {
+    str1[i] = (unsigned char) str[i];
+  }
+  jstring result = env->NewString(str1, len);
+  if (str1 != buf) {
+    free(str1);
+  }
+  return result;
 }
 
 /**
- * Returns a nul-terminated Latin1-encoded byte array for the
- * specified Java string, or null on failure.  Unencodable characters
- * are replaced by '?'.  Must be followed by a call to
- * ReleaseStringLatin1Chars.
+ * A nul-terminated Latin1-encoded copy of a Java string.  Unencodable
+ * characters are replaced by '?'.  Strings shorter than PATH_MAX are
+ * converted into a buffer inside the object itself, so instances on the stack
+ * only touch the heap for overlong strings.
  */
-static char *GetStringLatin1Chars(JNIEnv *env, jstring jstr) {
-  jint len = env->GetStringLength(jstr);
-  const jchar *str = env->GetStringCritical(jstr, NULL);
-  if (str == NULL) {
-    return NULL;
+class Latin1Chars {
+ public:
+  Latin1Chars(JNIEnv *env, jstring jstr) : chars_(NULL) {
+    jsize len = env->GetStringLength(jstr);
+    jchar *str = buf_;
+    if (static_cast<size_t>(len) >= arraysize(buf_)) {
+      str = reinterpret_cast<jchar *>(malloc((len + 1) * sizeof(jchar)));
+      if (str == NULL) {
+        ::PostException(env, ENOMEM, "Out of memory in Latin1Chars");
+        return;
+      }
+    }
+
+    // GetStringRegion copies into our buffer, unlike GetStringCritical, which
+    // may have to allocate a temporary UTF-16 copy of compact strings.
+    env->GetStringRegion(jstr, 0, len, str);
+
+    // Narrow in place: character i is written to byte i, which overlaps only
+    // UTF-16 units that have already been read.
+    char *result = reinterpret_cast<char *>(str);
+    for (jsize i = 0; i < len; i++) {
+      jchar unicode = str[i];  // (unsigned)
+      result[i] = unicode <= 0x00ff ? unicode : '?';
+    }
+    result[len] = 0;
+    chars_ = result;
   }
 
-  char *result = reinterpret_cast<char *>(malloc(len + 1));
-  if (result == NULL) {
-    env->ReleaseStringCritical(jstr, str);
-    ::PostException(env, ENOMEM, "Out of memory in GetStringLatin1Chars");
+  ~Latin1Chars() {
+    if (chars_ != reinterpret_cast<char *>(buf_)) {
+      free(chars_);
+    }
+  }
+
+  // Returns the converted string, or NULL if the conversion failed, in which
+  // case a Java exception is pending.
+  char *get() const { return chars_; }
+
+ private:
+  jchar buf_[PATH_MAX];
+  char *chars_;
+
+  Latin1Chars(const Latin1Chars &) = delete;
+  Latin1Chars &operator=(const Latin1Chars &) = delete;
+};
+
+////////////////////////////////////////////////////////////////////////
+// Classes and constructors used to build results, resolved once when the
+// library is loaded rather than looked up on every call.
+
+static jclass string_class;
+static jclass file_status_class;
+static jmethodID file_status_ctor;
+static jclass dirents_class;
+static jmethodID dirents_ctor;
+
+static jclass FindClassGlobal(JNIEnv *env, const char *name) {
+  jclass local = env->FindClass(name);
+  if (local == NULL) {
     return NULL;
   }
+  jclass global = static_cast<jclass>(env->NewGlobalRef(local));
+  env->DeleteLocalRef(local);
+  return global;
+}
 
-  for (int i = 0; i < len; i++) {
-    jchar unicode = str[i];  // (unsigned)
-    result[i] = unicode <= 0x00ff ? unicode : '?';
+// ErrnoFileStatus is deliberately not resolved here: finding a class
+// initializes it, and its static initializer calls back into this library,
+// whose native methods are not yet bound while JNI_OnLoad runs.
+extern "C" JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *vm, void *reserved) {
+  JNIEnv *env;
+  if (vm->GetEnv(reinterpret_cast<void **>(&env), JNI_VERSION_1_6) != JNI_OK) {
+    return JNI_ERR;
   }
 
-  result[len] = 0;
-  env->ReleaseStringCritical(jstr, str);
-  return result;
-}
+  string_class = FindClassGlobal(env, "java/lang/String");
+  file_status_class =
+      FindClassGlobal(env, "com/google/devtools/build/lib/unix/FileStatus");
+  dirents_class = FindClassGlobal(
+      env, "com/google/devtools/build/lib/unix/NativePosixFiles$Dirents");
+  if (string_class == NULL || file_status_class == NULL ||
+      dirents_class == NULL) {
+    return JNI_ERR;
+  }
 
-/**
- * Release the Latin1 chars returned by a prior call to
- * GetStringLatin1Chars.
- */
-static void ReleaseStringLatin1Chars(const char *s) {
-  if (s != NULL) {
-    free(const_cast<char *>(s));
+  file_status_ctor =
+      env->GetMethodID(file_status_class, "<init>", "(IIIIIIIJIJ)V");
+  dirents_ctor =
+      env->GetMethodID(dirents_class, "<init>", "([Ljava/lang/String;[B)V");
+  if (file_status_ctor == NULL || dirents_ctor == NULL) {
+    return JNI_ERR;
   }
+  return JNI_VERSION_1_6;
 }
 
 ////////////////////////////////////////////////////////////////////////
@@ -249,15 +328,17 @@ extern "C" JNIEXPORT jstring JNICALL
 Java_com_google_devtools_build_lib_unix_NativePosixFiles_readlink(JNIEnv *env,
                                                      jclass clazz,
                                                      jstring path) {
-  const char *path_chars = GetStringLatin1Chars(env, path);
-  char target[PATH_MAX] = "";
+  Latin1Chars path_latin1(env, path);
+  const char *path_chars = path_latin1.get();
+  char target[PATH_MAX];
   jstring r = NULL;
-  if (readlink(path_chars, target, arraysize(target)) == -1) {
+  ssize_t len = readlink(path_chars, target, arraysize(target) - 1);
+  if (len == -1) {
     ::PostFileException(env, errno, path_chars);
   } else {
-    r = NewStringLatin1(env, target);
+    target[len] = 0;
+    r = NewStringLatin1(env, target, len);
   }
-  ReleaseStringLatin1Chars(path_chars);
   return r;
 }
 
@@ -266,24 +347,24 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_chmod(JNIEnv *env,
                                                   jclass clazz,
                                                   jstring path,
                                                   jint mode) {
-  const char *path_chars = GetStringLatin1Chars(env, path);
+  Latin1Chars path_latin1(env, path);
+  const char *path_chars = path_latin1.get();
   if (chmod(path_chars, static_cast<int>(mode)) == -1) {
     ::PostFileException(env, errno, path_chars);
   }
-  ReleaseStringLatin1Chars(path_chars);
 }
 
 static void link_common(JNIEnv *env,
                         jstring oldpath,
                         jstring newpath,
                         int (*link_function)(const char *, const char *)) {
-  const char *oldpath_chars = GetStringLatin1Chars(env, oldpath);
-  const char *newpath_chars = GetStringLatin1Chars(env, newpath);
+  Latin1Chars oldpath_latin1(env, oldpath);
+  const char *oldpath_chars = oldpath_latin1.get();
+  Latin1Chars newpath_latin1(env, newpath);
+  const char *newpath_chars = newpath_latin1.get();
   if (link_function(oldpath_chars, newpath_chars) == -1) {
     ::PostFileException(env, errno, newpath_chars);
   }
-  ReleaseStringLatin1Chars(oldpath_chars);
-  ReleaseStringLatin1Chars(newpath_chars);
 }
 
 extern "C" JNIEXPORT void JNICALL
@@ -304,21 +385,8 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_symlink(JNIEnv *env,
 
 static jobject NewFileStatus(JNIEnv *env,
                              const portable_stat_struct &stat_ref) {
-  static jclass file_status_class = NULL;
-  if (file_status_class == NULL) {  // note: harmless race condition
-    jclass local = env->FindClass("com/google/devtools/build/lib/unix/FileStatus");
-    CHECK(local != NULL);
-    file_status_class = static_cast<jclass>(env->NewGlobalRef(local));
-  }
-
-  static jmethodID method = NULL;
-  if (method == NULL) {  // note: harmless race condition
-    method = env->GetMethodID(file_status_class, "<init>", "(IIIIIIIJIJ)V");
-    CHECK(method != NULL);
-  }
-
   return env->NewObject(
-      file_status_class, method, stat_ref.st_mode,
+      file_status_class, file_status_ctor, stat_ref.st_mode,
       StatSeconds(stat_ref, STAT_ATIME), StatNanoSeconds(stat_ref, STAT_ATIME),
       StatSeconds(stat_ref, STAT_MTIME), StatNanoSeconds(stat_ref, STAT_MTIME),
       StatSeconds(stat_ref, STAT_CTIME), StatNanoSeconds(stat_ref, STAT_CTIME),
@@ -326,28 +394,37 @@ static jobject NewFileStatus(JNIEnv *env,
       static_cast<int>(stat_ref.st_dev), static_cast<jlong>(stat_ref.st_ino));
 }
 
-static jobject NewErrnoFileStatus(JNIEnv *env,
-                                  int saved_errno,
-                                  const portable_stat_struct &stat_ref) {
-  static jclass errno_file_status_class = NULL;
-  if (errno_file_status_class == NULL) {  // note: harmless race condition
-    jclass local = env->FindClass("com/google/devtools/build/lib/unix/ErrnoFileStatus");
-    CHECK(local != NULL);
-    errno_file_status_class = static_cast<jclass>(env->NewGlobalRef(local));
-  }
-
-  static jmethodID no_error_ctor = NULL;
-  if (no_error_ctor == NULL) {  // note: harmless race condition
-    no_error_ctor = env->GetMethodID(errno_file_status_class,
-                                     "<init>", "(IIIIIIIJIJ)V");
+// ErrnoFileStatus and its constructors. Unlike the classes above, these are
+// resolved on first use (see JNI_OnLoad); the function-local static makes the
+// lookup happen exactly once, even with concurrent callers.
+struct ErrnoFileStatusClass {
+  explicit ErrnoFileStatusClass(JNIEnv *env) {
+    clazz = FindClassGlobal(
+        env, "com/google/devtools/build/lib/unix/ErrnoFileStatus");
+    CHECK(clazz != NULL);
+    no_error_ctor = env->GetMethodID(clazz, "<init>", "(IIIIIIIJIJ)V");
     CHECK(no_error_ctor != NULL);
+    errno_ctor = env->GetMethodID(clazz, "<init>", "(I)V");
+    CHECK(errno_ctor != NULL);
   }
 
-  static jmethodID errorno_ctor = NULL;
-  if (errorno_ctor == NULL) {  // note: harmless race condition
-    errorno_ctor = env->GetMethodID(errno_file_status_class, "<init>", "(I)V");
-    CHECK(errorno_ctor != NULL);
-  }
+  jclass clazz;
+  jmethodID no_error_ctor;
+  jmethodID errno_ctor;
+};
+
+static const ErrnoFileStatusClass &GetErrnoFileStatusClass(JNIEnv *env) {
+  static const ErrnoFileStatusClass errno_file_status(env);
+  return errno_file_status;
+}
+
+static jobject NewErrnoFileStatus(JNIEnv *env,
+                                  int saved_errno,
+                                  const portable_stat_struct &stat_ref) {
+  const ErrnoFileStatusClass &errno_file_status = GetErrnoFileStatusClass(env);
+  jclass errno_file_status_class = errno_file_status.clazz;
+  jmethodID no_error_ctor = errno_file_status.no_error_ctor;
+  jmethodID errorno_ctor = errno_file_status.errno_ctor;
 
   if (saved_errno != 0) {
     return env->NewObject(errno_file_status_class, errorno_ctor, saved_errno);
@@ -387,7 +464,8 @@ static jobject StatCommon(JNIEnv *env,
                           int (*stat_function)(const char *, portable_stat_struct *),
                           bool should_throw) {
   portable_stat_struct statbuf;
-  const char *path_chars = GetStringLatin1Chars(env, path);
+  Latin1Chars path_latin1(env, path);
+  const char *path_chars = path_latin1.get();
   int r;
   int saved_errno = 0;
   while ((r = stat_function(path_chars, &statbuf)) == -1 && errno == EINTR) { }
@@ -400,15 +478,12 @@ static jobject StatCommon(JNIEnv *env,
     // ENOMEM                      -> OutOfMemoryError
 
     if (PostRuntimeException(env, saved_errno, path_chars)) {
-      ::ReleaseStringLatin1Chars(path_chars);
       return NULL;
     } else if (should_throw) {
       ::PostFileException(env, saved_errno, path_chars);
-      ::ReleaseStringLatin1Chars(path_chars);
       return NULL;
     }
   }
-  ::ReleaseStringLatin1Chars(path_chars);
 
   return should_throw
     ? NewFileStatus(env, statbuf)
@@ -477,7 +552,8 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_utime(JNIEnv *env,
                                                   jstring path,
                                                   jboolean now,
                                                   jint modtime) {
-  const char *path_chars = GetStringLatin1Chars(env, path);
+  Latin1Chars path_latin1(env, path);
+  const char *path_chars = path_latin1.get();
 #ifdef __linux
   struct timespec spec[2] = {{0, UTIME_OMIT}, {modtime, now ? UTIME_NOW : 0}};
   if (::utimensat(AT_FDCWD, path_chars, spec, 0) == -1) {
@@ -493,7 +569,6 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_utime(JNIEnv *env,
     ::PostFileException(env, errno, path_chars);
   }
 #endif
-  ReleaseStringLatin1Chars(path_chars);
 }
 
 /*
@@ -519,7 +594,8 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_mkdir(JNIEnv *env,
                                                   jclass clazz,
                                                   jstring path,
                                                   jint mode) {
-  const char *path_chars = GetStringLatin1Chars(env, path);
+  Latin1Chars path_latin1(env, path);
+  const char *path_chars = path_latin1.get();
   jboolean result = true;
   if (::mkdir(path_chars, mode) == -1) {
     // EACCES ENOENT ELOOP
@@ -533,7 +609,308 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_mkdir(JNIEnv *env,
       ::PostFileException(env, errno, path_chars);
     }
   }
-  ReleaseStringLatin1Chars(path_chars);
+  return result;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Recursive directory creation
+
+// The maximum number of directories remembered by the mkdirs cache.
+static const size_t kMkdirsCacheSize = 16384;
+
+// A bounded, least-recently-used set of paths that were directories when
+// last seen. Entries are only hints: a hit saves looking at a directory's
+// ancestors, while a stale entry shows up as a failing mkdir beneath it, upon
+// which it is evicted and the lookup is repeated without the cache.
+class DirectoryCache {
+ public:
+  bool Contains(const std::string &path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(path);
+    if (it == index_.end()) {
+      return false;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return true;
+  }
+
+  void Insert(const std::string &path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(path);
+    if (it != index_.end()) {
+      lru_.splice(lru_.begin(), lru_, it->second);
+      return;
+    }
+    lru_.push_front(path);
+    index_.emplace(path, lru_.begin());
+    if (index_.size() > kMkdirsCacheSize) {
+      index_.erase(lru_.back());
+      lru_.pop_back();
+    }
+  }
+
+  void Erase(const std::string &path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(path);
+    if (it != index_.end()) {
+      lru_.erase(it->second);
+      index_.erase(it);
+    }
+  }
+
+ private:
+  std::mutex mutex_;
+  std::list<std::string> lru_;
+  std::unordered_map<std::string, std::list<std::string>::iterator> index_;
+};
+
+static DirectoryCache *GetMkdirsCache() {
+  // Never destroyed, so that it outlives threads still running at exit.
+  static DirectoryCache *cache = new DirectoryCache();
+  return cache;
+}
+
+// Returns whether dir is path itself or one of its ancestors. The empty
+// string stands for the working directory, the ancestor of relative paths.
+static bool IsAncestorOrSelf(const std::string &dir, const std::string &path) {
+  if (dir.empty()) {
+    return path.empty() || path[0] != '/';
+  }
+  if (dir == "/") {
+    return path[0] == '/';
+  }
+  return path.compare(0, dir.size(), dir) == 0 &&
+         (path.size() == dir.size() || path[dir.size()] == '/');
+}
+
+// Creates directories and their missing ancestors (mkdir -p).
+//
+// A walker remembers the ancestors of the last directory it created, so that
+// creating many directories in sorted order checks each shared ancestor only
+// once. Once an ancestor is the parent of more than one new directory, it is
+// opened and its children are created with mkdirat relative to it, so that
+// the kernel no longer resolves the full path of every sibling.
+class MkdirsWalker {
+ public:
+  MkdirsWalker(DirectoryCache *cache, int mode) : cache_(cache), mode_(mode) {}
+  ~MkdirsWalker() { Unwind(0); }
+
+  // Creates path and its missing ancestors. Returns 0 on success; otherwise
+  // returns an errno value and sets *error_path to the offending directory.
+  int Mkdirs(const std::string &path, std::string *error_path) {
+    if (path.empty()) {
+      *error_path = path;
+      return ENOENT;
+    }
+    int result = Attempt(path, true, error_path);
+    if (result == kStaleCache) {
+      Unwind(0);
+      result = Attempt(path, false, error_path);
+    }
+    return result;
+  }
+
+ private:
+  // Returned by Attempt when a cached directory turned out to be missing.
+  static const int kStaleCache = -1;
+
+  struct Dir {
+    std::string path;
+    int fd;         // -1 until opened
+    int children;   // number of directories created in it so far
+    bool verified;  // checked by this walker, as opposed to taken from cache
+    bool cached;    // known to be a directory and in the cache
+  };
+
+  void Push(const std::string &path, bool verified, bool cached) {
+    stack_.push_back(Dir{path, -1, 0, verified, cached});
+  }
+
+  // Forgets all but the outermost depth remembered directories.
+  void Unwind(size_t depth) {
+    while (stack_.size() > depth) {
+      if (stack_.back().fd >= 0) {
+        close(stack_.back().fd);
+      }
+      stack_.pop_back();
+    }
+  }
+
+  int Attempt(const std::string &path, bool use_cache,
+              std::string *error_path) {
+    size_t depth = stack_.size();
+    while (depth > 0 && !IsAncestorOrSelf(stack_[depth - 1].path, path)) {
+      depth--;
+    }
+    if (depth > 0 && stack_[depth - 1].path == path &&
+        !stack_[depth - 1].verified) {
+      depth--;
+    }
+    Unwind(depth);
+    if (stack_.empty()) {
+      int result = FindExistingAncestor(path, use_cache, error_path);
+      if (result != 0) {
+        return result;
+      }
+    }
+    return CreateDescendants(path, error_path);
+  }
+
+  // Pushes the innermost directory on the way to path that is known to
+  // exist, or path itself if it already does.
+  int FindExistingAncestor(const std::string &path, bool use_cache,
+                           std::string *error_path) {
+    portable_stat_struct statbuf;
+    if (use_cache) {
+      // A cached path itself most likely still exists; for anything else,
+      // optimistically assume that the innermost cached ancestor does.
+      if (cache_->Contains(path)) {
+        if (portable_stat(path.c_str(), &statbuf) == 0 &&
+            S_ISDIR(statbuf.st_mode)) {
+          Push(path, true, true);
+          return 0;
+        }
+        cache_->Erase(path);
+      }
+      for (size_t pos = path.rfind('/'); pos != std::string::npos && pos > 0;
+           pos = path.rfind('/', pos - 1)) {
+        std::string ancestor = path.substr(0, pos);
+        if (cache_->Contains(ancestor)) {
+          Push(ancestor, false, true);
+          return 0;
+        }
+      }
+    }
+
+    // First, check if the directory already exists and early-out.
+    if (portable_stat(path.c_str(), &statbuf) == 0) {
+      if (!S_ISDIR(statbuf.st_mode)) {
+        // Exists but is not a directory.
+        *error_path = path;
+        return ENOTDIR;
+      }
+      cache_->Insert(path);
+      Push(path, true, true);
+      return 0;
+    } else if (errno != ENOENT) {
+      *error_path = path;
+      return errno;
+    }
+
+    // Find the first ancestor that already exists.
+    for (size_t pos = path.rfind('/'); pos != std::string::npos && pos > 0;
+         pos = path.rfind('/', pos - 1)) {
+      std::string ancestor = path.substr(0, pos);
+      if (portable_stat(ancestor.c_str(), &statbuf) == 0) {
+        // Exists and must be a directory, or the initial stat would have
+        // failed with ENOTDIR.
+        cache_->Insert(ancestor);
+        Push(ancestor, true, true);
+        return 0;
+      } else if (errno != ENOENT) {
+        *error_path = ancestor;
+        return errno;
+      }
+    }
+    Push(path[0] == '/' ? "/" : "", true, true);
+    return 0;
+  }
+
+  // Successively creates each directory between the innermost remembered
+  // one and path.
+  int CreateDescendants(const std::string &path, std::string *error_path) {
+    while (stack_.back().path != path) {
+      Dir &parent = stack_.back();
+      size_t start = parent.path.size();
+      while (path[start] == '/') {
+        start++;
+      }
+      size_t end = std::min(path.find('/', start), path.size());
+      std::string child = path.substr(0, end);
+
+      // The first child is created by its full path, which costs less than
+      // opening the parent for a single use.
+      int dirfd = AT_FDCWD;
+      const char *name = child.c_str();
+      std::string component;
+      if (parent.children++ > 0) {
+        if (parent.fd < 0) {
+          parent.fd = open(parent.path.empty() ? "." : parent.path.c_str(),
+                           O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+          if (parent.fd < 0) {
+            return Failed(parent, parent.path, error_path);
+          }
+        }
+        dirfd = parent.fd;
+        component = path.substr(start, end - start);
+        name = component.c_str();
+      }
+
+      bool is_target = end == path.size();
+      bool is_dir = true;
+      if (mkdirat(dirfd, name, mode_) != 0) {
+        // EEXIST is fine, just means we're racing to create the directory.
+        // Note that somebody could have raced to create a file here, but that
+        // will get handled by a ENOTDIR by a subsequent mkdir call, or by the
+        // stat below for the target itself.
+        if (errno != EEXIST) {
+          return Failed(parent, child, error_path);
+        }
+        if (is_target) {
+          portable_stat_struct statbuf;
+          if (portable_fstatat(dirfd, const_cast<char *>(name), &statbuf, 0) !=
+              0) {
+            *error_path = child;
+            return errno;
+          }
+          if (!S_ISDIR(statbuf.st_mode)) {
+            // Exists but is not a directory.
+            *error_path = child;
+            return ENOTDIR;
+          }
+        } else {
+          is_dir = false;
+        }
+      }
+      // Getting this far proves that the parent is a directory.
+      if (!parent.cached) {
+        cache_->Insert(parent.path);
+        parent.cached = true;
+      }
+      if (is_dir) {
+        cache_->Insert(child);
+      }
+      Push(child, true, is_dir);
+    }
+    return 0;
+  }
+
+  // Handles the failure to create path (or open it, if it is parent). If
+  // parent came from the cache and has gone away, the caller should retry
+  // without the cache.
+  int Failed(const Dir &parent, const std::string &path,
+             std::string *error_path) {
+    int error_number = errno;
+    if (!parent.verified &&
+        (error_number == ENOENT || error_number == ENOTDIR)) {
+      cache_->Erase(parent.path);
+      return kStaleCache;
+    }
+    *error_path = path;
+    return error_number;
+  }
+
+  DirectoryCache *cache_;
+  int mode_;
+  std::vector<Dir> stack_;
+};
+
+// Strips trailing slashes, which mkdir(2) ignores, from path.
+static std::string DirectoryPath(const char *path) {
+  std::string result(path);
+  while (result.size() > 1 && result.back() == '/') {
+    result.pop_back();
+  }
   return result;
 }
 
@@ -548,95 +925,23 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_mkdirs(JNIEnv *env,
                                                                 jclass clazz,
                                                                 jstring path,
                                                                 int mode) {
-  char *path_chars = GetStringLatin1Chars(env, path);
-  portable_stat_struct statbuf;
-  int len;
-  char *p;
-
-  // First, check if the directory already exists and early-out.
-  if (portable_stat(path_chars, &statbuf) == 0) {
-    if (!S_ISDIR(statbuf.st_mode)) {
-      // Exists but is not a directory.
-      ::PostFileException(env, ENOTDIR, path_chars);
-    }
-    goto cleanup;
-  } else if (errno != ENOENT) {
-    ::PostFileException(env, errno, path_chars);
-    goto cleanup;
-  }
-
-  // Find the first directory that already exists and leave a pointer just past
-  // it.
-  len = strlen(path_chars);
-  p = path_chars + len - 1;
-  for (; p > path_chars; --p) {
-    if (*p == '/') {
-      *p = 0;
-      int res = portable_stat(path_chars, &statbuf);
-      *p = '/';
-      if (res == 0) {
-        // Exists and must be a directory, or the initial stat would have failed
-        // with ENOTDIR.
-        break;
-      } else if (errno != ENOENT) {
-        ::PostFileException(env, errno, path_chars);
-        goto cleanup;
-      }
-    }
-  }
-  // p now points at the '/' after the last directory that exists.
-  // Successively create each directory
-  for (const char *end = path_chars + len; p < end; ++p) {
-    if (*p == '/') {
-      *p = 0;
-      int res = ::mkdir(path_chars, mode);
-      *p = '/';
-      // EEXIST is fine, just means we're racing to create the directory.
-      // Note that somebody could have raced to create a file here, but that
-      // will get handled by a ENOTDIR by a subsequent mkdir call.
-      if (res != 0 && errno != EEXIST) {
-        ::PostFileException(env, errno, path_chars);
-        goto cleanup;
-      }
-    }
+  Latin1Chars path_latin1(env, path);
+  const char *path_chars = path_latin1.get();
+  if (path_chars == NULL) {
+    return;
   }
-  if (::mkdir(path_chars, mode) != 0) {
-    if (errno != EEXIST) {
-      ::PostFileException(env, errno, path_chars);
-      goto cleanup;
-    }
-    if (portable_stat(path_chars, &statbuf) != 0) {
-      ::PostFileException(env, errno, path_chars);
-      goto cleanup;
-    }
-    if (!S_ISDIR(statbuf.st_mode)) {
-      // Exists but is not a directory.
-      ::PostFileException(env, ENOTDIR, path_chars);
-      goto cleanup;
-    }
+  MkdirsWalker walker(GetMkdirsCache(), mode);
+  std::string error_path;
+  int error_number = walker.Mkdirs(DirectoryPath(path_chars), &error_path);
+  if (error_number != 0) {
+    ::PostFileException(env, error_number, error_path.c_str());
   }
-cleanup:
-  ReleaseStringLatin1Chars(path_chars);
 }
 
 static jobject NewDirents(JNIEnv *env,
                           jobjectArray names,
                           jbyteArray types) {
-  // See http://java.sun.com/docs/books/jni/html/fldmeth.html#26855
-  static jclass dirents_class = NULL;
-  if (dirents_class == NULL) {  // note: harmless race condition
-    jclass local = env->FindClass("com/google/devtools/build/lib/unix/NativePosixFiles$Dirents");
-    CHECK(local != NULL);
-    dirents_class = static_cast<jclass>(env->NewGlobalRef(local));
-  }
-
-  static jmethodID ctor = NULL;
-  if (ctor == NULL) {  // note: harmless race condition
-    ctor = env->GetMethodID(dirents_class, "<init>", "([Ljava/lang/String;[B)V");
-    CHECK(ctor != NULL);
-  }
-
-  return env->NewObject(dirents_class, ctor, names, types);
+  return env->NewObject(dirents_class, dirents_ctor, names, types);
 }
 
 static char GetDirentType(struct dirent *entry,
@@ -676,7 +981,8 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_readdir(JNIEnv *env,
                                                     jclass clazz,
                                                     jstring path,
                                                     jchar read_types) {
-  const char *path_chars = GetStringLatin1Chars(env, path);
+  Latin1Chars path_latin1(env, path);
+  const char *path_chars = path_latin1.get();
   DIR *dirh;
   while ((dirh = ::opendir(path_chars)) == NULL && errno == EINTR) { }
   if (dirh == NULL) {
@@ -684,7 +990,6 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_readdir(JNIEnv *env,
     // ENOMEM                              -> OutOfMemoryError
     ::PostFileException(env, errno, path_chars);
   }
-  ReleaseStringLatin1Chars(path_chars);
   if (dirh == NULL) {
     return NULL;
   }
@@ -725,18 +1030,20 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_readdir(JNIEnv *env,
   }
 
   size_t len = entries.size();
-  jclass jlStringClass = env->GetObjectClass(path);
-  jobjectArray names_obj = env->NewObjectArray(len, jlStringClass, NULL);
+  jobjectArray names_obj = env->NewObjectArray(len, string_class, NULL);
   if (names_obj == NULL && env->ExceptionOccurred()) {
     return NULL;  // async exception!
   }
 
   for (size_t ii = 0; ii < len; ++ii) {
-    jstring s = NewStringLatin1(env, entries[ii].c_str());
+    jstring s =
+        NewStringLatin1(env, entries[ii].c_str(), entries[ii].size());
     if (s == NULL && env->ExceptionOccurred()) {
       return NULL;  // async exception!
     }
     env->SetObjectArrayElement(names_obj, ii, s);
+    // Large directories would otherwise overflow the local reference table.
+    env->DeleteLocalRef(s);
   }
 
   jbyteArray types_obj = NULL;
@@ -763,8 +1070,10 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_rename(JNIEnv *env,
                                                    jclass clazz,
                                                    jstring oldpath,
                                                    jstring newpath) {
-  const char *oldpath_chars = GetStringLatin1Chars(env, oldpath);
-  const char *newpath_chars = GetStringLatin1Chars(env, newpath);
+  Latin1Chars oldpath_latin1(env, oldpath);
+  const char *oldpath_chars = oldpath_latin1.get();
+  Latin1Chars newpath_latin1(env, newpath);
+  const char *newpath_chars = newpath_latin1.get();
   if (::rename(oldpath_chars, newpath_chars) == -1) {
     // EISDIR EXDEV ENOTEMPTY EEXIST EBUSY
     // EINVAL EMLINK ENOTDIR EACCES EPERM
@@ -774,15 +1083,14 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_rename(JNIEnv *env,
     std::string filename(std::string(oldpath_chars) + " -> " + newpath_chars);
     ::PostFileException(env, errno, filename.c_str());
   }
-  ReleaseStringLatin1Chars(oldpath_chars);
-  ReleaseStringLatin1Chars(newpath_chars);
 }
 
 static bool delete_common(JNIEnv *env,
                           jstring path,
                           int (*delete_function)(const char *),
                           bool (*error_function)(int)) {
-  const char *path_chars = GetStringLatin1Chars(env, path);
+  Latin1Chars path_latin1(env, path);
+  const char *path_chars = path_latin1.get();
   if (path_chars == NULL) {
       return false;
   }
@@ -792,7 +1100,6 @@ static bool delete_common(JNIEnv *env,
       ::PostFileException(env, errno, path_chars);
     }
   }
-  ReleaseStringLatin1Chars(path_chars);
   return ok;
 }
 
@@ -825,6 +1132,301 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_remove(JNIEnv *env,
   return ::delete_common(env, path, ::remove, ::remove_err);
 }
 
+////////////////////////////////////////////////////////////////////////
+// Recursive deletion of directory trees.
+
+// Upper bound on the number of threads used to delete a single tree.
+static const unsigned int kMaxDeleteTreeThreads = 16;
+
+// How many directory levels may be expanded up front to find enough
+// independent subtrees for the worker threads.
+static const int kMaxDeleteTreeExpansionDepth = 4;
+
+// State shared by all threads working on a single deleteTreesBelow call. Only
+// the first error is kept; once it is set, the remaining work is abandoned.
+struct DeleteTreeContext {
+  DeleteTreeContext() : failed(false), error_number(0) {}
+
+  void Fail(int err, const std::string &path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!failed) {
+      error_number = err;
+      error_path = path;
+      failed = true;
+    }
+  }
+
+  std::mutex mutex;
+  std::atomic<bool> failed;
+  int error_number;
+  std::string error_path;
+};
+
+// A directory whose contents still have to be deleted. "parent" is the open
+// parent directory (nullptr for the root), "name" the entry within it.
+struct DeleteTreeDir {
+  DIR *parent;
+  DIR *dir;
+  std::string name;
+  std::string path;
+};
+
+// Opens the directory "name" below parent_fd for deletion, without following
+// symlinks, and makes sure that its owner may list, traverse and modify it.
+// Returns nullptr and sets errno on failure.
+static DIR *OpenDirectoryForDeletion(int parent_fd, const char *name) {
+  const int flags = O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC;
+  int fd;
+  while ((fd = openat(parent_fd, name, flags)) == -1 && errno == EINTR) { }
+  if (fd == -1 && errno == EACCES) {
+    // The directory may not be readable; try once more after fixing that,
+    // keeping the rest of its mode.
+    struct stat statbuf;
+    if (fstatat(parent_fd, name, &statbuf, AT_SYMLINK_NOFOLLOW) == 0 &&
+        fchmodat(parent_fd, name, statbuf.st_mode | S_IRWXU, 0) == 0) {
+      while ((fd = openat(parent_fd, name, flags)) == -1 && errno == EINTR) { }
+    } else {
+      errno = EACCES;
+    }
+  }
+  if (fd == -1) {
+    return nullptr;
+  }
+
+  struct stat statbuf;
+  if (fstat(fd, &statbuf) == -1 ||
+      ((statbuf.st_mode & S_IRWXU) != S_IRWXU &&
+       fchmod(fd, statbuf.st_mode | S_IRWXU) == -1)) {
+    int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return nullptr;
+  }
+
+  DIR *dir = fdopendir(fd);
+  if (dir == nullptr) {
+    int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+  }
+  return dir;
+}
+
+// Returns true iff the directory entry is a directory (not a symlink to one).
+static bool IsDirectoryEntry(DIR *dir, struct dirent *entry) {
+  if (entry->d_type != DT_UNKNOWN) {
+    return entry->d_type == DT_DIR;
+  }
+  portable_stat_struct statbuf;
+  return portable_fstatat(dirfd(dir), entry->d_name, &statbuf,
+                          AT_SYMLINK_NOFOLLOW) == 0 &&
+         S_ISDIR(statbuf.st_mode);
+}
+
+// Unlinks every non-directory entry of "dir" and appends the names of its
+// subdirectories to "subdirs". Returns false on error.
+static bool DeleteFilesIn(DIR *dir, const std::string &path,
+                          std::vector<std::string> *subdirs,
+                          DeleteTreeContext *ctx) {
+  std::vector<std::string> files;
+  for (;;) {
+    errno = 0;
+    struct dirent *entry = ::readdir(dir);
+    if (entry == nullptr) {
+      if (errno == 0) break;  // EOF
+      if (errno == EINTR) continue;
+      ctx->Fail(errno, path);
+      return false;
+    }
+    if (entry->d_name[0] == '.') {
+      if (entry->d_name[1] == '\0') continue;
+      if (entry->d_name[1] == '.' && entry->d_name[2] == '\0') continue;
+    }
+    if (IsDirectoryEntry(dir, entry)) {
+      subdirs->push_back(entry->d_name);
+    } else {
+      files.push_back(entry->d_name);
+    }
+  }
+
+  // Unlink only after reading the whole directory, so that modifying it
+  // cannot make readdir() skip entries.
+  for (const std::string &name : files) {
+    if (unlinkat(dirfd(dir), name.c_str(), 0) == -1 && errno != ENOENT) {
+      ctx->Fail(errno, path + "/" + name);
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool DeleteSubtree(DIR *parent, const std::string &name,
+                          const std::string &path, DeleteTreeContext *ctx);
+
+// Deletes everything below "dir", serially.
+static bool DeleteDirectoryContents(DIR *dir, const std::string &path,
+                                    DeleteTreeContext *ctx) {
+  std::vector<std::string> subdirs;
+  if (!DeleteFilesIn(dir, path, &subdirs, ctx)) {
+    return false;
+  }
+  for (const std::string &name : subdirs) {
+    if (ctx->failed || !DeleteSubtree(dir, name, path + "/" + name, ctx)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Removes an (already emptied) directory from its parent.
+static bool RemoveEmptyDirectory(DIR *parent, const std::string &name,
+                                 const std::string &path,
+                                 DeleteTreeContext *ctx) {
+  if (unlinkat(dirfd(parent), name.c_str(), AT_REMOVEDIR) == -1 &&
+      errno != ENOENT) {
+    ctx->Fail(errno, path);
+    return false;
+  }
+  return true;
+}
+
+// Deletes the directory "name" below "parent" and everything beneath it.
+static bool DeleteSubtree(DIR *parent, const std::string &name,
+                          const std::string &path, DeleteTreeContext *ctx) {
+  DIR *dir = OpenDirectoryForDeletion(dirfd(parent), name.c_str());
+  if (dir == nullptr) {
+    if (errno == ENOENT) {
+      return true;  // Somebody else deleted it in the meantime.
+    }
+    ctx->Fail(errno, path);
+    return false;
+  }
+  bool ok = DeleteDirectoryContents(dir, path, ctx);
+  closedir(dir);
+  return ok && RemoveEmptyDirectory(parent, name, path, ctx);
+}
+
+// Deletes the subtrees in "work" on up to "num_threads" threads, including the
+// calling one. Subtrees are handed out in order as threads become free.
+static void DeleteSubtreesInParallel(const std::vector<DeleteTreeDir> &work,
+                                     unsigned int num_threads,
+                                     DeleteTreeContext *ctx) {
+  std::atomic<size_t> next(0);
+  auto worker = [&work, &next, ctx]() {
+    for (size_t i = next++; i < work.size() && !ctx->failed; i = next++) {
+      DeleteSubtree(work[i].parent, work[i].name, work[i].path, ctx);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned int i = 1; i < num_threads && i < work.size(); i++) {
+    try {
+      threads.emplace_back(worker);
+    } catch (const std::system_error &) {
+      break;  // Make do with the threads we already have.
+    }
+  }
+  worker();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+}
+
+// Deletes everything below the directory "path", leaving the directory itself
+// in place. Symlinks are never followed; if "path" is not a directory, this
+// does nothing.
+//
+// Directories are walked relative to open directory descriptors, so every
+// syscall only resolves a single path component. The top levels of the tree
+// are expanded until there are enough independent subtrees, which are then
+// deleted concurrently.
+static void DeleteTreesBelow(const char *path, DeleteTreeContext *ctx) {
+  DIR *root = OpenDirectoryForDeletion(AT_FDCWD, path);
+  if (root == nullptr) {
+    if (errno != ENOENT && errno != ENOTDIR && errno != ELOOP) {
+      ctx->Fail(errno, path);
+    }
+    return;
+  }
+
+  unsigned int num_threads = std::min(
+      std::max(std::thread::hardware_concurrency(), 1u), kMaxDeleteTreeThreads);
+
+  // Directories that were opened while expanding the tree, in the order they
+  // were opened. They are removed in reverse order once all work is done.
+  std::vector<DeleteTreeDir> expanded;
+  expanded.push_back({nullptr, root, "", path});
+  size_t level_begin = 0;
+  std::vector<DeleteTreeDir> frontier;
+  for (int depth = 0; !ctx->failed; depth++) {
+    frontier.clear();
+    size_t level_end = expanded.size();
+    for (size_t i = level_begin; i < level_end && !ctx->failed; i++) {
+      std::vector<std::string> subdirs;
+      if (DeleteFilesIn(expanded[i].dir, expanded[i].path, &subdirs, ctx)) {
+        for (const std::string &name : subdirs) {
+          frontier.push_back(
+              {expanded[i].dir, nullptr, name, expanded[i].path + "/" + name});
+        }
+      }
+    }
+    if (ctx->failed || frontier.size() >= 4 * num_threads ||
+        depth == kMaxDeleteTreeExpansionDepth) {
+      break;
+    }
+
+    // Not enough subtrees to keep all threads busy yet, go one level deeper.
+    level_begin = level_end;
+    for (DeleteTreeDir &subtree : frontier) {
+      subtree.dir =
+          OpenDirectoryForDeletion(dirfd(subtree.parent), subtree.name.c_str());
+      if (subtree.dir != nullptr) {
+        expanded.push_back(subtree);
+      } else if (errno != ENOENT) {
+        ctx->Fail(errno, subtree.path);
+        break;
+      }
+    }
+    frontier.clear();
+    if (expanded.size() == level_end) {
+      break;  // Nothing left to expand.
+    }
+  }
+
+  if (!ctx->failed) {
+    DeleteSubtreesInParallel(frontier, num_threads, ctx);
+  }
+
+  for (size_t i = expanded.size(); i-- > 0;) {
+    closedir(expanded[i].dir);
+    if (expanded[i].parent != nullptr && !ctx->failed) {
+      RemoveEmptyDirectory(expanded[i].parent, expanded[i].name,
+                           expanded[i].path, ctx);
+    }
+  }
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    deleteTreesBelow
+ * Signature: (Ljava/lang/String;)V
+ * Throws:    java.io.IOException
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_deleteTreesBelow(
+    JNIEnv *env, jclass clazz, jstring path) {
+  Latin1Chars path_latin1(env, path);
+  const char *path_chars = path_latin1.get();
+  if (path_chars == NULL) {
+    return;
+  }
+  DeleteTreeContext ctx;
+  DeleteTreesBelow(path_chars, &ctx);
+  if (ctx.failed) {
+    ::PostFileException(env, ctx.error_number, ctx.error_path.c_str());
+  }
+}
+
 /*
  * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
  * Method:    mkfifo
@@ -836,11 +1438,470 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_mkfifo(JNIEnv *env,
                                                    jclass clazz,
                                                    jstring path,
                                                    jint mode) {
-  const char *path_chars = GetStringLatin1Chars(env, path);
+  Latin1Chars path_latin1(env, path);
+  const char *path_chars = path_latin1.get();
   if (mkfifo(path_chars, mode) == -1) {
     ::PostFileException(env, errno, path_chars);
   }
-  ReleaseStringLatin1Chars(path_chars);
+}
+
+////////////////////////////////////////////////////////////////////////
+// Batched filesystem operations
+
+// See unix_jni.h.
+void RunBatchOp(BatchOp *op) {
+  int r;
+  switch (op->kind) {
+    case BATCH_STAT:
+      while ((r = portable_stat(op->path, &op->statbuf)) == -1 &&
+             errno == EINTR) { }
+      break;
+    case BATCH_LSTAT:
+      while ((r = portable_lstat(op->path, &op->statbuf)) == -1 &&
+             errno == EINTR) { }
+      break;
+    case BATCH_READLINK: {
+      char target[PATH_MAX];
+      ssize_t len = ::readlink(op->path, target, arraysize(target));
+      if (len >= 0) {
+        op->link_target.assign(target, len);
+      }
+      r = len < 0 ? -1 : 0;
+      break;
+    }
+    case BATCH_MKDIR:
+      r = ::mkdir(op->path, op->mode);
+      break;
+    case BATCH_SYMLINK:
+      r = ::symlink(op->target, op->path);
+      break;
+    case BATCH_UNLINK:
+      r = ::unlink(op->path);
+      break;
+    default:
+      CHECK(false);
+  }
+  op->error_number = r == -1 ? errno : 0;
+}
+
+// The Latin1 encodings of the elements of a Java String[], stored back to
+// back in a single buffer instead of one Latin1Chars per element.
+class Latin1Array {
+ public:
+  // Converts the elements of array. Returns false, with a Java exception
+  // pending, if an element is null.
+  bool Init(JNIEnv *env, jobjectArray array) {
+    jsize count = env->GetArrayLength(array);
+    std::vector<size_t> offsets;
+    offsets.reserve(count);
+    std::vector<jchar> utf16;
+    for (jsize i = 0; i < count; i++) {
+      jstring str = static_cast<jstring>(env->GetObjectArrayElement(array, i));
+      if (str == NULL) {
+        env->ThrowNew(env->FindClass("java/lang/NullPointerException"),
+                      "null path in batch");
+        return false;
+      }
+      jsize len = env->GetStringLength(str);
+      utf16.resize(len);
+      env->GetStringRegion(str, 0, len, utf16.data());
+      env->DeleteLocalRef(str);
+
+      offsets.push_back(chars_.size());
+      for (jchar unicode : utf16) {
+        chars_.push_back(unicode <= 0x00ff ? unicode : '?');
+      }
+      chars_.push_back('\0');
+    }
+    strings_.reserve(count);
+    for (size_t offset : offsets) {
+      strings_.push_back(chars_.data() + offset);
+    }
+    return true;
+  }
+
+  size_t size() const { return strings_.size(); }
+  const char *operator[](size_t i) const { return strings_[i]; }
+
+ private:
+  std::vector<char> chars_;
+  std::vector<const char *> strings_;
+};
+
+// A batch of operations of a single kind, built from the arguments of one of
+// the batch* native methods.
+class Batch {
+ public:
+  // Converts the arguments and runs one operation per path. targets is only
+  // used by BATCH_SYMLINK and must then have as many elements as paths.
+  // Returns false, with a Java exception pending, on invalid arguments.
+  bool Run(JNIEnv *env, BatchOpKind kind, jobjectArray paths,
+           jobjectArray targets, int mode) {
+    if (!paths_.Init(env, paths)) {
+      return false;
+    }
+    if (targets != NULL) {
+      if (!targets_.Init(env, targets)) {
+        return false;
+      }
+      if (targets_.size() != paths_.size()) {
+        ::PostException(env, EINVAL, "batch arrays differ in length");
+        return false;
+      }
+    }
+    ops_.resize(paths_.size());
+    for (size_t i = 0; i < ops_.size(); i++) {
+      ops_[i].kind = kind;
+      ops_[i].path = paths_[i];
+      ops_[i].target = targets != NULL ? targets_[i] : NULL;
+      ops_[i].mode = mode;
+    }
+    portable_run_batch(ops_.data(), ops_.size());
+    return true;
+  }
+
+  const std::vector<BatchOp> &ops() const { return ops_; }
+
+  // Returns the errno value of each operation, or 0 where it succeeded.
+  jintArray NewErrnoArray(JNIEnv *env) const {
+    jintArray result = env->NewIntArray(ops_.size());
+    if (result == NULL) {
+      return NULL;
+    }
+    std::vector<jint> errnos(ops_.size());
+    for (size_t i = 0; i < ops_.size(); i++) {
+      errnos[i] = ops_[i].error_number;
+    }
+    env->SetIntArrayRegion(result, 0, errnos.size(), errnos.data());
+    return result;
+  }
+
+ private:
+  Latin1Array paths_;
+  Latin1Array targets_;
+  std::vector<BatchOp> ops_;
+};
+
+static jobjectArray BatchStatCommon(JNIEnv *env, jobjectArray paths,
+                                    BatchOpKind kind) {
+  Batch batch;
+  if (!batch.Run(env, kind, paths, NULL, 0)) {
+    return NULL;
+  }
+  const std::vector<BatchOp> &ops = batch.ops();
+  jobjectArray result = env->NewObjectArray(
+      ops.size(), GetErrnoFileStatusClass(env).clazz, NULL);
+  if (result == NULL) {
+    return NULL;
+  }
+  for (size_t i = 0; i < ops.size(); i++) {
+    jobject status = NewErrnoFileStatus(env, ops[i].error_number,
+                                        ops[i].statbuf);
+    if (status == NULL) {
+      return NULL;
+    }
+    env->SetObjectArrayElement(result, i, status);
+    env->DeleteLocalRef(status);
+  }
+  return result;
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    batchStat
+ * Signature: ([Ljava/lang/String;)[Lcom/google/devtools/build/lib/unix/ErrnoFileStatus;
+ */
+extern "C" JNIEXPORT jobjectArray JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_batchStat(
+    JNIEnv *env, jclass clazz, jobjectArray paths) {
+  return BatchStatCommon(env, paths, BATCH_STAT);
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    batchLstat
+ * Signature: ([Ljava/lang/String;)[Lcom/google/devtools/build/lib/unix/ErrnoFileStatus;
+ */
+extern "C" JNIEXPORT jobjectArray JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_batchLstat(
+    JNIEnv *env, jclass clazz, jobjectArray paths) {
+  return BatchStatCommon(env, paths, BATCH_LSTAT);
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    batchReadlink
+ * Signature: ([Ljava/lang/String;[Ljava/lang/String;)[I
+ */
+extern "C" JNIEXPORT jintArray JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_batchReadlink(
+    JNIEnv *env, jclass clazz, jobjectArray paths, jobjectArray targets) {
+  if (env->GetArrayLength(targets) != env->GetArrayLength(paths)) {
+    ::PostException(env, EINVAL, "batch arrays differ in length");
+    return NULL;
+  }
+  Batch batch;
+  if (!batch.Run(env, BATCH_READLINK, paths, NULL, 0)) {
+    return NULL;
+  }
+  const std::vector<BatchOp> &ops = batch.ops();
+  for (size_t i = 0; i < ops.size(); i++) {
+    if (ops[i].error_number != 0) {
+      continue;
+    }
+    jstring target = NewStringLatin1(env, ops[i].link_target.c_str(),
+                                     ops[i].link_target.size());
+    if (target == NULL) {
+      return NULL;
+    }
+    env->SetObjectArrayElement(targets, i, target);
+    env->DeleteLocalRef(target);
+  }
+  return batch.NewErrnoArray(env);
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    batchMkdir
+ * Signature: ([Ljava/lang/String;I)[I
+ */
+extern "C" JNIEXPORT jintArray JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_batchMkdir(
+    JNIEnv *env, jclass clazz, jobjectArray paths, jint mode) {
+  Batch batch;
+  if (!batch.Run(env, BATCH_MKDIR, paths, NULL, mode)) {
+    return NULL;
+  }
+  return batch.NewErrnoArray(env);
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    batchSymlink
+ * Signature: ([Ljava/lang/String;[Ljava/lang/String;)[I
+ */
+extern "C" JNIEXPORT jintArray JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_batchSymlink(
+    JNIEnv *env, jclass clazz, jobjectArray targets, jobjectArray links) {
+  Batch batch;
+  if (!batch.Run(env, BATCH_SYMLINK, links, targets, 0)) {
+    return NULL;
+  }
+  return batch.NewErrnoArray(env);
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    batchUnlink
+ * Signature: ([Ljava/lang/String;)[I
+ */
+extern "C" JNIEXPORT jintArray JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_batchUnlink(
+    JNIEnv *env, jclass clazz, jobjectArray paths) {
+  Batch batch;
+  if (!batch.Run(env, BATCH_UNLINK, paths, NULL, 0)) {
+    return NULL;
+  }
+  return batch.NewErrnoArray(env);
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    mkdirsBatch
+ * Signature: ([Ljava/lang/String;I)V
+ * Throws:    java.io.IOException
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_mkdirsBatch(
+    JNIEnv *env, jclass clazz, jobjectArray paths, jint mode) {
+  Latin1Array paths_latin1;
+  if (!paths_latin1.Init(env, paths)) {
+    return;
+  }
+  // In sorted order, every directory follows its ancestors, and directories
+  // with common ancestors are mostly adjacent, which lets the walker reuse
+  // them.
+  std::vector<std::string> sorted;
+  sorted.reserve(paths_latin1.size());
+  for (size_t i = 0; i < paths_latin1.size(); i++) {
+    sorted.push_back(DirectoryPath(paths_latin1[i]));
+  }
+  std::sort(sorted.begin(), sorted.end());
+
+  MkdirsWalker walker(GetMkdirsCache(), mode);
+  std::string error_path;
+  for (const std::string &path : sorted) {
+    int error_number = walker.Mkdirs(path, &error_path);
+    if (error_number != 0) {
+      ::PostFileException(env, error_number, error_path.c_str());
+      return;
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////
+// Symlink forests
+
+// The minimum number of links worth handing to another thread.
+static const size_t kMinSymlinksPerThread = 512;
+
+// Calls fn(i) for every i in [0, count), spread over up to num_threads
+// threads including the calling one.
+template <typename Fn>
+static void ParallelFor(size_t count, unsigned int num_threads, Fn fn) {
+  std::atomic<size_t> next(0);
+  auto worker = [count, &next, &fn]() {
+    for (size_t i = next++; i < count; i = next++) {
+      fn(i);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned int i = 1;
+       i < num_threads && i * kMinSymlinksPerThread < count; i++) {
+    try {
+      threads.emplace_back(worker);
+    } catch (const std::system_error &) {
+      break;  // Make do with the threads we already have.
+    }
+  }
+  worker();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+}
+
+// Creates the symlinks links[i] -> targets[i] for all i, where the link paths
+// are relative to the directory root_fd, and stores the errno value of each
+// (or 0) in errors[i].
+//
+// The links are first created optimistically in parallel. Links that failed
+// with ENOENT lack a parent directory; the union of their ancestors is then
+// created in sorted order, so that every directory is made once and after its
+// parent, and the links are retried.
+//
+// A link must not be below another link of the same forest: creating it
+// would write through the other link. Such links fail with ENOTDIR.
+static void CreateSymlinkForest(int root_fd, const Latin1Array &links,
+                                const Latin1Array &targets, int dir_mode,
+                                unsigned int num_threads,
+                                std::vector<int> *errors) {
+  size_t count = links.size();
+  std::unordered_map<std::string, size_t> link_set;
+  link_set.reserve(count);
+  for (size_t i = 0; i < count; i++) {
+    link_set.emplace(links[i], i);
+  }
+  for (size_t i = 0; i < count; i++) {
+    const char *link = links[i];
+    if (link[0] == '/' || link[0] == '\0') {
+      (*errors)[i] = EINVAL;
+      continue;
+    }
+    std::string path(link);
+    for (size_t pos = path.find('/'); pos != std::string::npos;
+         pos = path.find('/', pos + 1)) {
+      if (link_set.count(path.substr(0, pos)) > 0) {
+        (*errors)[i] = ENOTDIR;
+        break;
+      }
+    }
+  }
+
+  auto create = [root_fd, &links, &targets, errors](size_t i) {
+    if ((*errors)[i] == 0 &&
+        symlinkat(targets[i], root_fd, links[i]) != 0) {
+      (*errors)[i] = errno;
+    }
+  };
+  ParallelFor(count, num_threads, create);
+
+  std::vector<size_t> retry;
+  std::vector<std::string> dirs;
+  for (size_t i = 0; i < count; i++) {
+    if ((*errors)[i] != ENOENT) {
+      continue;
+    }
+    retry.push_back(i);
+    std::string path(links[i]);
+    for (size_t pos = path.find('/'); pos != std::string::npos;
+         pos = path.find('/', pos + 1)) {
+      dirs.push_back(path.substr(0, pos));
+    }
+  }
+  if (retry.empty()) {
+    return;
+  }
+  std::sort(dirs.begin(), dirs.end());
+  dirs.erase(std::unique(dirs.begin(), dirs.end()), dirs.end());
+  for (const std::string &dir : dirs) {
+    // Failures are reported by the retried symlinkat below.
+    mkdirat(root_fd, dir.c_str(), dir_mode);
+  }
+
+  for (size_t i : retry) {
+    (*errors)[i] = 0;
+  }
+  ParallelFor(retry.size(), num_threads,
+              [&retry, &create](size_t i) { create(retry[i]); });
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    throwFileException
+ * Signature: (Ljava/lang/String;I)V
+ * Throws:    java.io.IOException
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_throwFileException(
+    JNIEnv *env, jclass clazz, jstring path, jint error_number) {
+  Latin1Chars path_latin1(env, path);
+  const char *path_chars = path_latin1.get();
+  if (path_chars != NULL) {
+    ::PostFileException(env, error_number, path_chars);
+  }
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    createSymlinkForest
+ * Signature: (Ljava/lang/String;[Ljava/lang/String;[Ljava/lang/String;II)[I
+ * Throws:    java.io.IOException
+ */
+extern "C" JNIEXPORT jintArray JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_createSymlinkForest(
+    JNIEnv *env, jclass clazz, jstring root, jobjectArray links,
+    jobjectArray targets, jint dir_mode, jint parallelism) {
+  Latin1Array links_latin1;
+  Latin1Array targets_latin1;
+  if (!links_latin1.Init(env, links) || !targets_latin1.Init(env, targets)) {
+    return NULL;
+  }
+  if (links_latin1.size() != targets_latin1.size()) {
+    ::PostException(env, EINVAL, "symlink forest arrays differ in length");
+    return NULL;
+  }
+
+  Latin1Chars root_latin1(env, root);
+  const char *root_chars = root_latin1.get();
+  if (root_chars == NULL) {
+    return NULL;
+  }
+  int root_fd = open(root_chars, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (root_fd == -1) {
+    ::PostFileException(env, errno, root_chars);
+    return NULL;
+  }
+  std::vector<int> errors(links_latin1.size());
+  CreateSymlinkForest(root_fd, links_latin1, targets_latin1, dir_mode,
+                      parallelism > 0 ? parallelism : 1, &errors);
+  close(root_fd);
+
+  jintArray result = env->NewIntArray(errors.size());
+  if (result != NULL) {
+    env->SetIntArrayRegion(result, 0, errors.size(), errors.data());
+  }
+  return result;
 }
 
 ////////////////////////////////////////////////////////////////////////
@@ -853,8 +1914,10 @@ static jbyteArray getxattr_common(JNIEnv *env,
                                   jstring path,
                                   jstring name,
                                   getxattr_func getxattr) {
-  const char *path_chars = GetStringLatin1Chars(env, path);
-  const char *name_chars = GetStringLatin1Chars(env, name);
+  Latin1Chars path_latin1(env, path);
+  const char *path_chars = path_latin1.get();
+  Latin1Chars name_latin1(env, name);
+  const char *name_chars = name_latin1.get();
 
   // TODO(bazel-team): on ERANGE, try again with larger buffer.
   jbyte value[4096];
@@ -870,8 +1933,6 @@ static jbyteArray getxattr_common(JNIEnv *env,
     result = env->NewByteArray(size);
     env->SetByteArrayRegion(result, 0, size, value);
   }
-  ReleaseStringLatin1Chars(path_chars);
-  ReleaseStringLatin1Chars(name_chars);
   return result;
 }
 
@@ -932,7 +1993,8 @@ static int md5sumAsBytes(const char *file,
 extern "C" JNIEXPORT jbyteArray JNICALL
 Java_com_google_devtools_build_lib_unix_NativePosixFiles_md5sumAsBytes(
     JNIEnv *env, jclass clazz, jstring path) {
-  const char *path_chars = GetStringLatin1Chars(env, path);
+  Latin1Chars path_latin1(env, path);
+  const char *path_chars = path_latin1.get();
   jbyte value[Md5Digest::kDigestLength];
   jbyteArray result = NULL;
   if (md5sumAsBytes(path_chars, value) == 0) {
@@ -941,19 +2003,18 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_md5sumAsBytes(
   } else {
     ::PostFileException(env, errno, path_chars);
   }
-  ReleaseStringLatin1Chars(path_chars);
   return result;
 }
 
 extern "C" JNIEXPORT jlong JNICALL
 Java_com_google_devtools_build_lib_unix_NativePosixSystem_sysctlbynameGetLong(
     JNIEnv *env, jclass clazz, jstring name) {
-  const char *name_chars = GetStringLatin1Chars(env, name);
+  Latin1Chars name_latin1(env, name);
+  const char *name_chars = name_latin1.get();
   long r;
   size_t len = sizeof(r);
   if (portable_sysctlbyname(name_chars, &r, &len) == -1) {
     ::PostSystemException(env, errno, "sysctlbyname", name_chars);
   }
-  ReleaseStringLatin1Chars(name_chars);
   return (jlong)r;
 }
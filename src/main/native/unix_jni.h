@@ -98,4 +98,35 @@ ssize_t portable_lgetxattr(const char *path, const char *name, void *value,
 // Run sysctlbyname(3), only available on darwin
 int portable_sysctlbyname(const char *name_chars, long *mibp, size_t *sizep);
 
+// Kinds of filesystem operations that can be run in a batch.
+enum BatchOpKind {
+  BATCH_STAT,      // stat(path)
+  BATCH_LSTAT,     // lstat(path)
+  BATCH_READLINK,  // readlink(path)
+  BATCH_MKDIR,     // mkdir(path, mode)
+  BATCH_SYMLINK,   // symlink(target, path)
+  BATCH_UNLINK,    // unlink(path)
+};
+
+// A single operation of a batch, together with its outcome.
+struct BatchOp {
+  BatchOpKind kind;
+  const char *path;
+  const char *target;  // BATCH_SYMLINK only
+  int mode;            // BATCH_MKDIR only
+
+  int error_number;              // 0 on success, the errno value otherwise
+  portable_stat_struct statbuf;  // BATCH_STAT and BATCH_LSTAT only
+  std::string link_target;       // BATCH_READLINK only
+};
+
+// Runs a single batch operation synchronously and fills in its outcome.
+void RunBatchOp(BatchOp *op);
+
+// Runs the independent operations ops[0..count) and fills in their outcomes.
+// Where the kernel offers an asynchronous interface (io_uring on Linux), the
+// operations are submitted together and may complete in any order; other
+// platforms and unsupported operations fall back to RunBatchOp.
+void portable_run_batch(BatchOp *ops, size_t count);
+
 #endif  // BAZEL_SRC_MAIN_NATIVE_UNIX_JNI_H__
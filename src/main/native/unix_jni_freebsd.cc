@@ -89,3 +89,9 @@ ssize_t portable_lgetxattr(const char *path, const char *name, void *value,
 int portable_sysctlbyname(const char *name_chars, long *mibp, size_t *sizep) {
   return sysctlbyname(name_chars, mibp, sizep, NULL, 0);
 }
+
+void portable_run_batch(BatchOp *ops, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    RunBatchOp(&ops[i]);
+  }
+}
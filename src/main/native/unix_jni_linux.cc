@@ -15,12 +15,35 @@
 #include "src/main/native/unix_jni.h"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
 #include <sys/xattr.h>
+#include <time.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <memory>
 #include <string>
+#include <vector>
+
+// io_uring is used when both the kernel headers and the C library (for
+// struct statx) know about it; the kernel we run on may still lack it, which
+// is detected at runtime.
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(__NR_io_uring_setup) && defined(STATX_BASIC_STATS)
+#define UNIX_JNI_HAVE_IO_URING 1
+#endif
+#endif
+#endif
 
 std::string ErrorMessage(int error_number) {
   char buf[1024] = "";
@@ -91,3 +114,338 @@ int portable_sysctlbyname(const char *name_chars, long *mibp, size_t *sizep) {
   errno = ENOSYS;
   return -1;
 }
+
+#if defined(UNIX_JNI_HAVE_IO_URING)
+
+namespace {
+
+// Opcodes of the operations we submit. These are stable kernel ABI, but
+// older uapi headers only declare some of them.
+const uint8_t kOpStatx = 21;
+const uint8_t kOpUnlinkat = 36;
+const uint8_t kOpMkdirat = 37;
+const uint8_t kOpSymlinkat = 38;
+const uint8_t kMaxOp = kOpSymlinkat;
+
+const unsigned int kRegisterProbe = 8;  // IORING_REGISTER_PROBE
+const unsigned int kRingEntries = 256;
+
+// The layout of struct io_uring_probe, with room for every opcode we use.
+struct RingProbe {
+  uint8_t last_op;
+  uint8_t ops_len;
+  uint16_t resv;
+  uint32_t resv2[3];
+  struct {
+    uint8_t op;
+    uint8_t resv;
+    uint16_t flags;  // IO_URING_OP_SUPPORTED
+    uint32_t resv2;
+  } ops[kMaxOp + 1];
+};
+
+// A single-issuer io_uring instance. Instances are per thread, so the
+// submission and completion queues need no locking.
+class IoUring {
+ public:
+  // Returns the calling thread's ring, or NULL if io_uring is unavailable.
+  static IoUring *ForCurrentThread();
+
+  ~IoUring();
+
+  // Runs ops[0..count), submitting those the kernel supports to the ring
+  // and running the rest synchronously.
+  void Run(BatchOp *ops, size_t count);
+
+ private:
+  IoUring() {}
+  bool Init();
+  bool Supports(uint8_t op) const { return op <= kMaxOp && supported_[op]; }
+  static uint8_t OpcodeFor(const BatchOp &op);
+
+  // Submits ops[0..count), count <= sq_entries_, and waits for all of them
+  // to complete. If the ring fails, waits for the operations the kernel has
+  // already accepted, runs the rest synchronously and marks the ring as
+  // broken.
+  void RunChunk(BatchOp **ops, size_t count);
+  void Prepare(struct io_uring_sqe *sqe, BatchOp *op, struct statx *stx);
+  void Complete(BatchOp *op, int res, const struct statx &stx);
+  size_t Reap(BatchOp **ops, struct statx *stx, std::vector<bool> *done);
+
+  int fd_ = -1;
+  bool supported_[kMaxOp + 1] = {};
+  // Set once io_uring_enter failed unexpectedly; all later operations of
+  // this thread then run synchronously.
+  bool broken_ = false;
+
+  void *sq_ring_ = MAP_FAILED;
+  size_t sq_ring_size_ = 0;
+  void *cq_ring_ = MAP_FAILED;
+  size_t cq_ring_size_ = 0;
+  struct io_uring_sqe *sqes_ = static_cast<struct io_uring_sqe *>(MAP_FAILED);
+  size_t sqes_size_ = 0;
+
+  unsigned int sq_entries_ = 0;
+  unsigned int *sq_tail_ = nullptr;
+  unsigned int sq_mask_ = 0;
+  unsigned int *sq_array_ = nullptr;
+  unsigned int *cq_head_ = nullptr;
+  unsigned int *cq_tail_ = nullptr;
+  unsigned int cq_mask_ = 0;
+  struct io_uring_cqe *cqes_ = nullptr;
+};
+
+// Set once creating a ring has failed, e.g. because the kernel is too old or
+// io_uring is disabled by sysctl or seccomp, so other threads do not retry.
+std::atomic<bool> io_uring_unavailable(false);
+
+IoUring *IoUring::ForCurrentThread() {
+  thread_local std::unique_ptr<IoUring> ring;
+  if (ring == nullptr) {
+    if (io_uring_unavailable.load(std::memory_order_relaxed)) {
+      return nullptr;
+    }
+    std::unique_ptr<IoUring> created(new IoUring());
+    if (!created->Init()) {
+      io_uring_unavailable.store(true, std::memory_order_relaxed);
+      return nullptr;
+    }
+    ring = std::move(created);
+  }
+  return ring.get();
+}
+
+bool IoUring::Init() {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  fd_ = syscall(__NR_io_uring_setup, kRingEntries, &params);
+  if (fd_ < 0) {
+    return false;
+  }
+  fcntl(fd_, F_SETFD, FD_CLOEXEC);
+
+  RingProbe probe;
+  memset(&probe, 0, sizeof(probe));
+  if (syscall(__NR_io_uring_register, fd_, kRegisterProbe, &probe,
+              kMaxOp + 1) < 0) {
+    return false;  // Before Linux 5.6, which also lacks the ops we need.
+  }
+  for (unsigned int op = 0; op <= kMaxOp && op <= probe.last_op; op++) {
+    supported_[op] = (probe.ops[op].flags & 1) != 0;
+  }
+  if (!Supports(kOpStatx)) {
+    return false;
+  }
+
+  sq_entries_ = params.sq_entries;
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+
+  sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+  cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+  sqes_ = static_cast<struct io_uring_sqe *>(
+      mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES));
+  if (sq_ring_ == MAP_FAILED || cq_ring_ == MAP_FAILED ||
+      sqes_ == MAP_FAILED) {
+    return false;
+  }
+
+  char *sq = static_cast<char *>(sq_ring_);
+  sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  sq_mask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+  char *cq = static_cast<char *>(cq_ring_);
+  cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  cq_mask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+  return true;
+}
+
+IoUring::~IoUring() {
+  if (sqes_ != MAP_FAILED) {
+    munmap(sqes_, sqes_size_);
+  }
+  if (cq_ring_ != MAP_FAILED) {
+    munmap(cq_ring_, cq_ring_size_);
+  }
+  if (sq_ring_ != MAP_FAILED) {
+    munmap(sq_ring_, sq_ring_size_);
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+uint8_t IoUring::OpcodeFor(const BatchOp &op) {
+  switch (op.kind) {
+    case BATCH_STAT:
+    case BATCH_LSTAT:
+      return kOpStatx;
+    case BATCH_MKDIR:
+      return kOpMkdirat;
+    case BATCH_SYMLINK:
+      return kOpSymlinkat;
+    case BATCH_UNLINK:
+      return kOpUnlinkat;
+    default:
+      // readlink has no io_uring equivalent.
+      return UINT8_MAX;
+  }
+}
+
+void IoUring::Run(BatchOp *ops, size_t count) {
+  std::vector<BatchOp *> async_ops;
+  async_ops.reserve(count);
+  for (size_t i = 0; i < count; i++) {
+    if (!broken_ && Supports(OpcodeFor(ops[i]))) {
+      async_ops.push_back(&ops[i]);
+    } else {
+      RunBatchOp(&ops[i]);
+    }
+  }
+  for (size_t i = 0; i < async_ops.size(); i += sq_entries_) {
+    RunChunk(&async_ops[i],
+             std::min<size_t>(sq_entries_, async_ops.size() - i));
+  }
+}
+
+void IoUring::Prepare(struct io_uring_sqe *sqe, BatchOp *op,
+                      struct statx *stx) {
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = OpcodeFor(*op);
+  sqe->fd = AT_FDCWD;
+  sqe->addr = reinterpret_cast<uintptr_t>(op->path);
+  switch (op->kind) {
+    case BATCH_STAT:
+    case BATCH_LSTAT:
+      sqe->len = STATX_BASIC_STATS;
+      sqe->off = reinterpret_cast<uintptr_t>(stx);
+      sqe->rw_flags = op->kind == BATCH_LSTAT ? AT_SYMLINK_NOFOLLOW : 0;
+      break;
+    case BATCH_MKDIR:
+      sqe->len = op->mode;
+      break;
+    case BATCH_SYMLINK:
+      // symlinkat(target, newdirfd, linkpath)
+      sqe->fd = AT_FDCWD;
+      sqe->addr = reinterpret_cast<uintptr_t>(op->target);
+      sqe->addr2 = reinterpret_cast<uintptr_t>(op->path);
+      break;
+    default:
+      break;
+  }
+}
+
+void IoUring::Complete(BatchOp *op, int res, const struct statx &stx) {
+  op->error_number = res < 0 ? -res : 0;
+  if (res < 0 || (op->kind != BATCH_STAT && op->kind != BATCH_LSTAT)) {
+    return;
+  }
+  portable_stat_struct *st = &op->statbuf;
+  memset(st, 0, sizeof(*st));
+  st->st_dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+  st->st_ino = stx.stx_ino;
+  st->st_mode = stx.stx_mode;
+  st->st_nlink = stx.stx_nlink;
+  st->st_uid = stx.stx_uid;
+  st->st_gid = stx.stx_gid;
+  st->st_rdev = makedev(stx.stx_rdev_major, stx.stx_rdev_minor);
+  st->st_size = stx.stx_size;
+  st->st_blksize = stx.stx_blksize;
+  st->st_blocks = stx.stx_blocks;
+  st->st_atim.tv_sec = stx.stx_atime.tv_sec;
+  st->st_atim.tv_nsec = stx.stx_atime.tv_nsec;
+  st->st_mtim.tv_sec = stx.stx_mtime.tv_sec;
+  st->st_mtim.tv_nsec = stx.stx_mtime.tv_nsec;
+  st->st_ctim.tv_sec = stx.stx_ctime.tv_sec;
+  st->st_ctim.tv_nsec = stx.stx_ctime.tv_nsec;
+}
+
+size_t IoUring::Reap(BatchOp **ops, struct statx *stx,
+                     std::vector<bool> *done) {
+  unsigned int head = *cq_head_;
+  unsigned int tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+  size_t reaped = 0;
+  for (; head != tail; head++, reaped++) {
+    const struct io_uring_cqe &cqe = cqes_[head & cq_mask_];
+    Complete(ops[cqe.user_data], cqe.res, stx[cqe.user_data]);
+    (*done)[cqe.user_data] = true;
+  }
+  __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+  return reaped;
+}
+
+void IoUring::RunChunk(BatchOp **ops, size_t count) {
+  std::unique_ptr<struct statx[]> stx(new struct statx[count]);
+  std::vector<bool> done(count);
+  unsigned int tail = *sq_tail_;
+  for (size_t i = 0; i < count; i++, tail++) {
+    unsigned int index = tail & sq_mask_;
+    Prepare(&sqes_[index], ops[i], &stx[i]);
+    sqes_[index].user_data = i;
+    sq_array_[index] = index;
+  }
+  __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+
+  // The completion queue has room for twice as many entries as the
+  // submission queue, so it cannot overflow while we wait for a chunk.
+  size_t unsubmitted = count;
+  size_t completed = 0;
+  while (completed < count) {
+    long r = syscall(__NR_io_uring_enter, fd_, unsubmitted, 1,
+                     IORING_ENTER_GETEVENTS, nullptr, 0);
+    if (r < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY &&
+        errno != ENOMEM) {
+      // The ring itself is broken. The kernel consumes submissions in order
+      // and a failed call consumes none, so ops[0..accepted) are in flight or
+      // done. They may still read their paths and write to stx, and running
+      // them again would turn e.g. a successful mkdir into EEXIST, so wait
+      // for their completions, which the kernel keeps posting to the mapped
+      // ring. Only the operations it never saw run synchronously.
+      broken_ = true;
+      size_t accepted = count - unsubmitted;
+      while (completed < accepted) {
+        struct timespec delay = {0, 1000000};
+        nanosleep(&delay, nullptr);
+        completed += Reap(ops, stx.get(), &done);
+      }
+      for (size_t i = accepted; i < count; i++) {
+        RunBatchOp(ops[i]);
+      }
+      return;
+    }
+    if (r > 0) {
+      unsubmitted -= r;
+    }
+    completed += Reap(ops, stx.get(), &done);
+  }
+}
+
+}  // namespace
+
+void portable_run_batch(BatchOp *ops, size_t count) {
+  IoUring *ring = count > 1 ? IoUring::ForCurrentThread() : nullptr;
+  if (ring != nullptr) {
+    ring->Run(ops, count);
+    return;
+  }
+  for (size_t i = 0; i < count; i++) {
+    RunBatchOp(&ops[i]);
+  }
+}
+
+#else  // !defined(UNIX_JNI_HAVE_IO_URING)
+
+void portable_run_batch(BatchOp *ops, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    RunBatchOp(&ops[i]);
+  }
+}
+
+#endif  // defined(UNIX_JNI_HAVE_IO_URING)
@@ -19,6 +19,12 @@
 // and any extraneous ones are removed. Second, any missing files are created.
 // Finally, a copy of the input manifest is written to RUNFILES/MANIFEST.
 //
+// If RUNFILES/MANIFEST exists from a previous run and no directory of the tree
+// was modified after it, the tree is assumed to match it, and only the paths
+// that differ between it and INPUT are removed and created instead. Should the
+// tree turn out not to match, e.g. because a path to remove is missing or one
+// to create already exists, we fall back to scanning the whole tree.
+//
 // The input manifest consists of lines, each containing a relative path within
 // the runfiles, a space, and an optional absolute path.  If this second path
 // is present, a symlink is created pointing to it; otherwise an empty file is
@@ -37,6 +43,16 @@
 // If --use_metadata is supplied, every other line is treated as opaque
 // metadata, and is ignored here.
 //
+// With --materialization=hardlink, reflink or copy, the files that lines point
+// to are hard linked, cloned or copied into the tree instead, for consumers
+// that cannot follow symlinks out of it or that want the data close by.
+// Targets that are not regular files are still symlinked. Cloning falls back
+// to copying where the file system does not support it, and so does hard
+// linking across file systems. The copies keep the modification time of their
+// target, by which later runs tell whether they are still up to date. A mode
+// other than symlink is recorded in RUNFILES/MANIFEST.mode, and a tree is only
+// updated incrementally if it was created with the same mode.
+//
 // All output paths must be relative and generally (but not always) begin with
 // <workspace root>. No output path may be equal to another.  No output path may
 // be a path prefix of another.
@@ -50,11 +66,25 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
-#include <map>
+#if defined(__linux__)
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 // program_invocation_short_name is not portable.
 static const char *argv0;
@@ -88,130 +118,738 @@ enum FileType {
   FILE_TYPE_SYMLINK
 };
 
-struct FileInfo {
-  FileType type;
-  std::string symlink_target;
+// How the entries of the manifest that have a target are created.
+enum Materialization {
+  MATERIALIZE_SYMLINK,
+  MATERIALIZE_HARDLINK,
+  MATERIALIZE_REFLINK,
+  MATERIALIZE_COPY,
+  NUM_MATERIALIZATIONS
+};
+
+static const char *const kMaterializationNames[NUM_MATERIALIZATIONS] = {
+    "symlink", "hardlink", "reflink", "copy"};
+
+static bool ParseMaterialization(const char *name, Materialization *result) {
+  for (int i = 0; i < NUM_MATERIALIZATIONS; ++i) {
+    if (strcmp(name, kMaterializationNames[i]) == 0) {
+      *result = static_cast<Materialization>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+// Creating and deleting files mostly means waiting for the file system,
+// especially on network and overlay file systems, so we use more threads than
+// there are CPUs. Small trees are not worth starting threads for.
+static const size_t kMaxThreads = 16;
+static const size_t kMinEntriesPerThread = 256;
+
+static size_t NumThreads(size_t entries) {
+  return std::max<size_t>(1,
+                          std::min(kMaxThreads, entries / kMinEntriesPerThread));
+}
+
+// Runs jobs on a number of threads, including the calling one. Jobs may add
+// more jobs.
+class WorkQueue {
+ public:
+  explicit WorkQueue(size_t num_threads) : num_threads_(num_threads) {}
+
+  void Add(std::function<void()> job) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    jobs_.push_back(std::move(job));
+    cv_.notify_one();
+  }
+
+  // Returns once all jobs are done.
+  void Run() {
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < num_threads_; ++i) {
+      threads.emplace_back(&WorkQueue::Work, this);
+    }
+    Work();
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+  }
+
+ private:
+  void Work() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      // Running jobs may still add more.
+      while (jobs_.empty() && busy_ > 0) {
+        cv_.wait(lock);
+      }
+      if (jobs_.empty()) {
+        return;
+      }
+      std::function<void()> job = std::move(jobs_.front());
+      jobs_.pop_front();
+      ++busy_;
+      lock.unlock();
+      job();
+      lock.lock();
+      if (--busy_ == 0 && jobs_.empty()) {
+        cv_.notify_all();
+      }
+    }
+  }
+
+  const size_t num_threads_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::function<void()>> jobs_;
+  size_t busy_ = 0;
+};
+
+// Failures of the worker threads. Only the one for the first path is reported,
+// so that the output does not depend on the order in which threads ran.
+class PathErrors {
+ public:
+  // Records that the operation described by message failed on path with
+  // error.
+  void Add(const std::string &path, const std::string &message, int error) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (message_.empty() || path < path_) {
+      path_ = path;
+      message_ = message;
+      error_ = error;
+    }
+  }
+
+  void DieIfAny() {
+    if (!message_.empty()) {
+      errno = error_;
+      PDIE("%s", message_.c_str());
+    }
+  }
+
+ private:
+  std::mutex mutex_;
+  std::string path_;
+  std::string message_;
+  int error_;
+};
+
+static struct timespec ModificationTime(const struct stat &st) {
+#if defined(__APPLE__)
+  return st.st_mtimespec;
+#else
+  return st.st_mtim;
+#endif
+}
+
+// Copies the file in_fd of the given size to out_fd, cloning its extents
+// instead if reflink is set and the file system supports it. Returns false
+// with errno set on failure.
+static bool CopyContents(int in_fd, int out_fd, off_t size, bool reflink) {
+#ifdef FICLONE
+  if (reflink && ioctl(out_fd, FICLONE, in_fd) == 0) {
+    return true;
+  }
+#endif
+#ifdef SYS_copy_file_range
+  // Copy within the kernel, which also lets file systems share or offload the
+  // data, and fall back to reading and writing it if it cannot.
+  for (off_t copied = 0; copied < size;) {
+    ssize_t n = syscall(SYS_copy_file_range, in_fd, nullptr, out_fd, nullptr,
+                        static_cast<size_t>(size - copied), 0);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EXDEV || errno == ENOSYS || errno == EINVAL ||
+          errno == EOPNOTSUPP) {
+        break;
+      }
+      return false;
+    }
+    if (n == 0) {
+      return true;
+    }
+    copied += n;
+  }
+#endif
+  char buffer[65536];
+  while (true) {
+    ssize_t n = read(in_fd, buffer, sizeof(buffer));
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    if (n == 0) {
+      return true;
+    }
+    for (ssize_t written = 0; written < n;) {
+      ssize_t w = write(out_fd, buffer + written, n - written);
+      if (w < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      written += w;
+    }
+  }
+}
+
+// The runfiles tree described by a manifest, as a trie of path components.
+// All nodes live in one vector, and their names and symlink targets point into
+// the manifest, which stays mapped, so that even manifests with millions of
+// lines only take a handful of allocations.
+class ManifestTree {
+ public:
+  static const uint32_t kNone = UINT32_MAX;
+  static const uint32_t kRoot = 0;
+
+  struct Node {
+    // The file name and symlink target, null-terminated.
+    const char *name;
+    const char *target;
+    uint32_t name_length;
+    uint32_t target_length;
+    uint32_t parent;
+    // The children are children_[first_child, first_child + num_children),
+    // sorted by name.
+    uint32_t first_child;
+    uint32_t num_children;
+    FileType type;
+    // Whether the entry is known to exist already, so it need not be created.
+    bool exists;
+  };
+
+  ManifestTree() : data_(nullptr), size_(0), slots_(1024, kNone) {
+    Node root = {"", "", 0, 0, kNone, 0, 0, FILE_TYPE_DIRECTORY, true};
+    nodes_.push_back(root);
+  }
+
+  ~ManifestTree() {
+    if (data_ != nullptr) {
+      munmap(data_, size_);
+    }
+  }
+
+  // Maps the manifest at path privately, so that parsing can replace its
+  // delimiters with null characters, and stores its attributes in st. Returns
+  // false with errno set on failure.
+  bool Map(const std::string &path, struct stat *st) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return false;
+    }
+    if (fstat(fd, st) != 0) {
+      int saved_errno = errno;
+      close(fd);
+      errno = saved_errno;
+      return false;
+    }
+    size_ = st->st_size;
+    if (size_ > 0) {
+      void *data = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                        fd, 0);
+      if (data == MAP_FAILED) {
+        int saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return false;
+      }
+      data_ = static_cast<char *>(data);
+    }
+    close(fd);
+    return true;
+  }
+
+  char *data() const { return data_; }
+  size_t size() const { return size_; }
+
+  // Adds the entry link, which must be null-terminated and whose components
+  // must be separated by null characters instead of slashes, and all of its
+  // parent directories. An empty target means an empty file. Must not be
+  // called after Finish().
+  void Add(char *link, size_t link_length, const char *target,
+           size_t target_length) {
+    uint32_t parent = kRoot;
+    size_t depth = 0;
+    char *end = link + link_length;
+    while (true) {
+      size_t length = strlen(link);
+      uint32_t child;
+      // Consecutive lines of a sorted manifest mostly share their directories.
+      if (depth < last_dirs_.size() &&
+          nodes_[last_dirs_[depth]].name_length == length &&
+          memcmp(nodes_[last_dirs_[depth]].name, link, length) == 0) {
+        child = last_dirs_[depth];
+      } else {
+        last_dirs_.resize(depth);
+        child = FindOrAdd(parent, link, length);
+      }
+      if (link + length == end) {
+        Node *node = &nodes_[child];
+        if (target_length == 0) {
+          // No target means an empty file.
+          node->type = FILE_TYPE_REGULAR;
+        } else {
+          node->type = FILE_TYPE_SYMLINK;
+        }
+        node->target = target;
+        node->target_length = target_length;
+        return;
+      }
+      if (depth == last_dirs_.size()) {
+        last_dirs_.push_back(child);
+      }
+      parent = child;
+      link += length + 1;
+      ++depth;
+    }
+  }
+
+  // Sorts the children of every node. Must be called once after the last
+  // Add() and before Find().
+  void Finish() {
+    std::vector<uint32_t>().swap(slots_);
+    std::vector<uint32_t>().swap(last_dirs_);
+    for (size_t i = 1; i < nodes_.size(); ++i) {
+      ++nodes_[nodes_[i].parent].num_children;
+    }
+    uint32_t next = 0;
+    for (Node &node : nodes_) {
+      node.first_child = next;
+      next += node.num_children;
+      node.num_children = 0;
+    }
+    children_.resize(next);
+    for (size_t i = 1; i < nodes_.size(); ++i) {
+      Node *parent = &nodes_[nodes_[i].parent];
+      children_[parent->first_child + parent->num_children++] = i;
+    }
+    for (const Node &node : nodes_) {
+      std::sort(children_.begin() + node.first_child,
+                children_.begin() + node.first_child + node.num_children,
+                [this](uint32_t a, uint32_t b) {
+                  return Compare(nodes_[a], nodes_[b].name,
+                                 nodes_[b].name_length) < 0;
+                });
+    }
+  }
+
+  size_t num_nodes() const { return nodes_.size(); }
+  const Node &node(uint32_t i) const { return nodes_[i]; }
+  Node *mutable_node(uint32_t i) { return &nodes_[i]; }
+  uint32_t child(const Node &node, uint32_t i) const {
+    return children_[node.first_child + i];
+  }
 
-  bool operator==(const FileInfo &other) const {
-    return type == other.type && symlink_target == other.symlink_target;
+  // Returns the child of dir with the given name, or kNone.
+  uint32_t Find(uint32_t dir, const char *name, size_t length) const {
+    const Node &node = nodes_[dir];
+    std::vector<uint32_t>::const_iterator begin =
+        children_.begin() + node.first_child;
+    std::vector<uint32_t>::const_iterator end = begin + node.num_children;
+    std::vector<uint32_t>::const_iterator it = std::lower_bound(
+        begin, end, 0, [this, name, length](uint32_t child, int) {
+          return Compare(nodes_[child], name, length) < 0;
+        });
+    if (it == end || Compare(nodes_[*it], name, length) != 0) {
+      return kNone;
+    }
+    return *it;
   }
 
-  bool operator!=(const FileInfo &other) const {
-    return !(*this == other);
+  // Returns the path of the node relative to the root, which is empty.
+  std::string Path(uint32_t i) const {
+    std::string path;
+    for (; i != kRoot; i = nodes_[i].parent) {
+      path.insert(0, nodes_[i].name, nodes_[i].name_length);
+      if (nodes_[i].parent != kRoot) {
+        path.insert(0, 1, '/');
+      }
+    }
+    return path;
   }
+
+  // Returns whether two nodes, possibly of different trees, describe the same
+  // file, not taking children into account.
+  static bool SameEntry(const Node &a, const Node &b) {
+    return a.type == b.type && a.target_length == b.target_length &&
+           memcmp(a.target, b.target, a.target_length) == 0;
+  }
+
+ private:
+  ManifestTree(const ManifestTree &) = delete;
+  ManifestTree &operator=(const ManifestTree &) = delete;
+
+  static int Compare(const Node &node, const char *name, size_t length) {
+    int result = memcmp(node.name, name, std::min<size_t>(node.name_length,
+                                                          length));
+    if (result != 0) {
+      return result;
+    }
+    return node.name_length < length ? -1 : node.name_length > length;
+  }
+
+  static size_t Hash(uint32_t parent, const char *name, size_t length) {
+    // FNV-1a
+    size_t hash = 2166136261u ^ parent;
+    for (size_t i = 0; i < length; ++i) {
+      hash = (hash ^ static_cast<unsigned char>(name[i])) * 16777619u;
+    }
+    return hash;
+  }
+
+  // Returns the child of parent with the given name, adding it as a directory
+  // if there is none, using an open-addressing hash table of node indices.
+  uint32_t FindOrAdd(uint32_t parent, const char *name, size_t length) {
+    size_t mask = slots_.size() - 1;
+    for (size_t slot = Hash(parent, name, length) & mask;;
+         slot = (slot + 1) & mask) {
+      uint32_t i = slots_[slot];
+      if (i == kNone) {
+        Node node = {name, "", static_cast<uint32_t>(length), 0, parent, 0, 0,
+                     FILE_TYPE_DIRECTORY, false};
+        i = nodes_.size();
+        nodes_.push_back(node);
+        slots_[slot] = i;
+        if (nodes_.size() * 2 > slots_.size()) {
+          Rehash();
+        }
+        return i;
+      }
+      if (nodes_[i].parent == parent && Compare(nodes_[i], name, length) == 0) {
+        return i;
+      }
+    }
+  }
+
+  void Rehash() {
+    std::vector<uint32_t> slots(slots_.size() * 2, kNone);
+    size_t mask = slots.size() - 1;
+    for (size_t i = 1; i < nodes_.size(); ++i) {
+      size_t slot = Hash(nodes_[i].parent, nodes_[i].name,
+                         nodes_[i].name_length) & mask;
+      while (slots[slot] != kNone) {
+        slot = (slot + 1) & mask;
+      }
+      slots[slot] = i;
+    }
+    slots_.swap(slots);
+  }
+
+  char *data_;
+  size_t size_;
+  std::vector<Node> nodes_;
+  std::vector<uint32_t> children_;
+  // Only used while adding entries.
+  std::vector<uint32_t> slots_;
+  std::vector<uint32_t> last_dirs_;
 };
 
-typedef std::map<std::string, FileInfo> FileInfoMap;
+const uint32_t ManifestTree::kNone;
+const uint32_t ManifestTree::kRoot;
 
 class RunfilesCreator {
  public:
-  explicit RunfilesCreator(const std::string &output_base)
+  RunfilesCreator(const std::string &output_base, bool use_metadata,
+                  Materialization materialization)
       : output_base_(output_base),
         output_filename_("MANIFEST"),
-        temp_filename_(output_filename_ + ".tmp") {
+        temp_filename_(output_filename_ + ".tmp"),
+        materialization_filename_(output_filename_ + ".mode"),
+        use_metadata_(use_metadata),
+        materialization_(materialization) {
     SetupOutputBase();
     if (chdir(output_base_.c_str()) != 0) {
       PDIE("chdir '%s'", output_base_.c_str());
     }
+    // The output manifest only exists if the previous run completed, and then
+    // it describes the tree that run left behind. This has to happen before we
+    // write the temp manifest, which modifies the output base.
+    struct timespec previous_mtime;
+    Materialization previous_materialization;
+    have_previous_manifest_ =
+        ReadPreviousManifest(&previous_mtime) &&
+        ReadPreviousMaterialization(&previous_materialization) &&
+        previous_materialization == materialization_ &&
+        !TreeModifiedSince(previous_mtime);
   }
 
-  void ReadManifest(const std::string &manifest_file, bool allow_relative,
-                    bool use_metadata) {
+  void ReadManifest(const std::string &manifest_file, bool allow_relative) {
     FILE *outfile = fopen(temp_filename_.c_str(), "w");
     if (!outfile) {
       PDIE("opening '%s/%s' for writing", output_base_.c_str(),
            temp_filename_.c_str());
     }
-    FILE *infile = fopen(manifest_file.c_str(), "r");
-    if (!infile) {
+    struct stat st;
+    if (!manifest_.Map(manifest_file, &st)) {
       PDIE("opening '%s' for reading", manifest_file.c_str());
     }
 
-    // read input manifest
-    int lineno = 0;
-    char buf[3 * PATH_MAX];
-    while (fgets(buf, sizeof buf, infile)) {
-      // copy line to output manifest
-      if (fputs(buf, outfile) == EOF) {
+    // copy the input manifest before parsing modifies it
+    if (fwrite(manifest_.data(), 1, manifest_.size(), outfile) !=
+            manifest_.size() ||
+        fclose(outfile) != 0) {
+      PDIE("writing to '%s/%s'", output_base_.c_str(),
+           temp_filename_.c_str());
+    }
+
+    ParseManifest(&manifest_, true, allow_relative);
+  }
+
+  void CreateRunfiles() {
+    if (unlink(output_filename_.c_str()) != 0 && errno != ENOENT) {
+      PDIE("removing previous file at '%s/%s'", output_base_.c_str(),
+           output_filename_.c_str());
+    }
+    if (unlink(materialization_filename_.c_str()) != 0 && errno != ENOENT) {
+      PDIE("removing previous file at '%s/%s'", output_base_.c_str(),
+           materialization_filename_.c_str());
+    }
+
+    if (!have_previous_manifest_ || !UpdateTree()) {
+      ScanTreeAndPrune(".", ManifestTree::kRoot);
+      DeleteStale();
+      CreateFiles();
+    }
+
+    if (materialization_ != MATERIALIZE_SYMLINK) {
+      FILE *file = fopen(materialization_filename_.c_str(), "w");
+      if (file == nullptr ||
+          fprintf(file, "%s\n", kMaterializationNames[materialization_]) < 0 ||
+          fclose(file) != 0) {
         PDIE("writing to '%s/%s'", output_base_.c_str(),
-             temp_filename_.c_str());
+             materialization_filename_.c_str());
       }
+    }
+
+    // rename output file into place
+    if (rename(temp_filename_.c_str(), output_filename_.c_str()) != 0) {
+      PDIE("renaming '%s/%s' to '%s/%s'",
+           output_base_.c_str(), temp_filename_.c_str(),
+           output_base_.c_str(), output_filename_.c_str());
+    }
+    // Renaming modified the output base, and the manifest has to be at least
+    // as new as every directory for the next run to trust it.
+    if (utimensat(AT_FDCWD, output_filename_.c_str(), nullptr, 0) != 0) {
+      PDIE("touching '%s/%s'", output_base_.c_str(), output_filename_.c_str());
+    }
+  }
+
+ private:
+  // Parses the manifest mapped in tree into it, in place. If strict, every
+  // line is validated, and we die on the first malformed one. Otherwise, the
+  // manifest is assumed to have been validated before, and we only return
+  // false if it does not parse.
+  bool ParseManifest(ManifestTree *tree, bool strict, bool allow_relative) {
+    int lineno = 0;
+    char *line = tree->data();
+    char *data_end = line + tree->size();
+    for (char *next; line < data_end; line = next) {
+      char *end = static_cast<char *>(memchr(line, '\n', data_end - line));
+      next = end == nullptr ? data_end : end + 1;
 
       // parse line
       ++lineno;
       // Skip metadata lines. They are used solely for
       // dependency checking.
-      if (use_metadata && lineno % 2 == 0) continue;
+      if (use_metadata_ && lineno % 2 == 0) continue;
 
-      int n = strlen(buf)-1;
-      if (!n || buf[n] != '\n') {
-        DIE("missing terminator at line %d: '%s'\n", lineno, buf);
+      int n = next - line;
+      if (end == nullptr || end == line) {
+        if (strict) {
+          DIE("missing terminator at line %d: '%.*s'\n", lineno, n, line);
+        }
+        return false;
       }
-      buf[n] = '\0';
-      if (buf[0] ==  '/') {
-        DIE("paths must not be absolute: line %d: '%s'\n", lineno, buf);
+      n = end - line;
+      if (strict && line[0] == '/') {
+        DIE("paths must not be absolute: line %d: '%.*s'\n", lineno, n, line);
       }
-      const char *s = strchr(buf, ' ');
+      char *s = static_cast<char *>(memchr(line, ' ', n));
       if (!s) {
-        DIE("missing field delimiter at line %d: '%s'\n", lineno, buf);
-      } else if (strchr(s+1, ' ')) {
-        DIE("link or target filename contains space on line %d: '%s'\n",
-            lineno, buf);
-      }
-      std::string link(buf, s-buf);
-      const char *target = s+1;
-      if (!allow_relative && target[0] != '\0' && target[0] != '/'
-          && target[1] != ':') {  // Match Windows paths, e.g. C:\foo or C:/foo.
-        DIE("expected absolute path at line %d: '%s'\n", lineno, buf);
-      }
-
-      FileInfo *info = &manifest_[link];
-      if (target[0] == '\0') {
-        // No target means an empty file.
-        info->type = FILE_TYPE_REGULAR;
-      } else {
-        info->type = FILE_TYPE_SYMLINK;
-        info->symlink_target = target;
+        if (strict) {
+          DIE("missing field delimiter at line %d: '%.*s'\n", lineno, n, line);
+        }
+        return false;
+      }
+      const char *target = s + 1;
+      size_t target_length = end - target;
+      if (strict) {
+        if (memchr(target, ' ', target_length)) {
+          DIE("link or target filename contains space on line %d: '%.*s'\n",
+              lineno, n, line);
+        }
+        if (!allow_relative && target_length > 0 && target[0] != '/' &&
+            (target_length < 2 || target[1] != ':')) {
+          // Match Windows paths, e.g. C:\foo or C:/foo.
+          DIE("expected absolute path at line %d: '%.*s'\n", lineno, n, line);
+        }
       }
 
-      FileInfo parent_info;
-      parent_info.type = FILE_TYPE_DIRECTORY;
+      // Null-terminate the target and every component of the link.
+      *end = '\0';
+      *s = '\0';
+      std::replace(line, s, '/', '\0');
+      tree->Add(line, s - line, target, target_length);
+    }
+    tree->Finish();
+    return true;
+  }
 
-      while (true) {
-        int k = link.rfind('/');
-        if (k < 0) break;
-        link.erase(k, std::string::npos);
-        if (!manifest_.insert(std::make_pair(link, parent_info)).second) break;
-      }
+  // Reads the output manifest of the previous run into previous_manifest_ and
+  // its modification time into mtime. Returns false if there is none or it is
+  // malformed.
+  bool ReadPreviousManifest(struct timespec *mtime) {
+    struct stat st;
+    if (!previous_manifest_.Map(output_filename_, &st)) {
+      return false;
     }
-    if (fclose(outfile) != 0) {
-      PDIE("writing to '%s/%s'", output_base_.c_str(),
-           temp_filename_.c_str());
+    *mtime = ModificationTime(st);
+    return ParseManifest(&previous_manifest_, false, true);
+  }
+
+  // Reads how the previous run materialized the tree. Trees without a record
+  // consist of symlinks. Returns false if the record is unreadable.
+  bool ReadPreviousMaterialization(Materialization *materialization) {
+    FILE *file = fopen(materialization_filename_.c_str(), "r");
+    if (file == nullptr) {
+      *materialization = MATERIALIZE_SYMLINK;
+      return errno == ENOENT;
     }
-    fclose(infile);
+    char name[16];
+    bool ok = fscanf(file, "%15s", name) == 1 &&
+              ParseMaterialization(name, materialization);
+    fclose(file);
+    return ok;
+  }
 
-    // Don't delete the temp manifest file.
-    manifest_[temp_filename_].type = FILE_TYPE_REGULAR;
+  // Returns whether entries were added to or removed from any directory of the
+  // tree described by previous_manifest_ after mtime, which means that someone
+  // else modified it. This only takes a stat() per directory instead of
+  // reading every symlink.
+  bool TreeModifiedSince(const struct timespec &mtime) {
+    std::vector<uint32_t> dirs(1, ManifestTree::kRoot);
+    while (!dirs.empty()) {
+      uint32_t dir = dirs.back();
+      dirs.pop_back();
+      std::string path = dir == ManifestTree::kRoot
+                             ? std::string(".")
+                             : previous_manifest_.Path(dir);
+      struct stat st;
+      if (lstat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+        return true;
+      }
+      struct timespec dir_mtime = ModificationTime(st);
+      if (dir_mtime.tv_sec > mtime.tv_sec ||
+          (dir_mtime.tv_sec == mtime.tv_sec &&
+           dir_mtime.tv_nsec > mtime.tv_nsec)) {
+        return true;
+      }
+      const ManifestTree::Node &node = previous_manifest_.node(dir);
+      for (uint32_t i = 0; i < node.num_children; ++i) {
+        uint32_t child = previous_manifest_.child(node, i);
+        if (previous_manifest_.node(child).type == FILE_TYPE_DIRECTORY) {
+          dirs.push_back(child);
+        }
+      }
+    }
+    return false;
   }
 
-  void CreateRunfiles() {
-    if (unlink(output_filename_.c_str()) != 0 && errno != ENOENT) {
-      PDIE("removing previous file at '%s/%s'", output_base_.c_str(),
-           output_filename_.c_str());
+  // Turns the tree described by previous_manifest_ into the one described by
+  // manifest_, touching only the paths that differ. Returns false if the tree
+  // does not match previous_manifest_, in which case it is left in an unknown
+  // state.
+  bool UpdateTree() {
+    std::string path;
+    return RemoveStale(ManifestTree::kRoot, ManifestTree::kRoot, &path) &&
+           CreateMissing(ManifestTree::kRoot, ManifestTree::kRoot, &path);
+  }
+
+  // Removes the children of the directory previous_dir of previous_manifest_
+  // at path that differ from those of dir in manifest_, which is kNone if the
+  // whole directory is stale. Directories are emptied before we remove them.
+  bool RemoveStale(uint32_t previous_dir, uint32_t dir, std::string *path) {
+    const ManifestTree::Node &node = previous_manifest_.node(previous_dir);
+    for (uint32_t i = 0; i < node.num_children; ++i) {
+      uint32_t child = previous_manifest_.child(node, i);
+      const ManifestTree::Node &old_node = previous_manifest_.node(child);
+      uint32_t new_child =
+          dir == ManifestTree::kNone
+              ? ManifestTree::kNone
+              : manifest_.Find(dir, old_node.name, old_node.name_length);
+      bool same = new_child != ManifestTree::kNone &&
+                  ManifestTree::SameEntry(old_node, manifest_.node(new_child));
+
+      size_t length = path->size();
+      if (!path->empty()) {
+        path->push_back('/');
+      }
+      path->append(old_node.name, old_node.name_length);
+      if (old_node.type == FILE_TYPE_DIRECTORY &&
+          !RemoveStale(child, same ? new_child : ManifestTree::kNone, path)) {
+        return false;
+      }
+      if (!same) {
+        int err = old_node.type == FILE_TYPE_DIRECTORY ? rmdir(path->c_str())
+                                                        : unlink(path->c_str());
+        if (err != 0) {
+          return false;
+        }
+      }
+      path->resize(length);
     }
+    return true;
+  }
 
-    ScanTreeAndPrune(".");
-    CreateFiles();
+  // Creates the children of the directory dir of manifest_ at path that differ
+  // from those of previous_dir in previous_manifest_, which is kNone if the
+  // whole directory is new. Directories are created before their contents.
+  bool CreateMissing(uint32_t previous_dir, uint32_t dir, std::string *path) {
+    const ManifestTree::Node &node = manifest_.node(dir);
+    for (uint32_t i = 0; i < node.num_children; ++i) {
+      uint32_t child = manifest_.child(node, i);
+      const ManifestTree::Node &new_node = manifest_.node(child);
+      uint32_t old_child = previous_dir == ManifestTree::kNone
+                               ? ManifestTree::kNone
+                               : previous_manifest_.Find(previous_dir,
+                                                         new_node.name,
+                                                         new_node.name_length);
+      bool same =
+          old_child != ManifestTree::kNone &&
+          ManifestTree::SameEntry(previous_manifest_.node(old_child), new_node);
 
-    // rename output file into place
-    if (rename(temp_filename_.c_str(), output_filename_.c_str()) != 0) {
-      PDIE("renaming '%s/%s' to '%s/%s'",
-           output_base_.c_str(), temp_filename_.c_str(),
-           output_base_.c_str(), output_filename_.c_str());
+      size_t length = path->size();
+      if (!path->empty()) {
+        path->push_back('/');
+      }
+      path->append(new_node.name, new_node.name_length);
+      if (same && new_node.type == FILE_TYPE_SYMLINK &&
+          materialization_ != MATERIALIZE_SYMLINK &&
+          !IsMaterializedAt(AT_FDCWD, path->c_str(), new_node)) {
+        // The target changed since the previous run.
+        if (unlink(path->c_str()) != 0) {
+          return false;
+        }
+        same = false;
+      }
+      if (!same && !CreateFileAt(AT_FDCWD, path->c_str(), new_node)) {
+        return false;
+      }
+      if (new_node.type == FILE_TYPE_DIRECTORY &&
+          !CreateMissing(same ? old_child : ManifestTree::kNone, child,
+                         path)) {
+        return false;
+      }
+      path->resize(length);
     }
+    return true;
   }
 
- private:
   void SetupOutputBase() {
     struct stat st;
     if (stat(output_base_.c_str(), &st) != 0) {
@@ -225,7 +863,9 @@ class RunfilesCreator {
     }
   }
 
-  void ScanTreeAndPrune(const std::string &path) {
+  // Compares the directory at path with the node dir of manifest_. Matching
+  // entries are marked as existing, and the others are queued for deletion.
+  void ScanTreeAndPrune(const std::string &path, uint32_t dir) {
     // A note on non-empty files:
     // We don't distinguish between empty and non-empty files. That is, if
     // there's a file that has contents, we don't truncate it here, even though
@@ -243,31 +883,42 @@ class RunfilesCreator {
     const std::string prefix = (path == "." ? "" : path + "/");
     while ((entry = readdir(dh)) != nullptr) {
       if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) continue;
+      // Don't delete the temp manifest file.
+      if (dir == ManifestTree::kRoot && entry->d_name == temp_filename_) {
+        continue;
+      }
 
       std::string entry_path = prefix + entry->d_name;
-      FileInfo actual_info;
-      actual_info.type = DentryToFileType(entry_path, entry);
-
-      if (actual_info.type == FILE_TYPE_SYMLINK) {
-        ReadLinkOrDie(entry_path, &actual_info.symlink_target);
+      FileType type = DentryToFileType(entry_path, entry);
+      std::string symlink_target;
+      if (type == FILE_TYPE_SYMLINK) {
+        ReadLinkOrDie(entry_path, &symlink_target);
       }
 
-      FileInfoMap::iterator expected_it = manifest_.find(entry_path);
-      if (expected_it == manifest_.end() ||
-          expected_it->second != actual_info) {
-#if !defined(__CYGWIN__)
-        DelTree(entry_path, actual_info.type);
-#else
-        // On Windows, if deleting failed, lamely assume that
-        // the link points to the right place.
-        if (!DelTree(entry_path, actual_info.type)) {
-          manifest_.erase(expected_it);
-        }
-#endif
+      uint32_t expected =
+          manifest_.Find(dir, entry->d_name, strlen(entry->d_name));
+      ManifestTree::Node *expected_node =
+          expected == ManifestTree::kNone ? nullptr
+                                          : manifest_.mutable_node(expected);
+      bool matches;
+      if (expected_node == nullptr) {
+        matches = false;
+      } else if (expected_node->type == FILE_TYPE_SYMLINK &&
+                 materialization_ != MATERIALIZE_SYMLINK) {
+        matches = IsMaterializedAt(AT_FDCWD, entry_path.c_str(),
+                                   *expected_node);
+      } else {
+        matches = expected_node->type == type &&
+                  symlink_target.size() == expected_node->target_length &&
+                  memcmp(symlink_target.data(), expected_node->target,
+                         symlink_target.size()) == 0;
+      }
+      if (!matches) {
+        stale_.push_back(StaleEntry{entry_path, type, expected});
       } else {
-        manifest_.erase(expected_it);
-        if (actual_info.type == FILE_TYPE_DIRECTORY) {
-          ScanTreeAndPrune(entry_path);
+        expected_node->exists = true;
+        if (type == FILE_TYPE_DIRECTORY) {
+          ScanTreeAndPrune(entry_path, expected);
         }
       }
 
@@ -279,60 +930,242 @@ class RunfilesCreator {
     closedir(dh);
   }
 
+  // Deletes the entries that ScanTreeAndPrune() found to be stale, in
+  // parallel.
+  void DeleteStale() {
+    std::vector<char> deleted(stale_.size());
+    PathErrors errors;
+    WorkQueue queue(NumThreads(stale_.size()));
+    for (size_t i = 0; i < stale_.size(); ++i) {
+      queue.Add([this, i, &deleted, &errors]() {
+        const std::string &path = stale_[i].path;
+        deleted[i] = DelTree(AT_FDCWD, path, path, stale_[i].type, &errors);
+      });
+    }
+    queue.Run();
+    errors.DieIfAny();
+#if defined(__CYGWIN__)
+    // On Windows, if deleting failed, lamely assume that
+    // the link points to the right place.
+    for (size_t i = 0; i < stale_.size(); ++i) {
+      if (!deleted[i] && stale_[i].node != ManifestTree::kNone) {
+        manifest_.mutable_node(stale_[i].node)->exists = true;
+      }
+    }
+#endif
+    stale_.clear();
+  }
+
+  // Creates all entries of manifest_ that do not exist yet. Each directory is
+  // populated by a job of its own, which creates the entries relative to the
+  // directory's fd and adds jobs for the subdirectories.
   void CreateFiles() {
-    for (FileInfoMap::const_iterator it = manifest_.begin();
-         it != manifest_.end(); ++it) {
-      const std::string &path = it->first;
-      switch (it->second.type) {
-        case FILE_TYPE_DIRECTORY:
-          if (mkdir(path.c_str(), 0777) != 0) {
-            PDIE("mkdir '%s'", path.c_str());
-          }
-          break;
-        case FILE_TYPE_REGULAR:
-          {
-            int fd = open(path.c_str(), O_CREAT|O_EXCL|O_WRONLY, 0555);
-            if (fd < 0) {
-              PDIE("creating empty file '%s'", path.c_str());
+    PathErrors errors;
+    WorkQueue queue(NumThreads(manifest_.num_nodes()));
+    std::function<void(uint32_t)> populate = [&](uint32_t dir) {
+      const ManifestTree::Node &dir_node = manifest_.node(dir);
+      int dirfd = AT_FDCWD;
+      for (uint32_t i = 0; i < dir_node.num_children; ++i) {
+        uint32_t child = manifest_.child(dir_node, i);
+        const ManifestTree::Node &node = manifest_.node(child);
+        if (!node.exists) {
+          // Only open directories that we have to add something to.
+          if (dirfd == AT_FDCWD && dir != ManifestTree::kRoot) {
+            std::string dir_path = manifest_.Path(dir);
+            dirfd = open(dir_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (dirfd < 0) {
+              errors.Add(dir_path, "opendir '" + dir_path + "'", errno);
+              return;
             }
-            close(fd);
           }
-          break;
-        case FILE_TYPE_SYMLINK:
-          {
-            const std::string& target = it->second.symlink_target;
-            if (symlink(target.c_str(), path.c_str()) != 0) {
-              PDIE("symlinking '%s' -> '%s'", path.c_str(), target.c_str());
-            }
+          if (!CreateFileAt(dirfd, node.name, node)) {
+            std::string path = manifest_.Path(child);
+            errors.Add(path, CreateFileMessage(path, node), errno);
+            continue;
+          }
+        }
+        if (node.type == FILE_TYPE_DIRECTORY && node.num_children > 0) {
+          queue.Add([&populate, child]() { populate(child); });
+        }
+      }
+      if (dirfd != AT_FDCWD) {
+        close(dirfd);
+      }
+    };
+    queue.Add([&populate]() { populate(ManifestTree::kRoot); });
+    queue.Run();
+    errors.DieIfAny();
+  }
+
+  std::string CreateFileMessage(const std::string &path,
+                                const ManifestTree::Node &node) const {
+    switch (node.type) {
+      case FILE_TYPE_DIRECTORY:
+        return "mkdir '" + path + "'";
+      case FILE_TYPE_REGULAR:
+        return "creating empty file '" + path + "'";
+      case FILE_TYPE_SYMLINK:
+        if (materialization_ != MATERIALIZE_SYMLINK) {
+          return std::string(kMaterializationNames[materialization_]) + " '" +
+                 path + "' from '" + node.target + "'";
+        }
+        return "symlinking '" + path + "' -> '" + node.target + "'";
+    }
+    return path;
+  }
+
+  // Creates the directory, empty file or symlink described by node at name in
+  // the directory dirfd. Returns false with errno set on failure, which
+  // includes the path already existing.
+  bool CreateFileAt(int dirfd, const char *name,
+                    const ManifestTree::Node &node) const {
+    switch (node.type) {
+      case FILE_TYPE_DIRECTORY:
+        return mkdirat(dirfd, name, 0777) == 0;
+      case FILE_TYPE_REGULAR:
+        {
+          int fd = openat(dirfd, name, O_CREAT|O_EXCL|O_WRONLY|O_CLOEXEC,
+                          0555);
+          if (fd < 0) {
+            return false;
           }
-          break;
+          close(fd);
+        }
+        return true;
+      case FILE_TYPE_SYMLINK:
+        return MaterializeAt(dirfd, name, node);
+    }
+    return false;
+  }
+
+  // Returns the path of the target of node relative to dirfd, given that the
+  // entry is called name in it. Relative targets are relative to the
+  // directory of the entry, as for symlinks.
+  static std::string TargetPathAt(const char *name,
+                                  const ManifestTree::Node &node) {
+    const char *slash = strrchr(name, '/');
+    if (node.target[0] == '/' || slash == nullptr) {
+      return node.target;
+    }
+    return std::string(name, slash + 1 - name) + node.target;
+  }
+
+  // Creates the entry for node at name in the directory dirfd according to
+  // materialization_. Returns false with errno set on failure.
+  bool MaterializeAt(int dirfd, const char *name,
+                     const ManifestTree::Node &node) const {
+    std::string target = TargetPathAt(name, node);
+    struct stat target_st;
+    if (materialization_ == MATERIALIZE_SYMLINK ||
+        fstatat(dirfd, target.c_str(), &target_st, 0) != 0 ||
+        !S_ISREG(target_st.st_mode)) {
+      return symlinkat(node.target, dirfd, name) == 0;
+    }
+    if (materialization_ == MATERIALIZE_HARDLINK) {
+      if (linkat(dirfd, target.c_str(), dirfd, name, AT_SYMLINK_FOLLOW) == 0) {
+        return true;
+      }
+      if (errno != EXDEV && errno != EPERM) {
+        return false;
       }
     }
+
+    int in_fd = openat(dirfd, target.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in_fd < 0) {
+      return false;
+    }
+    int out_fd = openat(dirfd, name, O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC,
+                        target_st.st_mode & 07777);
+    struct timespec times[2] = {{0, UTIME_OMIT},
+                                ModificationTime(target_st)};
+    bool ok = out_fd >= 0 &&
+              CopyContents(in_fd, out_fd, target_st.st_size,
+                           materialization_ == MATERIALIZE_REFLINK) &&
+              futimens(out_fd, times) == 0;
+    int saved_errno = errno;
+    close(in_fd);
+    if (out_fd >= 0) {
+      close(out_fd);
+      if (!ok) {
+        unlinkat(dirfd, name, 0);
+      }
+    }
+    errno = saved_errno;
+    return ok;
+  }
+
+  // Returns whether the entry at name in the directory dirfd is what
+  // MaterializeAt() would create for node now.
+  bool IsMaterializedAt(int dirfd, const char *name,
+                        const ManifestTree::Node &node) const {
+    struct stat st;
+    if (fstatat(dirfd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+      return false;
+    }
+    std::string target = TargetPathAt(name, node);
+    struct stat target_st;
+    bool regular_target = fstatat(dirfd, target.c_str(), &target_st, 0) == 0 &&
+                          S_ISREG(target_st.st_mode);
+    if (S_ISLNK(st.st_mode)) {
+      char buffer[PATH_MAX];
+      ssize_t n = readlinkat(dirfd, name, buffer, sizeof(buffer));
+      return !regular_target && n == node.target_length &&
+             memcmp(buffer, node.target, n) == 0;
+    }
+    if (!regular_target || !S_ISREG(st.st_mode)) {
+      return false;
+    }
+    if (st.st_dev == target_st.st_dev && st.st_ino == target_st.st_ino) {
+      return materialization_ == MATERIALIZE_HARDLINK;
+    }
+    if (materialization_ == MATERIALIZE_HARDLINK &&
+        st.st_dev == target_st.st_dev) {
+      // A copy that could be a hard link.
+      return false;
+    }
+    struct timespec mtime = ModificationTime(st);
+    struct timespec target_mtime = ModificationTime(target_st);
+    return st.st_size == target_st.st_size &&
+           mtime.tv_sec == target_mtime.tv_sec &&
+           mtime.tv_nsec == target_mtime.tv_nsec;
   }
 
   FileType DentryToFileType(const std::string &path, struct dirent *ent) {
+    FileType type;
+    if (!DentryToFileTypeAt(AT_FDCWD, path.c_str(), ent, &type)) {
+      PDIE("lstating file '%s'", path.c_str());
+    }
+    return type;
+  }
+
+  // Determines the type of the entry ent, which is called name in the
+  // directory dirfd. Returns false with errno set on failure.
+  static bool DentryToFileTypeAt(int dirfd, const char *name,
+                                 struct dirent *ent, FileType *type) {
 #ifdef _DIRENT_HAVE_D_TYPE
     if (ent->d_type != DT_UNKNOWN) {
       if (ent->d_type == DT_DIR) {
-        return FILE_TYPE_DIRECTORY;
+        *type = FILE_TYPE_DIRECTORY;
       } else if (ent->d_type == DT_LNK) {
-        return FILE_TYPE_SYMLINK;
+        *type = FILE_TYPE_SYMLINK;
       } else {
-        return FILE_TYPE_REGULAR;
+        *type = FILE_TYPE_REGULAR;
       }
-    } else  // NOLINT (the brace is in the next line)
+      return true;
+    }
 #endif
-    {
-      struct stat st;
-      LStatOrDie(path, &st);
-      if (S_ISDIR(st.st_mode)) {
-        return FILE_TYPE_DIRECTORY;
-      } else if (S_ISLNK(st.st_mode)) {
-        return FILE_TYPE_SYMLINK;
-      } else {
-        return FILE_TYPE_REGULAR;
-      }
+    struct stat st;
+    if (fstatat(dirfd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+      return false;
+    }
+    if (S_ISDIR(st.st_mode)) {
+      *type = FILE_TYPE_DIRECTORY;
+    } else if (S_ISLNK(st.st_mode)) {
+      *type = FILE_TYPE_SYMLINK;
+    } else {
+      *type = FILE_TYPE_REGULAR;
     }
+    return true;
   }
 
   void LStatOrDie(const std::string &path, struct stat *st) {
@@ -369,48 +1202,94 @@ class RunfilesCreator {
     }
   }
 
-  bool DelTree(const std::string &path, FileType file_type) {
+  // Deletes the file or directory tree called name in the directory dirfd,
+  // whose path relative to the output base is path, using paths relative to
+  // directory fds throughout. Returns false and records the error in errors on
+  // failure.
+  static bool DelTree(int dirfd, const std::string &name,
+                      const std::string &path, FileType file_type,
+                      PathErrors *errors) {
     if (file_type != FILE_TYPE_DIRECTORY) {
-      if (unlink(path.c_str()) != 0) {
+      if (unlinkat(dirfd, name.c_str(), 0) != 0) {
 #if !defined(__CYGWIN__)
-        PDIE("unlinking '%s'", path.c_str());
+        errors->Add(path, "unlinking '" + path + "'", errno);
 #endif
         return false;
       }
       return true;
     }
 
-    EnsureDirReadAndWritePerms(path);
+    // Ensure that we can read and write the directory.
+    const int kMode = 0700;
+    struct stat st;
+    if (fstatat(dirfd, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0) {
+      errors->Add(path, "lstating file '" + path + "'", errno);
+      return false;
+    }
+    if ((st.st_mode & kMode) != kMode &&
+        fchmodat(dirfd, name.c_str(), st.st_mode | kMode, 0) != 0) {
+      errors->Add(path, "chmod '" + path + "'", errno);
+      return false;
+    }
 
-    struct dirent *entry;
-    DIR *dh = opendir(path.c_str());
+    int fd = openat(dirfd, name.c_str(),
+                    O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    DIR *dh = fd < 0 ? nullptr : fdopendir(fd);
     if (!dh) {
-      PDIE("opendir '%s'", path.c_str());
+      errors->Add(path, "opendir '" + path + "'", errno);
+      if (fd >= 0) {
+        close(fd);
+      }
+      return false;
     }
+    bool ok = true;
+    struct dirent *entry;
     errno = 0;
     while ((entry = readdir(dh)) != nullptr) {
       if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) continue;
       const std::string entry_path = path + '/' + entry->d_name;
-      FileType entry_file_type = DentryToFileType(entry_path, entry);
-      DelTree(entry_path, entry_file_type);
+      FileType entry_file_type;
+      if (!DentryToFileTypeAt(fd, entry->d_name, entry, &entry_file_type)) {
+        errors->Add(entry_path, "lstating file '" + entry_path + "'", errno);
+        ok = false;
+      } else {
+        ok = DelTree(fd, entry->d_name, entry_path, entry_file_type,
+                     errors) && ok;
+      }
       errno = 0;
     }
     if (errno != 0) {
-      PDIE("readdir '%s'", path.c_str());
+      errors->Add(path, "readdir '" + path + "'", errno);
+      ok = false;
     }
     closedir(dh);
-    if (rmdir(path.c_str()) != 0) {
-      PDIE("rmdir '%s'", path.c_str());
+    if (ok && unlinkat(dirfd, name.c_str(), AT_REMOVEDIR) != 0) {
+      errors->Add(path, "rmdir '" + path + "'", errno);
+      ok = false;
     }
-    return true;
+    return ok;
   }
 
  private:
   std::string output_base_;
   std::string output_filename_;
   std::string temp_filename_;
+  std::string materialization_filename_;
+  bool use_metadata_;
+  Materialization materialization_;
+
+  ManifestTree manifest_;
+  // The output manifest of the previous run, if the tree still matches it.
+  ManifestTree previous_manifest_;
+  bool have_previous_manifest_;
 
-  FileInfoMap manifest_;
+  // An entry that ScanTreeAndPrune() found not to match manifest_.
+  struct StaleEntry {
+    std::string path;
+    FileType type;
+    uint32_t node;  // in manifest_, or kNone if it is not there at all
+  };
+  std::vector<StaleEntry> stale_;
 };
 
 int main(int argc, char **argv) {
@@ -419,6 +1298,9 @@ int main(int argc, char **argv) {
   argc--; argv++;
   bool allow_relative = false;
   bool use_metadata = false;
+  bool bad_flag = false;
+  Materialization materialization = MATERIALIZE_SYMLINK;
+  static const char kMaterializationFlag[] = "--materialization=";
 
   while (argc >= 1) {
     if (strcmp(argv[0], "--allow_relative") == 0) {
@@ -427,14 +1309,22 @@ int main(int argc, char **argv) {
     } else if (strcmp(argv[0], "--use_metadata") == 0) {
       use_metadata = true;
       argc--; argv++;
+    } else if (strncmp(argv[0], kMaterializationFlag,
+                       sizeof(kMaterializationFlag) - 1) == 0) {
+      if (!ParseMaterialization(argv[0] + sizeof(kMaterializationFlag) - 1,
+                                &materialization)) {
+        bad_flag = true;
+      }
+      argc--; argv++;
     } else {
       break;
     }
   }
 
-  if (argc != 2) {
+  if (argc != 2 || bad_flag) {
     fprintf(stderr, "usage: %s "
             "[--allow_relative] [--use_metadata] "
+            "[--materialization=symlink|hardlink|reflink|copy] "
             "INPUT RUNFILES\n",
             argv0);
     return 1;
@@ -452,8 +1342,9 @@ int main(int argc, char **argv) {
     manifest_file = std::string(cwd_buf) + '/' + manifest_file;
   }
 
-  RunfilesCreator runfiles_creator(output_base_dir);
-  runfiles_creator.ReadManifest(manifest_file, allow_relative, use_metadata);
+  RunfilesCreator runfiles_creator(output_base_dir, use_metadata,
+                                   materialization);
+  runfiles_creator.ReadManifest(manifest_file, allow_relative);
   runfiles_creator.CreateRunfiles();
 
   return 0;
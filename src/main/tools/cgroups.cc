@@ -0,0 +1,275 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/tools/cgroups.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+
+#include "src/main/protobuf/execution_statistics.pb.h"
+#include "src/main/tools/logging.h"
+
+// The period for cpu.max, in microseconds. This is the kernel's default.
+static const int64_t kCpuMaxPeriodUsec = 100000;
+
+// Reads the file called name in cgroup into *content. Returns false if the
+// file does not exist, e.g. because its controller is not enabled.
+static bool ReadCgroupFile(const std::string &cgroup, const char *name,
+                           std::string *content) {
+  std::string path = cgroup + "/" + name;
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    if (errno == ENOENT) {
+      return false;
+    }
+    DIE("open(%s)", path.c_str());
+  }
+  content->clear();
+  char buf[4096];
+  ssize_t n;
+  while ((n = read(fd, buf, sizeof(buf))) != 0) {
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      DIE("read(%s)", path.c_str());
+    }
+    content->append(buf, n);
+  }
+  close(fd);
+  return true;
+}
+
+// Writes content to the file called name in cgroup. Returns false and leaves
+// errno set if that fails.
+static bool WriteCgroupFile(const std::string &cgroup, const char *name,
+                            const std::string &content) {
+  std::string path = cgroup + "/" + name;
+  int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  bool ok = write(fd, content.data(), content.size()) ==
+            static_cast<ssize_t>(content.size());
+  int saved_errno = errno;
+  close(fd);
+  errno = saved_errno;
+  return ok;
+}
+
+// Returns the value of key in content, which consists of "<key> <value>"
+// lines, or 0 if there is none.
+static int64_t GetKeyedValue(const std::string &content, const char *key) {
+  std::istringstream lines(content);
+  std::string line;
+  size_t key_length = strlen(key);
+  while (std::getline(lines, line)) {
+    if (line.compare(0, key_length, key) == 0 && line.size() > key_length &&
+        line[key_length] == ' ') {
+      return strtoll(line.c_str() + key_length + 1, nullptr, 10);
+    }
+  }
+  return 0;
+}
+
+// Returns the sum of all "<key>=<value>" fields in content.
+static int64_t SumNestedKeyedValues(const std::string &content,
+                                    const std::string &key) {
+  std::istringstream fields(content);
+  std::string field;
+  int64_t sum = 0;
+  while (fields >> field) {
+    if (field.size() > key.size() && field.compare(0, key.size(), key) == 0 &&
+        field[key.size()] == '=') {
+      sum += strtoll(field.c_str() + key.size() + 1, nullptr, 10);
+    }
+  }
+  return sum;
+}
+
+// Returns the "total" field of the "some" or "full" line of a pressure stall
+// information file.
+static int64_t GetPressureTotal(const std::string &content, const char *line) {
+  std::istringstream lines(content);
+  std::string current;
+  while (std::getline(lines, current)) {
+    if (current.compare(0, strlen(line), line) == 0) {
+      return SumNestedKeyedValues(current, "total");
+    }
+  }
+  return 0;
+}
+
+// Enables the controllers we care about for the children of parent, as far as
+// parent has them.
+static void EnableControllers(const std::string &parent) {
+  std::string available, enabled;
+  if (!ReadCgroupFile(parent, "cgroup.controllers", &available) ||
+      !ReadCgroupFile(parent, "cgroup.subtree_control", &enabled)) {
+    errno = ENOENT;
+    DIE("%s is not a cgroup v2 directory", parent.c_str());
+  }
+  for (const char *controller : {"memory", "cpu", "io", "pids"}) {
+    std::istringstream available_controllers(available);
+    std::istringstream enabled_controllers(enabled);
+    std::string name;
+    bool is_available = false;
+    while (available_controllers >> name) {
+      is_available |= name == controller;
+    }
+    bool is_enabled = false;
+    while (enabled_controllers >> name) {
+      is_enabled |= name == controller;
+    }
+    if (is_available && !is_enabled &&
+        !WriteCgroupFile(parent, "cgroup.subtree_control",
+                         std::string("+") + controller)) {
+      // This fails if parent contains processes itself. The limits that need
+      // the controller will fail below, and its statistics are just missing.
+      PRINT_DEBUG("cannot enable the %s controller in %s: %s", controller,
+                  parent.c_str(), strerror(errno));
+    }
+  }
+}
+
+// Writes a limit to the file called name in cgroup, dying if that fails.
+static void SetCgroupLimit(const std::string &cgroup, const char *name,
+                           const std::string &value) {
+  PRINT_DEBUG("%s: %s", name, value.c_str());
+  if (!WriteCgroupFile(cgroup, name, value)) {
+    DIE("could not set %s of %s to %s (is its controller enabled?)", name,
+        cgroup.c_str(), value.c_str());
+  }
+}
+
+std::string CreateCgroup(const std::string &parent, const std::string &name,
+                         const CgroupLimits &limits) {
+  EnableControllers(parent);
+
+  std::string cgroup = parent + "/" + name + "-" + std::to_string(getpid());
+  PRINT_DEBUG("cgroup: %s", cgroup.c_str());
+  if (mkdir(cgroup.c_str(), 0755) < 0) {
+    // A previous process with our PID may have died before cleaning up.
+    if (errno != EEXIST || rmdir(cgroup.c_str()) < 0 ||
+        mkdir(cgroup.c_str(), 0755) < 0) {
+      DIE("mkdir(%s)", cgroup.c_str());
+    }
+  }
+
+  if (limits.memory_max_bytes > 0) {
+    SetCgroupLimit(cgroup, "memory.max",
+                   std::to_string(limits.memory_max_bytes));
+  }
+  if (limits.cpu_max > 0) {
+    // The kernel rejects quotas below one millisecond.
+    int64_t quota =
+        std::max<int64_t>(1000, llround(limits.cpu_max * kCpuMaxPeriodUsec));
+    SetCgroupLimit(cgroup, "cpu.max",
+                   std::to_string(quota) + " " +
+                       std::to_string(kCpuMaxPeriodUsec));
+  }
+  if (limits.pids_max > 0) {
+    SetCgroupLimit(cgroup, "pids.max", std::to_string(limits.pids_max));
+  }
+  return cgroup;
+}
+
+int OpenCgroupProcs(const std::string &cgroup) {
+  std::string path = cgroup + "/cgroup.procs";
+  int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+  if (fd < 0) {
+    DIE("open(%s)", path.c_str());
+  }
+  return fd;
+}
+
+void JoinCgroup(int procs_fd) {
+  // "0" stands for the writing process, whatever its PID namespace.
+  if (write(procs_fd, "0", 1) != 1) {
+    DIE("could not join cgroup");
+  }
+  if (close(procs_fd) < 0) {
+    DIE("close");
+  }
+}
+
+void EmptyCgroup(const std::string &cgroup) {
+  std::string events;
+  while (ReadCgroupFile(cgroup, "cgroup.events", &events) &&
+         GetKeyedValue(events, "populated") != 0) {
+    // cgroup.kill only exists since Linux 5.14.
+    if (!WriteCgroupFile(cgroup, "cgroup.kill", "1")) {
+      std::string procs;
+      ReadCgroupFile(cgroup, "cgroup.procs", &procs);
+      std::istringstream pids(procs);
+      pid_t pid;
+      while (pids >> pid) {
+        kill(pid, SIGKILL);
+      }
+    }
+    usleep(1000);
+  }
+}
+
+void ReadCgroupUsage(const std::string &cgroup,
+                     tools::protos::CgroupUsage *usage) {
+  std::string content;
+  if (ReadCgroupFile(cgroup, "memory.peak", &content)) {
+    usage->set_memory_peak_bytes(strtoll(content.c_str(), nullptr, 10));
+  }
+  if (ReadCgroupFile(cgroup, "memory.events", &content)) {
+    usage->set_memory_oom_kills(GetKeyedValue(content, "oom_kill"));
+  }
+  if (ReadCgroupFile(cgroup, "cpu.stat", &content)) {
+    usage->set_cpu_usage_usec(GetKeyedValue(content, "usage_usec"));
+    usage->set_cpu_user_usec(GetKeyedValue(content, "user_usec"));
+    usage->set_cpu_system_usec(GetKeyedValue(content, "system_usec"));
+  }
+  if (ReadCgroupFile(cgroup, "io.stat", &content)) {
+    usage->set_io_read_bytes(SumNestedKeyedValues(content, "rbytes"));
+    usage->set_io_write_bytes(SumNestedKeyedValues(content, "wbytes"));
+  }
+  if (ReadCgroupFile(cgroup, "pids.peak", &content)) {
+    usage->set_pids_peak(strtoll(content.c_str(), nullptr, 10));
+  }
+  if (ReadCgroupFile(cgroup, "cpu.pressure", &content)) {
+    usage->set_cpu_pressure_some_usec(GetPressureTotal(content, "some"));
+  }
+  if (ReadCgroupFile(cgroup, "memory.pressure", &content)) {
+    usage->set_memory_pressure_some_usec(GetPressureTotal(content, "some"));
+    usage->set_memory_pressure_full_usec(GetPressureTotal(content, "full"));
+  }
+  if (ReadCgroupFile(cgroup, "io.pressure", &content)) {
+    usage->set_io_pressure_some_usec(GetPressureTotal(content, "some"));
+    usage->set_io_pressure_full_usec(GetPressureTotal(content, "full"));
+  }
+}
+
+void RemoveCgroup(const std::string &cgroup) {
+  if (rmdir(cgroup.c_str()) < 0) {
+    DIE("rmdir(%s)", cgroup.c_str());
+  }
+}
@@ -0,0 +1,67 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Helpers for running a command in its own cgroup (v2 only), which accounts
+// for and limits the resources of all of its processes.
+
+#ifndef SRC_MAIN_TOOLS_CGROUPS_H_
+#define SRC_MAIN_TOOLS_CGROUPS_H_
+
+#include <stdint.h>
+#include <string>
+
+namespace tools {
+namespace protos {
+class CgroupUsage;
+}  // namespace protos
+}  // namespace tools
+
+// Resource limits for a cgroup. Non-positive values mean no limit.
+struct CgroupLimits {
+  // Maximum memory usage in bytes (memory.max)
+  int64_t memory_max_bytes;
+  // Maximum CPU bandwidth in CPUs (cpu.max)
+  double cpu_max;
+  // Maximum number of processes (pids.max)
+  int64_t pids_max;
+};
+
+// Creates a new cgroup called <name>-<our pid> below parent, which must be a
+// cgroup v2 directory that we may write to, applies the given limits to it
+// and returns its path. The memory, cpu, io and pids controllers are enabled
+// for the children of parent if possible.
+std::string CreateCgroup(const std::string &parent, const std::string &name,
+                         const CgroupLimits &limits);
+
+// Opens the cgroup.procs file of cgroup for JoinCgroup. The descriptor keeps
+// working after a switch to a read-only mount namespace, and since Linux 5.16,
+// the kernel checks the permissions of its opener rather than of the writer,
+// which might be in a user namespace by then.
+int OpenCgroupProcs(const std::string &cgroup);
+
+// Moves the calling process into the cgroup whose cgroup.procs file procs_fd
+// refers to, and closes procs_fd.
+void JoinCgroup(int procs_fd);
+
+// Kills all processes left in cgroup and waits until they are gone.
+void EmptyCgroup(const std::string &cgroup);
+
+// Reads the resource usage accounted to cgroup into usage.
+void ReadCgroupUsage(const std::string &cgroup,
+                     tools::protos::CgroupUsage *usage);
+
+// Removes cgroup, which must be empty.
+void RemoveCgroup(const std::string &cgroup);
+
+#endif  // SRC_MAIN_TOOLS_CGROUPS_H_
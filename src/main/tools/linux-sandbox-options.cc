@@ -15,6 +15,8 @@
 #include "src/main/tools/linux-sandbox-options.h"
 
 #include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
 #include <sched.h>
 #include <stdarg.h>
 #include <stdbool.h>
@@ -46,13 +48,17 @@ static void Usage(char *program_name, const char *fmt, ...) {
   vfprintf(stderr, fmt, ap);
   va_end(ap);
 
-  fprintf(stderr, "\nUsage: %s -- command arg1 @args\n", program_name);
+  fprintf(stderr,
+          "\nUsage: %s [--connect <socket>] -- command arg1 @args\n"
+          "       %s --server <socket> [-R | -U] [-D]\n",
+          program_name, program_name);
   fprintf(stderr,
           "\nPossible arguments:\n"
           "  -W <working-dir>  working directory (uses current directory if "
           "not specified)\n"
-          "  -T <timeout>  timeout after which the child process will be "
-          "terminated with SIGTERM\n"
+          "  -T <timeout>  timeout (in seconds, may be fractional) after which "
+          "the child process\n"
+          "    will be terminated with SIGTERM\n"
           "  -t <timeout>  in case timeout occurs, how long to wait before "
           "killing the child with SIGKILL\n"
           "  -l <file>  redirect stdout to a file\n"
@@ -65,17 +71,56 @@ static void Usage(char *program_name, const char *fmt, ...) {
           "mounted readonly.\n"
           "    The -M option specifies which directory to mount, the -m option "
           "specifies where to\n"
+          "  --bind_mounts <file>  read more -M/-m pairs from a file, one per "
+          "line: the source,\n"
+          "    optionally followed by a tab and the target\n"
           "  -S <file>  if set, write stats in protobuf format to a file\n"
           "  -H  if set, make hostname in the sandbox equal to 'localhost'\n"
           "  -N  if set, a new network namespace will be created\n"
           "  -R  if set, make the uid/gid be root\n"
           "  -U  if set, make the uid/gid be nobody\n"
           "  -D  if set, debug info will be printed\n"
+          "  --server <socket>  serve sandboxes on a Unix socket instead of "
+          "running a command\n"
+          "  --connect <socket>  run the command on a sandbox server; -R and -U "
+          "must match\n"
+          "    the server's\n"
+          "  --remount_each_mount  make the filesystem read-only one mount at "
+          "a time, as on\n"
+          "    kernels without mount_setattr (for benchmarking)\n"
+          "  --overlay_upper <dir>  mount an overlay filesystem on the working "
+          "directory,\n"
+          "    sending all writes to <dir>; requires --overlay_work and at least "
+          "one of:\n"
+          "  --overlay_lower <dir>  read-only directory to show below the "
+          "upper directory\n"
+          "  --overlay_inputs <file>  manifest of inputs to create above "
+          "--overlay_lower, one\n"
+          "    \"<path relative to working dir> <symlink target>\" per line "
+          "(empty target:\n"
+          "    empty file)\n"
+          "  --overlay_work <dir>  empty directory on the same filesystem as "
+          "the upper one\n"
+          "  --cgroup_parent <dir>  run the sandbox in a new cgroup (v2) below "
+          "<dir>, adding\n"
+          "    its resource usage to the stats\n"
+          "  --memory_max <bytes>  limit the memory usage of that cgroup\n"
+          "  --cpu_max <cpus>  limit the CPU bandwidth of that cgroup\n"
+          "  --pids_max <count>  limit the number of processes in that cgroup\n"
+          "  --trace  record which files the command accessed in <stats "
+          "file>.trace (requires -S)\n"
           "  @FILE  read newline-separated arguments from FILE\n"
           "  --  command to run inside sandbox, followed by arguments\n");
   exit(EXIT_FAILURE);
 }
 
+static void ValidateIsAbsoluteOverlayPath(char *path, char *program_name) {
+  if (path[0] != '/') {
+    Usage(program_name,
+          "The --overlay options must be used with absolute paths only.");
+  }
+}
+
 static void ValidateIsAbsolutePath(char *path, char *program_name, char flag) {
   if (path[0] != '/') {
     Usage(program_name, "The -%c option must be used with absolute paths only.",
@@ -83,6 +128,45 @@ static void ValidateIsAbsolutePath(char *path, char *program_name, char flag) {
   }
 }
 
+// Adds the bind mounts listed in the file at path, one per line: the source,
+// optionally followed by a tab and the target, like -M and -m.
+static void ReadBindMounts(const char *path, char *program_name) {
+  FILE *file = fopen(path, "re");
+  if (file == nullptr) {
+    DIE("fopen(%s)", path);
+  }
+
+  char *line = nullptr;
+  size_t line_size = 0;
+  ssize_t line_length;
+  while ((line_length = getline(&line, &line_size, file)) > 0) {
+    if (line[line_length - 1] == '\n') {
+      line[--line_length] = '\0';
+    }
+    if (line_length == 0) {
+      continue;
+    }
+    char *target = strchr(line, '\t');
+    if (target != nullptr) {
+      *target++ = '\0';
+    } else {
+      target = line;
+    }
+    if (line[0] != '/' || target[0] != '/') {
+      Usage(program_name,
+            "The --bind_mounts file must contain absolute paths only: %s",
+            line);
+    }
+    opt.bind_mount_sources.emplace_back(line);
+    opt.bind_mount_targets.emplace_back(target);
+  }
+  if (ferror(file)) {
+    DIE("getline(%s)", path);
+  }
+  free(line);
+  fclose(file);
+}
+
 // Parses command line flags from an argv array and puts the results into an
 // Options structure passed in as an argument.
 static void ParseCommandLine(unique_ptr<vector<char *>> args) {
@@ -91,8 +175,42 @@ static void ParseCommandLine(unique_ptr<vector<char *>> args) {
   int c;
   bool source_specified = false;
 
-  while ((c = getopt(args->size(), args->data(),
-                     ":W:T:t:l:L:w:e:M:m:S:HNRUD")) != -1) {
+  enum {
+    kServerOption = 256,
+    kConnectOption,
+    kRemountEachMountOption,
+    kOverlayLowerOption,
+    kOverlayInputsOption,
+    kOverlayUpperOption,
+    kOverlayWorkOption,
+    kCgroupParentOption,
+    kMemoryMaxOption,
+    kCpuMaxOption,
+    kPidsMaxOption,
+    kTraceOption,
+    kBindMountsOption,
+  };
+  static struct option long_options[] = {
+      {"server", required_argument, nullptr, kServerOption},
+      {"connect", required_argument, nullptr, kConnectOption},
+      {"remount_each_mount", no_argument, nullptr, kRemountEachMountOption},
+      {"overlay_lower", required_argument, nullptr, kOverlayLowerOption},
+      {"overlay_inputs", required_argument, nullptr, kOverlayInputsOption},
+      {"overlay_upper", required_argument, nullptr, kOverlayUpperOption},
+      {"overlay_work", required_argument, nullptr, kOverlayWorkOption},
+      {"cgroup_parent", required_argument, nullptr, kCgroupParentOption},
+      {"memory_max", required_argument, nullptr, kMemoryMaxOption},
+      {"cpu_max", required_argument, nullptr, kCpuMaxOption},
+      {"pids_max", required_argument, nullptr, kPidsMaxOption},
+      {"trace", no_argument, nullptr, kTraceOption},
+      {"bind_mounts", required_argument, nullptr, kBindMountsOption},
+      {nullptr, 0, nullptr, 0}};
+
+  // Start from scratch, as a sandbox server parses each request's arguments.
+  optind = 0;
+  while ((c = getopt_long(args->size(), args->data(),
+                          ":W:T:t:l:L:w:e:M:m:S:HNRUD", long_options,
+                          nullptr)) != -1) {
     if (c != 'M' && c != 'm') source_specified = false;
     switch (c) {
       case 'W':
@@ -105,13 +223,13 @@ static void ParseCommandLine(unique_ptr<vector<char *>> args) {
         }
         break;
       case 'T':
-        if (sscanf(optarg, "%d", &opt.timeout_secs) != 1 ||
+        if (sscanf(optarg, "%lf", &opt.timeout_secs) != 1 ||
             opt.timeout_secs < 0) {
           Usage(args->front(), "Invalid timeout (-T) value: %s", optarg);
         }
         break;
       case 't':
-        if (sscanf(optarg, "%d", &opt.kill_delay_secs) != 1 ||
+        if (sscanf(optarg, "%lf", &opt.kill_delay_secs) != 1 ||
             opt.kill_delay_secs < 0) {
           Usage(args->front(), "Invalid kill delay (-t) value: %s", optarg);
         }
@@ -190,6 +308,55 @@ static void ParseCommandLine(unique_ptr<vector<char *>> args) {
       case 'D':
         opt.debug = true;
         break;
+      case kServerOption:
+        opt.server_socket.assign(optarg);
+        break;
+      case kConnectOption:
+        opt.connect_socket.assign(optarg);
+        break;
+      case kRemountEachMountOption:
+        opt.remount_each_mount = true;
+        break;
+      case kOverlayLowerOption:
+        ValidateIsAbsoluteOverlayPath(optarg, args->front());
+        opt.overlay_lower.assign(optarg);
+        break;
+      case kOverlayInputsOption:
+        opt.overlay_inputs.assign(optarg);
+        break;
+      case kOverlayUpperOption:
+        ValidateIsAbsoluteOverlayPath(optarg, args->front());
+        opt.overlay_upper.assign(optarg);
+        break;
+      case kOverlayWorkOption:
+        ValidateIsAbsoluteOverlayPath(optarg, args->front());
+        opt.overlay_work.assign(optarg);
+        break;
+      case kCgroupParentOption:
+        opt.cgroup_parent.assign(optarg);
+        break;
+      case kMemoryMaxOption:
+        if (sscanf(optarg, "%" SCNd64, &opt.cgroup_limits.memory_max_bytes) !=
+            1) {
+          Usage(args->front(), "Invalid --memory_max value: %s", optarg);
+        }
+        break;
+      case kCpuMaxOption:
+        if (sscanf(optarg, "%lf", &opt.cgroup_limits.cpu_max) != 1) {
+          Usage(args->front(), "Invalid --cpu_max value: %s", optarg);
+        }
+        break;
+      case kPidsMaxOption:
+        if (sscanf(optarg, "%" SCNd64, &opt.cgroup_limits.pids_max) != 1) {
+          Usage(args->front(), "Invalid --pids_max value: %s", optarg);
+        }
+        break;
+      case kTraceOption:
+        opt.trace = true;
+        break;
+      case kBindMountsOption:
+        ReadBindMounts(optarg, args->front());
+        break;
       case '?':
         Usage(args->front(), "Unrecognized argument: -%c (%d)", optopt, optind);
         break;
@@ -257,6 +424,13 @@ void ParseOptions(int argc, char *argv[]) {
   vector<char *> args(argv, argv + argc);
   ParseCommandLine(ExpandArguments(args));
 
+  if (!opt.server_socket.empty()) {
+    if (!opt.args.empty() || !opt.connect_socket.empty()) {
+      Usage(args.front(), "--server does not take a command.");
+    }
+    return;
+  }
+
   if (opt.args.empty()) {
     Usage(args.front(), "No command specified.");
   }
@@ -264,4 +438,31 @@ void ParseOptions(int argc, char *argv[]) {
   if (opt.working_dir.empty()) {
     opt.working_dir = getcwd(nullptr, 0);
   }
+
+  if (opt.overlay_upper.empty()) {
+    if (!opt.overlay_lower.empty() || !opt.overlay_inputs.empty() ||
+        !opt.overlay_work.empty()) {
+      Usage(args.front(), "The --overlay options require --overlay_upper.");
+    }
+  } else if (opt.overlay_work.empty() ||
+             (opt.overlay_lower.empty() && opt.overlay_inputs.empty())) {
+    Usage(args.front(),
+          "--overlay_upper requires --overlay_work and --overlay_lower or "
+          "--overlay_inputs.");
+  }
+
+  if (opt.cgroup_parent.empty() &&
+      (opt.cgroup_limits.memory_max_bytes > 0 || opt.cgroup_limits.cpu_max > 0 ||
+       opt.cgroup_limits.pids_max > 0)) {
+    Usage(args.front(), "Limits require --cgroup_parent.");
+  }
+
+  if (opt.trace) {
+    if (opt.stats_path.empty()) {
+      Usage(args.front(), "--trace requires -S.");
+    }
+    if (!opt.connect_socket.empty()) {
+      Usage(args.front(), "--trace cannot be used with --connect.");
+    }
+  }
 }
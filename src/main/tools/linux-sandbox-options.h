@@ -20,14 +20,16 @@
 #include <string>
 #include <vector>
 
+#include "src/main/tools/cgroups.h"
+
 // Options parsing result.
 struct Options {
   // Working directory (-W)
   std::string working_dir;
   // How long to wait before killing the child (-T)
-  int timeout_secs;
+  double timeout_secs;
   // How long to wait before sending SIGKILL in case of timeout (-t)
-  int kill_delay_secs;
+  double kill_delay_secs;
   // Where to redirect stdout (-l)
   std::string stdout_path;
   // Where to redirect stderr (-L)
@@ -36,9 +38,11 @@ struct Options {
   std::vector<std::string> writable_files;
   // Directories where to mount an empty tmpfs (-e)
   std::vector<std::string> tmpfs_dirs;
-  // Source of files or directories to explicitly bind mount in the sandbox (-M)
+  // Source of files or directories to explicitly bind mount in the sandbox (-M,
+  // --bind_mounts)
   std::vector<std::string> bind_mount_sources;
-  // Target of files or directories to explicitly bind mount in the sandbox (-m)
+  // Target of files or directories to explicitly bind mount in the sandbox (-m,
+  // --bind_mounts)
   std::vector<std::string> bind_mount_targets;
   // Where to write stats, in protobuf format (-S)
   std::string stats_path;
@@ -52,6 +56,29 @@ struct Options {
   bool fake_username;
   // Print debugging messages (-D)
   bool debug;
+  // Remount each mount point separately instead of using mount_setattr
+  // (--remount_each_mount)
+  bool remount_each_mount;
+  // Unix socket on which to serve sandboxes (--server)
+  std::string server_socket;
+  // Unix socket of the server to run the command on (--connect)
+  std::string connect_socket;
+  // Read-only directory to use as the lower layer of an overlay filesystem on
+  // the working directory (--overlay_lower)
+  std::string overlay_lower;
+  // Manifest of inputs to create in a tmpfs above overlay_lower
+  // (--overlay_inputs)
+  std::string overlay_inputs;
+  // Directory receiving all writes to the overlay filesystem (--overlay_upper)
+  std::string overlay_upper;
+  // Empty directory on the same filesystem as overlay_upper (--overlay_work)
+  std::string overlay_work;
+  // Directory in which to create a cgroup for the sandbox (--cgroup_parent)
+  std::string cgroup_parent;
+  // Limits for that cgroup (--memory_max, --cpu_max, --pids_max)
+  CgroupLimits cgroup_limits;
+  // Whether to trace the command's file accesses (--trace)
+  bool trace;
   // Command to run (--)
   std::vector<char *> args;
 };
@@ -17,4 +17,13 @@
 
 int Pid1Main(void *sync_pipe_param);
 
+// Like Pid1Main, but for a sandbox cloned from the template namespaces of a
+// sandbox server, which already has its user namespace and a read-only
+// filesystem. Only the per-sandbox mounts are set up.
+int Pid1MainFromTemplate(void *sync_pipe_param);
+
+// Entry point of a sandbox server's template process: sets up the user and
+// mount namespaces shared by all sandboxes, then serves requests.
+int TemplateMain(void *sync_pipe_param);
+
 #endif
@@ -0,0 +1,338 @@
+// Copyright 2016 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/tools/linux-sandbox-server.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "src/main/tools/cgroups.h"
+#include "src/main/tools/linux-sandbox-options.h"
+#include "src/main/tools/linux-sandbox-pid1.h"
+#include "src/main/tools/linux-sandbox.h"
+#include "src/main/tools/logging.h"
+#include "src/main/tools/process-tools.h"
+
+// A request starts with a RequestHeader, which carries the client's stdin,
+// stdout and stderr as SCM_RIGHTS, optionally followed by the cgroup.procs file
+// of the cgroup that the sandbox should join. It is followed by payload_size
+// bytes: the client's working directory, its num_args arguments and its
+// environment, each terminated by '\0'.
+struct RequestHeader {
+  uint32_t payload_size;
+  uint32_t num_args;
+};
+
+// The reply to a request. Client and server are the same binary, so there is
+// no need for a more portable encoding.
+struct Response {
+  int32_t exit_code;
+  int32_t has_rusage;
+  struct rusage rusage;
+  struct ExecutionTimes times;
+};
+
+static const int kNumStdioFds = 3;
+static const int kMaxRequestFds = kNumStdioFds + 1;
+static const uint32_t kMaxPayloadSize = 64 * 1024 * 1024;
+
+// The socket on which the template receives the connections that RunServer()
+// accepted, one per message.
+static int global_request_fd = -1;
+
+// Receives a request on conn, installs the client's stdio as our own and
+// stores the payload in *payload and the number of arguments in *num_args.
+static void ReceiveRequest(int conn, std::vector<char> *payload,
+                           size_t *num_args) {
+  struct RequestHeader header;
+  int fds[kMaxRequestFds];
+  int num_fds =
+      ReceiveWithFds(conn, &header, sizeof(header), fds, kMaxRequestFds);
+  if (num_fds < 0) {
+    DIE("recvmsg");
+  }
+  if ((num_fds != kNumStdioFds && num_fds != kMaxRequestFds) ||
+      header.payload_size == 0 || header.payload_size > kMaxPayloadSize ||
+      header.num_args == 0) {
+    errno = EPROTO;
+    DIE("malformed request");
+  }
+
+  if (num_fds == kMaxRequestFds) {
+    global_cgroup_procs_fd = fds[kNumStdioFds];
+  }
+  for (int i = 0; i < kNumStdioFds; i++) {
+    if (dup2(fds[i], i) < 0) {
+      DIE("dup2");
+    }
+    if (close(fds[i]) < 0) {
+      DIE("close");
+    }
+  }
+
+  *num_args = header.num_args;
+  payload->resize(header.payload_size);
+  if (!ReadAll(conn, payload->data(), payload->size())) {
+    DIE("read");
+  }
+  if (payload->back() != '\0') {
+    errno = EPROTO;
+    DIE("malformed request");
+  }
+}
+
+// Runs one sandbox for the client on conn. Runs in a child of the template.
+static int HandleRequest(int conn) {
+  // Our sandbox must not outlive the server.
+  if (prctl(PR_SET_PDEATHSIG, SIGKILL) < 0) {
+    DIE("prctl");
+  }
+  InstallDefaultSignalHandler(SIGCHLD);
+
+  std::vector<char> payload;
+  size_t num_args;
+  ReceiveRequest(conn, &payload, &num_args);
+  std::vector<char *> strings;
+  for (size_t i = 0; i < payload.size(); i += strlen(&payload[i]) + 1) {
+    strings.push_back(&payload[i]);
+  }
+  if (strings.size() < 1 + num_args) {
+    errno = EPROTO;
+    DIE("malformed request");
+  }
+  const char *cwd = strings[0];
+  std::vector<char *> args(strings.begin() + 1,
+                           strings.begin() + 1 + num_args);
+  std::vector<char *> env(strings.begin() + 1 + num_args, strings.end());
+  env.push_back(nullptr);
+  if (chdir(cwd) < 0) {
+    DIE("chdir(%s)", cwd);
+  }
+  // The command runs with the client's environment, not ours.
+  environ = env.data();
+
+  // The user namespace of the template fixes the identity of the sandboxed
+  // process.
+  bool fake_root = opt.fake_root;
+  bool fake_username = opt.fake_username;
+  bool debug = opt.debug;
+  opt = Options();
+  ParseOptions(args.size(), args.data());
+  if (opt.fake_root != fake_root || opt.fake_username != fake_username) {
+    fprintf(stderr,
+            "linux-sandbox: -R and -U must be the same for the server and its "
+            "clients.\n");
+    return EXIT_FAILURE;
+  }
+  opt.debug |= debug;
+  global_debug = opt.debug;
+
+  // The client has already redirected its output according to -l and -L, and
+  // writes the statistics for -S itself.
+  struct Response response = {};
+  response.has_rusage = !opt.stats_path.empty();
+  response.exit_code = RunSandbox(
+      true, response.has_rusage ? &response.rusage : nullptr,
+      response.has_rusage ? &response.times : nullptr, conn);
+  if (!WriteAll(conn, &response, sizeof(response))) {
+    PRINT_DEBUG("failed to send the response: %s", strerror(errno));
+  }
+  return EXIT_SUCCESS;
+}
+
+int ServeSandboxes() {
+  // Handlers are never waited for, so have the kernel reap them.
+  IgnoreSignal(SIGCHLD);
+  IgnoreSignal(SIGPIPE);
+
+  PRINT_DEBUG("serving sandboxes on %s", opt.server_socket.c_str());
+  while (true) {
+    char token;
+    int conn;
+    int num_fds = ReceiveWithFds(global_request_fd, &token, 1, &conn, 1);
+    if (num_fds < 0) {
+      if (errno == EPIPE) {
+        // RunServer() is gone.
+        return EXIT_SUCCESS;
+      }
+      DIE("recvmsg");
+    } else if (num_fds != 1) {
+      errno = EPROTO;
+      DIE("malformed connection");
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+      // The client notices the closed connection and fails the request.
+      PRINT_DEBUG("fork: %s", strerror(errno));
+    } else if (pid == 0) {
+      if (close(global_request_fd) < 0) {
+        DIE("close");
+      }
+      _exit(HandleRequest(conn));
+    }
+    if (close(conn) < 0) {
+      DIE("close");
+    }
+  }
+}
+
+// Returns whether the peer of conn runs as our own user.
+static bool IsOwnUser(int conn) {
+  struct ucred cred;
+  socklen_t cred_len = sizeof(cred);
+  if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) < 0) {
+    DIE("getsockopt(SO_PEERCRED)");
+  }
+  if (cred.uid != getuid()) {
+    PRINT_DEBUG("rejecting request from UID %d", cred.uid);
+    return false;
+  }
+  return true;
+}
+
+int RunServer() {
+  int listen_fd = ListenOnSocket(opt.server_socket);
+
+  // Connections are accepted out here and handed to the template, because
+  // SO_PEERCRED translates UIDs into the user namespace of the caller. In the
+  // template's, every unmapped user shows up as the overflow UID, which is
+  // also what -U maps us to.
+  int request_fds[2];
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, request_fds) < 0) {
+    DIE("socketpair");
+  }
+  global_request_fd = request_fds[1];
+  pid_t pid = CloneWithSyncPipe(TemplateMain,
+                                CLONE_NEWUSER | CLONE_NEWNS | SIGCHLD);
+  PRINT_DEBUG("sandbox server template has PID %d", pid);
+  if (close(request_fds[1]) < 0) {
+    DIE("close");
+  }
+
+  // Stop accepting once the template is gone, which hangs up its end.
+  struct pollfd fds[2] = {{listen_fd, POLLIN, 0}, {request_fds[0], 0, 0}};
+  while (true) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      DIE("poll");
+    }
+    if (fds[1].revents != 0) {
+      break;
+    }
+    int conn = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (conn < 0) {
+      if (errno == EINTR || errno == ECONNABORTED || errno == EAGAIN) {
+        continue;
+      }
+      DIE("accept4");
+    }
+    char token = 0;
+    if (IsOwnUser(conn) && !SendWithFds(request_fds[0], &token, 1, &conn, 1)) {
+      PRINT_DEBUG("sendmsg: %s", strerror(errno));
+    }
+    if (close(conn) < 0) {
+      DIE("close");
+    }
+  }
+  if (close(listen_fd) < 0 || close(request_fds[0]) < 0) {
+    DIE("close");
+  }
+
+  int status = WaitChild(pid);
+  if (WIFSIGNALED(status)) {
+    return 128 + WTERMSIG(status);
+  }
+  return WEXITSTATUS(status);
+}
+
+int RunClient(int argc, char *argv[]) {
+  int conn = ConnectToSocket(opt.connect_socket);
+
+  std::string payload;
+  char *cwd = getcwd(nullptr, 0);
+  if (cwd == nullptr) {
+    DIE("getcwd");
+  }
+  payload.append(cwd);
+  payload.push_back('\0');
+  free(cwd);
+  for (int i = 0; i < argc; i++) {
+    payload.append(argv[i]);
+    payload.push_back('\0');
+  }
+  for (char **var = environ; *var != nullptr; var++) {
+    payload.append(*var);
+    payload.push_back('\0');
+  }
+
+  // The cgroup is managed from out here, where its files are writable.
+  std::string cgroup;
+  int num_fds = kNumStdioFds;
+  int fds[kMaxRequestFds] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO, -1};
+  if (!opt.cgroup_parent.empty()) {
+    cgroup = CreateCgroup(opt.cgroup_parent, "linux-sandbox", opt.cgroup_limits);
+    fds[num_fds++] = OpenCgroupProcs(cgroup);
+  }
+
+  struct RequestHeader header;
+  header.payload_size = payload.size();
+  header.num_args = argc;
+  if (!SendWithFds(conn, &header, sizeof(header), fds, num_fds)) {
+    DIE("sendmsg");
+  }
+  if (!WriteAll(conn, payload.data(), payload.size())) {
+    DIE("write");
+  }
+  if (num_fds > kNumStdioFds && close(fds[kNumStdioFds]) < 0) {
+    DIE("close");
+  }
+
+  struct Response response;
+  if (!ReadAll(conn, &response, sizeof(response))) {
+    // The handler has already reported why on our stderr.
+    PRINT_DEBUG("no response from the sandbox server: %s", strerror(errno));
+    response.exit_code = EXIT_FAILURE;
+    response.has_rusage = false;
+  }
+  if (!cgroup.empty()) {
+    EmptyCgroup(cgroup);
+  }
+  if (response.has_rusage && !opt.stats_path.empty()) {
+    WriteStatsToFile(&response.rusage, cgroup, &response.times,
+                     opt.stats_path);
+  }
+  if (!cgroup.empty()) {
+    RemoveCgroup(cgroup);
+  }
+  return response.exit_code;
+}
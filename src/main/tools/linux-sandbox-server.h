@@ -0,0 +1,42 @@
+// Copyright 2016 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A sandbox server (linux-sandbox --server <socket>) pays for the expensive
+// part of the sandbox setup only once: its "template" process creates the
+// user namespace and a private mount namespace in which the whole filesystem
+// is made read-only. The server accepts requests on a Unix domain socket,
+// checks that they come from its own user and hands them to the template; for
+// each one, the template forks a handler that clones a fresh PID 1 sharing the
+// template's user namespace and copying its mount namespace, so only the
+// per-action mounts remain to be done.
+//
+// Requests are sent by linux-sandbox --connect <socket>, which takes the usual
+// arguments and passes its working directory, arguments, environment and stdio
+// to the server.
+
+#ifndef SRC_MAIN_TOOLS_LINUX_SANDBOX_SERVER_H_
+#define SRC_MAIN_TOOLS_LINUX_SANDBOX_SERVER_H_
+
+// Listens on opt.server_socket and passes the connections of our own user to
+// the template process until it dies.
+int RunServer();
+
+// Accepts and serves requests. Runs in the template process.
+int ServeSandboxes();
+
+// Runs the command given by argv on the server at opt.connect_socket and
+// returns its exit code.
+int RunClient(int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,521 @@
+// Copyright 2017 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/tools/linux-sandbox-trace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "src/main/protobuf/execution_statistics.pb.h"
+#include "src/main/tools/logging.h"
+
+#if defined(__x86_64__)
+static const uint32_t kAuditArch = AUDIT_ARCH_X86_64;
+#elif defined(__aarch64__)
+static const uint32_t kAuditArch = AUDIT_ARCH_AARCH64;
+#else
+static const uint32_t kAuditArch = 0;
+#endif
+
+// PTRACE_GET_SYSCALL_INFO (Linux 5.3) and its result, struct
+// ptrace_syscall_info from linux/ptrace.h, which conflicts with sys/ptrace.h.
+static const int kPtraceGetSyscallInfo = 0x420e;
+static const uint8_t kSyscallInfoExit = 2;
+static const uint8_t kSyscallInfoSeccomp = 3;
+
+struct SyscallInfo {
+  uint8_t op;
+  uint32_t arch __attribute__((aligned(4)));
+  uint64_t instruction_pointer;
+  uint64_t stack_pointer;
+  union {
+    struct {
+      uint64_t nr;
+      uint64_t args[6];
+    } entry;
+    struct {
+      int64_t rval;
+      uint8_t is_error;
+    } exit;
+    struct {
+      uint64_t nr;
+      uint64_t args[6];
+      uint32_t ret_data;
+    } seccomp;
+  };
+};
+
+namespace {
+
+enum SyscallKind {
+  kOpen,      // opens path_arg relative to fd_arg (if not -1)
+  kExec,      // executes path_arg relative to fd_arg (if not -1)
+  kRead,      // reads from fd_arg
+  kWrite,     // writes to fd_arg
+  kTransfer,  // reads from fd_arg and writes to out_fd_arg
+  kClose,     // closes fd_arg
+  kCloseRange,
+  kDupTo,  // makes fd_arg a copy of another descriptor
+};
+
+struct TracedSyscall {
+  long nr;
+  SyscallKind kind;
+  int fd_arg;
+  int path_arg;
+  int out_fd_arg;
+};
+
+// The system calls that stop the tracee. Their index in this table is passed
+// as SECCOMP_RET_DATA.
+const TracedSyscall kTracedSyscalls[] = {
+#ifdef SYS_open
+    {SYS_open, kOpen, -1, 0, -1},
+#endif
+#ifdef SYS_creat
+    {SYS_creat, kOpen, -1, 0, -1},
+#endif
+    {SYS_openat, kOpen, 0, 1, -1},
+#ifdef SYS_openat2
+    {SYS_openat2, kOpen, 0, 1, -1},
+#endif
+    {SYS_execve, kExec, -1, 0, -1},
+#ifdef SYS_execveat
+    {SYS_execveat, kExec, 0, 1, -1},
+#endif
+    {SYS_read, kRead, 0, -1, -1},
+    {SYS_pread64, kRead, 0, -1, -1},
+    {SYS_readv, kRead, 0, -1, -1},
+    {SYS_preadv, kRead, 0, -1, -1},
+#ifdef SYS_preadv2
+    {SYS_preadv2, kRead, 0, -1, -1},
+#endif
+    {SYS_write, kWrite, 0, -1, -1},
+    {SYS_pwrite64, kWrite, 0, -1, -1},
+    {SYS_writev, kWrite, 0, -1, -1},
+    {SYS_pwritev, kWrite, 0, -1, -1},
+#ifdef SYS_pwritev2
+    {SYS_pwritev2, kWrite, 0, -1, -1},
+#endif
+    {SYS_sendfile, kTransfer, 1, -1, 0},
+    {SYS_splice, kTransfer, 0, -1, 2},
+#ifdef SYS_copy_file_range
+    {SYS_copy_file_range, kTransfer, 0, -1, 2},
+#endif
+    {SYS_close, kClose, 0, -1, -1},
+#ifdef SYS_close_range
+    {SYS_close_range, kCloseRange, -1, -1, -1},
+#endif
+#ifdef SYS_dup2
+    {SYS_dup2, kDupTo, 1, -1, -1},
+#endif
+    {SYS_dup3, kDupTo, 1, -1, -1},
+};
+const size_t kNumTracedSyscalls =
+    sizeof(kTracedSyscalls) / sizeof(kTracedSyscalls[0]);
+
+struct TracedThread {
+  pid_t tgid;
+  // Whether we have not seen this thread stop yet. New threads start with a
+  // SIGSTOP that must not be delivered.
+  bool is_new;
+  // Whether the thread is between the seccomp stop of a traced system call and
+  // its syscall-exit-stop.
+  bool in_syscall;
+  const TracedSyscall *syscall;
+  uint64_t args[6];
+  struct timespec entry_time;
+  // The path that an execve() is about to run, read before it replaces the
+  // memory it is stored in.
+  std::string exec_path;
+};
+
+std::map<pid_t, TracedThread> global_threads;
+
+// What the descriptors of each thread group refer to: a path for files, or an
+// empty string for pipes, sockets etc.
+std::map<std::pair<pid_t, int>, std::string> global_fd_paths;
+
+// The trace, by path.
+std::map<std::string, tools::protos::FileAccess> global_files;
+int64_t global_traced_syscalls = 0;
+
+pid_t ReadTgid(pid_t tid) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/status", tid);
+  FILE *status = fopen(path, "re");
+  if (status == nullptr) {
+    return tid;
+  }
+  pid_t tgid = tid;
+  char line[256];
+  while (fgets(line, sizeof(line), status) != nullptr) {
+    if (sscanf(line, "Tgid: %d", &tgid) == 1) {
+      break;
+    }
+  }
+  fclose(status);
+  return tgid;
+}
+
+std::string ReadLink(const std::string &path) {
+  char target[PATH_MAX];
+  ssize_t len = readlink(path.c_str(), target, sizeof(target));
+  if (len < 0 || len == sizeof(target)) {
+    return "";
+  }
+  return std::string(target, len);
+}
+
+// Returns the path of a file that fd of thread refers to, or an empty string
+// for anything that is not a file.
+const std::string &GetFdPath(const TracedThread &thread, pid_t tid, int fd) {
+  std::pair<pid_t, int> key(thread.tgid, fd);
+  auto it = global_fd_paths.find(key);
+  if (it == global_fd_paths.end()) {
+    std::string path =
+        ReadLink("/proc/" + std::to_string(tid) + "/fd/" + std::to_string(fd));
+    if (path.empty() || path[0] != '/') {
+      path.clear();
+    }
+    it = global_fd_paths.insert(std::make_pair(key, path)).first;
+  }
+  return it->second;
+}
+
+// Reads a string from the memory of tid.
+std::string ReadString(pid_t tid, uint64_t address) {
+  std::string result;
+  char buf[256];
+  while (result.size() < PATH_MAX) {
+    // Do not cross into the next page, which might not be mapped.
+    size_t size = 4096 - (address % 4096);
+    if (size > sizeof(buf)) {
+      size = sizeof(buf);
+    }
+    struct iovec local = {buf, size};
+    struct iovec remote = {reinterpret_cast<void *>(address), size};
+    ssize_t n = process_vm_readv(tid, &local, 1, &remote, 1, 0);
+    if (n <= 0) {
+      break;
+    }
+    size_t len = strnlen(buf, n);
+    result.append(buf, len);
+    if (len < static_cast<size_t>(n)) {
+      break;
+    }
+    address += n;
+  }
+  return result;
+}
+
+// Returns the absolute form of the path at path_arg, as seen by tid.
+std::string ReadPathArg(const TracedThread &thread, pid_t tid) {
+  std::string path = ReadString(tid, thread.args[thread.syscall->path_arg]);
+  if (path.empty() || path[0] == '/') {
+    return path;
+  }
+  std::string dir;
+  int dirfd = thread.syscall->fd_arg < 0
+                  ? AT_FDCWD
+                  : static_cast<int>(thread.args[thread.syscall->fd_arg]);
+  if (dirfd == AT_FDCWD) {
+    dir = ReadLink("/proc/" + std::to_string(tid) + "/cwd");
+  } else {
+    dir = GetFdPath(thread, tid, dirfd);
+  }
+  return dir.empty() ? path : dir + "/" + path;
+}
+
+int64_t MicrosSince(const struct timespec &start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start.tv_sec) * 1000000 +
+         (now.tv_nsec - start.tv_nsec) / 1000;
+}
+
+tools::protos::FileAccess *GetFile(const std::string &path) {
+  tools::protos::FileAccess *file = &global_files[path];
+  if (file->path().empty()) {
+    file->set_path(path);
+  }
+  return file;
+}
+
+void OnSyscallEntry(TracedThread *thread, pid_t tid, const SyscallInfo &info) {
+  if (info.seccomp.ret_data >= kNumTracedSyscalls) {
+    thread->in_syscall = false;
+    return;
+  }
+  global_traced_syscalls++;
+  thread->in_syscall = true;
+  thread->syscall = &kTracedSyscalls[info.seccomp.ret_data];
+  memcpy(thread->args, info.seccomp.args, sizeof(thread->args));
+  if (thread->syscall->kind == kExec) {
+    thread->exec_path = ReadPathArg(*thread, tid);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &thread->entry_time);
+}
+
+void OnSyscallExit(TracedThread *thread, pid_t tid, const SyscallInfo &info) {
+  thread->in_syscall = false;
+  const TracedSyscall *syscall = thread->syscall;
+  int64_t micros = MicrosSince(thread->entry_time);
+  bool failed = info.exit.is_error;
+  int64_t result = info.exit.rval;
+  int fd = syscall->fd_arg < 0 ? -1 : static_cast<int>(thread->args[syscall->fd_arg]);
+
+  switch (syscall->kind) {
+    case kOpen: {
+      if (failed) {
+        std::string path = ReadPathArg(*thread, tid);
+        if (!path.empty()) {
+          tools::protos::FileAccess *file = GetFile(path);
+          file->set_failed_opens(file->failed_opens() + 1);
+          file->set_io_time_usec(file->io_time_usec() + micros);
+        }
+        break;
+      }
+      // The descriptor number may have been used for something else before.
+      global_fd_paths.erase(std::make_pair(thread->tgid, result));
+      const std::string &path =
+          GetFdPath(*thread, tid, static_cast<int>(result));
+      if (!path.empty()) {
+        tools::protos::FileAccess *file = GetFile(path);
+        file->set_opens(file->opens() + 1);
+        file->set_io_time_usec(file->io_time_usec() + micros);
+      }
+      break;
+    }
+    case kExec: {
+      if (!thread->exec_path.empty()) {
+        tools::protos::FileAccess *file = GetFile(thread->exec_path);
+        if (failed) {
+          file->set_failed_opens(file->failed_opens() + 1);
+        } else {
+          file->set_opens(file->opens() + 1);
+        }
+      }
+      thread->exec_path.clear();
+      if (!failed) {
+        // All descriptors with FD_CLOEXEC are gone, and we do not know which.
+        auto begin = global_fd_paths.lower_bound(std::make_pair(thread->tgid, 0));
+        auto end =
+            global_fd_paths.lower_bound(std::make_pair(thread->tgid + 1, 0));
+        global_fd_paths.erase(begin, end);
+      }
+      break;
+    }
+    case kRead:
+    case kWrite:
+    case kTransfer: {
+      if (failed) {
+        break;
+      }
+      const std::string &path = GetFdPath(*thread, tid, fd);
+      if (!path.empty()) {
+        tools::protos::FileAccess *file = GetFile(path);
+        if (syscall->kind == kWrite) {
+          file->set_bytes_written(file->bytes_written() + result);
+        } else {
+          file->set_bytes_read(file->bytes_read() + result);
+        }
+        file->set_io_time_usec(file->io_time_usec() + micros);
+      }
+      if (syscall->kind == kTransfer) {
+        int out_fd = static_cast<int>(thread->args[syscall->out_fd_arg]);
+        const std::string &out_path = GetFdPath(*thread, tid, out_fd);
+        if (!out_path.empty()) {
+          tools::protos::FileAccess *file = GetFile(out_path);
+          file->set_bytes_written(file->bytes_written() + result);
+          if (out_path != path) {
+            file->set_io_time_usec(file->io_time_usec() + micros);
+          }
+        }
+      }
+      break;
+    }
+    case kClose:
+    case kDupTo:
+      if (!failed) {
+        global_fd_paths.erase(std::make_pair(thread->tgid, fd));
+      }
+      break;
+    case kCloseRange:
+      if (!failed) {
+        auto begin = global_fd_paths.lower_bound(
+            std::make_pair(thread->tgid, static_cast<int>(thread->args[0])));
+        auto end =
+            global_fd_paths.lower_bound(std::make_pair(thread->tgid + 1, 0));
+        global_fd_paths.erase(begin, end);
+      }
+      break;
+  }
+}
+
+void Resume(pid_t tid, const TracedThread &thread, int sig) {
+  // Stop at the exit of a traced system call, but nowhere else.
+  enum __ptrace_request request =
+      thread.in_syscall ? PTRACE_SYSCALL : PTRACE_CONT;
+  if (ptrace(request, tid, nullptr, reinterpret_cast<void *>(sig)) < 0 &&
+      errno != ESRCH) {
+    DIE("ptrace(%d)", tid);
+  }
+}
+
+}  // namespace
+
+void PrepareForTracing() {
+  if (kAuditArch == 0) {
+    errno = ENOSYS;
+    DIE("tracing is not supported on this architecture");
+  }
+
+  std::vector<struct sock_filter> filter;
+  filter.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+                            offsetof(struct seccomp_data, arch)));
+  filter.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, kAuditArch, 1, 0));
+  filter.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+  filter.push_back(
+      BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, nr)));
+  for (size_t i = 0; i < kNumTracedSyscalls; i++) {
+    uint32_t nr = static_cast<uint32_t>(kTracedSyscalls[i].nr);
+    uint32_t action = SECCOMP_RET_TRACE | static_cast<uint32_t>(i);
+    filter.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, nr, 0, 1));
+    filter.push_back(BPF_STMT(BPF_RET | BPF_K, action));
+  }
+  filter.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+  struct sock_fprog program;
+  program.len = filter.size();
+  program.filter = filter.data();
+
+  if (ptrace(PTRACE_TRACEME, 0, nullptr, nullptr) < 0) {
+    DIE("ptrace(PTRACE_TRACEME)");
+  }
+  // Unprivileged processes may only install filters along with this.
+  if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) < 0) {
+    DIE("prctl(PR_SET_NO_NEW_PRIVS)");
+  }
+  if (prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &program, 0, 0) < 0) {
+    DIE("prctl(PR_SET_SECCOMP)");
+  }
+  // Wait for our parent to set the tracing options.
+  if (raise(SIGSTOP) < 0) {
+    DIE("raise");
+  }
+}
+
+void StartTracing(pid_t pid) {
+  int status;
+  if (waitpid(pid, &status, __WALL) < 0) {
+    DIE("waitpid");
+  }
+  if (!WIFSTOPPED(status)) {
+    // The child died; WaitForChild() will find out why.
+    return;
+  }
+  long options = PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACESECCOMP |
+                 PTRACE_O_TRACEFORK | PTRACE_O_TRACEVFORK |
+                 PTRACE_O_TRACECLONE | PTRACE_O_TRACEEXEC |
+                 PTRACE_O_EXITKILL;
+  if (ptrace(PTRACE_SETOPTIONS, pid, nullptr,
+             reinterpret_cast<void *>(options)) < 0) {
+    DIE("ptrace(PTRACE_SETOPTIONS)");
+  }
+  TracedThread &thread = global_threads[pid];
+  thread.tgid = pid;
+  Resume(pid, thread, 0);
+}
+
+void HandleTraceStop(pid_t tid, int status) {
+  auto it = global_threads.find(tid);
+  if (it == global_threads.end()) {
+    it = global_threads.insert(std::make_pair(tid, TracedThread())).first;
+    it->second.tgid = ReadTgid(tid);
+    it->second.is_new = true;
+  }
+  TracedThread *thread = &it->second;
+  bool is_new = thread->is_new;
+  thread->is_new = false;
+
+  int sig = WSTOPSIG(status);
+  int event = status >> 16;
+  if (event == PTRACE_EVENT_SECCOMP || sig == (SIGTRAP | 0x80)) {
+    SyscallInfo info = {};
+    if (ptrace(static_cast<enum __ptrace_request>(kPtraceGetSyscallInfo), tid,
+               reinterpret_cast<void *>(sizeof(info)), &info) < 0) {
+      if (errno == ESRCH) {
+        return;
+      }
+      DIE("ptrace(PTRACE_GET_SYSCALL_INFO)");
+    }
+    if (info.op == kSyscallInfoSeccomp) {
+      OnSyscallEntry(thread, tid, info);
+    } else if (info.op == kSyscallInfoExit && thread->in_syscall) {
+      OnSyscallExit(thread, tid, info);
+    }
+    sig = 0;
+  } else if (event != 0 || (sig == SIGSTOP && is_new)) {
+    // Fork, clone, exec etc. New threads are traced automatically.
+    sig = 0;
+  }
+  Resume(tid, *thread, sig);
+}
+
+void ForgetTracedThread(pid_t tid) {
+  auto it = global_threads.find(tid);
+  if (it == global_threads.end()) {
+    return;
+  }
+  if (it->second.tgid == tid) {
+    auto begin = global_fd_paths.lower_bound(std::make_pair(tid, 0));
+    auto end = global_fd_paths.lower_bound(std::make_pair(tid + 1, 0));
+    global_fd_paths.erase(begin, end);
+  }
+  global_threads.erase(it);
+}
+
+void WriteTrace(int fd) {
+  tools::protos::FileAccessTrace trace;
+  trace.set_traced_syscalls(global_traced_syscalls);
+  for (const auto &entry : global_files) {
+    *trace.add_files() = entry.second;
+  }
+  if (!trace.SerializeToFileDescriptor(fd)) {
+    DIE("could not write the trace");
+  }
+}
@@ -35,6 +35,10 @@
  *  - The hostname and domainname will be set to "sandbox".
  *  - The process runs in its own PID namespace, so other processes on the
  *    system are invisible.
+ *
+ * With --server, linux-sandbox instead keeps a pre-built sandbox template
+ * around and runs the commands sent by linux-sandbox --connect in it, which
+ * saves most of the setup cost per command (see linux-sandbox-server.h).
  */
 
 #include "src/main/tools/linux-sandbox.h"
@@ -43,7 +47,7 @@
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
-#include <math.h>
+#include <poll.h>
 #include <sched.h>
 #include <signal.h>
 #include <stdbool.h>
@@ -52,111 +56,52 @@
 #include <string.h>
 #include <sys/prctl.h>
 #include <sys/resource.h>
+#include <sys/signalfd.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <string>
 #include <vector>
 
+#include "src/main/tools/cgroups.h"
 #include "src/main/tools/linux-sandbox-options.h"
 #include "src/main/tools/linux-sandbox-pid1.h"
+#include "src/main/tools/linux-sandbox-server.h"
 #include "src/main/tools/logging.h"
 #include "src/main/tools/process-tools.h"
 
 int global_outer_uid;
 int global_outer_gid;
+int global_cgroup_procs_fd = -1;
+int global_trace_fd = -1;
+int global_exec_notify_fd = -1;
 
 static int global_child_pid;
 
-// The signal that will be sent to the child when a timeout occurs.
-static volatile sig_atomic_t global_next_timeout_signal = SIGTERM;
-
-// The signal that caused us to kill the child (e.g. on timeout).
-static volatile sig_atomic_t global_signal;
-
-// Make sure the child process does not inherit any accidentally left open file
-// handles from our parent.
-static void CloseFds() {
-  DIR *fds = opendir("/proc/self/fd");
-  if (fds == nullptr) {
-    DIE("opendir");
-  }
-
-  while (1) {
-    errno = 0;
-    struct dirent *dent = readdir(fds);
-
-    if (dent == nullptr) {
-      if (errno != 0) {
-        DIE("readdir");
-      }
-      break;
-    }
-
-    if (isdigit(dent->d_name[0])) {
-      errno = 0;
-      int fd = strtol(dent->d_name, nullptr, 10);
-
-      // (1) Skip unparseable entries.
-      // (2) Close everything except stdin, stdout and stderr.
-      // (3) Do not accidentally close our directory handle.
-      if (errno == 0 && fd > STDERR_FILENO && fd != dirfd(fds)) {
-        if (close(fd) < 0) {
-          DIE("close");
-        }
-      }
-    }
-  }
-
-  if (closedir(fds) < 0) {
-    DIE("closedir");
-  }
-}
-
-static void OnTimeout(int sig) {
-  global_signal = sig;
-  kill(global_child_pid, global_next_timeout_signal);
-  if (global_next_timeout_signal == SIGTERM && opt.kill_delay_secs > 0) {
-    global_next_timeout_signal = SIGKILL;
-    alarm(opt.kill_delay_secs);
-  }
-}
-
-static void SpawnPid1() {
+pid_t CloneWithSyncPipe(int (*fn)(void *), int clone_flags) {
   const int kStackSize = 1024 * 1024;
   std::vector<char> child_stack(kStackSize);
 
   int sync_pipe[2];
-  if (pipe(sync_pipe) < 0) {
+  if (pipe2(sync_pipe, O_CLOEXEC) < 0) {
     DIE("pipe");
   }
 
-  int clone_flags =
-      CLONE_NEWUSER | CLONE_NEWNS | CLONE_NEWIPC | CLONE_NEWPID | SIGCHLD;
-  if (opt.create_netns) {
-    clone_flags |= CLONE_NEWNET;
-  }
-  if (opt.fake_hostname) {
-    clone_flags |= CLONE_NEWUTS;
-  }
-
   // We use clone instead of unshare, because unshare sometimes fails with
   // EINVAL due to a race condition in the Linux kernel (see
   // https://lkml.org/lkml/2015/7/28/833).
-  global_child_pid =
-      clone(Pid1Main, child_stack.data() + kStackSize, clone_flags, sync_pipe);
-  if (global_child_pid < 0) {
+  pid_t pid = clone(fn, child_stack.data() + kStackSize, clone_flags, sync_pipe);
+  if (pid < 0) {
     DIE("clone");
   }
 
-  PRINT_DEBUG("linux-sandbox-pid1 has PID %d", global_child_pid);
-
   // We close the write end of the sync pipe, read a byte and then close the
-  // pipe. This proves to the linux-sandbox-pid1 process that we still existed
-  // after it ran prctl(PR_SET_PDEATHSIG, SIGKILL), thus preventing a race
-  // condition where the parent is killed before that call was made.
+  // pipe. This proves to the child that we still existed after it ran
+  // prctl(PR_SET_PDEATHSIG, SIGKILL), thus preventing a race condition where
+  // the parent is killed before that call was made.
   char buf;
   if (close(sync_pipe[1]) < 0) {
     DIE("close");
@@ -167,35 +112,158 @@ static void SpawnPid1() {
   if (close(sync_pipe[0]) < 0) {
     DIE("close");
   }
+  return pid;
 }
 
-static int WaitForPid1() {
-  int err, status;
-  if (!opt.stats_path.empty()) {
-    struct rusage child_rusage;
-    do {
-      err = wait4(global_child_pid, &status, 0, &child_rusage);
-    } while (err < 0 && errno == EINTR);
-    if (err < 0) {
-      DIE("wait4");
+static void SpawnPid1(bool from_template) {
+  // A sandbox server's template already provides the user and mount
+  // namespaces; the latter is copied so that per-sandbox mounts stay private.
+  int clone_flags = CLONE_NEWNS | CLONE_NEWIPC | CLONE_NEWPID | SIGCHLD;
+  if (!from_template) {
+    clone_flags |= CLONE_NEWUSER;
+  }
+  if (opt.create_netns) {
+    clone_flags |= CLONE_NEWNET;
+  }
+  if (opt.fake_hostname) {
+    clone_flags |= CLONE_NEWUTS;
+  }
+
+  global_child_pid = CloneWithSyncPipe(
+      from_template ? Pid1MainFromTemplate : Pid1Main, clone_flags);
+
+  PRINT_DEBUG("linux-sandbox-pid1 has PID %d", global_child_pid);
+}
+
+// Reads the setup phases that PID 1 reported on the exec notification pipe
+// into times. Returns false once the pipe hits EOF, i.e. the command exec'd.
+static bool ReadSetupPhases(int exec_fd, struct ExecutionTimes *times) {
+  struct SetupPhaseRecord records[kNumSetupPhases];
+  ssize_t bytes_read = read(exec_fd, records, sizeof(records));
+  if (bytes_read < 0) {
+    if (errno == EINTR) {
+      return true;
     }
-    WriteStatsToFile(&child_rusage, opt.stats_path);
-  } else {
-    do {
-      err = waitpid(global_child_pid, &status, 0);
-    } while (err < 0 && errno == EINTR);
-    if (err < 0) {
-      DIE("waitpid");
+    DIE("read");
+  }
+  // Records are smaller than PIPE_BUF, so they are never split.
+  for (size_t i = 0; i < bytes_read / sizeof(records[0]); ++i) {
+    if (records[i].phase >= 0 && records[i].phase < kNumSetupPhases) {
+      times->setup_usec[records[i].phase] = records[i].time_usec;
+    }
+  }
+  return bytes_read > 0;
+}
+
+// Waits for PID 1 to exit, sending it SIGTERM (and SIGKILL after the kill
+// delay) when the timeout expires, and SIGKILL as soon as the peer of
+// hangup_fd (if not -1) hangs up. exec_fd (if not -1) is the read end of the
+// exec notification pipe, which hits EOF once the command has been exec'd.
+// SIGCHLD must be blocked.
+static int WaitForPid1(struct rusage *rusage, struct ExecutionTimes *times,
+                       int hangup_fd, int exec_fd) {
+  // The pidfd tells us when PID 1 exits. Without one (before Linux 5.3),
+  // SIGCHLD does.
+  int pidfd = PidfdOpen(global_child_pid);
+  int signal_fd = -1;
+  if (pidfd < 0) {
+    if (errno != ENOSYS) {
+      DIE("pidfd_open");
+    }
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGCHLD);
+    signal_fd = signalfd(-1, &signals, SFD_CLOEXEC | SFD_NONBLOCK);
+    if (signal_fd < 0) {
+      DIE("signalfd");
+    }
+  }
+  int timer_fd = -1;
+  if (opt.timeout_secs > 0) {
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (timer_fd < 0) {
+      DIE("timerfd_create");
+    }
+    ArmTimer(timer_fd, opt.timeout_secs);
+  }
+  int next_timeout_signal = SIGTERM;
+  bool timed_out = false;
+
+  while (!ChildHasExited(global_child_pid)) {
+    // poll() ignores negative descriptors.
+    struct pollfd fds[5] = {};
+    fds[0].fd = pidfd;
+    fds[0].events = POLLIN;
+    fds[1].fd = signal_fd;
+    fds[1].events = POLLIN;
+    fds[2].fd = timer_fd;
+    fds[2].events = POLLIN;
+    fds[3].fd = hangup_fd;
+    fds[3].events = POLLRDHUP;
+    fds[4].fd = exec_fd;
+    fds[4].events = POLLIN;
+    if (poll(fds, 5, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      DIE("poll");
+    }
+
+    if (fds[1].revents != 0) {
+      struct signalfd_siginfo info;
+      while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+      }
+    }
+    if (fds[2].revents != 0) {
+      uint64_t expirations;
+      if (read(timer_fd, &expirations, sizeof(expirations)) < 0 &&
+          errno != EAGAIN) {
+        DIE("read(timerfd)");
+      }
+      PRINT_DEBUG("timeout, sending signal %d to the sandbox",
+                  next_timeout_signal);
+      timed_out = true;
+      kill(global_child_pid, next_timeout_signal);
+      if (next_timeout_signal == SIGTERM && opt.kill_delay_secs > 0) {
+        next_timeout_signal = SIGKILL;
+        ArmTimer(timer_fd, opt.kill_delay_secs);
+      }
+    }
+    if (fds[3].revents != 0) {
+      PRINT_DEBUG("client hung up, killing the sandbox");
+      kill(global_child_pid, SIGKILL);
+      hangup_fd = -1;
+    }
+    if (fds[4].revents != 0 && !ReadSetupPhases(exec_fd, times)) {
+      times->exec_usec = WallTimeMicros();
+      if (close(exec_fd) < 0) {
+        DIE("close");
+      }
+      exec_fd = -1;
+    }
+  }
+  if (times != nullptr) {
+    times->exit_usec = WallTimeMicros();
+  }
+
+  int err, status;
+  do {
+    err = wait4(global_child_pid, &status, 0, rusage);
+  } while (err < 0 && errno == EINTR);
+  if (err < 0) {
+    DIE("wait4");
+  }
+  for (int fd : {pidfd, signal_fd, timer_fd, exec_fd}) {
+    if (fd >= 0 && close(fd) < 0) {
+      DIE("close");
     }
   }
 
-  if (global_signal > 0) {
-    // The child exited because we killed it due to receiving a signal
-    // ourselves. Do not trust the exitcode in this case, just calculate it from
-    // the signal.
-    PRINT_DEBUG("child exited due to us catching signal: %s",
-                strsignal(global_signal));
-    return 128 + global_signal;
+  if (timed_out) {
+    // The child exited because we killed it due to the timeout. Do not trust
+    // the exitcode in this case, just report the timeout like a SIGALRM.
+    PRINT_DEBUG("child exited due to the timeout");
+    return 128 + SIGALRM;
   } else if (WIFSIGNALED(status)) {
     PRINT_DEBUG("child exited due to receiving signal: %s",
                 strsignal(WTERMSIG(status)));
@@ -206,6 +274,40 @@ static int WaitForPid1() {
   }
 }
 
+int RunSandbox(bool from_template, struct rusage *rusage,
+               struct ExecutionTimes *times, int hangup_fd) {
+  // WaitForPid1() reads SIGCHLD from a signalfd on kernels without pidfds, so
+  // it must not get lost before.
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGCHLD);
+  if (sigprocmask(SIG_BLOCK, &signals, nullptr) < 0) {
+    DIE("sigprocmask");
+  }
+
+  // The command holds the write end of this pipe until it execs.
+  int exec_pipe[2] = {-1, -1};
+  if (times != nullptr) {
+    if (pipe2(exec_pipe, O_CLOEXEC) < 0) {
+      DIE("pipe2");
+    }
+    global_exec_notify_fd = exec_pipe[1];
+    times->start_usec = WallTimeMicros();
+  }
+
+  SpawnPid1(from_template);
+  for (int *fd : {&global_cgroup_procs_fd, &global_trace_fd,
+                  &global_exec_notify_fd}) {
+    if (*fd >= 0) {
+      if (close(*fd) < 0) {
+        DIE("close");
+      }
+      *fd = -1;
+    }
+  }
+  return WaitForPid1(rusage, times, hangup_fd, exec_pipe[0]);
+}
+
 int main(int argc, char *argv[]) {
   // Ask the kernel to kill us with SIGKILL if our parent dies.
   if (prctl(PR_SET_PDEATHSIG, SIGKILL) < 0) {
@@ -221,13 +323,45 @@ int main(int argc, char *argv[]) {
   global_outer_uid = getuid();
   global_outer_gid = getgid();
 
-  CloseFds();
+  // Neither we nor PID 1 ever exec, so close inherited descriptors right away.
+  CloseFds(STDERR_FILENO + 1, false);
 
-  if (opt.timeout_secs > 0) {
-    InstallSignalHandler(SIGALRM, OnTimeout);
-    SetTimeout(opt.timeout_secs);
+  if (!opt.server_socket.empty()) {
+    return RunServer();
+  } else if (!opt.connect_socket.empty()) {
+    return RunClient(argc, argv);
+  }
+
+  std::string cgroup;
+  if (!opt.cgroup_parent.empty()) {
+    cgroup = CreateCgroup(opt.cgroup_parent, "linux-sandbox", opt.cgroup_limits);
+    global_cgroup_procs_fd = OpenCgroupProcs(cgroup);
   }
 
-  SpawnPid1();
-  return WaitForPid1();
+  if (opt.trace) {
+    std::string trace_path = opt.stats_path + ".trace";
+    global_trace_fd = open(trace_path.c_str(),
+                           O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (global_trace_fd < 0) {
+      DIE("open(%s)", trace_path.c_str());
+    }
+  }
+
+  struct rusage child_rusage;
+  struct ExecutionTimes times = {};
+  bool want_stats = !opt.stats_path.empty();
+  int exit_code = RunSandbox(false, want_stats ? &child_rusage : nullptr,
+                             want_stats ? &times : nullptr, -1);
+  // Our PID namespace is gone, but its processes may still be on their way
+  // out.
+  if (!cgroup.empty()) {
+    EmptyCgroup(cgroup);
+  }
+  if (!opt.stats_path.empty()) {
+    WriteStatsToFile(&child_rusage, cgroup, &times, opt.stats_path);
+  }
+  if (!cgroup.empty()) {
+    RemoveCgroup(cgroup);
+  }
+  return exit_code;
 }
@@ -15,7 +15,44 @@
 #ifndef SRC_MAIN_TOOLS_LINUX_SANDBOX_H_
 #define SRC_MAIN_TOOLS_LINUX_SANDBOX_H_
 
+#include <sys/resource.h>
+#include <sys/types.h>
+
+#include "src/main/tools/process-tools.h"
+
 extern int global_outer_uid;
 extern int global_outer_gid;
 
+// The cgroup.procs file of the cgroup that PID 1 joins, or -1.
+extern int global_cgroup_procs_fd;
+
+// The file that PID 1 writes the trace of the command to (--trace), or -1.
+extern int global_trace_fd;
+
+// The write end of a close-on-exec pipe that the command keeps open until it
+// execs, which tells us when that happened, or -1. Before that, PID 1 writes a
+// SetupPhaseRecord to it whenever it finishes a step of setting up the sandbox.
+extern int global_exec_notify_fd;
+
+struct SetupPhaseRecord {
+  SetupPhase phase;
+  int64_t time_usec;
+};
+
+// Clones a child that runs fn in the namespaces given by clone_flags, and
+// waits until the child has arranged to die together with us. fn receives
+// the synchronization pipe that it has to pass to SetupSelfDestruction.
+pid_t CloneWithSyncPipe(int (*fn)(void *), int clone_flags);
+
+// Runs the command in opt in a new sandbox and returns its exit code.
+//
+// If from_template is true, we are a request handler of a sandbox server
+// and already run in its template namespaces (see linux-sandbox-server.h),
+// so only the per-sandbox part of the setup is done. If rusage is not null,
+// it receives the resource usage of the sandbox, and if times is not null,
+// the wall-clock times of the command. If hangup_fd is not -1, the sandbox is
+// killed as soon as the peer of that socket goes away.
+int RunSandbox(bool from_template, struct rusage *rusage,
+               struct ExecutionTimes *times, int hangup_fd);
+
 #endif
@@ -14,6 +14,8 @@
 
 #include "src/main/tools/process-tools.h"
 
+#include <ctype.h>
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <math.h>
@@ -22,15 +24,27 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/resource.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#ifdef __linux__
+#include <sched.h>
+#include <sys/timerfd.h>
+#else
+extern char **environ;
+#endif
+
 #include <memory>
+#include <vector>
 
 #include "src/main/protobuf/execution_statistics.pb.h"
+#include "src/main/tools/cgroups.h"
 #include "src/main/tools/logging.h"
 
 int SwitchToEuid() {
@@ -57,7 +71,7 @@ int SwitchToEgid() {
 
 void Redirect(const std::string &target_path, int fd) {
   if (!target_path.empty() && target_path != "-") {
-    const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_APPEND;
+    const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC;
     int fd_out = open(target_path.c_str(), flags, 0666);
     if (fd_out < 0) {
       DIE("open(%s)", target_path.c_str());
@@ -80,22 +94,6 @@ void Redirect(const std::string &target_path, int fd) {
   }
 }
 
-void KillEverything(pid_t pgrp, bool gracefully, double graceful_kill_delay) {
-  if (gracefully) {
-    kill(-pgrp, SIGTERM);
-
-    // Round up fractional seconds in this polling implementation.
-    int kill_delay = static_cast<int>(ceil(graceful_kill_delay));
-
-    // If the process is still alive, give it some time to die gracefully.
-    while (kill_delay-- > 0 && kill(-pgrp, 0) == 0) {
-      sleep(1);
-    }
-  }
-
-  kill(-pgrp, SIGKILL);
-}
-
 void InstallSignalHandler(int signum, void (*handler)(int)) {
   struct sigaction sa = {};
   sa.sa_handler = handler;
@@ -159,21 +157,327 @@ void ClearSignalMask() {
   }
 }
 
-void SetTimeout(double timeout_secs) {
+#ifdef __linux__
+// The CLOSE_RANGE_CLOEXEC flag from <linux/close_range.h>, which older
+// systems lack.
+static const unsigned int kCloseRangeCloexec = 1U << 2;
+
+static int CloseRange(int lowest_fd, bool on_exec) {
+#ifdef SYS_close_range
+  return syscall(SYS_close_range, lowest_fd, ~0U,
+                 on_exec ? kCloseRangeCloexec : 0);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+void CloseFds(int lowest_fd, bool on_exec) {
+  // close_range() exists since Linux 5.9 and CLOSE_RANGE_CLOEXEC since 5.11.
+  if (CloseRange(lowest_fd, on_exec) == 0) {
+    return;
+  } else if (errno != ENOSYS && errno != EINVAL) {
+    DIE("close_range");
+  }
+
+  DIR *fds = opendir("/proc/self/fd");
+  if (fds == nullptr) {
+    DIE("opendir");
+  }
+
+  while (1) {
+    errno = 0;
+    struct dirent *dent = readdir(fds);
+
+    if (dent == nullptr) {
+      if (errno != 0) {
+        DIE("readdir");
+      }
+      break;
+    }
+
+    if (isdigit(dent->d_name[0])) {
+      errno = 0;
+      int fd = strtol(dent->d_name, nullptr, 10);
+
+      // (1) Skip unparseable entries.
+      // (2) Leave the descriptors below lowest_fd alone.
+      // (3) Do not accidentally close our directory handle.
+      if (errno == 0 && fd >= lowest_fd && fd != dirfd(fds)) {
+        if (on_exec) {
+          if (fcntl(fd, F_SETFD, FD_CLOEXEC) < 0) {
+            DIE("fcntl");
+          }
+        } else if (close(fd) < 0) {
+          DIE("close");
+        }
+      }
+    }
+  }
+
+  if (closedir(fds) < 0) {
+    DIE("closedir");
+  }
+}
+#else
+void CloseFds(int lowest_fd, bool on_exec) {
+  // There is no portable way to list the open descriptors, so go through all
+  // that could be open. Do not take forever if there is no real limit.
+  const long kMaxFds = 65536;
+  long max_fds = sysconf(_SC_OPEN_MAX);
+  if (max_fds < 0 || max_fds > kMaxFds) {
+    max_fds = kMaxFds;
+  }
+
+  for (int fd = lowest_fd; fd < max_fds; ++fd) {
+    if (on_exec) {
+      if (fcntl(fd, F_SETFD, FD_CLOEXEC) < 0 && errno != EBADF) {
+        DIE("fcntl");
+      }
+    } else if (close(fd) < 0 && errno != EBADF) {
+      DIE("close");
+    }
+  }
+}
+#endif
+
+namespace {
+
+struct SpawnRequest {
+  char *const *args;
+  int cgroup_procs_fd;
+  const int *stdio_fds;
+  const char *cwd;
+  char *const *env;
+  // Set by the child if it could not run the command.
+  const char *failed_call;
+  int error;
+};
+
+// Runs in the child created by SpawnCommand(). As it may share all memory with
+// the parent, it must not touch anything but its own stack and the request, and
+// must not call anything that is not async-signal-safe (in particular not DIE).
+// Only returns if the command could not be run.
+void ExecRequest(SpawnRequest *request) {
+  // Our parent's handlers would run on our stack but act on its memory.
+  for (int i = 1; i < NSIG; ++i) {
+    if (i == SIGKILL || i == SIGSTOP) {
+      continue;
+    }
+    struct sigaction sa = {};
+    sa.sa_handler = SIG_DFL;
+    sigemptyset(&sa.sa_mask);
+    sigaction(i, &sa, nullptr);
+  }
+
+  if (request->cgroup_procs_fd >= 0 &&
+      write(request->cgroup_procs_fd, "0", 1) < 0) {
+    request->failed_call = "write(cgroup.procs)";
+  } else if (setsid() < 0) {
+    request->failed_call = "setsid";
+  } else if (request->cwd != nullptr && chdir(request->cwd) < 0) {
+    request->failed_call = "chdir";
+  } else if (request->stdio_fds != nullptr &&
+             (dup2(request->stdio_fds[0], STDIN_FILENO) < 0 ||
+              dup2(request->stdio_fds[1], STDOUT_FILENO) < 0 ||
+              dup2(request->stdio_fds[2], STDERR_FILENO) < 0)) {
+    request->failed_call = "dup2";
+  } else {
+    // Force umask to include read and execute for everyone, to make output
+    // permissions predictable.
+    umask(022);
+
+    sigset_t empty_sset;
+    sigemptyset(&empty_sset);
+    sigprocmask(SIG_SETMASK, &empty_sset, nullptr);
+
+    if (request->env == nullptr) {
+      execvp(request->args[0], request->args);
+    } else {
+#ifdef __linux__
+      execvpe(request->args[0], request->args, request->env);
+#else
+      // We are a copy of our parent, so we may replace our environment.
+      environ = const_cast<char **>(request->env);
+      execvp(request->args[0], request->args);
+#endif
+    }
+    request->failed_call = "execvp";
+  }
+  request->error = errno;
+}
+
+#ifdef __linux__
+int SpawnChild(void *param) {
+  ExecRequest(reinterpret_cast<SpawnRequest *>(param));
+  _exit(EXIT_FAILURE);
+}
+#endif
+
+}  // namespace
+
+#ifdef __linux__
+pid_t SpawnCommand(char *const *args, int cgroup_procs_fd,
+                   const int *stdio_fds, const char *cwd, char *const *env) {
+  // The child only needs enough stack to reach execvp().
+  const int kStackSize = 64 * 1024;
+  std::vector<char> child_stack(kStackSize);
+
+  SpawnRequest request = {args, cgroup_procs_fd, stdio_fds, cwd, env,
+                          nullptr, 0};
+
+  // Block all signals until the child has reset its handlers, so that none of
+  // ours runs in the child.
+  sigset_t all_signals, old_mask;
+  if (sigfillset(&all_signals) < 0) {
+    DIE("sigfillset");
+  }
+  if (sigprocmask(SIG_SETMASK, &all_signals, &old_mask) < 0) {
+    DIE("sigprocmask");
+  }
+
+  // CLONE_VFORK suspends us until the child has exec'd or exited.
+  pid_t pid = clone(SpawnChild, child_stack.data() + kStackSize,
+                    CLONE_VM | CLONE_VFORK | SIGCHLD, &request);
+  int clone_errno = errno;
+
+  if (sigprocmask(SIG_SETMASK, &old_mask, nullptr) < 0) {
+    DIE("sigprocmask");
+  }
+
+  if (pid < 0) {
+    errno = clone_errno;
+    return -1;
+  }
+  if (request.failed_call != nullptr) {
+    PRINT_DEBUG("%s failed in the child for %s", request.failed_call, args[0]);
+    waitpid(pid, nullptr, 0);
+    errno = request.error;
+    return -1;
+  }
+  return pid;
+}
+#else
+pid_t SpawnCommand(char *const *args, int cgroup_procs_fd,
+                   const int *stdio_fds, const char *cwd, char *const *env) {
+  // The child reports a failure to run the command through this pipe, which
+  // gets closed without a word once the command has been exec'd.
+  int error_pipe[2];
+  if (pipe(error_pipe) < 0) {
+    return -1;
+  }
+  if (fcntl(error_pipe[0], F_SETFD, FD_CLOEXEC) < 0 ||
+      fcntl(error_pipe[1], F_SETFD, FD_CLOEXEC) < 0) {
+    DIE("fcntl");
+  }
+
+  SpawnRequest request = {args, cgroup_procs_fd, stdio_fds, cwd, env,
+                          nullptr, 0};
+
+  // Block all signals until the child has reset its handlers, so that none of
+  // ours runs in the child.
+  sigset_t all_signals, old_mask;
+  if (sigfillset(&all_signals) < 0) {
+    DIE("sigfillset");
+  }
+  if (sigprocmask(SIG_SETMASK, &all_signals, &old_mask) < 0) {
+    DIE("sigprocmask");
+  }
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    ExecRequest(&request);
+    // The request's failed_call points to a literal, so it stays valid in the
+    // parent.
+    write(error_pipe[1], &request, sizeof(request));
+    _exit(EXIT_FAILURE);
+  }
+  int fork_errno = errno;
+
+  if (sigprocmask(SIG_SETMASK, &old_mask, nullptr) < 0) {
+    DIE("sigprocmask");
+  }
+  close(error_pipe[1]);
+
+  if (pid < 0) {
+    close(error_pipe[0]);
+    errno = fork_errno;
+    return -1;
+  }
+  ssize_t n;
+  do {
+    n = read(error_pipe[0], &request, sizeof(request));
+  } while (n < 0 && errno == EINTR);
+  close(error_pipe[0]);
+  if (n == sizeof(request)) {
+    PRINT_DEBUG("%s failed in the child for %s", request.failed_call, args[0]);
+    waitpid(pid, nullptr, 0);
+    errno = request.error;
+    return -1;
+  }
+  return pid;
+}
+#endif
+
+int PidfdOpen(pid_t pid) {
+#ifdef SYS_pidfd_open
+  return syscall(SYS_pidfd_open, pid, 0);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+bool ChildHasExited(pid_t pid) {
+  siginfo_t info = {};
+  if (waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) < 0) {
+    DIE("waitid");
+  }
+  return info.si_pid == pid;
+}
+
+void SetTimeout(double secs) {
   double int_val, fraction_val;
-  fraction_val = modf(timeout_secs, &int_val);
+  fraction_val = modf(secs, &int_val);
 
-  struct itimerval timer;
-  timer.it_interval.tv_sec = 0;
-  timer.it_interval.tv_usec = 0;
-  timer.it_value.tv_sec = static_cast<time_t>(int_val),
+  struct itimerval timer = {};
+  timer.it_value.tv_sec = static_cast<time_t>(int_val);
   timer.it_value.tv_usec = static_cast<suseconds_t>(fraction_val * 1e6);
-
+  if (timer.it_value.tv_sec == 0 && timer.it_value.tv_usec == 0) {
+    // A zero value would disarm the timer.
+    timer.it_value.tv_usec = 1;
+  }
   if (setitimer(ITIMER_REAL, &timer, nullptr) < 0) {
     DIE("setitimer");
   }
 }
 
+#ifdef __linux__
+void ArmTimer(int timerfd, double secs) {
+  double int_val, fraction_val;
+  fraction_val = modf(secs, &int_val);
+
+  struct itimerspec timer = {};
+  timer.it_value.tv_sec = static_cast<time_t>(int_val);
+  timer.it_value.tv_nsec = static_cast<long>(fraction_val * 1e9);
+  if (timer.it_value.tv_sec == 0 && timer.it_value.tv_nsec == 0) {
+    // A zero value would disarm the timer.
+    timer.it_value.tv_nsec = 1;
+  }
+  if (timerfd_settime(timerfd, 0, &timer, nullptr) < 0) {
+    DIE("timerfd_settime");
+  }
+}
+#endif
+
+int64_t WallTimeMicros() {
+  struct timespec ts;
+  if (clock_gettime(CLOCK_REALTIME, &ts) < 0) {
+    DIE("clock_gettime");
+  }
+  return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
 int WaitChild(pid_t pid) {
   int err, status;
 
@@ -233,8 +537,10 @@ CreateExecutionStatisticsProto(struct rusage *rusage) {
 }
 
 // Write execution statistics (e.g. resource usage) to a file.
-void WriteStatsToFile(struct rusage *rusage, const std::string &stats_path) {
-  const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_APPEND;
+void WriteStatsToFile(struct rusage *rusage, const std::string &cgroup,
+                      const ExecutionTimes *times,
+                      const std::string &stats_path) {
+  const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC;
   int fd_out = open(stats_path.c_str(), flags, 0666);
   if (fd_out < 0) {
     DIE("open(%s)", stats_path.c_str());
@@ -242,6 +548,23 @@ void WriteStatsToFile(struct rusage *rusage, const std::string &stats_path) {
 
   std::unique_ptr<tools::protos::ExecutionStatistics> execution_statistics =
       CreateExecutionStatisticsProto(rusage);
+  if (!cgroup.empty()) {
+    ReadCgroupUsage(cgroup, execution_statistics->mutable_cgroup_usage());
+  }
+  if (times != nullptr) {
+    tools::protos::ExecutionTimes *execution_times =
+        execution_statistics->mutable_execution_times();
+    execution_times->set_start_time_usec(times->start_usec);
+    execution_times->set_exec_time_usec(times->exec_usec);
+    execution_times->set_exit_time_usec(times->exit_usec);
+    execution_times->set_clone_time_usec(times->setup_usec[kSetupClone]);
+    execution_times->set_id_mapping_time_usec(
+        times->setup_usec[kSetupIdMapping]);
+    execution_times->set_mounts_time_usec(times->setup_usec[kSetupMounts]);
+    execution_times->set_read_only_time_usec(
+        times->setup_usec[kSetupReadOnly]);
+    execution_times->set_proc_time_usec(times->setup_usec[kSetupProc]);
+  }
 
   if (!execution_statistics->SerializeToFileDescriptor(fd_out)) {
     DIE("could not write resource usage to file: %s", stats_path.c_str());
@@ -249,3 +572,159 @@ void WriteStatsToFile(struct rusage *rusage, const std::string &stats_path) {
 
   close(fd_out);
 }
+
+#ifdef __linux__
+bool ReadAll(int fd, void *buf, size_t size) {
+  char *p = static_cast<char *>(buf);
+  while (size > 0) {
+    ssize_t n = read(fd, p, size);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    } else if (n == 0) {
+      errno = EPIPE;
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool WriteAll(int fd, const void *buf, size_t size) {
+  const char *p = static_cast<const char *>(buf);
+  while (size > 0) {
+    ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+static void GetSocketAddress(const std::string &path,
+                             struct sockaddr_un *addr) {
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr->sun_path)) {
+    errno = ENAMETOOLONG;
+    DIE("socket path %s", path.c_str());
+  }
+  strncpy(addr->sun_path, path.c_str(), sizeof(addr->sun_path) - 1);
+}
+
+int ListenOnSocket(const std::string &path) {
+  struct sockaddr_un addr;
+  GetSocketAddress(path, &addr);
+
+  int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (sock < 0) {
+    DIE("socket");
+  }
+  if (unlink(addr.sun_path) < 0 && errno != ENOENT) {
+    DIE("unlink(%s)", addr.sun_path);
+  }
+  mode_t old_umask = umask(077);
+  if (bind(sock, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) <
+      0) {
+    DIE("bind(%s)", addr.sun_path);
+  }
+  umask(old_umask);
+  if (listen(sock, SOMAXCONN) < 0) {
+    DIE("listen");
+  }
+  return sock;
+}
+
+int ConnectToSocket(const std::string &path) {
+  struct sockaddr_un addr;
+  GetSocketAddress(path, &addr);
+
+  int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (sock < 0) {
+    DIE("socket");
+  }
+  if (connect(sock, reinterpret_cast<struct sockaddr *>(&addr),
+              sizeof(addr)) < 0) {
+    DIE("connect(%s)", addr.sun_path);
+  }
+  return sock;
+}
+
+bool SendWithFds(int sock, const void *buf, size_t size, const int *fds,
+                 int num_fds) {
+  struct iovec iov;
+  iov.iov_base = const_cast<void *>(buf);
+  iov.iov_len = size;
+  std::vector<char> control(CMSG_SPACE(sizeof(int) * num_fds));
+  struct msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.data();
+  msg.msg_controllen = control.size();
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int) * num_fds);
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * num_fds);
+
+  ssize_t n;
+  do {
+    n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    return false;
+  }
+  // The descriptors went out with the first byte, so send the rest normally.
+  return WriteAll(sock, static_cast<const char *>(buf) + n, size - n);
+}
+
+int ReceiveWithFds(int sock, void *buf, size_t size, int *fds, int max_fds) {
+  struct iovec iov;
+  iov.iov_base = buf;
+  iov.iov_len = size;
+  std::vector<char> control(CMSG_SPACE(sizeof(int) * max_fds));
+  struct msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.data();
+  msg.msg_controllen = control.size();
+
+  ssize_t n;
+  do {
+    n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    return -1;
+  }
+
+  int num_fds = 0;
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg != nullptr && cmsg->cmsg_level == SOL_SOCKET &&
+      cmsg->cmsg_type == SCM_RIGHTS) {
+    num_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * num_fds);
+  }
+  if (msg.msg_flags & MSG_CTRUNC) {
+    for (int i = 0; i < num_fds; i++) {
+      close(fds[i]);
+    }
+    errno = EPROTO;
+    return -1;
+  }
+  if (!ReadAll(sock, static_cast<char *>(buf) + n, size - n)) {
+    for (int i = 0; i < num_fds; i++) {
+      close(fds[i]);
+    }
+    return -1;
+  }
+  return num_fds;
+}
+#endif
@@ -16,6 +16,7 @@
 #define SRC_MAIN_TOOLS_PROCESS_TOOLS_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <sys/types.h>
 #include <string>
 
@@ -31,12 +32,6 @@ int SwitchToEgid();
 // Redirect fd to the file target_path (but not if target_path is empty or "-").
 void Redirect(const std::string &target_path, int fd);
 
-// Make sure the process group "pgrp" and all its subprocesses are killed.
-// If "gracefully" is true, sends SIGTERM first and after a timeout of
-// "graceful_kill_delay" seconds, sends SIGKILL.
-// If not, send SIGKILL immediately.
-void KillEverything(pid_t pgrp, bool gracefully, double graceful_kill_delay);
-
 // Set up a signal handler for a signal.
 void InstallSignalHandler(int signum, void (*handler)(int));
 
@@ -50,9 +45,74 @@ void InstallDefaultSignalHandler(int sig);
 // default.
 void ClearSignalMask();
 
-// Receive SIGALRM after the given timeout. No-op if the timeout is
-// non-positive.
-void SetTimeout(double timeout_secs);
+// Close all file descriptors from lowest_fd upwards. If on_exec is true, only
+// mark them close-on-exec instead, so that they stay usable until the next
+// execve(). Uses a single close_range() call where the (Linux) kernel provides
+// it.
+void CloseFds(int lowest_fd, bool on_exec);
+
+// Run the command args (a null-terminated argv) in a new session with an empty
+// signal mask, default signal handlers and a umask of 022, like fork() followed
+// by execvp() would. On Linux, the child borrows our address space until it
+// execs (as with vfork()), so the cost of spawning does not grow with our
+// memory usage; elsewhere, this is fork() followed by execvp().
+// If cgroup_procs_fd is not negative, the child joins that cgroup first (see
+// JoinCgroup()). Unless they are null, stdio_fds replaces the child's stdin,
+// stdout and stderr, cwd its working directory and env (a null-terminated
+// array of "NAME=value" strings) its environment; the command is still looked
+// up in our own PATH. Returns -1 with errno set if the command cannot be run.
+pid_t SpawnCommand(char *const *args, int cgroup_procs_fd,
+                   const int *stdio_fds, const char *cwd, char *const *env);
+
+// Return a descriptor that becomes readable once our child pid has exited
+// (Linux 5.3+), or -1 with errno set (ENOSYS on older kernels).
+int PidfdOpen(pid_t pid);
+
+// Return whether our child pid has exited, without reaping it. As long as it is
+// not reaped, its PID and process group cannot be reused.
+bool ChildHasExited(pid_t pid);
+
+// Make SIGALRM arrive once, secs seconds from now. Fractions of a second are
+// honored.
+void SetTimeout(double secs);
+
+#ifdef __linux__
+// Make the timerfd fire once, secs seconds from now. Fractions of a second are
+// honored.
+void ArmTimer(int timerfd, double secs);
+#endif
+
+// Steps of setting up a sandbox before the command is spawned, in the order in
+// which linux-sandbox goes through them.
+enum SetupPhase {
+  // PID 1 started running in its new namespaces.
+  kSetupClone,
+  // The uid and gid maps of the user namespace were written.
+  kSetupIdMapping,
+  // All mounts (bind mounts, tmpfs, overlays) were created.
+  kSetupMounts,
+  // The file system was made read-only except for the writable paths.
+  kSetupReadOnly,
+  // /proc was mounted.
+  kSetupProc,
+  kNumSetupPhases
+};
+
+// Wall-clock times in the life of a command, in microseconds since the epoch,
+// or zero where unknown.
+struct ExecutionTimes {
+  // Right before the command was spawned.
+  int64_t start_usec;
+  // When each step of setting up the sandbox finished, if there was one.
+  int64_t setup_usec[kNumSetupPhases];
+  // Once the command had been exec'd.
+  int64_t exec_usec;
+  // Once the command was seen to have exited.
+  int64_t exit_usec;
+};
+
+// Return the current wall-clock time in microseconds since the epoch.
+int64_t WallTimeMicros();
 
 // Wait for "pid" to exit and return its exit code.
 int WaitChild(pid_t pid);
@@ -62,7 +122,42 @@ int WaitChild(pid_t pid);
 // child process.
 int WaitChildWithRusage(pid_t pid, struct rusage *rusage);
 
-// Write execution statistics to a file.
-void WriteStatsToFile(struct rusage *rusage, const std::string &stats_path);
+// Write execution statistics to a file. If cgroup is not empty, they include
+// the resource usage accounted to that cgroup, and unless times is null, the
+// wall-clock times of the command.
+void WriteStatsToFile(struct rusage *rusage, const std::string &cgroup,
+                      const ExecutionTimes *times,
+                      const std::string &stats_path);
+
+#ifdef __linux__
+// The following help the process-wrapper supervisor and the linux-sandbox
+// server talk to their clients over Unix domain sockets.
+
+// Read exactly size bytes from fd. Returns false with errno set on failure,
+// which includes hitting the end of the file early (EPIPE).
+bool ReadAll(int fd, void *buf, size_t size);
+
+// Write size bytes to the socket fd without raising SIGPIPE. Returns false with
+// errno set on failure.
+bool WriteAll(int fd, const void *buf, size_t size);
+
+// Create a Unix domain socket at path that only our own user may connect to,
+// replacing any existing file, and listen on it.
+int ListenOnSocket(const std::string &path);
+
+// Connect to the Unix domain socket at path.
+int ConnectToSocket(const std::string &path);
+
+// Send size bytes along with the num_fds descriptors in fds over the socket
+// sock. Returns false with errno set on failure.
+bool SendWithFds(int sock, const void *buf, size_t size, const int *fds,
+                 int num_fds);
+
+// Receive exactly size bytes from the socket sock in a single message, along
+// with up to max_fds descriptors, which are stored in fds with close-on-exec
+// set. Returns the number of descriptors received, or -1 with errno set on
+// failure (EPROTO for a malformed message).
+int ReceiveWithFds(int sock, void *buf, size_t size, int *fds, int max_fds);
+#endif
 
 #endif  // PROCESS_TOOLS_H__
@@ -14,7 +14,10 @@
 
 #include "src/main/tools/process-wrapper-legacy.h"
 
+#include <errno.h>
+#include <poll.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/resource.h>
@@ -25,6 +28,12 @@
 #include <unistd.h>
 #include <vector>
 
+#ifdef __linux__
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#endif
+
+#include "src/main/tools/cgroups.h"
 #include "src/main/tools/logging.h"
 #include "src/main/tools/process-tools.h"
 #include "src/main/tools/process-wrapper-options.h"
@@ -32,34 +41,159 @@
 
 pid_t LegacyProcessWrapper::child_pid = 0;
 volatile sig_atomic_t LegacyProcessWrapper::last_signal = 0;
+std::string LegacyProcessWrapper::cgroup;
+struct ExecutionTimes LegacyProcessWrapper::times;
+#ifndef __linux__
+volatile sig_atomic_t LegacyProcessWrapper::sent_sigterm = 0;
+#endif
 
 void LegacyProcessWrapper::RunCommand() {
+#ifdef __linux__
+  // WaitForChild() reads these from a signalfd. Block them right away, so that
+  // none can slip in before.
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGTERM);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGCHLD);
+  if (sigprocmask(SIG_BLOCK, &signals, nullptr) < 0) {
+    DIE("sigprocmask");
+  }
+
+  SpawnChild();
+  WaitForChild(signals);
+#else
   SpawnChild();
   WaitForChild();
+#endif
 }
 
 void LegacyProcessWrapper::SpawnChild() {
-  child_pid = fork();
+  int cgroup_procs_fd = -1;
+  if (!opt.cgroup_parent.empty()) {
+    cgroup = CreateCgroup(opt.cgroup_parent, "process-wrapper",
+                          opt.cgroup_limits);
+    cgroup_procs_fd = OpenCgroupProcs(cgroup);
+  }
+
+  times.start_usec = WallTimeMicros();
+  child_pid = SpawnCommand(opt.args.data(), cgroup_procs_fd, nullptr, nullptr,
+                           nullptr);
   if (child_pid < 0) {
-    DIE("fork");
-  } else if (child_pid == 0) {
-    // In child.
-    if (setsid() < 0) {
-      DIE("setsid");
+    DIE("execvp(%s, ...)", opt.args[0]);
+  }
+  // SpawnCommand() returns once the child has been exec'd.
+  times.exec_usec = WallTimeMicros();
+
+  if (cgroup_procs_fd >= 0) {
+    close(cgroup_procs_fd);
+  }
+}
+
+#ifdef __linux__
+void LegacyProcessWrapper::WaitForChild(const sigset_t &signals) {
+  // The pidfd tells us when the child exits. Without one (before Linux 5.3),
+  // SIGCHLD does.
+  sigset_t wake_signals = signals;
+  int pidfd = PidfdOpen(child_pid);
+  if (pidfd >= 0) {
+    sigdelset(&wake_signals, SIGCHLD);
+  } else if (errno != ENOSYS) {
+    DIE("pidfd_open");
+  }
+  int signal_fd = signalfd(-1, &wake_signals, SFD_CLOEXEC | SFD_NONBLOCK);
+  if (signal_fd < 0) {
+    DIE("signalfd");
+  }
+  int timer_fd = -1;
+  if (opt.timeout_secs > 0) {
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (timer_fd < 0) {
+      DIE("timerfd_create");
     }
-    ClearSignalMask();
+    ArmTimer(timer_fd, opt.timeout_secs);
+  }
+  int next_timeout_signal = SIGTERM;
 
-    // Force umask to include read and execute for everyone, to make output
-    // permissions predictable.
-    umask(022);
+  while (!ChildHasExited(child_pid)) {
+    // poll() ignores negative descriptors.
+    struct pollfd fds[3] = {};
+    fds[0].fd = signal_fd;
+    fds[1].fd = pidfd;
+    fds[2].fd = timer_fd;
+    for (struct pollfd &fd : fds) {
+      fd.events = POLLIN;
+    }
+    if (poll(fds, 3, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      DIE("poll");
+    }
 
-    // Does not return unless something went wrong.
-    if (execvp(opt.args[0], opt.args.data()) < 0) {
-      DIE("execvp(%s, ...)", opt.args[0]);
+    if (fds[0].revents != 0) {
+      struct signalfd_siginfo info;
+      while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+        if (info.ssi_signo != SIGCHLD) {
+          // Signals should kill the process quickly, as it's typically
+          // blocking the return of the prompt after a user hits "Ctrl-C".
+          last_signal = info.ssi_signo;
+          kill(-child_pid, SIGKILL);
+        }
+      }
+    }
+    if (fds[2].revents != 0) {
+      uint64_t expirations;
+      if (read(timer_fd, &expirations, sizeof(expirations)) < 0 &&
+          errno != EAGAIN) {
+        DIE("read(timerfd)");
+      }
+      // On timeout, give the process a bit of time to die gracefully if it
+      // needs it.
+      if (last_signal == 0) {
+        last_signal = SIGALRM;
+      }
+      kill(-child_pid, next_timeout_signal);
+      if (next_timeout_signal == SIGTERM) {
+        next_timeout_signal = SIGKILL;
+        if (opt.kill_delay_secs > 0) {
+          ArmTimer(timer_fd, opt.kill_delay_secs);
+        } else {
+          kill(-child_pid, SIGKILL);
+        }
+      }
     }
   }
-}
+  times.exit_usec = WallTimeMicros();
+
+  // The child is done for, but may have grandchildren that we still have to
+  // kill. The process group cannot have been reused, as we have not reaped the
+  // child yet.
+  kill(-child_pid, SIGKILL);
+  int status;
+  struct rusage child_rusage;
+  pid_t pid;
+  do {
+    pid = wait4(child_pid, &status, 0, &child_rusage);
+  } while (pid < 0 && errno == EINTR);
+  if (pid < 0) {
+    DIE("wait4");
+  }
+  if (pidfd >= 0) {
+    close(pidfd);
+  }
+  if (timer_fd >= 0) {
+    close(timer_fd);
+  }
+  close(signal_fd);
 
+  // Let the signals we raise in ExitLikeChild() through.
+  if (sigprocmask(SIG_UNBLOCK, &signals, nullptr) < 0) {
+    DIE("sigprocmask");
+  }
+  ExitLikeChild(status, &child_rusage);
+}
+#else
 void LegacyProcessWrapper::WaitForChild() {
   // Set up a signal handler which kills all subprocesses when the given signal
   // is triggered.
@@ -70,18 +204,53 @@ void LegacyProcessWrapper::WaitForChild() {
     SetTimeout(opt.timeout_secs);
   }
 
-  int status;
-  if (!opt.stats_path.empty()) {
-    struct rusage child_rusage;
-    status = WaitChildWithRusage(child_pid, &child_rusage);
-    WriteStatsToFile(&child_rusage, opt.stats_path);
-  } else {
-    status = WaitChild(child_pid);
-  }
+  struct rusage child_rusage;
+  int status = WaitChildWithRusage(child_pid, &child_rusage);
+  times.exit_usec = WallTimeMicros();
 
   // The child is done for, but may have grandchildren that we still have to
-  // kill.
+  // kill. Unlike on Linux, we cannot wait for the child without reaping it, so
+  // its process group may have been reused in the meantime.
+  kill(-child_pid, SIGKILL);
+
+  ExitLikeChild(status, &child_rusage);
+}
+
+// Called when the timeout or the kill delay expires, or a signal arrives.
+void LegacyProcessWrapper::OnSignal(int sig) {
+  if (sig == SIGALRM && !sent_sigterm) {
+    // On timeout, give the process a bit of time to die gracefully if it needs
+    // it. The next SIGALRM marks the end of the kill delay.
+    if (last_signal == 0) {
+      last_signal = SIGALRM;
+    }
+    sent_sigterm = 1;
+    kill(-child_pid, SIGTERM);
+    if (opt.kill_delay_secs > 0) {
+      SetTimeout(opt.kill_delay_secs);
+      return;
+    }
+  } else if (sig != SIGALRM) {
+    // Signals should kill the process quickly, as it's typically blocking the
+    // return of the prompt after a user hits "Ctrl-C".
+    last_signal = sig;
+  }
   kill(-child_pid, SIGKILL);
+}
+#endif
+
+void LegacyProcessWrapper::ExitLikeChild(int status,
+                                         struct rusage *child_rusage) {
+  if (!cgroup.empty()) {
+    EmptyCgroup(cgroup);
+  }
+
+  if (!opt.stats_path.empty()) {
+    WriteStatsToFile(child_rusage, cgroup, &times, opt.stats_path);
+  }
+  if (!cgroup.empty()) {
+    RemoveCgroup(cgroup);
+  }
 
   if (last_signal > 0) {
     // Don't trust the exit code if we got a timeout or signal.
@@ -95,18 +264,3 @@ void LegacyProcessWrapper::WaitForChild() {
     raise(sig);
   }
 }
-
-// Called when timeout or signal occurs.
-void LegacyProcessWrapper::OnSignal(int sig) {
-  last_signal = sig;
-
-  if (sig == SIGALRM) {
-    // SIGALRM represents a timeout, so we should give the process a bit of time
-    // to die gracefully if it needs it.
-    KillEverything(child_pid, true, opt.kill_delay_secs);
-  } else {
-    // Signals should kill the process quickly, as it's typically blocking the
-    // return of the prompt after a user hits "Ctrl-C".
-    KillEverything(child_pid, false, opt.kill_delay_secs);
-  }
-}
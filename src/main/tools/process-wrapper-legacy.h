@@ -16,12 +16,18 @@
 #define SRC_MAIN_TOOLS_PROCESS_WRAPPER_LEGACY_H_
 
 #include <signal.h>
+#include <string>
 #include <vector>
 
+#include "src/main/tools/process-tools.h"
+
 // The process-wrapper implementation that was used until and including Bazel
 // 0.4.5. Waits for the wrapped process to exit and then kills its process
 // group. Works on all POSIX operating systems (tested on Linux, macOS,
-// FreeBSD).
+// FreeBSD). On Linux, it waits for the exit, the timeout and SIGTERM or SIGINT
+// at once with poll() on a pidfd, a timerfd and a signalfd; elsewhere, with
+// waitpid() and signal handlers, using setitimer() for the timeout and the kill
+// delay. Either way, timeouts and kill delays may be fractions of a second.
 //
 // Caveats:
 // - Killing just the process group of the spawned child means that daemons or
@@ -29,8 +35,10 @@
 //   process group.
 // - Does not wait for grandchildren to exit, thus processes spawned by the
 //   child that could not be killed will linger around in the background.
-// - Has a PID reuse race condition, because the kill() to the process group is
-//   sent after waitpid() was called on the main child.
+// - Except on Linux, has a PID reuse race condition, because the kill() to the
+//   process group is sent after waitpid() was called on the main child.
+// With --cgroup_parent on Linux, the child runs in its own cgroup, whose
+// remaining processes are all killed and waited for instead.
 class LegacyProcessWrapper {
  public:
   // Run the command specified in the `opt.args` array and kill it after
@@ -39,11 +47,30 @@ class LegacyProcessWrapper {
 
  private:
   static void SpawnChild();
+#ifdef __linux__
+  // Waits for the child while `signals` (SIGTERM, SIGINT and SIGCHLD) are
+  // blocked, and exits like it did.
+  static void WaitForChild(const sigset_t &signals);
+#else
+  // Waits for the child and exits like it did.
   static void WaitForChild();
   static void OnSignal(int sig);
+#endif
+  // Cleans up after the child, which exited with `status`, and exits like it
+  // did.
+  static void ExitLikeChild(int status, struct rusage *child_rusage);
 
   static pid_t child_pid;
+  // The signal that made us kill the child (SIGALRM for the timeout), if any.
   static volatile sig_atomic_t last_signal;
+#ifndef __linux__
+  // Whether the timeout has expired, so that the next SIGALRM ends the kill
+  // delay.
+  static volatile sig_atomic_t sent_sigterm;
+#endif
+  // The cgroup of the child, if any.
+  static std::string cgroup;
+  static struct ExecutionTimes times;
 };
 
 #endif
@@ -15,6 +15,7 @@
 #include "src/main/tools/process-wrapper-options.h"
 
 #include <getopt.h>
+#include <inttypes.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -35,7 +36,14 @@ static void Usage(char *program_name, const char *fmt, ...) {
   vfprintf(stderr, fmt, ap);
   va_end(ap);
 
+#ifdef __linux__
+  fprintf(stderr,
+          "\nUsage: %s [--connect <socket>] -- command arg1 @args\n"
+          "       %s --server <socket>\n",
+          program_name, program_name);
+#else
   fprintf(stderr, "\nUsage: %s -- command arg1 @args\n", program_name);
+#endif
   fprintf(
       stderr,
       "\nPossible arguments:\n"
@@ -47,6 +55,18 @@ static void Usage(char *program_name, const char *fmt, ...) {
       "  -e/--stderr <file>  redirect stderr to a file\n"
       "  -s/--stats <file>  if set, write stats in protobuf format to a file\n"
       "  -d/--debug  if set, debug info will be printed\n"
+      "  --cgroup_parent <dir>  run the child in a new cgroup (v2) below <dir>"
+      ", adding\n"
+      "    its resource usage to the stats\n"
+      "  --memory_max <bytes>  limit the memory usage of that cgroup\n"
+      "  --cpu_max <cpus>  limit the CPU bandwidth of that cgroup\n"
+      "  --pids_max <count>  limit the number of processes in that cgroup\n"
+#ifdef __linux__
+      "  --server <socket>  supervise the commands of many clients, listening "
+      "on <socket>\n"
+      "  --connect <socket>  run the command on a supervisor instead of "
+      "spawning it\n"
+#endif
       "  --  command to run inside sandbox, followed by arguments\n");
   exit(EXIT_FAILURE);
 }
@@ -54,6 +74,14 @@ static void Usage(char *program_name, const char *fmt, ...) {
 // Parses command line flags from an argv array and puts the results into the
 // global `opt` struct.
 static void ParseCommandLine(const std::vector<char *> &args) {
+  enum {
+    kCgroupParentOption = 256,
+    kMemoryMaxOption,
+    kCpuMaxOption,
+    kPidsMaxOption,
+    kServerOption,
+    kConnectOption,
+  };
   static struct option long_options[] = {
       {"timeout", required_argument, 0, 't'},
       {"kill_delay", required_argument, 0, 'k'},
@@ -61,6 +89,14 @@ static void ParseCommandLine(const std::vector<char *> &args) {
       {"stderr", required_argument, 0, 'e'},
       {"stats", required_argument, 0, 's'},
       {"debug", no_argument, 0, 'd'},
+      {"cgroup_parent", required_argument, 0, kCgroupParentOption},
+      {"memory_max", required_argument, 0, kMemoryMaxOption},
+      {"cpu_max", required_argument, 0, kCpuMaxOption},
+      {"pids_max", required_argument, 0, kPidsMaxOption},
+#ifdef __linux__
+      {"server", required_argument, 0, kServerOption},
+      {"connect", required_argument, 0, kConnectOption},
+#endif
       {0, 0, 0, 0}};
   extern char *optarg;
   extern int optind, optopt;
@@ -106,6 +142,31 @@ static void ParseCommandLine(const std::vector<char *> &args) {
       case 'd':
         opt.debug = true;
         break;
+      case kCgroupParentOption:
+        opt.cgroup_parent.assign(optarg);
+        break;
+      case kMemoryMaxOption:
+        if (sscanf(optarg, "%" SCNd64, &opt.cgroup_limits.memory_max_bytes) !=
+            1) {
+          Usage(args.front(), "Invalid --memory_max value: %s", optarg);
+        }
+        break;
+      case kCpuMaxOption:
+        if (sscanf(optarg, "%lf", &opt.cgroup_limits.cpu_max) != 1) {
+          Usage(args.front(), "Invalid --cpu_max value: %s", optarg);
+        }
+        break;
+      case kPidsMaxOption:
+        if (sscanf(optarg, "%" SCNd64, &opt.cgroup_limits.pids_max) != 1) {
+          Usage(args.front(), "Invalid --pids_max value: %s", optarg);
+        }
+        break;
+      case kServerOption:
+        opt.server_socket.assign(optarg);
+        break;
+      case kConnectOption:
+        opt.connect_socket.assign(optarg);
+        break;
       case '?':
         Usage(args.front(), "Unrecognized argument: -%c (%d)", optopt, optind);
         break;
@@ -125,10 +186,23 @@ void ParseOptions(int argc, char *argv[]) {
 
   ParseCommandLine(args);
 
+  if (!opt.server_socket.empty()) {
+    if (!opt.args.empty() || !opt.connect_socket.empty()) {
+      Usage(args.front(), "--server does not take a command.");
+    }
+    return;
+  }
+
   if (opt.args.empty()) {
     Usage(args.front(), "No command specified.");
   }
 
+  if (opt.cgroup_parent.empty() &&
+      (opt.cgroup_limits.memory_max_bytes > 0 || opt.cgroup_limits.cpu_max > 0 ||
+       opt.cgroup_limits.pids_max > 0)) {
+    Usage(args.front(), "Limits require --cgroup_parent.");
+  }
+
   // argv[] passed to execve() must be a null-terminated array.
   opt.args.push_back(nullptr);
 }
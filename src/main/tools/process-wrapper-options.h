@@ -18,6 +18,8 @@
 #include <string>
 #include <vector>
 
+#include "src/main/tools/cgroups.h"
+
 // Options parsing result.
 struct Options {
   // How long to wait before killing the child (-t)
@@ -32,6 +34,14 @@ struct Options {
   bool debug;
   // Where to write stats, in protobuf format (-s)
   std::string stats_path;
+  // Directory in which to create a cgroup for the child (--cgroup_parent)
+  std::string cgroup_parent;
+  // Limits for that cgroup (--memory_max, --cpu_max, --pids_max)
+  CgroupLimits cgroup_limits;
+  // Where to listen for commands to supervise (--server)
+  std::string server_socket;
+  // Supervisor to run the command on (--connect)
+  std::string connect_socket;
   // Command to run (--)
   std::vector<char *> args;
 };
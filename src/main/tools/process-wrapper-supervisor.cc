@@ -0,0 +1,501 @@
+// Copyright 2017 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/tools/process-wrapper-supervisor.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/timerfd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "src/main/tools/cgroups.h"
+#include "src/main/tools/logging.h"
+#include "src/main/tools/process-tools.h"
+#include "src/main/tools/process-wrapper-options.h"
+
+namespace {
+
+// A request starts with a RequestHeader, which carries the client's stdin,
+// stdout and stderr as SCM_RIGHTS, optionally followed by the cgroup.procs file
+// of the cgroup that the command should join. It is followed by payload_size
+// bytes: the client's working directory, the num_args arguments of the command
+// and the client's environment, each terminated by '\0'.
+struct RequestHeader {
+  double timeout_secs;
+  double kill_delay_secs;
+  uint32_t payload_size;
+  uint32_t num_args;
+};
+
+// The reply to a request, sent once the command has exited. Client and
+// supervisor are the same binary, so there is no need for a more portable
+// encoding.
+struct Response {
+  // The status of the command, as returned by waitpid().
+  int32_t status;
+  // Whether the command was killed because of its timeout.
+  int32_t timed_out;
+  struct rusage rusage;
+  struct ExecutionTimes times;
+};
+
+const int kNumStdioFds = 3;
+const int kMaxRequestFds = kNumStdioFds + 1;
+const uint32_t kMaxPayloadSize = 64 * 1024 * 1024;
+const int kMaxEvents = 64;
+// How long a client may take to send its request, during which we serve no one
+// else.
+const int kRequestTimeoutSecs = 5;
+
+// A command being supervised.
+struct Action {
+  pid_t pid;
+  // Becomes readable when the command has exited.
+  int pidfd;
+  // Fires on timeout, and after the kill delay; -1 without a timeout.
+  int timerfd;
+  // The connection to the client.
+  int conn;
+  // The signal to send to the process group when timerfd fires next.
+  int next_signal;
+  double kill_delay_secs;
+  bool timed_out;
+  struct ExecutionTimes times;
+};
+
+int global_epoll_fd = -1;
+
+// Actions by pid, and the pids of actions by their descriptors.
+std::map<pid_t, Action> global_actions;
+std::map<int, pid_t> global_action_fds;
+
+// Descriptors to close once all events of the current epoll_wait() have been
+// handled, so that none of their numbers are reused in the meantime.
+std::vector<int> global_fds_to_close;
+
+void Watch(int fd, uint32_t events) {
+  struct epoll_event event = {};
+  event.events = events;
+  event.data.fd = fd;
+  if (epoll_ctl(global_epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+    DIE("epoll_ctl");
+  }
+}
+
+void Unwatch(int fd) {
+  if (epoll_ctl(global_epoll_fd, EPOLL_CTL_DEL, fd, nullptr) < 0) {
+    DIE("epoll_ctl");
+  }
+  global_action_fds.erase(fd);
+  global_fds_to_close.push_back(fd);
+}
+
+void CloseAll(const int *fds, int num_fds) {
+  for (int i = 0; i < num_fds; i++) {
+    if (close(fds[i]) < 0) {
+      DIE("close");
+    }
+  }
+}
+
+// Tells the client on conn that its command could not be run, and why.
+void RejectRequest(int conn, const int *fds, int num_fds, const char *command) {
+  if (num_fds >= kNumStdioFds) {
+    dprintf(fds[STDERR_FILENO], "process-wrapper: execvp(%s, ...): %s\n",
+            command, strerror(errno));
+  }
+  struct Response response = {};
+  response.status = W_EXITCODE(EXIT_FAILURE, 0);
+  WriteAll(conn, &response, sizeof(response));
+}
+
+// Receives a request on the new connection conn and starts its command.
+// Requests that cannot be served only fail their client.
+void StartAction(int conn) {
+  // Only our own user may run commands, and they run as our user.
+  struct ucred cred;
+  socklen_t cred_len = sizeof(cred);
+  if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) < 0) {
+    DIE("getsockopt(SO_PEERCRED)");
+  }
+  if (cred.uid != getuid()) {
+    PRINT_DEBUG("rejecting request from UID %d", cred.uid);
+    global_fds_to_close.push_back(conn);
+    return;
+  }
+
+  struct timeval timeout = {};
+  timeout.tv_sec = kRequestTimeoutSecs;
+  if (setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) <
+      0) {
+    DIE("setsockopt(SO_RCVTIMEO)");
+  }
+
+  struct RequestHeader header;
+  int fds[kMaxRequestFds];
+  int num_fds =
+      ReceiveWithFds(conn, &header, sizeof(header), fds, kMaxRequestFds);
+  if (num_fds < 0) {
+    PRINT_DEBUG("recvmsg: %s", strerror(errno));
+    global_fds_to_close.push_back(conn);
+    return;
+  }
+  std::vector<char> payload;
+  if (num_fds >= kNumStdioFds && header.payload_size > 0 &&
+      header.payload_size <= kMaxPayloadSize) {
+    payload.resize(header.payload_size);
+  }
+  if (payload.empty() || !ReadAll(conn, payload.data(), payload.size()) ||
+      payload.back() != '\0') {
+    PRINT_DEBUG("malformed request");
+    CloseAll(fds, num_fds);
+    global_fds_to_close.push_back(conn);
+    return;
+  }
+
+  std::vector<char *> strings;
+  for (size_t i = 0; i < payload.size(); i += strlen(&payload[i]) + 1) {
+    strings.push_back(&payload[i]);
+  }
+  if (header.num_args == 0 || strings.size() < 1 + header.num_args) {
+    PRINT_DEBUG("malformed request");
+    CloseAll(fds, num_fds);
+    global_fds_to_close.push_back(conn);
+    return;
+  }
+  const char *cwd = strings[0];
+  std::vector<char *> args(strings.begin() + 1,
+                           strings.begin() + 1 + header.num_args);
+  args.push_back(nullptr);
+  std::vector<char *> env(strings.begin() + 1 + header.num_args,
+                          strings.end());
+  env.push_back(nullptr);
+
+  int cgroup_procs_fd = num_fds > kNumStdioFds ? fds[kNumStdioFds] : -1;
+  int64_t start_usec = WallTimeMicros();
+  pid_t pid =
+      SpawnCommand(args.data(), cgroup_procs_fd, fds, cwd, env.data());
+  if (pid < 0) {
+    RejectRequest(conn, fds, num_fds, args[0]);
+    CloseAll(fds, num_fds);
+    global_fds_to_close.push_back(conn);
+    return;
+  }
+  CloseAll(fds, num_fds);
+  PRINT_DEBUG("started %s as PID %d", args[0], pid);
+
+  Action action = {};
+  action.pid = pid;
+  // SpawnCommand() returns once the command has been exec'd.
+  action.times.start_usec = start_usec;
+  action.times.exec_usec = WallTimeMicros();
+  action.pidfd = PidfdOpen(pid);
+  if (action.pidfd < 0) {
+    DIE("pidfd_open");
+  }
+  action.timerfd = -1;
+  action.conn = conn;
+  action.next_signal = SIGTERM;
+  action.kill_delay_secs = header.kill_delay_secs;
+  if (header.timeout_secs > 0) {
+    action.timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (action.timerfd < 0) {
+      DIE("timerfd_create");
+    }
+    ArmTimer(action.timerfd, header.timeout_secs);
+    Watch(action.timerfd, EPOLLIN);
+    global_action_fds[action.timerfd] = pid;
+  }
+  Watch(action.pidfd, EPOLLIN);
+  global_action_fds[action.pidfd] = pid;
+  // The client does not send anything else, so any input means it hung up.
+  Watch(action.conn, EPOLLIN | EPOLLRDHUP);
+  global_action_fds[action.conn] = pid;
+  global_actions[pid] = action;
+}
+
+// Sends the next signal to the process group of an action whose time is up.
+void OnTimeout(Action *action) {
+  uint64_t expirations;
+  if (read(action->timerfd, &expirations, sizeof(expirations)) < 0 &&
+      errno != EAGAIN) {
+    DIE("read(timerfd)");
+  }
+  PRINT_DEBUG("sending signal %d to PID %d", action->next_signal,
+              action->pid);
+  action->timed_out = true;
+  kill(-action->pid, action->next_signal);
+  if (action->next_signal == SIGTERM) {
+    action->next_signal = SIGKILL;
+    if (action->kill_delay_secs > 0) {
+      ArmTimer(action->timerfd, action->kill_delay_secs);
+    } else {
+      kill(-action->pid, SIGKILL);
+    }
+  }
+}
+
+// Kills the process group of an action whose client hung up or shut down its
+// end of the connection. The response is still sent if the client can read it.
+void OnHangup(Action *action) {
+  PRINT_DEBUG("client of PID %d hung up", action->pid);
+  kill(-action->pid, SIGKILL);
+  if (epoll_ctl(global_epoll_fd, EPOLL_CTL_DEL, action->conn, nullptr) < 0) {
+    DIE("epoll_ctl");
+  }
+  global_action_fds.erase(action->conn);
+}
+
+// Reaps an action whose command has exited and sends the response.
+void FinishAction(Action *action) {
+  action->times.exit_usec = WallTimeMicros();
+  // The child is done for, but may have grandchildren that we still have to
+  // kill. The group is ours until we reap the child.
+  kill(-action->pid, SIGKILL);
+
+  struct Response response = {};
+  int status;
+  pid_t pid;
+  do {
+    pid = wait4(action->pid, &status, 0, &response.rusage);
+  } while (pid < 0 && errno == EINTR);
+  if (pid < 0) {
+    DIE("wait4");
+  }
+  response.status = status;
+  response.timed_out = action->timed_out;
+  response.times = action->times;
+  PRINT_DEBUG("PID %d finished with status %d", action->pid, status);
+
+  if (!WriteAll(action->conn, &response, sizeof(response))) {
+    PRINT_DEBUG("failed to send the response: %s", strerror(errno));
+  }
+  if (global_action_fds.count(action->conn) > 0) {
+    Unwatch(action->conn);
+  } else {
+    global_fds_to_close.push_back(action->conn);
+  }
+  Unwatch(action->pidfd);
+  if (action->timerfd >= 0) {
+    Unwatch(action->timerfd);
+  }
+  global_actions.erase(action->pid);
+}
+
+}  // namespace
+
+int ProcessWrapperSupervisor::conn = -1;
+volatile sig_atomic_t ProcessWrapperSupervisor::last_signal = 0;
+
+void ProcessWrapperSupervisor::Serve() {
+  global_debug = opt.debug;
+  IgnoreSignal(SIGPIPE);
+
+  // Fail early if pidfds are not supported (before Linux 5.3).
+  int self_pidfd = PidfdOpen(getpid());
+  if (self_pidfd < 0) {
+    DIE("pidfd_open");
+  }
+  close(self_pidfd);
+
+  sigset_t stop_signals;
+  sigemptyset(&stop_signals);
+  sigaddset(&stop_signals, SIGTERM);
+  sigaddset(&stop_signals, SIGINT);
+  if (sigprocmask(SIG_BLOCK, &stop_signals, nullptr) < 0) {
+    DIE("sigprocmask");
+  }
+  int signal_fd = signalfd(-1, &stop_signals, SFD_CLOEXEC);
+  if (signal_fd < 0) {
+    DIE("signalfd");
+  }
+
+  int listen_fd = ListenOnSocket(opt.server_socket);
+  global_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (global_epoll_fd < 0) {
+    DIE("epoll_create1");
+  }
+  Watch(listen_fd, EPOLLIN);
+  Watch(signal_fd, EPOLLIN);
+
+  PRINT_DEBUG("supervising commands on %s", opt.server_socket.c_str());
+  while (true) {
+    struct epoll_event events[kMaxEvents];
+    int num_events = epoll_wait(global_epoll_fd, events, kMaxEvents, -1);
+    if (num_events < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      DIE("epoll_wait");
+    }
+
+    for (int i = 0; i < num_events; i++) {
+      int fd = events[i].data.fd;
+      if (fd == listen_fd) {
+        int conn = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (conn < 0) {
+          if (errno == EINTR || errno == ECONNABORTED) {
+            continue;
+          }
+          DIE("accept4");
+        }
+        StartAction(conn);
+      } else if (fd == signal_fd) {
+        struct signalfd_siginfo info;
+        if (read(signal_fd, &info, sizeof(info)) != sizeof(info)) {
+          DIE("read(signalfd)");
+        }
+        for (const auto &entry : global_actions) {
+          kill(-entry.first, SIGKILL);
+        }
+        unlink(opt.server_socket.c_str());
+        InstallDefaultSignalHandler(info.ssi_signo);
+        if (sigprocmask(SIG_UNBLOCK, &stop_signals, nullptr) < 0) {
+          DIE("sigprocmask");
+        }
+        raise(info.ssi_signo);
+      } else {
+        // Skip events of actions that an earlier event finished.
+        auto action_fd = global_action_fds.find(fd);
+        if (action_fd == global_action_fds.end()) {
+          continue;
+        }
+        Action *action = &global_actions[action_fd->second];
+        if (fd == action->pidfd) {
+          FinishAction(action);
+        } else if (fd == action->timerfd) {
+          OnTimeout(action);
+        } else {
+          OnHangup(action);
+        }
+      }
+    }
+
+    for (int fd : global_fds_to_close) {
+      if (close(fd) < 0) {
+        DIE("close");
+      }
+    }
+    global_fds_to_close.clear();
+  }
+}
+
+void ProcessWrapperSupervisor::RunCommand() {
+  conn = ConnectToSocket(opt.connect_socket);
+
+  std::string payload;
+  char *cwd = getcwd(nullptr, 0);
+  if (cwd == nullptr) {
+    DIE("getcwd");
+  }
+  payload.append(cwd);
+  payload.push_back('\0');
+  free(cwd);
+  // opt.args is null-terminated.
+  for (size_t i = 0; i + 1 < opt.args.size(); i++) {
+    payload.append(opt.args[i]);
+    payload.push_back('\0');
+  }
+  for (char **var = environ; *var != nullptr; var++) {
+    payload.append(*var);
+    payload.push_back('\0');
+  }
+
+  std::string cgroup;
+  int num_fds = kNumStdioFds;
+  int fds[kMaxRequestFds] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO, -1};
+  if (!opt.cgroup_parent.empty()) {
+    cgroup = CreateCgroup(opt.cgroup_parent, "process-wrapper",
+                          opt.cgroup_limits);
+    fds[num_fds++] = OpenCgroupProcs(cgroup);
+  }
+
+  struct RequestHeader header = {};
+  header.timeout_secs = opt.timeout_secs;
+  header.kill_delay_secs = opt.kill_delay_secs;
+  header.payload_size = payload.size();
+  header.num_args = opt.args.size() - 1;
+  if (!SendWithFds(conn, &header, sizeof(header), fds, num_fds)) {
+    DIE("sendmsg");
+  }
+  if (!WriteAll(conn, payload.data(), payload.size())) {
+    DIE("write");
+  }
+  if (num_fds > kNumStdioFds && close(fds[kNumStdioFds]) < 0) {
+    DIE("close");
+  }
+
+  // Have the supervisor kill the command when we are told to stop.
+  InstallSignalHandler(SIGTERM, OnSignal);
+  InstallSignalHandler(SIGINT, OnSignal);
+
+  struct Response response;
+  if (!ReadAll(conn, &response, sizeof(response))) {
+    // The supervisor is gone, and with it whoever knew about the command.
+    PRINT_DEBUG("no response from the supervisor: %s", strerror(errno));
+    response.status = W_EXITCODE(EXIT_FAILURE, 0);
+    response.timed_out = false;
+    memset(&response.rusage, 0, sizeof(response.rusage));
+    memset(&response.times, 0, sizeof(response.times));
+  }
+
+  if (!cgroup.empty()) {
+    EmptyCgroup(cgroup);
+  }
+  if (!opt.stats_path.empty()) {
+    WriteStatsToFile(&response.rusage, cgroup, &response.times,
+                     opt.stats_path);
+  }
+  if (!cgroup.empty()) {
+    RemoveCgroup(cgroup);
+  }
+
+  if (response.timed_out && last_signal == 0) {
+    last_signal = SIGALRM;
+  }
+  if (last_signal > 0) {
+    // Don't trust the exit code if we got a timeout or signal.
+    InstallDefaultSignalHandler(last_signal);
+    raise(last_signal);
+  } else if (WIFEXITED(response.status)) {
+    exit(WEXITSTATUS(response.status));
+  } else {
+    int sig = WTERMSIG(response.status);
+    InstallDefaultSignalHandler(sig);
+    raise(sig);
+  }
+}
+
+// Called when a signal occurs.
+void ProcessWrapperSupervisor::OnSignal(int sig) {
+  last_signal = sig;
+  // The supervisor kills the command when we stop writing, and still sends the
+  // response.
+  shutdown(conn, SHUT_WR);
+}
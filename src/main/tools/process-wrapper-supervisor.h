@@ -0,0 +1,51 @@
+// Copyright 2017 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_TOOLS_PROCESS_WRAPPER_SUPERVISOR_H_
+#define SRC_MAIN_TOOLS_PROCESS_WRAPPER_SUPERVISOR_H_
+
+#include <signal.h>
+
+// A supervisor (process-wrapper --server <socket>, Linux only) does the work of
+// any number of concurrent process-wrapper instances from a single process. It
+// accepts commands on a Unix domain socket and waits for all of them at once
+// with epoll: every command has a pidfd that becomes readable when it exits and,
+// given a timeout, a timerfd. Unlike LegacyProcessWrapper, it kills the process
+// group of a command before reaping it, so the group cannot have been reused.
+//
+// Commands are sent by process-wrapper --connect <socket>, which takes the
+// usual arguments, passes its working directory, arguments, environment and
+// stdio to the supervisor, and exits like the command did. The client creates
+// the cgroup for --cgroup_parent and writes the statistics, using the resource
+// usage that the supervisor sends back. If the client gets SIGTERM or SIGINT, it has the
+// supervisor kill the command.
+class ProcessWrapperSupervisor {
+ public:
+  // Supervise the commands sent to opt.server_socket until SIGTERM or SIGINT
+  // arrives, which kills all of them.
+  static void Serve();
+
+  // Run the command specified in the `opt.args` array on the supervisor at
+  // `opt.connect_socket`.
+  static void RunCommand();
+
+ private:
+  static void OnSignal(int sig);
+
+  // The connection to the supervisor.
+  static int conn;
+  static volatile sig_atomic_t last_signal;
+};
+
+#endif
@@ -42,6 +42,9 @@
 #include "src/main/tools/process-tools.h"
 #include "src/main/tools/process-wrapper-legacy.h"
 #include "src/main/tools/process-wrapper-options.h"
+#ifdef __linux__
+#include "src/main/tools/process-wrapper-supervisor.h"
+#endif
 
 int main(int argc, char *argv[]) {
   ParseOptions(argc, argv);
@@ -52,7 +55,20 @@ int main(int argc, char *argv[]) {
   Redirect(opt.stdout_path, STDOUT_FILENO);
   Redirect(opt.stderr_path, STDERR_FILENO);
 
+  // Do not leak anything but stdio into the command.
+  CloseFds(STDERR_FILENO + 1, true);
+
+#ifdef __linux__
+  if (!opt.server_socket.empty()) {
+    ProcessWrapperSupervisor::Serve();
+  } else if (!opt.connect_socket.empty()) {
+    ProcessWrapperSupervisor::RunCommand();
+  } else {
+    LegacyProcessWrapper::RunCommand();
+  }
+#else
   LegacyProcessWrapper::RunCommand();
+#endif
 
   return 0;
 }
@@ -0,0 +1,319 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// sandbox-benchmark measures how long linux-sandbox, process-wrapper and
+// build-runfiles take to set up before the command runs. It runs a trivial
+// command through each given tool many times and prints the median and 99th
+// percentile latency of each step of the setup, as reported in the execution
+// statistics of the tools, together with the total wall time of the tool.
+//
+// Any arguments after "--" are passed on to linux-sandbox, e.g. to choose the
+// namespaces to create (-N, -R, -H...). Use linux-sandbox_benchmark.sh to vary
+// the number of mount points on the host.
+//
+// Usage: sandbox-benchmark [--runs N] [--linux_sandbox PATH]
+//            [--bind_mounts N] [--process_wrapper PATH]
+//            [--build_runfiles PATH] [--runfiles N] [-- linux-sandbox args...]
+
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "src/main/protobuf/execution_statistics.pb.h"
+#include "src/main/tools/logging.h"
+#include "src/main/tools/process-tools.h"
+
+// Latencies of one step of the setup over all runs, in microseconds.
+struct Phase {
+  explicit Phase(const char *name) : name(name) {}
+
+  const char *name;
+  std::vector<double> latencies;
+};
+
+static int runs = 200;
+static std::string root;
+
+static double NowMicros() {
+  struct timespec ts;
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0) {
+    DIE("clock_gettime");
+  }
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void WriteFile(const std::string &path, const std::string &contents) {
+  FILE *file = fopen(path.c_str(), "we");
+  if (file == nullptr) {
+    DIE("fopen(%s)", path.c_str());
+  }
+  if (fputs(contents.c_str(), file) < 0 || fclose(file) != 0) {
+    DIE("write(%s)", path.c_str());
+  }
+}
+
+static int RemoveEntry(const char *path, const struct stat *, int,
+                       struct FTW *) {
+  if (remove(path) < 0) {
+    DIE("remove(%s)", path);
+  }
+  return 0;
+}
+
+static void RemoveTree(const std::string &path) {
+  if (nftw(path.c_str(), RemoveEntry, 64, FTW_DEPTH | FTW_PHYS) < 0 &&
+      errno != ENOENT) {
+    DIE("nftw(%s)", path.c_str());
+  }
+}
+
+// Runs the command and returns its wall time in microseconds.
+static double Run(const std::vector<std::string> &command) {
+  std::vector<char *> args;
+  for (const std::string &arg : command) {
+    args.push_back(const_cast<char *>(arg.c_str()));
+  }
+  args.push_back(nullptr);
+
+  double start = NowMicros();
+  pid_t pid = SpawnCommand(args.data(), -1, nullptr, nullptr, nullptr);
+  if (pid < 0) {
+    DIE("SpawnCommand(%s)", args[0]);
+  }
+  if (WaitChild(pid) != 0) {
+    fprintf(stderr, "%s failed\n", args[0]);
+    exit(EXIT_FAILURE);
+  }
+  return NowMicros() - start;
+}
+
+static tools::protos::ExecutionTimes ReadTimes(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    DIE("open(%s)", path.c_str());
+  }
+  tools::protos::ExecutionStatistics stats;
+  if (!stats.ParseFromFileDescriptor(fd)) {
+    fprintf(stderr, "could not parse %s\n", path.c_str());
+    exit(EXIT_FAILURE);
+  }
+  if (close(fd) < 0) {
+    DIE("close");
+  }
+  return stats.execution_times();
+}
+
+static void PrintPhases(std::vector<Phase> *phases) {
+  printf("  %-14s %10s %10s\n", "phase", "p50 (us)", "p99 (us)");
+  for (Phase &phase : *phases) {
+    std::vector<double> &latencies = phase.latencies;
+    std::sort(latencies.begin(), latencies.end());
+    printf("  %-14s %10.1f %10.1f\n", phase.name,
+           latencies[latencies.size() / 2],
+           latencies[latencies.size() * 99 / 100]);
+  }
+}
+
+static void BenchmarkLinuxSandbox(const std::string &linux_sandbox,
+                                  int bind_mounts,
+                                  const std::vector<std::string> &extra_args) {
+  std::string sandbox_dir = root + "/sandbox";
+  std::string stats_path = root + "/stats";
+  std::vector<std::string> command = {linux_sandbox, "-W", sandbox_dir, "-S",
+                                      stats_path};
+  if (bind_mounts > 0) {
+    std::string binds_dir = root + "/binds";
+    std::string mounts;
+    if (mkdir(binds_dir.c_str(), 0755) < 0) {
+      DIE("mkdir(%s)", binds_dir.c_str());
+    }
+    for (int i = 0; i < bind_mounts; ++i) {
+      std::string dir = binds_dir + "/" + std::to_string(i);
+      if (mkdir(dir.c_str(), 0755) < 0) {
+        DIE("mkdir(%s)", dir.c_str());
+      }
+      mounts += dir + "\n";
+    }
+    WriteFile(root + "/bind_mounts", mounts);
+    command.push_back("--bind_mounts");
+    command.push_back(root + "/bind_mounts");
+  }
+  command.insert(command.end(), extra_args.begin(), extra_args.end());
+  command.push_back("--");
+  command.push_back("/bin/true");
+
+  std::vector<Phase> phases = {
+      Phase("clone"), Phase("id mapping"), Phase("mounts"), Phase("read-only"),
+      Phase("proc"),  Phase("exec"),       Phase("setup"),  Phase("wall"),
+  };
+  for (int i = 0; i < runs; ++i) {
+    double wall = Run(command);
+    tools::protos::ExecutionTimes times = ReadTimes(stats_path);
+    const int64_t ends[kNumSetupPhases] = {
+        times.clone_time_usec(),  times.id_mapping_time_usec(),
+        times.mounts_time_usec(), times.read_only_time_usec(),
+        times.proc_time_usec(),
+    };
+    // Steps that were skipped, like the id mapping when running from a
+    // template, take no time.
+    int64_t previous = times.start_time_usec();
+    for (int phase = 0; phase < kNumSetupPhases; ++phase) {
+      int64_t end = ends[phase] != 0 ? ends[phase] : previous;
+      phases[phase].latencies.push_back(end - previous);
+      previous = end;
+    }
+    phases[kNumSetupPhases].latencies.push_back(times.exec_time_usec() -
+                                                previous);
+    phases[kNumSetupPhases + 1].latencies.push_back(times.exec_time_usec() -
+                                                    times.start_time_usec());
+    phases[kNumSetupPhases + 2].latencies.push_back(wall);
+  }
+
+  printf("linux-sandbox with %d bind mounts", bind_mounts);
+  for (const std::string &arg : extra_args) {
+    printf(" %s", arg.c_str());
+  }
+  printf("\n");
+  PrintPhases(&phases);
+}
+
+static void BenchmarkProcessWrapper(const std::string &process_wrapper) {
+  std::string stats_path = root + "/stats";
+  std::vector<std::string> command = {process_wrapper, "--stats", stats_path,
+                                      "--", "/bin/true"};
+  std::vector<Phase> phases = {Phase("exec"), Phase("wall")};
+  for (int i = 0; i < runs; ++i) {
+    double wall = Run(command);
+    tools::protos::ExecutionTimes times = ReadTimes(stats_path);
+    phases[0].latencies.push_back(times.exec_time_usec() -
+                                  times.start_time_usec());
+    phases[1].latencies.push_back(wall);
+  }
+  printf("process-wrapper\n");
+  PrintPhases(&phases);
+}
+
+static void BenchmarkBuildRunfiles(const std::string &build_runfiles,
+                                   int entries) {
+  std::string manifest;
+  for (int i = 0; i < entries; ++i) {
+    manifest += "dir" + std::to_string(i % 100) + "/file" + std::to_string(i) +
+                " /bin/true\n";
+  }
+  std::string manifest_path = root + "/MANIFEST";
+  std::string runfiles_dir = root + "/runfiles";
+  WriteFile(manifest_path, manifest);
+  std::vector<std::string> command = {build_runfiles, manifest_path,
+                                      runfiles_dir};
+  std::vector<Phase> phases = {Phase("wall")};
+  for (int i = 0; i < runs; ++i) {
+    phases[0].latencies.push_back(Run(command));
+    RemoveTree(runfiles_dir);
+  }
+  printf("build-runfiles, %d entries\n", entries);
+  PrintPhases(&phases);
+}
+
+static void Usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [--runs N] [--linux_sandbox PATH] [--bind_mounts N] "
+          "[--process_wrapper PATH] [--build_runfiles PATH] [--runfiles N] "
+          "[-- linux-sandbox args...]\n",
+          program);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {
+      {"runs", required_argument, nullptr, 'n'},
+      {"linux_sandbox", required_argument, nullptr, 'l'},
+      {"bind_mounts", required_argument, nullptr, 'b'},
+      {"process_wrapper", required_argument, nullptr, 'p'},
+      {"build_runfiles", required_argument, nullptr, 'r'},
+      {"runfiles", required_argument, nullptr, 'f'},
+      {nullptr, 0, nullptr, 0}};
+  std::string linux_sandbox, process_wrapper, build_runfiles;
+  int bind_mounts = 0;
+  int runfiles = 1000;
+  int c;
+  while ((c = getopt_long(argc, argv, "", long_options, nullptr)) != -1) {
+    switch (c) {
+      case 'n':
+        runs = atoi(optarg);
+        break;
+      case 'l':
+        linux_sandbox = optarg;
+        break;
+      case 'b':
+        bind_mounts = atoi(optarg);
+        break;
+      case 'p':
+        process_wrapper = optarg;
+        break;
+      case 'r':
+        build_runfiles = optarg;
+        break;
+      case 'f':
+        runfiles = atoi(optarg);
+        break;
+      default:
+        Usage(argv[0]);
+    }
+  }
+  if (runs <= 0 || bind_mounts < 0 || runfiles < 0 ||
+      (linux_sandbox.empty() && process_wrapper.empty() &&
+       build_runfiles.empty())) {
+    Usage(argv[0]);
+  }
+  std::vector<std::string> extra_args(argv + optind, argv + argc);
+
+  const char *tmpdir = getenv("TMPDIR");
+  std::string root_template =
+      std::string(tmpdir != nullptr ? tmpdir : "/tmp") +
+      "/sandbox-benchmark.XXXXXX";
+  if (mkdtemp(&root_template[0]) == nullptr) {
+    DIE("mkdtemp(%s)", root_template.c_str());
+  }
+  root = root_template;
+  std::string sandbox_dir = root + "/sandbox";
+  if (mkdir(sandbox_dir.c_str(), 0755) < 0) {
+    DIE("mkdir(%s)", sandbox_dir.c_str());
+  }
+
+  printf("%d runs of each tool\n", runs);
+  if (!linux_sandbox.empty()) {
+    BenchmarkLinuxSandbox(linux_sandbox, bind_mounts, extra_args);
+  }
+  if (!process_wrapper.empty()) {
+    BenchmarkProcessWrapper(process_wrapper);
+  }
+  if (!build_runfiles.empty()) {
+    BenchmarkBuildRunfiles(build_runfiles, runfiles);
+  }
+
+  RemoveTree(root);
+  return 0;
+}
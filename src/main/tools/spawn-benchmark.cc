@@ -0,0 +1,108 @@
+// Copyright 2017 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// spawn-benchmark measures how long it takes to start and reap a trivial
+// command with fork()+execvp() and with SpawnCommand(), which borrows the
+// parent's address space like vfork(). To mimic a JVM, it first allocates and
+// touches the given amount of memory, which fork() has to copy the page tables
+// of.
+//
+// Usage: spawn-benchmark [memory in MiB] [runs] [command args...]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "src/main/tools/logging.h"
+#include "src/main/tools/process-tools.h"
+
+static pid_t ForkAndExec(char *const *args) {
+  pid_t pid = fork();
+  if (pid < 0) {
+    DIE("fork");
+  } else if (pid == 0) {
+    execvp(args[0], args);
+    _exit(EXIT_FAILURE);
+  }
+  return pid;
+}
+
+static pid_t Spawn(char *const *args) {
+  pid_t pid = SpawnCommand(args, -1, nullptr, nullptr, nullptr);
+  if (pid < 0) {
+    DIE("SpawnCommand");
+  }
+  return pid;
+}
+
+static double NowMicros() {
+  struct timespec ts;
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0) {
+    DIE("clock_gettime");
+  }
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void Measure(const char *name, pid_t (*spawn)(char *const *),
+                    char *const *args, int runs) {
+  std::vector<double> latencies;
+  for (int i = 0; i < runs; ++i) {
+    double start = NowMicros();
+    pid_t pid = spawn(args);
+    // Only the time until the parent can go on counts, not the command's.
+    latencies.push_back(NowMicros() - start);
+    if (WaitChild(pid) != 0) {
+      fprintf(stderr, "%s failed\n", args[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+  std::sort(latencies.begin(), latencies.end());
+  printf("%-12s p50 %8.1f us  p99 %8.1f us\n", name,
+         latencies[latencies.size() / 2],
+         latencies[latencies.size() * 99 / 100]);
+}
+
+int main(int argc, char *argv[]) {
+  size_t memory_mib = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1024;
+  int runs = argc > 2 ? atoi(argv[2]) : 200;
+  std::vector<char *> args;
+  if (argc > 3) {
+    args.assign(argv + 3, argv + argc);
+  } else {
+    args.push_back(const_cast<char *>("/bin/true"));
+  }
+  args.push_back(nullptr);
+  if (runs <= 0) {
+    fprintf(stderr, "Usage: %s [memory in MiB] [runs] [command args...]\n",
+            argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  std::vector<char> ballast(memory_mib << 20);
+  for (size_t i = 0; i < ballast.size(); i += 4096) {
+    ballast[i] = 1;
+  }
+
+  printf("%zu MiB resident, %d runs of %s\n", memory_mib, runs, args[0]);
+  Measure("fork+exec", ForkAndExec, args.data(), runs);
+  Measure("vfork-style", Spawn, args.data(), runs);
+  return 0;
+}
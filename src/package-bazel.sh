@@ -47,3 +47,20 @@ if [ -n "${EMBEDDED_TOOLS}" ]; then
 fi
 
 (cd ${PACKAGE_DIR} && find . -type f | sort | zip -qDX@ "${WORKDIR}/${OUT}")
+
+# Store an index of the package in the zip comment, which ends the binary, so
+# that the client can learn the install key and the embedded files with a
+# single read instead of walking the central directory. It lists the install
+# key and the files in zip order, followed by a checksum line. If the index
+# does not fit into a zip comment, the client falls back to reading the zip.
+INDEX="${PACKAGE_DIR}/install_index"
+{
+  tr -d ' \t\r\n' < "${INSTALL_BASE_KEY}"
+  echo
+  unzip -Z1 "${WORKDIR}/${OUT}"
+} > "${INDEX}"
+echo "INSTALL_INDEX $(cksum < "${INDEX}")" >> "${INDEX}"
+# zip stores the line breaks of comments as CRLF.
+if [ $(( $(wc -c < "${INDEX}") + $(wc -l < "${INDEX}") )) -le 65535 ]; then
+  zip -qz "${WORKDIR}/${OUT}" < "${INDEX}"
+fi
@@ -90,6 +90,7 @@ TEST_F(BazelStartupOptionsTest, ValidStartupFlags) {
   ExpectIsNullaryOption(options, "ignore_all_rc_files");
   ExpectIsNullaryOption(options, "master_bazelrc");
   ExpectIsNullaryOption(options, "system_rc");
+  ExpectIsNullaryOption(options, "verify_install_base");
   ExpectIsNullaryOption(options, "watchfs");
   ExpectIsNullaryOption(options, "workspace_rc");
   ExpectIsNullaryOption(options, "write_command_log");
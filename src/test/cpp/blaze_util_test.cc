@@ -23,6 +23,7 @@
 #include "src/main/cpp/blaze_util.h"
 #include "src/main/cpp/blaze_util_platform.h"
 #include "src/main/cpp/util/file.h"
+#include "src/main/cpp/util/path.h"
 #include "googletest/include/gtest/gtest.h"
 
 namespace blaze {
@@ -211,4 +212,91 @@ TEST_F(BlazeUtilTest, TestSearchUnarySkipsAfterDashDashWithoutEquals) {
                    "--flag"));
 }
 
+// Returns the end of a zip file with the given comment.
+static string ZipTail(const string& comment) {
+  string tail("central directory PK\x05\x06", 22);
+  tail.append(16, '\0');
+  tail.push_back(comment.size() & 0xff);
+  tail.push_back(comment.size() >> 8);
+  return tail + comment;
+}
+
+TEST_F(BlazeUtilTest, TestParseInstallIndex) {
+  string install_md5;
+  std::vector<string> files;
+  // Like zip stores the comment, with CRLF line breaks and without the last.
+  ASSERT_TRUE(ParseInstallIndex(
+      ZipTail("d41d8cd98f00b204e9800998ecf8427e\r\n"
+              "A-server.jar\r\n"
+              "embedded_tools/BUILD\r\n"
+              "libunix.so\r\n"
+              "INSTALL_INDEX 1501915967 78"),
+      &install_md5, &files));
+  ASSERT_EQ("d41d8cd98f00b204e9800998ecf8427e", install_md5);
+  ASSERT_EQ(std::vector<string>(
+                {"A-server.jar", "embedded_tools/BUILD", "libunix.so"}),
+            files);
+
+  ASSERT_TRUE(ParseInstallIndex(
+      ZipTail("d41d8cd98f00b204e9800998ecf8427e\n"
+              "A-server.jar\n"
+              "embedded_tools/BUILD\n"
+              "libunix.so\n"
+              "INSTALL_INDEX 1501915967 78\n"),
+      &install_md5, &files));
+  ASSERT_EQ(3, files.size());
+}
+
+TEST_F(BlazeUtilTest, TestParseInstallIndexRejectsBadIndex) {
+  const string lines =
+      "d41d8cd98f00b204e9800998ecf8427e\n"
+      "A-server.jar\n"
+      "embedded_tools/BUILD\n"
+      "libunix.so\n";
+  string install_md5;
+  std::vector<string> files;
+  // No index.
+  ASSERT_FALSE(ParseInstallIndex(ZipTail(""), &install_md5, &files));
+  ASSERT_FALSE(ParseInstallIndex(lines, &install_md5, &files));
+  // Wrong checksum or size.
+  ASSERT_FALSE(ParseInstallIndex(
+      ZipTail(lines + "INSTALL_INDEX 1501915968 78"), &install_md5, &files));
+  ASSERT_FALSE(ParseInstallIndex(
+      ZipTail(lines + "INSTALL_INDEX 1501915967 77"), &install_md5, &files));
+  ASSERT_FALSE(ParseInstallIndex(
+      ZipTail("x" + lines + "INSTALL_INDEX 1501915967 78"), &install_md5,
+      &files));
+  // Data after the comment.
+  ASSERT_FALSE(ParseInstallIndex(
+      ZipTail(lines + "INSTALL_INDEX 1501915967 78") + "more", &install_md5,
+      &files));
+}
+
+TEST_F(BlazeUtilTest, TestComputeInstallStamp) {
+  const string root = blaze_util::JoinPath(GetEnv("TEST_TMPDIR"), "stamp");
+  ASSERT_TRUE(blaze_util::MakeDirectories(
+      blaze_util::JoinPath(root, "embedded_tools"), 0755));
+  ASSERT_TRUE(blaze_util::WriteFile(
+      "jar", blaze_util::JoinPath(root, "A-server.jar"), 0755));
+  ASSERT_TRUE(blaze_util::WriteFile(
+      "build", blaze_util::JoinPath(root, "embedded_tools/BUILD"), 0755));
+  const std::vector<string> files = {"A-server.jar", "embedded_tools/BUILD"};
+
+  string stamp1, stamp2;
+  ASSERT_TRUE(ComputeInstallStamp(root, files, &stamp1));
+  ASSERT_EQ(32, stamp1.size());
+  ASSERT_TRUE(ComputeInstallStamp(root, files, &stamp2));
+  ASSERT_EQ(stamp1, stamp2);
+
+  // The stamp depends on the list of files and on their contents.
+  ASSERT_TRUE(ComputeInstallStamp(root, {"A-server.jar"}, &stamp2));
+  ASSERT_NE(stamp1, stamp2);
+  ASSERT_TRUE(blaze_util::WriteFile(
+      "jar2", blaze_util::JoinPath(root, "A-server.jar"), 0755));
+  ASSERT_TRUE(ComputeInstallStamp(root, files, &stamp2));
+  ASSERT_NE(stamp1, stamp2);
+
+  ASSERT_FALSE(ComputeInstallStamp(root, {"libunix.so"}, &stamp2));
+}
+
 }  // namespace blaze
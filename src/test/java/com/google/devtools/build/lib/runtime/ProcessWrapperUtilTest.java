@@ -86,4 +86,12 @@ public final class ProcessWrapperUtilTest {
 
     assertThat(commandLine).containsExactlyElementsIn(expectedCommandLine).inOrder();
   }
+
+  @Test
+  public void testFormatSeconds() {
+    assertThat(ProcessWrapperUtil.formatSeconds(Duration.ofSeconds(10))).isEqualTo("10");
+    assertThat(ProcessWrapperUtil.formatSeconds(Duration.ofMillis(250))).isEqualTo("0.25");
+    assertThat(ProcessWrapperUtil.formatSeconds(Duration.ofSeconds(3, 1000)))
+        .isEqualTo("3.000001");
+  }
 }
@@ -172,4 +172,73 @@ public final class LinuxSandboxUtilTest {
 
     assertThat(commandLine).containsExactlyElementsIn(expectedCommandLine).inOrder();
   }
+
+  @Test
+  public void testLinuxSandboxCommandLineBuilder_BuildsWithOverlay() {
+    Path linuxSandboxPath = testFS.getPath("/linux-sandbox");
+    ImmutableList<String> commandArguments = ImmutableList.of("echo", "hello, ovid");
+    Path upperDir = testFS.getPath("/sandbox/upper");
+    Path workDir = testFS.getPath("/sandbox/work");
+    Path inputsManifest = testFS.getPath("/sandbox/inputs.manifest");
+
+    List<String> commandLine =
+        LinuxSandboxUtil.commandLineBuilder(linuxSandboxPath, commandArguments)
+            .setOverlayDirectories(upperDir, workDir)
+            .setOverlayInputsManifest(inputsManifest)
+            .build();
+
+    assertThat(commandLine)
+        .containsExactly(
+            linuxSandboxPath.getPathString(),
+            "--overlay_upper",
+            upperDir.getPathString(),
+            "--overlay_work",
+            workDir.getPathString(),
+            "--overlay_inputs",
+            inputsManifest.getPathString(),
+            "--",
+            "echo",
+            "hello, ovid")
+        .inOrder();
+  }
+
+  @Test
+  public void testLinuxSandboxCommandLineBuilder_BuildsWithConnectSocket() {
+    Path linuxSandboxPath = testFS.getPath("/linux-sandbox");
+    ImmutableList<String> commandArguments = ImmutableList.of("echo", "hello, sam");
+    Path socket = testFS.getPath("/sandbox/linux-sandbox.sock");
+
+    List<String> commandLine =
+        LinuxSandboxUtil.commandLineBuilder(linuxSandboxPath, commandArguments)
+            .setConnectSocket(socket)
+            .setUseFakeUsername(true)
+            .build();
+
+    assertThat(commandLine)
+        .containsExactly(
+            linuxSandboxPath.getPathString(),
+            "--connect",
+            socket.getPathString(),
+            "-U",
+            "--",
+            "echo",
+            "hello, sam")
+        .inOrder();
+  }
+
+  @Test
+  public void testLinuxSandboxCommandLineBuilder_overlayRequiresInputsManifest() {
+    Path linuxSandboxPath = testFS.getPath("/linux-sandbox");
+    ImmutableList<String> commandArguments = ImmutableList.of("echo", "hello, ovid");
+
+    Exception e =
+        assertThrows(
+            IllegalStateException.class,
+            () ->
+                LinuxSandboxUtil.commandLineBuilder(linuxSandboxPath, commandArguments)
+                    .setOverlayDirectories(
+                        testFS.getPath("/sandbox/upper"), testFS.getPath("/sandbox/work"))
+                    .build());
+    assertThat(e).hasMessageThat().contains("inputs manifest");
+  }
 }
@@ -0,0 +1,109 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.devtools.build.lib.sandbox;
+
+import static com.google.common.truth.Truth.assertThat;
+import static java.nio.charset.StandardCharsets.ISO_8859_1;
+
+import com.google.common.collect.ImmutableList;
+import com.google.common.collect.ImmutableMap;
+import com.google.common.collect.ImmutableSet;
+import com.google.devtools.build.lib.vfs.FileSystemUtils;
+import com.google.devtools.build.lib.vfs.Path;
+import com.google.devtools.build.lib.vfs.PathFragment;
+import com.google.devtools.build.lib.vfs.Symlinks;
+import java.io.IOException;
+import java.util.HashMap;
+import java.util.Map;
+import org.junit.Before;
+import org.junit.Test;
+import org.junit.runner.RunWith;
+import org.junit.runners.JUnit4;
+
+/** Tests for {@link OverlaySandboxedSpawn}. */
+@RunWith(JUnit4.class)
+public class OverlaySandboxedSpawnTest extends SandboxTestCase {
+  private Path workspaceDir;
+  private Path sandboxDir;
+  private Path execRoot;
+  private Path outputsDir;
+
+  @Before
+  public final void setupTestDirs() throws IOException {
+    workspaceDir = testRoot.getRelative("workspace");
+    workspaceDir.createDirectory();
+    sandboxDir = testRoot.getRelative("sandbox");
+    sandboxDir.createDirectory();
+    execRoot = sandboxDir.getRelative("execroot");
+    execRoot.createDirectory();
+    outputsDir = testRoot.getRelative("outputs");
+    outputsDir.createDirectory();
+  }
+
+  @Test
+  public void createFileSystem() throws Exception {
+    Path helloTxt = workspaceDir.getRelative("hello.txt");
+    FileSystemUtils.createEmptyFile(helloTxt);
+    Map<PathFragment, Path> inputs = new HashMap<>();
+    inputs.put(PathFragment.create("such/input.txt"), helloTxt);
+    inputs.put(PathFragment.create("such/empty.txt"), null);
+
+    OverlaySandboxedSpawn overlayExecRoot =
+        new OverlaySandboxedSpawn(
+            sandboxDir,
+            execRoot,
+            ImmutableList.of("/bin/true"),
+            ImmutableMap.of(),
+            inputs,
+            ImmutableSet.of(PathFragment.create("very/output.txt")),
+            ImmutableSet.of(execRoot.getRelative("wow/writable")));
+
+    overlayExecRoot.createFileSystem();
+
+    // The inputs are only created by the linux-sandbox, from the manifest.
+    assertThat(execRoot.getDirectoryEntries()).isEmpty();
+    assertThat(
+            FileSystemUtils.readLines(
+                OverlaySandboxedSpawn.getInputsManifest(sandboxDir), ISO_8859_1))
+        .containsExactly("such/input.txt " + helloTxt.getPathString(), "such/empty.txt ");
+    Path upperDir = OverlaySandboxedSpawn.getUpperDirectory(sandboxDir);
+    assertThat(upperDir.getRelative("very").isDirectory()).isTrue();
+    assertThat(upperDir.getRelative("wow/writable").isDirectory()).isTrue();
+    assertThat(OverlaySandboxedSpawn.getWorkDirectory(sandboxDir).isDirectory()).isTrue();
+  }
+
+  @Test
+  public void copyOutputs() throws Exception {
+    OverlaySandboxedSpawn overlayExecRoot =
+        new OverlaySandboxedSpawn(
+            sandboxDir,
+            execRoot,
+            ImmutableList.of("/bin/true"),
+            ImmutableMap.of(),
+            ImmutableMap.of(),
+            ImmutableSet.of(PathFragment.create("very/output.txt")),
+            ImmutableSet.of());
+    overlayExecRoot.createFileSystem();
+
+    // Writes to the execRoot end up in the upper directory of the overlay filesystem.
+    FileSystemUtils.createEmptyFile(
+        OverlaySandboxedSpawn.getUpperDirectory(sandboxDir).getRelative("very/output.txt"));
+
+    outputsDir.getRelative("very").createDirectory();
+    overlayExecRoot.copyOutputs(outputsDir);
+
+    assertThat(outputsDir.getRelative("very/output.txt").isFile(Symlinks.NOFOLLOW)).isTrue();
+  }
+}
@@ -23,6 +23,7 @@ import com.google.devtools.build.lib.vfs.FileSystem;
 import com.google.devtools.build.lib.vfs.Path;
 import java.io.BufferedOutputStream;
 import java.time.Duration;
+import java.time.Instant;
 import java.util.Optional;
 import org.junit.Before;
 import org.junit.Test;
@@ -137,4 +138,106 @@ public final class ExecutionStatisticsTest {
     assertThat(resourceUsage.getInvoluntaryContextSwitches())
         .isEqualTo(riggedInvoluntaryContextSwitches);
   }
+
+  @Test
+  public void testNoCgroupUsage_whenNoCgroupUsageProto() throws Exception {
+    com.google.devtools.build.lib.shell.Protos.ExecutionStatistics executionStatisticsProto =
+        com.google.devtools.build.lib.shell.Protos.ExecutionStatistics.newBuilder()
+            .setResourceUsage(
+                com.google.devtools.build.lib.shell.Protos.ResourceUsage.getDefaultInstance())
+            .build();
+    Path protoFilename = createExecutionStatisticsProtoFile(executionStatisticsProto);
+
+    Optional<ExecutionStatistics.CgroupUsage> cgroupUsage =
+        ExecutionStatistics.getCgroupUsage(protoFilename);
+    assertThat(cgroupUsage).isEmpty();
+  }
+
+  @Test
+  public void testCgroupStatisticsProvided_fromProtoFilename() throws Exception {
+    com.google.devtools.build.lib.shell.Protos.CgroupUsage cgroupUsageProto =
+        com.google.devtools.build.lib.shell.Protos.CgroupUsage.newBuilder()
+            .setMemoryPeakBytes(1)
+            .setMemoryOomKills(2)
+            .setCpuUsageUsec(3000003)
+            .setCpuUserUsec(2000001)
+            .setCpuSystemUsec(1000002)
+            .setIoReadBytes(4)
+            .setIoWriteBytes(5)
+            .setPidsPeak(6)
+            .setCpuPressureSomeUsec(7)
+            .setMemoryPressureSomeUsec(8)
+            .setMemoryPressureFullUsec(9)
+            .setIoPressureSomeUsec(10)
+            .setIoPressureFullUsec(11)
+            .build();
+
+    com.google.devtools.build.lib.shell.Protos.ExecutionStatistics executionStatisticsProto =
+        com.google.devtools.build.lib.shell.Protos.ExecutionStatistics.newBuilder()
+            .setCgroupUsage(cgroupUsageProto)
+            .build();
+    Path protoFilename = createExecutionStatisticsProtoFile(executionStatisticsProto);
+
+    Optional<ExecutionStatistics.CgroupUsage> maybeCgroupUsage =
+        ExecutionStatistics.getCgroupUsage(protoFilename);
+    assertThat(maybeCgroupUsage).isPresent();
+    ExecutionStatistics.CgroupUsage cgroupUsage = maybeCgroupUsage.get();
+
+    assertThat(cgroupUsage.getMemoryPeak()).isEqualTo(1);
+    assertThat(cgroupUsage.getMemoryOomKills()).isEqualTo(2);
+    assertThat(cgroupUsage.getCpuTime()).isEqualTo(Duration.ofSeconds(3).plusNanos(3000));
+    assertThat(cgroupUsage.getUserCpuTime()).isEqualTo(Duration.ofSeconds(2).plusNanos(1000));
+    assertThat(cgroupUsage.getSystemCpuTime()).isEqualTo(Duration.ofSeconds(1).plusNanos(2000));
+    assertThat(cgroupUsage.getIoReadBytes()).isEqualTo(4);
+    assertThat(cgroupUsage.getIoWriteBytes()).isEqualTo(5);
+    assertThat(cgroupUsage.getPidsPeak()).isEqualTo(6);
+    assertThat(cgroupUsage.getCpuPressureSome()).isEqualTo(Duration.ofNanos(7000));
+    assertThat(cgroupUsage.getMemoryPressureSome()).isEqualTo(Duration.ofNanos(8000));
+    assertThat(cgroupUsage.getMemoryPressureFull()).isEqualTo(Duration.ofNanos(9000));
+    assertThat(cgroupUsage.getIoPressureSome()).isEqualTo(Duration.ofNanos(10000));
+    assertThat(cgroupUsage.getIoPressureFull()).isEqualTo(Duration.ofNanos(11000));
+  }
+
+  @Test
+  public void testNoExecutionTimes_whenNoExecutionTimesProto() throws Exception {
+    com.google.devtools.build.lib.shell.Protos.ExecutionStatistics executionStatisticsProto =
+        com.google.devtools.build.lib.shell.Protos.ExecutionStatistics.newBuilder()
+            .setResourceUsage(
+                com.google.devtools.build.lib.shell.Protos.ResourceUsage.getDefaultInstance())
+            .build();
+    Path protoFilename = createExecutionStatisticsProtoFile(executionStatisticsProto);
+
+    Optional<ExecutionStatistics.ExecutionTimes> executionTimes =
+        ExecutionStatistics.getExecutionTimes(protoFilename);
+    assertThat(executionTimes).isEmpty();
+  }
+
+  @Test
+  public void testExecutionTimesProvided_fromProtoFilename() throws Exception {
+    com.google.devtools.build.lib.shell.Protos.ExecutionTimes executionTimesProto =
+        com.google.devtools.build.lib.shell.Protos.ExecutionTimes.newBuilder()
+            .setStartTimeUsec(1500000000000001L)
+            .setExecTimeUsec(1500000000002501L)
+            .setExitTimeUsec(1500000001250001L)
+            .build();
+
+    com.google.devtools.build.lib.shell.Protos.ExecutionStatistics executionStatisticsProto =
+        com.google.devtools.build.lib.shell.Protos.ExecutionStatistics.newBuilder()
+            .setExecutionTimes(executionTimesProto)
+            .build();
+    Path protoFilename = createExecutionStatisticsProtoFile(executionStatisticsProto);
+
+    Optional<ExecutionStatistics.ExecutionTimes> maybeExecutionTimes =
+        ExecutionStatistics.getExecutionTimes(protoFilename);
+    assertThat(maybeExecutionTimes).isPresent();
+    ExecutionStatistics.ExecutionTimes executionTimes = maybeExecutionTimes.get();
+
+    assertThat(executionTimes.getStartTime())
+        .isEqualTo(Instant.ofEpochSecond(1500000000, 1000));
+    assertThat(executionTimes.getExecTime())
+        .hasValue(Instant.ofEpochSecond(1500000000, 2501000));
+    assertThat(executionTimes.getExitTime())
+        .isEqualTo(Instant.ofEpochSecond(1500000001, 250001000));
+    assertThat(executionTimes.getWallTime()).isEqualTo(Duration.ofMillis(1250));
+  }
 }
@@ -0,0 +1,116 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+package com.google.devtools.build.lib.unix;
+
+import com.google.caliper.AfterExperiment;
+import com.google.caliper.BeforeExperiment;
+import com.google.caliper.Benchmark;
+import com.google.caliper.Param;
+import java.io.File;
+import java.io.IOException;
+import java.nio.file.Files;
+import java.nio.file.Paths;
+
+/**
+ * Microbenchmarks for the per-call overhead of the {@link NativePosixFiles} JNI methods that run
+ * most often during a build. The file system work behind each call is kept trivial (everything is
+ * in the page cache), so the numbers are dominated by argument and result marshalling.
+ */
+public class NativePosixFilesBenchmark {
+  /** Longest file name that common file systems accept. */
+  private static final int NAME_MAX = 255;
+
+  /**
+   * Length of the paths passed to the native methods, not counting the short temporary directory
+   * they live in; real execroot paths are often long.
+   */
+  @Param({"16", "128", "1024"})
+  int pathLength;
+
+  /** Number of entries in the directory read by {@link #readdir}. */
+  @Param({"10", "1000"})
+  int dirEntries;
+
+  private File root;
+  private String file;
+  private String link;
+  private String dir;
+
+  @BeforeExperiment
+  void createFiles() throws IOException {
+    // Keep the root short and independent of $TMPDIR, so that pathLength decides the length.
+    root = Files.createTempDirectory(Paths.get("/tmp"), "npfb").toFile();
+    // Leave room for the "/f" of the file below.
+    int dirLength = pathLength - 2;
+    StringBuilder name = new StringBuilder(root.getPath());
+    for (int length = 0; length < dirLength; ) {
+      int component = Math.max(1, Math.min(NAME_MAX, dirLength - length - 1));
+      name.append('/');
+      for (int i = 0; i < component; i++) {
+        name.append('x');
+      }
+      length += component + 1;
+      NativePosixFiles.mkdir(name.toString(), 0755);
+    }
+    dir = name.toString();
+    for (int i = 0; i < dirEntries; i++) {
+      new File(dir, "entry" + i).createNewFile();
+    }
+    file = dir + "/f";
+    new File(file).createNewFile();
+    link = dir + "/l";
+    NativePosixFiles.symlink(file, link);
+  }
+
+  @AfterExperiment
+  void deleteFiles() throws IOException {
+    NativePosixFiles.rmTree(root.getPath());
+  }
+
+  @Benchmark
+  int stat(int reps) throws IOException {
+    int dummy = 0;
+    for (int i = 0; i < reps; i++) {
+      dummy += NativePosixFiles.stat(file).getPermissions();
+    }
+    return dummy;
+  }
+
+  @Benchmark
+  int errnoLstat(int reps) {
+    int dummy = 0;
+    for (int i = 0; i < reps; i++) {
+      dummy += NativePosixFiles.errnoLstat(file).getPermissions();
+    }
+    return dummy;
+  }
+
+  @Benchmark
+  int readlink(int reps) throws IOException {
+    int dummy = 0;
+    for (int i = 0; i < reps; i++) {
+      dummy += NativePosixFiles.readlink(link).length();
+    }
+    return dummy;
+  }
+
+  @Benchmark
+  int readdir(int reps) throws IOException {
+    int dummy = 0;
+    for (int i = 0; i < reps; i++) {
+      dummy += NativePosixFiles.readdir(dir, NativePosixFiles.ReadTypes.NOFOLLOW).size();
+    }
+    return dummy;
+  }
+}
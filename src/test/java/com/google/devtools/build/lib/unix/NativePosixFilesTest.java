@@ -117,6 +117,41 @@ public class NativePosixFilesTest {
     }
   }
 
+  @Test
+  public void testBatchOperations() throws Exception {
+    int count = 1000;  // More than fit into a single io_uring submission.
+    String[] dirs = new String[count];
+    String[] links = new String[count];
+    String[] targets = new String[count];
+    for (int i = 0; i < count; i++) {
+      dirs[i] = workingDir.getChild("dir" + i).getPathString();
+      links[i] = workingDir.getChild("link" + i).getPathString();
+      targets[i] = "dir" + i;
+    }
+    int[] success = new int[count];
+
+    assertThat(NativePosixFiles.batchMkdir(dirs, 0755)).isEqualTo(success);
+    assertThat(NativePosixFiles.batchMkdir(dirs, 0755)[0]).isNotEqualTo(0);
+    assertThat(NativePosixFiles.batchSymlink(targets, links)).isEqualTo(success);
+
+    ErrnoFileStatus[] stats = NativePosixFiles.batchStat(links);
+    ErrnoFileStatus[] lstats = NativePosixFiles.batchLstat(links);
+    for (int i = 0; i < count; i++) {
+      assertThat(stats[i].isDirectory()).isTrue();
+      assertThat(stats[i].getInodeNumber())
+          .isEqualTo(NativePosixFiles.stat(dirs[i]).getInodeNumber());
+      assertThat(lstats[i].isSymbolicLink()).isTrue();
+    }
+
+    String[] read = new String[count];
+    assertThat(NativePosixFiles.batchReadlink(links, read)).isEqualTo(success);
+    assertThat(read).isEqualTo(targets);
+
+    assertThat(NativePosixFiles.batchUnlink(links)).isEqualTo(success);
+    assertThat(NativePosixFiles.batchLstat(links)[0].getErrno())
+        .isEqualTo(ErrnoFileStatus.ENOENT);
+  }
+
   /** Skips the test if the file system does not support extended attributes. */
   private static void assumeXattrsSupported() throws Exception {
     // The standard file systems on macOS support extended attributes by default, so we can assume
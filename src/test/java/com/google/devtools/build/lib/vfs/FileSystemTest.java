@@ -18,6 +18,7 @@ import static java.nio.charset.StandardCharsets.UTF_8;
 import static org.junit.Assert.fail;
 
 import com.google.common.base.Preconditions;
+import com.google.common.collect.ImmutableList;
 import com.google.common.io.BaseEncoding;
 import com.google.devtools.build.lib.testutil.MoreAsserts;
 import com.google.devtools.build.lib.testutil.TestUtils;
@@ -29,6 +30,8 @@ import java.io.IOException;
 import java.io.InputStream;
 import java.io.OutputStream;
 import java.nio.file.FileAlreadyExistsException;
+import java.util.ArrayList;
+import java.util.List;
 import java.util.regex.Matcher;
 import java.util.regex.Pattern;
 import org.junit.After;
@@ -288,6 +291,16 @@ public abstract class FileSystemTest {
     assertThat(nonDir.getRelative("file").statIfFound()).isNull();
   }
 
+  @Test
+  public void testBatchStatIfFound() throws Exception {
+    List<Path> paths = ImmutableList.of(xFile, xNothing, xEmptyDirectory);
+    List<FileStatus> statuses = testFS.batchStatIfFound(paths, /*followSymlinks=*/ false);
+    assertThat(statuses).hasSize(3);
+    assertThat(statuses.get(0).isFile()).isTrue();
+    assertThat(statuses.get(1)).isNull();
+    assertThat(statuses.get(2).isDirectory()).isTrue();
+  }
+
   // The following tests check the handling of the current working directory.
   @Test
   public void testCreatePathRelativeToWorkingDirectory() {
@@ -506,6 +519,33 @@ public abstract class FileSystemTest {
     MoreAsserts.assertThrows(IOException.class, theHierarchy::createDirectoryAndParents);
   }
 
+  @Test
+  public void testCreateDirectoriesAndParents() throws Exception {
+    List<Path> paths = new ArrayList<>();
+    for (int i = 0; i < 10; i++) {
+      paths.add(absolutize("outputs/dir" + i + "/sub"));
+      paths.add(absolutize("outputs/dir" + i));
+    }
+    Path existing = absolutize("outputs/dir3/sub/existing");
+    existing.createDirectoryAndParents();
+    paths.add(existing);
+
+    testFS.createDirectoriesAndParents(paths);
+    for (Path path : paths) {
+      assertThat(path.isDirectory()).isTrue();
+    }
+    assertThat(existing.getParentDirectory().getDirectoryEntries()).containsExactly(existing);
+  }
+
+  @Test
+  public void testCreateDirectoriesAndParentsWhenAncestorIsFile() throws IOException {
+    Path file = absolutize("outputs/file");
+    file.getParentDirectory().createDirectoryAndParents();
+    FileSystemUtils.createEmptyFile(file);
+    List<Path> paths = ImmutableList.of(absolutize("outputs/dir"), file.getChild("sub"));
+    MoreAsserts.assertThrows(IOException.class, () -> testFS.createDirectoriesAndParents(paths));
+  }
+
   @Test
   public void testCreateDirectoryAndParentsWhenSymlinkToDir() throws IOException {
     Path somewhereDeepIn = absolutize("somewhere/deep/in");
@@ -781,6 +821,68 @@ public abstract class FileSystemTest {
     assertThat(xNonEmptyDirectoryFoo.isFile()).isTrue();
   }
 
+  @Test
+  public void testDeleteTreesBelowRemovesContentsButNotDirectory() throws Exception {
+    Path topDir = absolutize("top-dir");
+    Path aDir = topDir.getRelative("a/b/c");
+    aDir.createDirectoryAndParents();
+    FileSystemUtils.createEmptyFile(aDir.getChild("file"));
+    FileSystemUtils.createEmptyFile(topDir.getChild("file"));
+    topDir.getRelative("d").createDirectory();
+
+    topDir.deleteTreesBelow();
+
+    assertThat(topDir.isDirectory(Symlinks.NOFOLLOW)).isTrue();
+    assertThat(topDir.getDirectoryEntries()).isEmpty();
+  }
+
+  @Test
+  public void testDeleteTreesBelowFixesPermissions() throws Exception {
+    Path topDir = absolutize("top-dir");
+    Path aDir = topDir.getRelative("a");
+    Path bDir = aDir.getRelative("b");
+    bDir.createDirectoryAndParents();
+    FileSystemUtils.createEmptyFile(bDir.getChild("file"));
+    bDir.setReadable(false);
+    bDir.setWritable(false);
+    aDir.setWritable(false);
+
+    topDir.deleteTreesBelow();
+
+    assertThat(topDir.getDirectoryEntries()).isEmpty();
+  }
+
+  @Test
+  public void testDeleteTreesBelowDoesNotFollowSymlinks() throws Exception {
+    Path topDir = absolutize("top-dir");
+    topDir.createDirectory();
+    createSymbolicLink(topDir.getChild("dir-link"), xNonEmptyDirectory);
+    createSymbolicLink(topDir.getChild("file-link"), xFile);
+
+    topDir.deleteTreesBelow();
+
+    assertThat(topDir.getDirectoryEntries()).isEmpty();
+    assertThat(xNonEmptyDirectoryFoo.isFile()).isTrue();
+    assertThat(xFile.isFile()).isTrue();
+  }
+
+  @Test
+  public void testDeleteTreesBelowIgnoresSymlinkToDirectory() throws Exception {
+    createSymbolicLink(xLink, xNonEmptyDirectory);
+
+    xLink.deleteTreesBelow();
+
+    assertThat(xLink.isSymbolicLink()).isTrue();
+    assertThat(xNonEmptyDirectoryFoo.isFile()).isTrue();
+  }
+
+  @Test
+  public void testDeleteTreeRemovesDirectory() throws Exception {
+    xNonEmptyDirectory.deleteTree();
+
+    assertThat(xNonEmptyDirectory.exists(Symlinks.NOFOLLOW)).isFalse();
+  }
+
   // Test the date functions
   @Test
   public void testCreateFileChangesTimeOfDirectory() throws Exception {
@@ -21,6 +21,8 @@ import com.google.devtools.build.lib.vfs.FileSystem.NotASymlinkException;
 import java.io.FileNotFoundException;
 import java.io.IOException;
 import java.util.Collection;
+import java.util.HashMap;
+import java.util.Map;
 import org.junit.Before;
 import org.junit.Test;
 
@@ -105,6 +107,41 @@ public abstract class SymlinkAwareFileSystemTest extends FileSystemTest {
       getDirectoryEntries()).containsExactly(newPath, linkPath);
   }
 
+  @Test
+  public void testCreateSymbolicLinkForest() throws IOException {
+    Map<PathFragment, PathFragment> links = new HashMap<>();
+    for (int i = 0; i < 10; i++) {
+      links.put(PathFragment.create("pkg" + i + "/sub/file"), xFile.asFragment());
+      links.put(PathFragment.create("pkg" + i + "/dir"), xNonEmptyDirectory.asFragment());
+    }
+    links.put(PathFragment.create("relative"), PathFragment.create("pkg0/dir"));
+
+    testFS.createSymbolicLinkForest(xEmptyDirectory, links);
+
+    for (Map.Entry<PathFragment, PathFragment> entry : links.entrySet()) {
+      Path link = xEmptyDirectory.getRelative(entry.getKey());
+      assertThat(link.isSymbolicLink()).isTrue();
+      assertThat(link.readSymbolicLink()).isEqualTo(entry.getValue());
+    }
+    assertThat(xEmptyDirectory.getRelative("relative/foo").isFile()).isTrue();
+  }
+
+  @Test
+  public void testCreateSymbolicLinkForestReportsFailures() throws IOException {
+    Map<PathFragment, PathFragment> links = new HashMap<>();
+    links.put(PathFragment.create("xFile/link"), xFile.asFragment());
+    links.put(PathFragment.create("ok"), xFile.asFragment());
+
+    try {
+      testFS.createSymbolicLinkForest(workingDir, links);
+      fail();
+    } catch (IOException e) {
+      assertThat(e).hasMessageThat().contains("xFile");
+    }
+    // Other links are created regardless.
+    assertThat(workingDir.getChild("ok").isSymbolicLink()).isTrue();
+  }
+
   @Test
   public void testFileCanonicalPath() throws IOException {
     Path newPath = absolutize("new-file");
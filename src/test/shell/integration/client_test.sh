@@ -75,6 +75,21 @@ function test_multiple_requests_same_server() {
   expect_not_log "WARNING.* Running B\\(azel\\|laze\\) server needs to be killed"
 }
 
+function test_unix_domain_socket() {
+  [[ "${PLATFORM}" == linux ]] || return 0
+  local server_pid1=$(bazel info server_pid 2>$TEST_log)
+  local socket="$(bazel info output_base 2>$TEST_log)/server/command.socket"
+  # Paths of Unix domain sockets are limited to 107 bytes.
+  (( ${#socket} < 108 )) || return 0
+  [[ -S "$socket" ]] || fail "Server does not listen on $socket"
+
+  # The client does not connect to ports on other hosts, so only the socket
+  # leads to the running server.
+  echo "192.0.2.1:1" > "$(dirname "$socket")/command_port"
+  local server_pid2=$(bazel info server_pid 2>$TEST_log)
+  assert_equals "$server_pid1" "$server_pid2"
+}
+
 function test_shutdown() {
   local server_pid1=$(bazel info server_pid 2>$TEST_log)
   bazel shutdown >& $TEST_log || fail "Expected success"
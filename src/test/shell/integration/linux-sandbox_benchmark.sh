@@ -0,0 +1,90 @@
+#!/bin/bash
+#
+# Copyright 2018 The Bazel Authors. All rights reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#    http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Measures how long linux-sandbox takes to set up a sandbox for a trivial
+# command, step by step, depending on the number of mount points on the host,
+# both with a single mount_setattr call and with one remount per mount point
+# for making the filesystem read-only. See sandbox-benchmark.cc for the steps.
+#
+# The extra mount points are tmpfs mounts in a private mount namespace, so the
+# host is not affected. Arguments after "--" are passed on to sandbox-benchmark,
+# e.g. "-- --bind_mounts=1000 -- -N -R" to also bind mount 1000 directories
+# into the sandbox and create network and user namespaces.
+#
+# Usage: linux-sandbox_benchmark.sh <sandbox-benchmark> <linux-sandbox> [runs]
+#            [extra mounts...] [-- sandbox-benchmark args...]
+
+set -euo pipefail
+
+if [[ $# -lt 2 ]]; then
+  echo "Usage: $0 <sandbox-benchmark> <linux-sandbox> [runs]" \
+      "[extra mounts...] [-- sandbox-benchmark args...]" >&2
+  exit 1
+fi
+
+if [[ -z "${LINUX_SANDBOX_BENCHMARK_UNSHARED:-}" ]]; then
+  unshare_opts="--mount --propagation private"
+  if [[ "$(id -u)" != 0 ]]; then
+    unshare_opts="--user --map-root-user $unshare_opts"
+  fi
+  LINUX_SANDBOX_BENCHMARK_UNSHARED=1 exec unshare $unshare_opts "$0" "$@"
+fi
+
+sandbox_benchmark="$(readlink -f "$1")"; shift
+linux_sandbox="$(readlink -f "$1")"; shift
+runs=100
+if [[ $# -gt 0 && "$1" != "--" ]]; then
+  runs="$1"; shift
+fi
+mount_counts=()
+while [[ $# -gt 0 && "$1" != "--" ]]; do
+  mount_counts+=("$1"); shift
+done
+if [[ ${#mount_counts[@]} -eq 0 ]]; then
+  mount_counts=(0 100 250 500 1000)
+fi
+shift || true
+benchmark_args=("$@")
+
+root="$(mktemp -d "${TMPDIR:-/tmp}/linux-sandbox-benchmark.XXXXXX")"
+mkdir "$root/mounts"
+mount -t tmpfs tmpfs "$root/mounts"
+
+extra=0
+for count in "${mount_counts[@]}"; do
+  for ((; extra < count; extra++)); do
+    mkdir "$root/mounts/$extra"
+    mount -t tmpfs tmpfs "$root/mounts/$extra"
+  done
+  for remount_option in "" "--remount_each_mount"; do
+    echo "== $count extra mounts ($(wc -l < /proc/self/mounts) in total)" \
+        "${remount_option:-with mount_setattr}"
+    # sandbox-benchmark only passes on linux-sandbox arguments after "--", so
+    # the extra option has to go to the end.
+    args=("${benchmark_args[@]}")
+    if [[ -n "$remount_option" ]]; then
+      if [[ " ${args[*]} " != *" -- "* ]]; then
+        args+=("--")
+      fi
+      args+=("$remount_option")
+    fi
+    TMPDIR="$root" "$sandbox_benchmark" --runs="$runs" \
+        --linux_sandbox="$linux_sandbox" "${args[@]}"
+  done
+done
+
+umount -R "$root/mounts"
+rm -rf "$root"
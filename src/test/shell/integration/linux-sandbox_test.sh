@@ -110,6 +110,38 @@ function test_timeout_kill() {
   expect_log "^before$"
 }
 
+function test_subsecond_timeout() {
+  local stats="${TEST_TMPDIR}/timeout.stats"
+  local start="$(date +%s%N)"
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS -T 0.2 -t 0.3 -S "${stats}" -- \
+    /bin/bash -c 'trap "" SIGTERM; sleep 1000' &> $TEST_log || code=$?
+  local elapsed_ms=$(( ($(date +%s%N) - start) / 1000000 ))
+  assert_equals 142 "$code" # SIGNAL_BASE + SIGALRM = 128 + 14
+  [[ "${elapsed_ms}" -lt 2000 ]] || fail "Sandbox took ${elapsed_ms}ms"
+
+  "${protoc_compiler}" --proto_path="${STATS_PROTO_DIR}" \
+      --decode tools.protos.ExecutionStatistics execution_statistics.proto \
+      < "${stats}" > "${TEST_log}"
+  expect_log "start_time_usec"
+  expect_log "exec_time_usec"
+  expect_log "exit_time_usec"
+}
+
+function test_stats_contain_setup_phases() {
+  local stats="${TEST_TMPDIR}/setup.stats"
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS -S "${stats}" -- /bin/true \
+    &> $TEST_log || fail
+
+  "${protoc_compiler}" --proto_path="${STATS_PROTO_DIR}" \
+      --decode tools.protos.ExecutionStatistics execution_statistics.proto \
+      < "${stats}" > "${TEST_log}"
+  expect_log "clone_time_usec"
+  expect_log "id_mapping_time_usec"
+  expect_log "mounts_time_usec"
+  expect_log "read_only_time_usec"
+  expect_log "proc_time_usec"
+}
+
 function test_debug_logging() {
   touch ${TEST_TMPDIR}/testfile
   $linux_sandbox $SANDBOX_DEFAULT_OPTS -D -- /bin/true &> $TEST_log || code=$?
@@ -184,6 +216,28 @@ function test_mount_additional_paths_other_flag_between_M_m_pair() {
   expect_log "The -m option must be strictly preceded by an -M option.\$"
 }
 
+function test_bind_mounts_file() {
+  mkdir -p ${TEST_TMPDIR}/foo ${TEST_TMPDIR}/bar ${MOUNT_TARGET_ROOT}/bar
+  echo "from file" > ${TEST_TMPDIR}/foo/testfile
+  touch ${TEST_TMPDIR}/bar/testfile
+  printf '%s\n\n%s\t%s\n' ${TEST_TMPDIR}/foo \
+    ${TEST_TMPDIR}/bar ${MOUNT_TARGET_ROOT}/bar > ${TEST_TMPDIR}/mounts
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS -D \
+    --bind_mounts ${TEST_TMPDIR}/mounts \
+    -- /bin/cat ${TEST_TMPDIR}/foo/testfile &> $TEST_log || fail
+  expect_log "from file"
+  expect_log "bind mount: ${TEST_TMPDIR}/foo -> ${TEST_TMPDIR}/foo\$"
+  expect_log "bind mount: ${TEST_TMPDIR}/bar -> ${MOUNT_TARGET_ROOT}/bar\$"
+}
+
+function test_bind_mounts_file_relative_path() {
+  echo "relative/path" > ${TEST_TMPDIR}/mounts
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS \
+    --bind_mounts ${TEST_TMPDIR}/mounts \
+    -- /bin/true &> $TEST_log && fail "Expected an error"
+  expect_log "must contain absolute paths only: relative/path"
+}
+
 function test_mount_additional_paths_multiple_sources_mount_to_one_target() {
   mkdir -p ${TEST_TMPDIR}/foo
   mkdir -p ${TEST_TMPDIR}/bar
@@ -223,6 +277,164 @@ function test_dev_shm_is_writable() {
     &> $TEST_log || fail
 }
 
+function start_sandbox_server() {
+  SANDBOX_SOCKET="${TEST_TMPDIR}/sandbox.sock"
+  "${linux_sandbox}" --server "${SANDBOX_SOCKET}" &
+  SANDBOX_SERVER_PID=$!
+  for i in $(seq 50); do
+    test -S "${SANDBOX_SOCKET}" && return 0
+    sleep 0.1
+  done
+  fail "sandbox server did not start"
+}
+
+function stop_sandbox_server() {
+  kill "${SANDBOX_SERVER_PID}"
+  wait "${SANDBOX_SERVER_PID}" || true
+}
+
+function test_server_runs_commands() {
+  start_sandbox_server
+  local code=0
+  $linux_sandbox --connect "${SANDBOX_SOCKET}" $SANDBOX_DEFAULT_OPTS -- \
+      /bin/bash -c "echo hi there; exit 42" &> $TEST_log || code=$?
+  stop_sandbox_server
+  expect_log "hi there"
+  assert_equals 42 "$code"
+}
+
+function test_server_sandboxes_are_isolated() {
+  start_sandbox_server
+  $linux_sandbox --connect "${SANDBOX_SOCKET}" $SANDBOX_DEFAULT_OPTS -- \
+      /bin/bash -c "touch $SANDBOX_DIR/foo" &> $TEST_log || fail
+  $linux_sandbox --connect "${SANDBOX_SOCKET}" $SANDBOX_DEFAULT_OPTS -- \
+      /bin/bash -c "touch $OUT_DIR/bar" &> $TEST_log && fail "Not sandboxed"
+  stop_sandbox_server
+  expect_log "Read-only file system"
+  [ -e "$SANDBOX_DIR/foo" ] || fail "Sandbox directory was not writable"
+}
+
+function test_server_redirect_output() {
+  start_sandbox_server
+  $linux_sandbox --connect "${SANDBOX_SOCKET}" $SANDBOX_DEFAULT_OPTS \
+      -l $OUT -L $ERR -- /bin/bash -c "echo out; echo err >&2" \
+      &> $TEST_log || fail
+  stop_sandbox_server
+  assert_equals "out" "$(cat $OUT)"
+  assert_equals "err" "$(cat $ERR)"
+}
+
+function test_server_passes_environment() {
+  start_sandbox_server
+  SANDBOX_TEST_VAR="from the client" \
+      $linux_sandbox --connect "${SANDBOX_SOCKET}" $SANDBOX_DEFAULT_OPTS -- \
+      /bin/bash -c 'echo "var=$SANDBOX_TEST_VAR"' &> $TEST_log || fail
+  stop_sandbox_server
+  expect_log "var=from the client"
+}
+
+function test_server_timeout() {
+  start_sandbox_server
+  local code=0
+  $linux_sandbox --connect "${SANDBOX_SOCKET}" $SANDBOX_DEFAULT_OPTS -T 1 -- \
+      /bin/sleep 100 &> $TEST_log || code=$?
+  stop_sandbox_server
+  assert_equals 142 "$code" # SIGNAL_BASE + SIGALRM = 128 + 14
+}
+
+# Returns whether the kernel lets unprivileged users mount overlayfs in their
+# user namespaces, which it does since Linux 5.11.
+function has_unprivileged_overlayfs() {
+  local version="$(uname -r)"
+  local major="${version%%.*}"
+  local minor="${version#*.}"
+  minor="${minor%%[!0-9]*}"
+  (( major > 5 || (major == 5 && minor >= 11) ))
+}
+
+function test_overlay() {
+  if ! has_unprivileged_overlayfs; then
+    echo "Skipping test: overlayfs cannot be mounted in user namespaces." 1>&2
+    return 0
+  fi
+  local overlay="${TEST_TMPDIR}/overlay"
+  rm -rf "$overlay"
+  mkdir -p "$overlay/lower/pkg" "$overlay/upper/out" "$overlay/work"
+  echo "from lower" > "$overlay/lower/pkg/lower.txt"
+  echo "from input" > "$overlay/input.txt"
+  printf "pkg/input.txt %s\npkg/sub/empty.txt \n" "$overlay/input.txt" \
+      > "$overlay/inputs.manifest"
+
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS \
+      --overlay_lower "$overlay/lower" \
+      --overlay_inputs "$overlay/inputs.manifest" \
+      --overlay_upper "$overlay/upper" \
+      --overlay_work "$overlay/work" \
+      -- /bin/bash -c "cat pkg/input.txt pkg/lower.txt; test -f pkg/sub/empty.txt \
+          && echo output > out/output.txt && echo changed > pkg/lower.txt" \
+      &> $TEST_log || fail
+  expect_log "from input"
+  expect_log "from lower"
+  assert_equals "output" "$(cat "$overlay/upper/out/output.txt")"
+  assert_equals "changed" "$(cat "$overlay/upper/pkg/lower.txt")"
+  assert_equals "from lower" "$(cat "$overlay/lower/pkg/lower.txt")"
+  [ -z "$(ls -A "$SANDBOX_DIR")" ] || fail "Overlay leaked into the working directory"
+}
+
+# Prints a cgroup (v2) directory in which the test may create cgroups, if any.
+function find_writable_cgroup() {
+  local mount_point="$(awk '$3 == "cgroup2" { print $2; exit }' /proc/self/mounts)"
+  local own_cgroup="$(sed -n 's/^0:://p' /proc/self/cgroup)"
+  local cgroup="${mount_point}${own_cgroup}"
+  if [[ -n "${mount_point}" ]] && mkdir "${cgroup}/linux-sandbox-test" 2>/dev/null; then
+    rmdir "${cgroup}/linux-sandbox-test"
+    echo "${cgroup}"
+  fi
+}
+
+function test_cgroup_kills_escaped_processes() {
+  local cgroup="$(find_writable_cgroup)"
+  if [[ -z "${cgroup}" ]]; then
+    echo "Skipping test: no writable cgroup (v2) available." 1>&2
+    return 0
+  fi
+  local stats="${TEST_TMPDIR}/cgroup.stats"
+
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS --cgroup_parent "${cgroup}" -S "${stats}" \
+      -- /bin/sh -c "setsid sleep 1234 & echo started" &> $TEST_log || fail
+  expect_log "started"
+  if pgrep -x -f "sleep 1234" > /dev/null; then
+    fail "Process that left the session survived the sandbox"
+  fi
+  [[ -z "$(ls -d "${cgroup}"/linux-sandbox-* 2>/dev/null)" ]] \
+      || fail "cgroup was not removed"
+
+  "${protoc_compiler}" --proto_path="${STATS_PROTO_DIR}" \
+      --decode tools.protos.ExecutionStatistics execution_statistics.proto \
+      < "${stats}" > "${TEST_log}"
+  expect_log "cgroup_usage"
+}
+
+function test_trace_records_file_accesses() {
+  local stats="${TEST_TMPDIR}/trace.stats"
+  echo "twelve bytes" > "${SANDBOX_DIR}/input.txt"
+
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS -w "${SANDBOX_DIR}" -S "${stats}" \
+      --trace -- /bin/sh -c \
+      "cat input.txt > output.txt; cat missing.txt 2> /dev/null; true" \
+      &> $TEST_log || fail
+
+  "${protoc_compiler}" --proto_path="${STATS_PROTO_DIR}" \
+      --decode tools.protos.FileAccessTrace execution_statistics.proto \
+      < "${stats}.trace" > "${TEST_log}"
+  expect_log "path: \"${SANDBOX_DIR}/input.txt\""
+  expect_log "bytes_read: 13"
+  expect_log "path: \"${SANDBOX_DIR}/output.txt\""
+  expect_log "bytes_written: 13"
+  expect_log "path: \"${SANDBOX_DIR}/missing.txt\""
+  expect_log "failed_opens: 1"
+}
+
 function assert_linux_sandbox_exec_time() {
   local user_time_low="$1"; shift
   local user_time_high="$1"; shift
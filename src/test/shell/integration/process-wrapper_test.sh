@@ -110,6 +110,17 @@ function test_timeout_kill() {
   assert_stdout "before"
 }
 
+# Tests that timeouts and kill delays may be fractions of a second.
+function test_subsecond_timeout() {
+  local code=0
+  local start="$(date +%s%N)"
+  $process_wrapper --timeout=0.2 --kill_delay=0.3 --stdout=$OUT --stderr=$ERR /bin/sh -c \
+    'trap "echo before" TERM; sleep 10; sleep 10' &> $TEST_log || code=$?
+  local elapsed_ms=$(( ($(date +%s%N) - start) / 1000000 ))
+  assert_equals "${EXIT_STATUS_SIGALRM}" "$code"
+  [[ "${elapsed_ms}" -lt 2000 ]] || fail "process-wrapper took ${elapsed_ms}ms"
+}
+
 function test_execvp_error_message() {
   local code=0
   $process_wrapper --stdout=$OUT --stderr=$ERR /bin/notexisting &> $TEST_log || code=$?
@@ -117,6 +128,97 @@ function test_execvp_error_message() {
   assert_contains "\"execvp(/bin/notexisting, ...)\": No such file or directory" "$ERR"
 }
 
+# Starts a supervisor, or returns 1 on platforms without one, so that tests can
+# skip themselves with "start_supervisor || return 0".
+function start_supervisor() {
+  if [[ "${PLATFORM}" != "linux" ]]; then
+    echo "Skipping test: the supervisor only exists on Linux." 1>&2
+    return 1
+  fi
+  SUPERVISOR_SOCKET="${TEST_TMPDIR}/supervisor.sock"
+  $process_wrapper --server "${SUPERVISOR_SOCKET}" &> "${TEST_TMPDIR}/supervisor.log" &
+  SUPERVISOR_PID=$!
+  for i in $(seq 50); do
+    [[ -S "${SUPERVISOR_SOCKET}" ]] && return 0
+    sleep 0.1
+  done
+  fail "Supervisor did not start: $(cat "${TEST_TMPDIR}/supervisor.log")"
+}
+
+function stop_supervisor() {
+  kill "${SUPERVISOR_PID}"
+  wait "${SUPERVISOR_PID}" || true
+}
+
+function test_supervisor_runs_commands() {
+  start_supervisor || return 0
+  local code=0
+  $process_wrapper --connect "${SUPERVISOR_SOCKET}" --stdout=$OUT --stderr=$ERR \
+    /bin/sh -c "echo hi there; echo \$PWD >&2; exit 71" &> $TEST_log || code=$?
+  assert_equals 71 "$code"
+  assert_output "hi there" "$PWD"
+
+  code=0
+  $process_wrapper --connect "${SUPERVISOR_SOCKET}" --stdout=$OUT --stderr=$ERR \
+    /bin/notexisting &> $TEST_log || code=$?
+  assert_equals 1 "$code"
+  assert_contains "execvp(/bin/notexisting, ...): No such file or directory" "$ERR"
+  stop_supervisor
+}
+
+function test_supervisor_passes_environment() {
+  start_supervisor || return 0
+  PROCESS_WRAPPER_TEST_VAR="from the client" \
+    $process_wrapper --connect "${SUPERVISOR_SOCKET}" --stdout=$OUT --stderr=$ERR \
+    /bin/sh -c 'echo "var=$PROCESS_WRAPPER_TEST_VAR"' &> $TEST_log || fail
+  assert_stdout "var=from the client"
+  stop_supervisor
+}
+
+function test_supervisor_timeout_kill() {
+  start_supervisor || return 0
+  local code=0
+  $process_wrapper --connect "${SUPERVISOR_SOCKET}" --timeout=0.5 --kill_delay=1 \
+    --stdout=$OUT --stderr=$ERR /bin/sh -c \
+    'trap "echo before; sleep 10; echo after; exit 0" INT TERM ALRM; sleep 10' \
+    &> $TEST_log || code=$?
+  assert_equals "${EXIT_STATUS_SIGALRM}" "$code"
+  assert_stdout "before"
+  stop_supervisor
+}
+
+function test_supervisor_runs_commands_concurrently() {
+  start_supervisor || return 0
+  local start=$(date +%s)
+  local pids=""
+  for i in $(seq 20); do
+    $process_wrapper --connect "${SUPERVISOR_SOCKET}" --stdout="${OUT}.$i" \
+      /bin/sh -c "sleep 2; echo $i" &> $TEST_log &
+    pids="$pids $!"
+  done
+  wait $pids || fail "A command failed"
+  [[ $(( $(date +%s) - start )) -lt 10 ]] || fail "Commands did not run concurrently"
+  for i in $(seq 20); do
+    assert_equals "$i" "$(cat "${OUT}.$i")"
+  done
+  stop_supervisor
+}
+
+function test_supervisor_kills_command_of_terminated_client() {
+  start_supervisor || return 0
+  local code=0
+  $process_wrapper --connect "${SUPERVISOR_SOCKET}" --stdout=$OUT --stderr=$ERR \
+    /bin/sh -c "echo started; sleep 5; echo finished" &> $TEST_log &
+  local client=$!
+  sleep 1
+  kill -TERM "$client"
+  wait "$client" || code=$?
+  assert_equals 143 "$code"  # SIGNAL_BASE + SIGTERM = 128 + 15
+  sleep 5
+  assert_stdout "started"
+  stop_supervisor
+}
+
 function assert_process_wrapper_exec_time() {
   local user_time_low="$1"; shift
   local user_time_high="$1"; shift
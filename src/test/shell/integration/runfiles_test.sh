@@ -178,5 +178,52 @@ EOF
     || fail "Old foo still found"
 }
 
+function test_runfiles_tree_updated_from_previous_manifest() {
+  mkdir -p pkg/sub
+  echo a > pkg/a.txt
+  echo b > pkg/sub/b.txt
+  echo c > pkg/c.txt
+  cat > pkg/BUILD << EOF
+sh_binary(name = "foo",
+          srcs = [ "x/y/z.sh" ],
+          data = [ "a.txt", "sub/b.txt" ])
+EOF
+  bazel build pkg:foo >&$TEST_log || fail "build failed"
+
+  local -r runfiles=${PRODUCT_NAME}-bin/pkg/foo.runfiles/${WORKSPACE_NAME}/pkg
+  [[ -L ${runfiles}/sub/b.txt ]] || fail "sub/b.txt is not a symlink"
+
+  # Replace a symlink behind Bazel's back without changing its directory's
+  # mtime. The MANIFEST of the previous build is trusted, so build-runfiles
+  # only touches the paths that changed and leaves this one alone.
+  touch -r ${runfiles}/sub ${TEST_TMPDIR}/sub_mtime
+  rm ${runfiles}/sub/b.txt
+  echo tampered > ${runfiles}/sub/b.txt
+  touch -r ${TEST_TMPDIR}/sub_mtime ${runfiles}/sub
+
+  cat > pkg/BUILD << EOF
+sh_binary(name = "foo",
+          srcs = [ "x/y/z.sh" ],
+          data = [ "c.txt", "sub/b.txt" ])
+EOF
+  bazel build pkg:foo >&$TEST_log || fail "build failed"
+  [[ ! -e ${runfiles}/a.txt ]] || fail "a.txt still found"
+  [[ -L ${runfiles}/c.txt ]] || fail "c.txt not found"
+  [[ ! -L ${runfiles}/sub/b.txt ]] \
+    || fail "tree was rescanned despite the previous MANIFEST"
+
+  # Once a directory is newer than the MANIFEST, the whole tree is rescanned.
+  touch -d "+1 hour" ${runfiles}/sub
+  cat > pkg/BUILD << EOF
+sh_binary(name = "foo",
+          srcs = [ "x/y/z.sh" ],
+          data = [ "sub/b.txt" ])
+EOF
+  bazel build pkg:foo >&$TEST_log || fail "build failed"
+  [[ ! -e ${runfiles}/c.txt ]] || fail "c.txt still found"
+  [[ -L ${runfiles}/sub/b.txt ]] || fail "sub/b.txt was not restored"
+  assert_equals b "$(cat ${runfiles}/sub/b.txt)"
+}
+
 
 run_suite "runfiles"
@@ -16,12 +16,17 @@
 #ifdef _WIN32
 #include <windows.h>
 #else  // not _WIN32
+#include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 #endif  // _WIN32
 
+#include <algorithm>
 #include <fstream>
 #include <map>
 #include <sstream>
@@ -44,34 +49,42 @@ using std::vector;
 
 namespace {
 
-bool starts_with(const string& s, const char* prefix) {
-  if (!prefix || !*prefix) {
+bool ends_with(const string& s, const string& suffix) {
+  if (suffix.empty()) {
     return true;
   }
   if (s.empty()) {
     return false;
   }
-  return s.find(prefix) == 0;
+  return s.rfind(suffix) == s.size() - suffix.size();
 }
 
-bool contains(const string& s, const char* substr) {
-  if (!substr || !*substr) {
-    return true;
-  }
-  if (s.empty()) {
+// Returns true if `path` is a valid runfiles-root-relative path: it must not be
+// empty, have "." or ".." segments, segments starting with "..", or empty
+// segments other than the first or the last one.
+bool IsValidPath(const string& path) {
+  if (path.empty()) {
     return false;
   }
-  return s.find(substr) != string::npos;
-}
-
-bool ends_with(const string& s, const string& suffix) {
-  if (suffix.empty()) {
-    return true;
-  }
-  if (s.empty()) {
-    return false;
+  size_t start = 0;
+  while (true) {
+    size_t end = path.find('/', start);
+    if (end == string::npos) {
+      end = path.size();
+    }
+    const char* segment = path.data() + start;
+    size_t size = end - start;
+    if ((size == 1 && segment[0] == '.') ||
+        (size >= 2 && segment[0] == '.' && segment[1] == '.' &&
+         (start > 0 || size == 2)) ||
+        (size == 0 && start > 0 && end < path.size())) {
+      return false;
+    }
+    if (end == path.size()) {
+      return true;
+    }
+    start = end + 1;
   }
-  return s.rfind(suffix) == s.size() - suffix.size();
 }
 
 bool IsReadableFile(const string& path) {
@@ -98,11 +111,44 @@ bool PathsFrom(const std::string& argv0, std::string runfiles_manifest_file,
 bool ParseManifest(const string& path, map<string, string>* result,
                    string* error);
 
+#ifndef _WIN32
+// A line of a mapped runfiles manifest. `target` is nullptr if the line is
+// malformed.
+struct ManifestLine {
+  const char* path;
+  size_t path_size;
+  const char* target;
+  size_t target_size;
+};
+
+bool MapManifest(const string& path, const char** data, size_t* size,
+                 string* error);
+
+int ComparePath(const char* key, size_t key_size, const string& path);
+
+size_t ReadManifestLine(const char* data, size_t size, size_t offset,
+                        ManifestLine* line);
+
+// Returns the offset of the first line at or after `low` in the sorted
+// manifest whose path does not sort before `path`.
+size_t LowerBound(const char* data, size_t size, size_t low,
+                  const string& path);
+#endif  // not _WIN32
+
 }  // namespace
 
+Runfiles::~Runfiles() {
+#ifndef _WIN32
+  if (manifest_data_ != nullptr) {
+    munmap(const_cast<char*>(manifest_data_), manifest_size_);
+  }
+#endif  // not _WIN32
+}
+
 Runfiles* Runfiles::Create(const string& argv0,
                            const string& runfiles_manifest_file,
-                           const string& runfiles_dir, string* error) {
+                           const string& runfiles_dir, string* error,
+                           ManifestMode mode) {
   string manifest, directory;
   if (!PathsFrom(argv0, runfiles_manifest_file, runfiles_dir,
                  [](const string& path) {
@@ -131,14 +177,28 @@ Runfiles* Runfiles::Create(const string& argv0,
       {"JAVA_RUNFILES", directory}};
 
   map<string, string> runfiles;
+  const char* manifest_data = nullptr;
+  size_t manifest_size = 0;
   if (!manifest.empty()) {
+#ifndef _WIN32
+    if (mode == ManifestMode::kMap) {
+      if (!MapManifest(manifest, &manifest_data, &manifest_size, error)) {
+        return nullptr;
+      }
+    } else if (!ParseManifest(manifest, &runfiles, error)) {
+      return nullptr;
+    }
+#else   // _WIN32
+    // Manifests on Windows are sorted case-insensitively, so they cannot be
+    // searched byte-wise.
     if (!ParseManifest(manifest, &runfiles, error)) {
       return nullptr;
     }
+#endif  // _WIN32
   }
 
   return new Runfiles(std::move(runfiles), std::move(directory),
-                      std::move(envvars));
+                      std::move(envvars), manifest_data, manifest_size);
 }
 
 bool IsAbsolute(const string& path) {
@@ -168,17 +228,16 @@ string GetEnv(const string& key) {
 }
 
 string Runfiles::Rlocation(const string& path) const {
-  if (path.empty() || starts_with(path, "../") || contains(path, "/..") ||
-      starts_with(path, "./") || contains(path, "/./") ||
-      ends_with(path, "/.") || contains(path, "//")) {
+  if (!IsValidPath(path)) {
     return string();
   }
   if (IsAbsolute(path)) {
     return path;
   }
-  const auto value = runfiles_map_.find(path);
-  if (value != runfiles_map_.end()) {
-    return value->second;
+  size_t manifest_offset = 0;
+  StringPiece target;
+  if (Find(path, &manifest_offset, &target)) {
+    return target.ToString();
   }
   if (!directory_.empty()) {
     return directory_ + "/" + path;
@@ -186,6 +245,105 @@ string Runfiles::Rlocation(const string& path) const {
   return "";
 }
 
+bool Runfiles::Find(const string& path, size_t* manifest_offset,
+                    StringPiece* target) const {
+  const auto value = runfiles_map_.find(path);
+  if (value != runfiles_map_.end()) {
+    *target = {value->second.data(), value->second.size()};
+    return true;
+  }
+#ifndef _WIN32
+  if (manifest_data_ != nullptr) {
+    *manifest_offset =
+        LowerBound(manifest_data_, manifest_size_, *manifest_offset, path);
+    ManifestLine line;
+    if (*manifest_offset < manifest_size_) {
+      ReadManifestLine(manifest_data_, manifest_size_, *manifest_offset, &line);
+      if (line.target != nullptr &&
+          ComparePath(line.path, line.path_size, path) == 0) {
+        *target = {line.target, line.target_size};
+        return true;
+      }
+    }
+  }
+#endif  // not _WIN32
+  return false;
+}
+
+Runfiles::Locations Runfiles::Rlocations(const vector<string>& paths) const {
+  // Look the paths up in sorted order, so that each search of the mapped
+  // manifest can start where the previous one ended.
+  vector<size_t> order(paths.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  if (manifest_data_ != nullptr) {
+    std::sort(order.begin(), order.end(), [&paths](size_t a, size_t b) {
+      return paths[a] < paths[b];
+    });
+  }
+  Locations result;
+  result.paths_.resize(paths.size(), {"", 0});
+  size_t manifest_offset = 0;
+  for (size_t i : order) {
+    const string& path = paths[i];
+    // Same as `Rlocation`, except that only the runtime paths that are not in
+    // the map or the manifest are built as new strings.
+    if (!IsValidPath(path)) {
+      continue;
+    } else if (IsAbsolute(path)) {
+      result.owned_.push_back(path);
+    } else if (Find(path, &manifest_offset, &result.paths_[i])) {
+      continue;
+    } else if (!directory_.empty()) {
+      result.owned_.push_back(directory_ + "/" + path);
+    } else {
+      continue;
+    }
+    result.paths_[i] = {result.owned_.back().data(),
+                        result.owned_.back().size()};
+  }
+  return result;
+}
+
+vector<Runfiles::Entry> Runfiles::ListRunfiles(const string& dir) const {
+  vector<Entry> result;
+  if (!dir.empty() && (!IsValidPath(dir) || IsAbsolute(dir))) {
+    return result;
+  }
+  string prefix = dir;
+  if (!prefix.empty() && prefix.back() != '/') {
+    prefix.push_back('/');
+  }
+  // Both the map and the manifest are sorted byte-wise, so the runfiles under
+  // `dir` are contiguous.
+  for (auto i = runfiles_map_.lower_bound(prefix);
+       i != runfiles_map_.end() &&
+       i->first.compare(0, prefix.size(), prefix) == 0;
+       ++i) {
+    result.push_back({{i->first.data(), i->first.size()},
+                      {i->second.data(), i->second.size()}});
+  }
+#ifndef _WIN32
+  if (manifest_data_ != nullptr) {
+    size_t offset = LowerBound(manifest_data_, manifest_size_, 0, prefix);
+    while (offset < manifest_size_) {
+      ManifestLine line;
+      offset = ReadManifestLine(manifest_data_, manifest_size_, offset, &line);
+      if (line.path_size < prefix.size() ||
+          memcmp(line.path, prefix.data(), prefix.size()) != 0) {
+        break;
+      }
+      if (line.target != nullptr) {
+        result.push_back(
+            {{line.path, line.path_size}, {line.target, line.target_size}});
+      }
+    }
+  }
+#endif  // not _WIN32
+  return result;
+}
+
 namespace {
 
 bool ParseManifest(const string& path, map<string, string>* result,
@@ -222,6 +380,109 @@ bool ParseManifest(const string& path, map<string, string>* result,
   return true;
 }
 
+#ifndef _WIN32
+bool MapManifest(const string& path, const char** data, size_t* size,
+                 string* error) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    if (error) {
+      std::ostringstream err;
+      err << "ERROR: " << __FILE__ << "(" << __LINE__
+          << "): cannot open runfiles manifest \"" << path << "\"";
+      *error = err.str();
+    }
+    return false;
+  }
+  *data = nullptr;
+  *size = st.st_size;
+  // An empty manifest cannot be mapped, but it has no entries either.
+  if (*size > 0) {
+    void* addr = mmap(nullptr, *size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+      close(fd);
+      if (error) {
+        std::ostringstream err;
+        err << "ERROR: " << __FILE__ << "(" << __LINE__
+            << "): cannot map runfiles manifest \"" << path
+            << "\": " << strerror(errno);
+        *error = err.str();
+      }
+      return false;
+    }
+    *data = static_cast<const char*>(addr);
+  }
+  close(fd);
+  return true;
+}
+
+// Compares the path in a manifest line with `path` the way Bazel sorts the
+// manifest: byte-wise, with a path sorting after all of its prefixes.
+int ComparePath(const char* key, size_t key_size, const string& path) {
+  int result = memcmp(key, path.data(), std::min(key_size, path.size()));
+  if (result != 0) {
+    return result;
+  }
+  return key_size < path.size() ? -1 : key_size > path.size() ? 1 : 0;
+}
+
+// Splits the manifest line starting at `offset` into its path and target.
+// Returns the offset of the next line.
+size_t ReadManifestLine(const char* data, size_t size, size_t offset,
+                        ManifestLine* line) {
+  const char* newline =
+      static_cast<const char*>(memchr(data + offset, '\n', size - offset));
+  size_t end = newline != nullptr ? newline - data : size;
+  const char* space =
+      static_cast<const char*>(memchr(data + offset, ' ', end - offset));
+  line->path = data + offset;
+  line->path_size = (space != nullptr ? space - data : end) - offset;
+  line->target = space != nullptr ? space + 1 : nullptr;
+  line->target_size = space != nullptr ? data + end - space - 1 : 0;
+  return end < size ? end + 1 : size;
+}
+
+size_t LowerBound(const char* data, size_t size, size_t low,
+                  const string& path) {
+  // Every line starting before `low` sorts before `path`, and every line
+  // starting at or after `high` does not; `low` is always the start of a line.
+  size_t high = size;
+  // Searching from a previous result, `path` is likely close by, so probe
+  // exponentially growing distances before the binary search.
+  for (size_t step = 4096; low > 0 && low + step < high; step *= 2) {
+    size_t start = low + step;
+    while (start > low && data[start - 1] != '\n') {
+      --start;
+    }
+    ManifestLine line;
+    size_t next = ReadManifestLine(data, size, start, &line);
+    if (ComparePath(line.path, line.path_size, path) < 0) {
+      low = next;
+    } else {
+      high = start;
+      break;
+    }
+  }
+  while (low < high) {
+    size_t start = low + (high - low) / 2;
+    while (start > low && data[start - 1] != '\n') {
+      --start;
+    }
+    ManifestLine line;
+    size_t next = ReadManifestLine(data, size, start, &line);
+    if (ComparePath(line.path, line.path_size, path) < 0) {
+      low = next;
+    } else {
+      high = start;
+    }
+  }
+  return low;
+}
+#endif  // not _WIN32
+
 }  // namespace
 
 namespace testing {
@@ -238,9 +499,10 @@ bool TestOnly_IsAbsolute(const string& path) { return IsAbsolute(path); }
 
 }  // namespace testing
 
-Runfiles* Runfiles::Create(const string& argv0, string* error) {
+Runfiles* Runfiles::Create(const string& argv0, string* error,
+                           ManifestMode mode) {
   return Runfiles::Create(argv0, GetEnv("RUNFILES_MANIFEST_FILE"),
-                          GetEnv("RUNFILES_DIR"), error);
+                          GetEnv("RUNFILES_DIR"), error, mode);
 }
 
 namespace {
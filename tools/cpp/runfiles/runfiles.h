@@ -71,6 +71,7 @@
 #ifndef TOOLS_CPP_RUNFILES_RUNFILES_H_
 #define TOOLS_CPP_RUNFILES_RUNFILES_H_ 1
 
+#include <deque>
 #include <functional>
 #include <map>
 #include <memory>
@@ -84,7 +85,21 @@ namespace runfiles {
 
 class Runfiles {
  public:
-  virtual ~Runfiles() {}
+  // How `Create` reads the runfiles manifest.
+  enum class ManifestMode {
+    // Parse the whole manifest into memory when creating the instance.
+    kParse,
+    // Map the manifest into memory and look entries up lazily by binary search,
+    // so creating the instance takes constant time and the pages of the
+    // manifest are shared by all processes that read it.
+    //
+    // The manifest must be sorted by path, as the manifests Bazel writes are.
+    // Malformed lines are not reported, they never match any path.
+    // On Windows this is the same as `kParse`.
+    kMap,
+  };
+
+  virtual ~Runfiles();
 
   // Returns a new `Runfiles` instance.
   //
@@ -94,8 +109,11 @@ class Runfiles {
   // This method looks at the RUNFILES_MANIFEST_FILE and RUNFILES_DIR
   // environment variables. If either is empty, the method looks for the
   // manifest or directory using the other environment variable, or using argv0.
+  //
+  // `mode` chooses how the runfiles manifest is read, see `ManifestMode`.
   static Runfiles* Create(const std::string& argv0,
-                          std::string* error = nullptr);
+                          std::string* error = nullptr,
+                          ManifestMode mode = ManifestMode::kParse);
 
   // Returns a new `Runfiles` instance.
   //
@@ -105,7 +123,8 @@ class Runfiles {
   static Runfiles* Create(const std::string& argv0,
                           const std::string& runfiles_manifest_file,
                           const std::string& runfiles_dir,
-                          std::string* error = nullptr);
+                          std::string* error = nullptr,
+                          ManifestMode mode = ManifestMode::kParse);
 
   // Returns the runtime path of a runfile.
   //
@@ -124,6 +143,71 @@ class Runfiles {
   //   an empty string if the method doesn't know about this runfile
   std::string Rlocation(const std::string& path) const;
 
+  // A string owned by the `Runfiles` instance, e.g. a part of the mapped
+  // manifest. It is valid as long as the instance and is not NUL-terminated.
+  struct StringPiece {
+    const char* data;
+    size_t size;
+
+    std::string ToString() const { return std::string(data, size); }
+  };
+
+  // A runfile listed in the manifest.
+  struct Entry {
+    // The runfiles-root-relative path of the runfile.
+    StringPiece path;
+    // The runtime path of the runfile.
+    StringPiece target;
+  };
+
+  // The runtime paths of many runfiles, as returned by `Rlocations`.
+  class Locations {
+   public:
+    Locations(Locations&&) = default;
+    Locations& operator=(Locations&&) = default;
+
+    size_t size() const { return paths_.size(); }
+
+    // Returns the runtime path of the `i`th runfile, or an empty string if it
+    // is unknown. It is valid as long as both this object and the `Runfiles`
+    // instance.
+    const StringPiece& operator[](size_t i) const { return paths_[i]; }
+
+   private:
+    friend class Runfiles;
+
+    Locations() {}
+    Locations(const Locations&) = delete;
+    Locations& operator=(const Locations&) = delete;
+
+    std::vector<StringPiece> paths_;
+    // Runtime paths that the instance does not hold: absolute paths and
+    // directory-based runfiles. A deque, so that growing it does not move the
+    // strings `paths_` points into.
+    std::deque<std::string> owned_;
+  };
+
+  // Returns the runtime paths of many runfiles.
+  //
+  // Same as calling `Rlocation` for each of `paths`, and returns the results in
+  // the same order, but searches the mapped manifest only once. Runtime paths
+  // listed in the manifest are not copied.
+  Locations Rlocations(const std::vector<std::string>& paths) const;
+
+  // Returns the runfiles under a directory, sorted by path.
+  //
+  // Only runfiles listed in the manifest are returned, so directory-based
+  // runfiles return nothing.
+  //
+  // Args:
+  //   dir: runfiles-root-relative path of the directory, with the same
+  //     restrictions as the argument of `Rlocation`; if empty, all runfiles
+  //     in the manifest are returned
+  // Returns:
+  //   the paths and runtime paths of the runfiles under `dir`, which stay
+  //   valid as long as this instance
+  std::vector<Entry> ListRunfiles(const std::string& dir) const;
+
   // Returns environment variables for subprocesses.
   //
   // The caller should set the returned key-value pairs in the environment of
@@ -136,18 +220,31 @@ class Runfiles {
  private:
   Runfiles(const std::map<std::string, std::string>&& runfiles_map,
            const std::string&& directory,
-           const std::vector<std::pair<std::string, std::string> >&& envvars)
+           const std::vector<std::pair<std::string, std::string> >&& envvars,
+           const char* manifest_data, size_t manifest_size)
       : runfiles_map_(std::move(runfiles_map)),
         directory_(std::move(directory)),
-        envvars_(std::move(envvars)) {}
+        envvars_(std::move(envvars)),
+        manifest_data_(manifest_data),
+        manifest_size_(manifest_size) {}
   Runfiles(const Runfiles&) = delete;
   Runfiles(Runfiles&&) = delete;
   Runfiles& operator=(const Runfiles&) = delete;
   Runfiles& operator=(Runfiles&&) = delete;
 
+  // Looks up the runtime path of the runfile `path` in the runfiles map or the
+  // mapped manifest. Searches the mapped manifest from `*manifest_offset` on
+  // and updates it to where `path` is or would be.
+  // Returns false if neither lists `path`.
+  bool Find(const std::string& path, size_t* manifest_offset,
+            StringPiece* target) const;
+
   const std::map<std::string, std::string> runfiles_map_;
   const std::string directory_;
   const std::vector<std::pair<std::string, std::string> > envvars_;
+  // The mapped manifest in `ManifestMode::kMap`, or nullptr.
+  const char* const manifest_data_;
+  const size_t manifest_size_;
 };
 
 // The "testing" namespace contains functions that allow unit testing the code.
@@ -83,6 +83,10 @@ class RunfilesTest : public ::testing::Test {
                      const string& expected_directory);
 
   static string GetTemp();
+
+  // Returns the result of `runfiles.Rlocations(paths)` as strings.
+  static vector<string> Rlocations(const Runfiles& runfiles,
+                                   const vector<string>& paths);
 };
 
 void RunfilesTest::AssertEnvvars(const Runfiles& runfiles,
@@ -95,6 +99,16 @@ void RunfilesTest::AssertEnvvars(const Runfiles& runfiles,
   ASSERT_EQ(runfiles.EnvVars(), expected);
 }
 
+vector<string> RunfilesTest::Rlocations(const Runfiles& runfiles,
+                                        const vector<string>& paths) {
+  Runfiles::Locations locations = runfiles.Rlocations(paths);
+  vector<string> result;
+  for (size_t i = 0; i < locations.size(); ++i) {
+    result.push_back(locations[i].ToString());
+  }
+  return result;
+}
+
 string RunfilesTest::GetTemp() {
 #ifdef _WIN32
   DWORD size = ::GetEnvironmentVariableA("TEST_TMPDIR", NULL, 0);
@@ -241,6 +255,149 @@ TEST_F(RunfilesTest, ManifestBasedRunfilesRlocationAndEnvVars) {
   EXPECT_EQ(r->Rlocation("c:\\Foo"), "c:\\Foo");
 }
 
+TEST_F(RunfilesTest, MappedManifestBasedRunfilesRlocationAndEnvVars) {
+  unique_ptr<MockFile> mf(MockFile::Create(
+      "foo" LINE_AS_STRING() ".runfiles/MANIFEST",
+      {"a-b h", "a/b c/d", "a/b/c", "a/b/c/d e f", "a/bc g", "b/c ", "x/y z"}));
+  EXPECT_TRUE(mf != nullptr);
+  string dir = mf->DirName();
+
+  string error;
+  unique_ptr<Runfiles> r(Runfiles::Create("ignore-argv0", mf->Path(), "",
+                                          &error,
+                                          Runfiles::ManifestMode::kMap));
+
+  ASSERT_NE(r, nullptr);
+  EXPECT_TRUE(error.empty());
+  EXPECT_EQ(r->Rlocation("a/b"), "c/d");
+  EXPECT_EQ(r->Rlocation("a/b/c/d"), "e f");
+  EXPECT_EQ(r->Rlocation("a/bc"), "g");
+  EXPECT_EQ(r->Rlocation("a-b"), "h");
+  EXPECT_EQ(r->Rlocation("b/c"), "");
+  EXPECT_EQ(r->Rlocation("x/y"), "z");
+  // Malformed lines and paths missing from the manifest are looked up in the
+  // runfiles directory.
+  EXPECT_EQ(r->Rlocation("a/b/c"), dir + "/a/b/c");
+  EXPECT_EQ(r->Rlocation("aa"), dir + "/aa");
+  EXPECT_EQ(r->Rlocation("a/b/"), dir + "/a/b/");
+  EXPECT_EQ(r->Rlocation("mm"), dir + "/mm");
+  EXPECT_EQ(r->Rlocation("zz"), dir + "/zz");
+  EXPECT_EQ(r->Rlocation(""), "");
+  EXPECT_EQ(r->Rlocation("../foo"), "");
+  EXPECT_EQ(r->Rlocation("/Foo"), "/Foo");
+  AssertEnvvars(*r, mf->Path(), dir);
+}
+
+TEST_F(RunfilesTest, MappedManifestBasedRunfilesWithLargeManifest) {
+  vector<string> lines;
+  for (int i = 10000; i < 20000; i += 2) {
+    lines.push_back("d" + std::to_string(i / 100) + "/f" + std::to_string(i) +
+                    " /t" + std::to_string(i));
+  }
+  unique_ptr<MockFile> mf(
+      MockFile::Create("foo" LINE_AS_STRING() ".runfiles_manifest", lines));
+  EXPECT_TRUE(mf != nullptr);
+
+  string error;
+  unique_ptr<Runfiles> r(Runfiles::Create("ignore-argv0", mf->Path(), "",
+                                          &error,
+                                          Runfiles::ManifestMode::kMap));
+
+  ASSERT_NE(r, nullptr);
+  EXPECT_TRUE(error.empty());
+  vector<string> paths, expected;
+  for (int i = 10000; i < 20000; ++i) {
+    string path = "d" + std::to_string(i / 100) + "/f" + std::to_string(i);
+    paths.push_back(path);
+    expected.push_back(i % 2 == 0 ? "/t" + std::to_string(i) : "");
+    EXPECT_EQ(r->Rlocation(path), expected.back())
+        << " (path=\"" << path << "\")";
+  }
+  EXPECT_EQ(Rlocations(*r, paths), expected);
+}
+
+TEST_F(RunfilesTest, MappedManifestBasedRunfilesWithEmptyManifest) {
+  unique_ptr<MockFile> mf(
+      MockFile::Create("foo" LINE_AS_STRING() ".runfiles_manifest"));
+  EXPECT_TRUE(mf != nullptr);
+
+  string error;
+  unique_ptr<Runfiles> r(Runfiles::Create("ignore-argv0", mf->Path(), "",
+                                          &error,
+                                          Runfiles::ManifestMode::kMap));
+
+  ASSERT_NE(r, nullptr);
+  EXPECT_TRUE(error.empty());
+  EXPECT_EQ(r->Rlocation("a/b"), "");
+  AssertEnvvars(*r, mf->Path(), "");
+}
+
+TEST_F(RunfilesTest, RlocationsReturnsSameAsRlocation) {
+  unique_ptr<MockFile> mf(MockFile::Create(
+      "foo" LINE_AS_STRING() ".runfiles/MANIFEST",
+      {"a-b h", "a/b c/d", "a/b/c/d e f", "a/bc g", "x/y z"}));
+  EXPECT_TRUE(mf != nullptr);
+  const vector<string> paths = {"x/y", "a/b",    "missing", "a/b",  "",
+                                "../a", "/Foo", "a-b",     "a/bc", "a/b/c/d"};
+
+  for (auto mode :
+       {Runfiles::ManifestMode::kParse, Runfiles::ManifestMode::kMap}) {
+    string error;
+    unique_ptr<Runfiles> r(
+        Runfiles::Create("ignore-argv0", mf->Path(), "", &error, mode));
+    ASSERT_NE(r, nullptr);
+    EXPECT_TRUE(error.empty());
+
+    vector<string> expected;
+    for (const string& path : paths) {
+      expected.push_back(r->Rlocation(path));
+    }
+    EXPECT_EQ(Rlocations(*r, paths), expected);
+    EXPECT_EQ(expected[0], "z");
+    EXPECT_EQ(expected[2], mf->DirName() + "/missing");
+
+    // Runtime paths from the manifest point into the instance.
+    Runfiles::Locations first = r->Rlocations(paths);
+    Runfiles::Locations second = r->Rlocations(paths);
+    EXPECT_EQ(first[0].data, second[0].data);
+    EXPECT_NE(first[2].data, second[2].data);
+  }
+}
+
+TEST_F(RunfilesTest, ListRunfiles) {
+  unique_ptr<MockFile> mf(MockFile::Create(
+      "foo" LINE_AS_STRING() ".runfiles_manifest",
+      {"a-b h", "a/b c/d", "a/b/c/d e f", "a/b/e g", "a/bc i", "x/y z"}));
+  EXPECT_TRUE(mf != nullptr);
+
+  for (auto mode :
+       {Runfiles::ManifestMode::kParse, Runfiles::ManifestMode::kMap}) {
+    string error;
+    unique_ptr<Runfiles> r(
+        Runfiles::Create("ignore-argv0", mf->Path(), "", &error, mode));
+    ASSERT_NE(r, nullptr);
+    EXPECT_TRUE(error.empty());
+
+    auto list = [&r](const string& dir) {
+      vector<pair<string, string> > result;
+      for (const Runfiles::Entry& entry : r->ListRunfiles(dir)) {
+        result.push_back({entry.path.ToString(), entry.target.ToString()});
+      }
+      return result;
+    };
+    const vector<pair<string, string> > under_a_b = {{"a/b/c/d", "e f"},
+                                                     {"a/b/e", "g"}};
+    EXPECT_EQ(list("a/b"), under_a_b);
+    EXPECT_EQ(list("a/b/"), under_a_b);
+    EXPECT_EQ(list("a").size(), 4);
+    EXPECT_EQ(list("").size(), 6);
+    EXPECT_TRUE(list("a/b/c/d").empty());
+    EXPECT_TRUE(list("missing").empty());
+    EXPECT_TRUE(list("../a").empty());
+    EXPECT_TRUE(list("/a").empty());
+  }
+}
+
 TEST_F(RunfilesTest, DirectoryBasedRunfilesRlocationAndEnvVars) {
   unique_ptr<MockFile> dummy(
       MockFile::Create("foo" LINE_AS_STRING() ".runfiles/dummy", {"a/b c/d"}));
@@ -254,7 +411,10 @@ TEST_F(RunfilesTest, DirectoryBasedRunfilesRlocationAndEnvVars) {
 
   EXPECT_EQ(r->Rlocation("a/b"), dir + "/a/b");
   EXPECT_EQ(r->Rlocation("c/d"), dir + "/c/d");
+  EXPECT_EQ(r->Rlocation("a"), dir + "/a");
   EXPECT_EQ(r->Rlocation(""), "");
+  EXPECT_EQ(r->Rlocation("."), "");
+  EXPECT_EQ(r->Rlocation(".."), "");
   EXPECT_EQ(r->Rlocation("foo"), dir + "/foo");
   EXPECT_EQ(r->Rlocation("foo/"), dir + "/foo/");
   EXPECT_EQ(r->Rlocation("foo/bar"), dir + "/foo/bar");